@@ -0,0 +1,23 @@
+#include "bench_common.h"
+#include <stdio.h>
+#include <time.h>
+
+long long bench_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void bench_report(const char *name, double megabytes, long long elapsed_ns)
+{
+    double seconds = elapsed_ns / 1e9;
+
+    printf("%-40s %10.3f ms %10.1f MB/s\n", name, seconds * 1000, megabytes / seconds);
+}
+
+void bench_report_ops(const char *name, long long ops, long long elapsed_ns)
+{
+    printf("%-48s %10.3f ms %10.1f ns/op\n", name, elapsed_ns / 1e6, (double) elapsed_ns / ops);
+}
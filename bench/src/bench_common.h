@@ -0,0 +1,19 @@
+#if !defined(CIO_BENCH_COMMON_H)
+#define CIO_BENCH_COMMON_H
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+long long bench_now_ns();
+
+/**
+ * Prints one result line: name, amount of processed megabytes and elapsed time.
+ */
+void bench_report(const char *name, double megabytes, long long elapsed_ns);
+
+/**
+ * Same for a number of operations.
+ */
+void bench_report_ops(const char *name, long long ops, long long elapsed_ns);
+
+#endif /* CIO_BENCH_COMMON_H */
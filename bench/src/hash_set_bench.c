@@ -0,0 +1,339 @@
+#include "bench_common.h"
+#include <cio_hash_set.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int ROUNDS = 5;
+
+enum KEY_TYPE {
+    KEY_INT,
+    KEY_POINTER,
+    KEY_STRING
+};
+
+static int int_cmp(const void *l, const void *r)
+{
+    return *((int *) l) == *((int *) r);
+}
+
+static void int_hash_data(const void *elem, void **data, int *len)
+{
+    *data = (void *) elem;
+    *len = sizeof(int);
+}
+
+/**
+ * Elements keyed by a pointer member, as the pooled connections are.
+ */
+struct pointer_elem {
+    void *key;
+};
+
+static int pointer_cmp(const void *l, const void *r)
+{
+    return ((struct pointer_elem *) l)->key == ((struct pointer_elem *) r)->key;
+}
+
+static void pointer_hash_data(const void *elem, void **data, int *len)
+{
+    *data = &((struct pointer_elem *) elem)->key;
+    *len = sizeof(void *);
+}
+
+static int string_cmp(const void *l, const void *r)
+{
+    return !strcmp(l, r);
+}
+
+static void string_hash_data(const void *elem, void **data, int *len)
+{
+    *data = (void *) elem;
+    *len = strlen(elem);
+}
+
+/**
+ * 2 * count distinct keys in random order, the second half is never added and used for the
+ * missing lookups: set elements and, except for the strings, the same keys as integers.
+ */
+struct keys {
+    void **elems;
+    uintptr_t *int_keys;
+    void *storage;
+    void *objects;
+};
+
+static void free_keys(struct keys *keys)
+{
+    free(keys->elems);
+    free(keys->int_keys);
+    free(keys->storage);
+    free(keys->objects);
+}
+
+static int generate_keys(struct keys *keys, enum KEY_TYPE type, int count)
+{
+    static const int STRING_SIZE = 32;
+    int i, j, *ints, *order = NULL;
+    struct pointer_elem *pointers;
+    char *strings;
+    void *tmp;
+
+    memset(keys, 0, sizeof(*keys));
+    if (!(keys->elems = malloc(2 * count * sizeof(*keys->elems)))
+            || !(keys->int_keys = malloc(2 * count * sizeof(*keys->int_keys)))
+            || !(order = malloc(2 * count * sizeof(*order))))
+        goto fail;
+
+    srand(1);
+    for (i = 0; i < 2 * count; ++i)
+        order[i] = i;
+    for (i = 2 * count - 1; i > 0; --i) {
+        j = rand() % (i + 1);
+        tmp = (void *) (uintptr_t) order[i];
+        order[i] = order[j];
+        order[j] = (int) (uintptr_t) tmp;
+    }
+
+    switch (type) {
+    case KEY_INT:
+        if (!(keys->storage = ints = malloc(2 * count * sizeof(*ints))))
+            goto fail;
+        for (i = 0; i < 2 * count; ++i) {
+            ints[i] = order[i] * 7 + 3;
+            keys->elems[i] = &ints[i];
+            keys->int_keys[i] = ints[i];
+        }
+        break;
+    case KEY_POINTER:
+        /* Keys pointing to heap objects of a typical size. */
+        if (!(keys->storage = pointers = malloc(2 * count * sizeof(*pointers)))
+                || !(keys->objects = malloc(2 * count * 64)))
+            goto fail;
+        for (i = 0; i < 2 * count; ++i) {
+            pointers[i].key = (char *) keys->objects + order[i] * 64;
+            keys->elems[i] = &pointers[i];
+            keys->int_keys[i] = (uintptr_t) pointers[i].key;
+        }
+        break;
+    case KEY_STRING:
+        /* Host names with ports, as the pool endpoints are. */
+        if (!(keys->storage = strings = malloc(2 * count * STRING_SIZE)))
+            goto fail;
+        for (i = 0; i < 2 * count; ++i) {
+            snprintf(strings + i * STRING_SIZE, STRING_SIZE, "host-%d.example.com:%d", order[i],
+                     8000 + order[i] % 100);
+            keys->elems[i] = strings + i * STRING_SIZE;
+        }
+        break;
+    }
+
+    free(order);
+    return 0;
+
+fail:
+    free(order);
+    free_keys(keys);
+    return -1;
+}
+
+enum OP {
+    OP_ADD,
+    OP_GET_HIT,
+    OP_GET_MISS,
+    OP_REMOVE,
+    OP_COUNT
+};
+
+enum VARIANT {
+    VARIANT_CHAINED,
+    VARIANT_OPEN,
+    VARIANT_INT_MAP,
+    VARIANT_COUNT
+};
+
+static void *new_container(enum VARIANT variant, enum KEY_TYPE type, unsigned capacity)
+{
+    static const struct {
+        int (*cmp)(const void *, const void *);
+        void (*hash_data)(const void *elem, void **data, int *len);
+    } callbacks[] = {
+        { int_cmp, int_hash_data },
+        { pointer_cmp, pointer_hash_data },
+        { string_cmp, string_hash_data }
+    };
+
+    switch (variant) {
+    case VARIANT_CHAINED:
+        return cio_new_hash_set_impl(CIO_HASH_SET_CHAINED, capacity, callbacks[type].cmp,
+                                     callbacks[type].hash_data, NULL);
+    case VARIANT_OPEN:
+        return cio_new_hash_set_impl(CIO_HASH_SET_OPEN, capacity, callbacks[type].cmp,
+                                     callbacks[type].hash_data, NULL);
+    default:
+        return cio_new_int_map(capacity, sizeof(void *));
+    }
+}
+
+/**
+ * Number of failed operations.
+ */
+static int run_op(enum VARIANT variant, enum OP op, void *container, const struct keys *keys,
+    int count)
+{
+    int failed = 0, j;
+
+    for (j = 0; j < count; ++j) {
+        if (variant == VARIANT_INT_MAP) {
+            switch (op) {
+            case OP_ADD:
+                failed += !cio_int_map_put(container, keys->int_keys[j], &keys->elems[j]);
+                break;
+            case OP_GET_HIT:
+                failed += !cio_int_map_get(container, keys->int_keys[j]);
+                break;
+            case OP_GET_MISS:
+                failed += !!cio_int_map_get(container, keys->int_keys[count + j]);
+                break;
+            default:
+                failed += !!cio_int_map_remove(container, keys->int_keys[j], NULL);
+                break;
+            }
+        } else {
+            switch (op) {
+            case OP_ADD:
+                failed += !cio_hash_set_add(container, keys->elems[j]);
+                break;
+            case OP_GET_HIT:
+                failed += !cio_hash_set_get(container, keys->elems[j]);
+                break;
+            case OP_GET_MISS:
+                failed += !!cio_hash_set_get(container, keys->elems[count + j]);
+                break;
+            default:
+                failed += !cio_hash_set_remove(container, keys->elems[j]);
+                break;
+            }
+        }
+    }
+
+    return failed;
+}
+
+static void free_container(enum VARIANT variant, void *container)
+{
+    if (variant == VARIANT_INT_MAP)
+        cio_free_int_map(container);
+    else
+        cio_free_hash_set(container);
+}
+
+static void run(enum KEY_TYPE type, int count, unsigned capacity)
+{
+    static const char *type_names[] = { "int", "pointer", "string" };
+    static const char *variant_names[] = { "chained", "open", "int map" };
+    static const char *op_names[] = { "add", "get hit", "get miss", "remove" };
+    long long best[OP_COUNT], start, elapsed;
+    struct keys keys;
+    char name[128];
+    void *container;
+    int variant, op, round, failed;
+
+    if (generate_keys(&keys, type, count)) {
+        perror("generate_keys");
+        return;
+    }
+
+    for (variant = 0; variant < VARIANT_COUNT; ++variant) {
+        if (variant == VARIANT_INT_MAP && type == KEY_STRING)
+            continue;
+
+        for (op = 0; op < OP_COUNT; ++op)
+            best[op] = -1;
+
+        failed = 0;
+        for (round = 0; round < ROUNDS; ++round) {
+            if (!(container = new_container(variant, type, capacity))) {
+                perror("new_container");
+                goto finally;
+            }
+
+            for (op = 0; op < OP_COUNT; ++op) {
+                start = bench_now_ns();
+                failed += run_op(variant, op, container, &keys, count);
+                elapsed = bench_now_ns() - start;
+                if (best[op] == -1 || elapsed < best[op])
+                    best[op] = elapsed;
+            }
+
+            free_container(variant, container);
+        }
+
+        if (failed)
+            printf("%s: %d operations failed\n", variant_names[variant], failed);
+
+        for (op = 0; op < OP_COUNT; ++op) {
+            snprintf(name, sizeof(name), "%s %d / %u, %s, %s", type_names[type], count, capacity,
+                     variant_names[variant], op_names[op]);
+            bench_report_ops(name, count, best[op]);
+        }
+    }
+
+finally:
+    free_keys(&keys);
+}
+
+/**
+ * The slowest single add while growing from the minimal capacity, a whole-table rehash would
+ * show up here.
+ */
+static void run_worst_add(int count)
+{
+    long long start, elapsed, worst = 0;
+    struct keys keys;
+    char name[128];
+    void *set;
+    int i;
+
+    if (generate_keys(&keys, KEY_INT, count)) {
+        perror("generate_keys");
+        return;
+    }
+
+    if (!(set = cio_new_hash_set(0, int_cmp, int_hash_data, NULL))) {
+        perror("cio_new_hash_set");
+        goto finally;
+    }
+
+    for (i = 0; i < count; ++i) {
+        start = bench_now_ns();
+        cio_hash_set_add(set, keys.elems[i]);
+        elapsed = bench_now_ns() - start;
+        if (elapsed > worst)
+            worst = elapsed;
+    }
+    cio_free_hash_set(set);
+
+    snprintf(name, sizeof(name), "int %d, open, worst add", count);
+    bench_report_ops(name, 1, worst);
+
+finally:
+    free_keys(&keys);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int counts[] = { 1000, 100 * 1000, 1000 * 1000 };
+    int type, i;
+
+    for (type = KEY_INT; type <= KEY_STRING; ++type) {
+        for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+            run(type, counts[i], counts[i] / 0.75);
+    }
+
+    /* Sized for far less than it holds, as an event loop created for 1024 fds with 50k. */
+    run(KEY_INT, 50 * 1000, 1024 / 0.75);
+    run_worst_add(1000 * 1000);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include "bench_common.h"
+#include <cio_scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int DATA_SIZE = 64 * 1024 * 1024;
+static const int ROUNDS = 5;
+
+static char *generate_lines(int size, int line_len, const char *delim, int delim_len)
+{
+    char *data;
+    int i, next_delim;
+
+    if (!(data = malloc(size)))
+        return NULL;
+
+    srand(1);
+    next_delim = line_len;
+    for (i = 0; i < size; ++i) {
+        if (i == next_delim && i + delim_len <= size) {
+            memcpy(data + i, delim, delim_len);
+            i += delim_len - 1;
+            next_delim = i + 1 + line_len / 2 + rand() % line_len;
+        } else {
+            /* Printable, never a delimiter byte. */
+            data[i] = 'a' + rand() % 26;
+        }
+    }
+
+    return data;
+}
+
+static int scan_all(enum CIO_SCAN_IMPL impl, const char *data, int size, const char *delim,
+    int delim_len)
+{
+    int offset = 0, pos, found = 0;
+
+    while ((pos = cio_scan_delim_impl(impl, data + offset, size - offset, delim,
+                                      delim_len)) != -1) {
+        offset += pos + delim_len;
+        found++;
+    }
+
+    return found;
+}
+
+static void run(const char *delim_name, const char *delim, int delim_len, int line_len)
+{
+    static const struct {
+        enum CIO_SCAN_IMPL impl;
+        const char *name;
+    } impls[] = {
+        { CIO_SCAN_SCALAR, "scalar" },
+        { CIO_SCAN_SSE2, "sse2" },
+        { CIO_SCAN_AVX2, "avx2" }
+    };
+    char name[128];
+    char *data;
+    long long start, best;
+    int i, round, found, expected = -1;
+
+    if (!(data = generate_lines(DATA_SIZE, line_len, delim, delim_len))) {
+        perror("generate_lines");
+        return;
+    }
+
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        if (!cio_scan_impl_supported(impls[i].impl))
+            continue;
+
+        best = -1;
+        for (round = 0; round < ROUNDS; ++round) {
+            start = bench_now_ns();
+            found = scan_all(impls[i].impl, data, DATA_SIZE, delim, delim_len);
+            start = bench_now_ns() - start;
+            if (best == -1 || start < best)
+                best = start;
+        }
+
+        if (expected == -1)
+            expected = found;
+        else if (found != expected)
+            printf("%s: %d delimiters found, %d expected\n", impls[i].name, found, expected);
+
+        snprintf(name, sizeof(name), "%s, line %d, %s", delim_name, line_len, impls[i].name);
+        bench_report(name, DATA_SIZE / (1024.0 * 1024.0), best);
+    }
+
+    free(data);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int line_lengths[] = { 16, 80, 1024 };
+    int i;
+
+    for (i = 0; i < sizeof(line_lengths) / sizeof(line_lengths[0]); ++i) {
+        run("'\\n'", "\n", 1, line_lengths[i]);
+        run("'\\r\\n'", "\r\n", 2, line_lengths[i]);
+    }
+
+    return EXIT_SUCCESS;
+}
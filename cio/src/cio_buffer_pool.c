@@ -0,0 +1,120 @@
+#include "cio_buffer_pool.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+/**
+ * Idle buffers are linked through their own memory.
+ */
+struct idle_buffer {
+    struct idle_buffer *next;
+};
+
+struct buffer_pool {
+    struct idle_buffer *idle;
+    int buffer_size;
+    int max_idle;
+    int max_total;
+    int idle_count;
+    int in_use;
+    pthread_mutex_t mutex;
+};
+
+void *cio_new_buffer_pool(int buffer_size, int max_idle, int max_total)
+{
+    struct buffer_pool *pool;
+
+    if (buffer_size <= 0)
+        return NULL;
+
+    if (!(pool = malloc(sizeof(*pool))))
+        return NULL;
+
+    pool->idle = NULL;
+    pool->buffer_size = CIO_MAX(buffer_size, (int) sizeof(struct idle_buffer));
+    pool->max_idle = max_idle;
+    pool->max_total = max_total;
+    pool->idle_count = 0;
+    pool->in_use = 0;
+    pool->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+    return pool;
+}
+
+void cio_free_buffer_pool(void *buffer_pool)
+{
+    struct buffer_pool *pool = buffer_pool;
+    struct idle_buffer *buffer;
+
+    if (!pool)
+        return;
+
+    while ((buffer = pool->idle)) {
+        pool->idle = buffer->next;
+        free(buffer);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+void *cio_buffer_pool_get(void *buffer_pool)
+{
+    struct buffer_pool *pool = buffer_pool;
+    struct idle_buffer *buffer = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->max_total && pool->in_use >= pool->max_total)
+        goto finally;
+
+    if ((buffer = pool->idle)) {
+        pool->idle = buffer->next;
+        pool->idle_count--;
+    } else if (!(buffer = malloc(pool->buffer_size))) {
+        goto finally;
+    }
+
+    pool->in_use++;
+
+finally:
+    pthread_mutex_unlock(&pool->mutex);
+    return buffer;
+}
+
+void cio_buffer_pool_put(void *buffer_pool, void *buffer)
+{
+    struct buffer_pool *pool = buffer_pool;
+    struct idle_buffer *idle_buffer = buffer;
+
+    if (!buffer)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->in_use--;
+    if (pool->idle_count < pool->max_idle) {
+        idle_buffer->next = pool->idle;
+        pool->idle = idle_buffer;
+        pool->idle_count++;
+        idle_buffer = NULL;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(idle_buffer);
+}
+
+int cio_buffer_pool_buffer_size(void *buffer_pool)
+{
+    return ((struct buffer_pool *) buffer_pool)->buffer_size;
+}
+
+int cio_buffer_pool_in_use(void *buffer_pool)
+{
+    struct buffer_pool *pool = buffer_pool;
+    int in_use;
+
+    pthread_mutex_lock(&pool->mutex);
+    in_use = pool->in_use;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return in_use;
+}
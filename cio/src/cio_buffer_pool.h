@@ -0,0 +1,31 @@
+#if !defined(CIO_BUFFER_POOL_H)
+#define CIO_BUFFER_POOL_H
+
+/**
+ * Pool of equally sized buffers, typically one per event loop, shared by its connections (see
+ * cio_tcp_connection_async_read_pooled()). Thread safe.
+ *
+ * max_idle - how many returned buffers are kept for reuse, the rest are freed.
+ * max_total - limit for the buffers given out simultaneously, 0 - unlimited.
+ */
+void *cio_new_buffer_pool(int buffer_size, int max_idle, int max_total);
+
+/**
+ * All the buffers must be returned before the pool is destroyed.
+ */
+void cio_free_buffer_pool(void *buffer_pool);
+
+/**
+ * Returns NULL if 'max_total' buffers are in use or allocation fails.
+ */
+void *cio_buffer_pool_get(void *buffer_pool);
+void cio_buffer_pool_put(void *buffer_pool, void *buffer);
+
+int cio_buffer_pool_buffer_size(void *buffer_pool);
+
+/**
+ * Number of buffers currently given out.
+ */
+int cio_buffer_pool_in_use(void *buffer_pool);
+
+#endif /* CIO_BUFFER_POOL_H */
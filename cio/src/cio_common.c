@@ -26,6 +26,12 @@ void cio_perror(enum CIO_ERROR error, const char *message)
         case CIO_WRONG_STATE_ERROR:         PRINT_ERROR(message, "wrong state error"); break;
         case CIO_ALREADY_DESTROYED_ERROR:   PRINT_ERROR(message, "already destroyed"); break;
         case CIO_CONNECTION_CLOSED_ERROR:   PRINT_ERROR(message, "connection closed"); break;
+        case CIO_INVALID_ARGUMENT_ERROR:    PRINT_ERROR(message, "invalid argument"); break;
+        case CIO_SOCKET_OPTION_ERROR:       PRINT_ERROR(message, "socket option error"); break;
+        case CIO_TIMEOUT_ERROR:             PRINT_ERROR(message, "timeout"); break;
+        case CIO_WRITE_LIMIT_ERROR:         PRINT_ERROR(message, "write queue limit exceeded"); break;
+        case CIO_ACCEPT_ERROR:              PRINT_ERROR(message, "accept error"); break;
+        case CIO_BUFFER_POOL_EXHAUSTED_ERROR: PRINT_ERROR(message, "buffer pool exhausted"); break;
         case CIO_ERROR_COUNT:               assert(0); break;
     };
 
@@ -37,19 +43,34 @@ long long time_ms(struct timeval *tv)
     return (long long) tv->tv_sec*1000 + tv->tv_usec/1000;
 }
 
+long long now_time_ms(void)
+{
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0)
+        goto fail;
+
+    return time_ms(&tv);
+
+fail:
+    perror("now_time_ms");
+    return -1LL;
+}
+
 int toggle_fd_nonblocking(int fd, int on)
 {
-    int flags;
+    int flags, new_flags;
 
-    if ((flags = fcntl(fd, F_GETFL) == -1))
+    if ((flags = fcntl(fd, F_GETFL)) == -1)
         goto fail;
 
     if (on)
-        flags |= O_NONBLOCK;
+        new_flags = flags | O_NONBLOCK;
     else
-        flags &= ~O_NONBLOCK;
+        new_flags = flags & ~O_NONBLOCK;
 
-    if ((fcntl(fd, F_SETFL, flags) == -1))
+    /* Accepted sockets usually come non-blocking already. */
+    if (new_flags != flags && fcntl(fd, F_SETFL, new_flags) == -1)
         goto fail;
 
     return 0;
@@ -19,6 +19,12 @@ enum CIO_ERROR {
     CIO_WRONG_STATE_ERROR,
     CIO_ALREADY_DESTROYED_ERROR,
     CIO_CONNECTION_CLOSED_ERROR,
+    CIO_INVALID_ARGUMENT_ERROR,
+    CIO_SOCKET_OPTION_ERROR,
+    CIO_TIMEOUT_ERROR,
+    CIO_WRITE_LIMIT_ERROR,
+    CIO_ACCEPT_ERROR,
+    CIO_BUFFER_POOL_EXHAUSTED_ERROR,
     
     CIO_ERROR_COUNT
 };
@@ -38,6 +44,11 @@ typedef void (*pollset_cb_t)(void *ctx, int fd, int flags);
 
 long long time_ms(struct timeval *tv);
 
+/**
+ * time_ms() of the current time, -1 if it can't be got.
+ */
+long long now_time_ms(void);
+
 int toggle_fd_nonblocking(int fd, int on);
 
 /**
@@ -46,7 +57,9 @@ int toggle_fd_nonblocking(int fd, int on);
 enum obj_type {
     ACCEPTOR,
     CONNECTION,
-    COMPLETION
+    COMPLETION,
+    CONNECTION_POOL,
+    DNS_RESOLVER
 };
 
 /**
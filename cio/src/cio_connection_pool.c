@@ -0,0 +1,518 @@
+#include "cio_connection_pool.h"
+#include "cio_tcp_connection.h"
+#include "cio_event_loop.h"
+#include "cio_hash_set.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+struct checkout_ctx {
+    struct connection_pool *pool;
+    void *user_ctx;
+    void (*on_checkout)(void *ctx, int ecode, void *connection);
+    struct checkout_ctx *next;
+    int port;
+    char host[];
+};
+
+struct pool_endpoint;
+
+struct pooled_connection {
+    void *connection;
+    struct pool_endpoint *endpoint;
+    /**
+     * Checkout the connection is being connected for.
+     */
+    struct checkout_ctx *checkout;
+    long long idle_since;
+    struct pooled_connection *next;
+};
+
+struct pool_endpoint {
+    /**
+     * Most recently checked in first: its congestion window is the warmest.
+     */
+    struct pooled_connection *idle;
+    int idle_count;
+    int total;
+    struct checkout_ctx *waiters;
+    struct checkout_ctx *waiters_tail;
+    struct pool_endpoint *next;
+    int port;
+    char host[];
+};
+
+struct connection_pool {
+    enum obj_type type;
+    void *event_loop;
+    /**
+     * Endpoints by (host, port) and, for iterating, in a list.
+     */
+    void *endpoints;
+    struct pool_endpoint *endpoint_list;
+    /**
+     * Checked out pooled_connections by connection.
+     */
+    void *checked_out;
+    int max_idle;
+    int max_total;
+    int idle_timeout_ms;
+    /**
+     * See cio_connection_pool_set_endpoint_selector(), NULL - none.
+     */
+    void *endpoint_selector;
+    /**
+     * Armed for the earliest idle timeout.
+     */
+    void *reaper;
+};
+
+static const int HASH_SET_CAPACITY = 64;
+
+static void reap_idle_connections(void *ctx);
+
+static int endpoint_cmp(const void *l, const void *r)
+{
+    const struct pool_endpoint *le = l, *re = r;
+    return le->port == re->port && strcmp(le->host, re->host) == 0;
+}
+
+static void endpoint_hash_data(const void *elem, void **data, int *len)
+{
+    struct pool_endpoint *endpoint = (struct pool_endpoint *) elem;
+    *data = endpoint->host;
+    *len = strlen(endpoint->host);
+}
+
+void *cio_new_connection_pool(void *event_loop, int max_idle, int max_total, int idle_timeout_ms)
+{
+    struct connection_pool *pool;
+
+    if (!(pool = malloc(sizeof(*pool))))
+        return NULL;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->type = CONNECTION_POOL;
+    pool->event_loop = event_loop;
+    pool->max_idle = CIO_MAX(max_idle, 0);
+    pool->max_total = CIO_MAX(max_total, 0);
+    pool->idle_timeout_ms = CIO_MAX(idle_timeout_ms, 0);
+
+    if (!(pool->endpoints = cio_new_hash_set(HASH_SET_CAPACITY, endpoint_cmp,
+                                             endpoint_hash_data, NULL)))
+        goto fail;
+
+    if (!(pool->checked_out = cio_new_int_map(HASH_SET_CAPACITY,
+                                              sizeof(struct pooled_connection *))))
+        goto fail;
+
+    if (!(pool->reaper = cio_event_loop_new_timer(event_loop, pool, reap_idle_connections)))
+        goto fail;
+
+    return pool;
+
+fail:
+    cio_free_hash_set(pool->endpoints);
+    cio_free_int_map(pool->checked_out);
+    free(pool);
+    return NULL;
+}
+
+static struct pool_endpoint *get_endpoint(struct connection_pool *pool, const char *host,
+    int port)
+{
+    struct pool_endpoint *endpoint, *found;
+    int host_len = strlen(host);
+
+    if (!(endpoint = malloc(sizeof(*endpoint) + host_len + 1)))
+        return NULL;
+
+    memcpy(endpoint->host, host, host_len + 1);
+    endpoint->port = port;
+    if ((found = cio_hash_set_get(pool->endpoints, endpoint))) {
+        free(endpoint);
+        return found;
+    }
+
+    endpoint->idle = NULL;
+    endpoint->idle_count = 0;
+    endpoint->total = 0;
+    endpoint->waiters = NULL;
+    endpoint->waiters_tail = NULL;
+    if (!cio_hash_set_add(pool->endpoints, endpoint)) {
+        free(endpoint);
+        return NULL;
+    }
+
+    endpoint->next = pool->endpoint_list;
+    pool->endpoint_list = endpoint;
+    return endpoint;
+}
+
+static void complete_checkout(struct checkout_ctx *checkout_ctx, int cio_error, void *connection)
+{
+    checkout_ctx->on_checkout(checkout_ctx->user_ctx, cio_error, connection);
+    free(checkout_ctx);
+}
+
+static void close_pooled_connection(struct pooled_connection *pooled)
+{
+    pooled->endpoint->total--;
+    cio_free_tcp_connection_async(pooled->connection);
+    free(pooled);
+}
+
+static void hand_over(struct pooled_connection *pooled, struct checkout_ctx *checkout_ctx)
+{
+    if (!cio_int_map_put(checkout_ctx->pool->checked_out, (uintptr_t) pooled->connection,
+                         &pooled)) {
+        close_pooled_connection(pooled);
+        return complete_checkout(checkout_ctx, CIO_ALLOC_ERROR, NULL);
+    }
+
+    cio_tcp_connection_set_user_ctx(pooled->connection, checkout_ctx->user_ctx);
+    complete_checkout(checkout_ctx, CIO_NO_ERROR, pooled->connection);
+}
+
+static void serve_waiters(struct pool_endpoint *endpoint, struct connection_pool *pool);
+
+static void on_pool_connect(void *ctx, int ecode)
+{
+    struct pooled_connection *pooled = ctx;
+    struct checkout_ctx *checkout_ctx = pooled->checkout;
+    struct pool_endpoint *endpoint = pooled->endpoint;
+
+    pooled->checkout = NULL;
+    if (ecode == CIO_NO_ERROR)
+        return hand_over(pooled, checkout_ctx);
+
+    close_pooled_connection(pooled);
+    serve_waiters(endpoint, checkout_ctx->pool);
+    complete_checkout(checkout_ctx, ecode, NULL);
+}
+
+static void open_connection(struct pool_endpoint *endpoint, struct checkout_ctx *checkout_ctx)
+{
+    struct connection_pool *pool = checkout_ctx->pool;
+    struct pooled_connection *pooled;
+
+    if (!(pooled = malloc(sizeof(*pooled))))
+        return complete_checkout(checkout_ctx, CIO_ALLOC_ERROR, NULL);
+
+    pooled->endpoint = endpoint;
+    pooled->checkout = checkout_ctx;
+    pooled->next = NULL;
+    if (!(pooled->connection = cio_new_tcp_connection(pool->event_loop, pooled))) {
+        free(pooled);
+        return complete_checkout(checkout_ctx, CIO_ALLOC_ERROR, NULL);
+    }
+
+    endpoint->total++;
+    if (pool->endpoint_selector)
+        cio_tcp_connection_set_endpoint_selector(pooled->connection, pool->endpoint_selector);
+    cio_tcp_connection_async_connect(pooled->connection, endpoint->host, endpoint->port,
+                                     on_pool_connect);
+}
+
+static void serve(struct pool_endpoint *endpoint, struct checkout_ctx *checkout_ctx)
+{
+    struct connection_pool *pool = checkout_ctx->pool;
+    struct pooled_connection *pooled;
+
+    while ((pooled = endpoint->idle)) {
+        endpoint->idle = pooled->next;
+        endpoint->idle_count--;
+        if (cio_tcp_connection_is_alive(pooled->connection))
+            return hand_over(pooled, checkout_ctx);
+        close_pooled_connection(pooled);
+    }
+
+    if (pool->max_total && endpoint->total >= pool->max_total) {
+        checkout_ctx->next = NULL;
+        if (endpoint->waiters_tail)
+            endpoint->waiters_tail->next = checkout_ctx;
+        else
+            endpoint->waiters = checkout_ctx;
+        endpoint->waiters_tail = checkout_ctx;
+        return;
+    }
+
+    open_connection(endpoint, checkout_ctx);
+}
+
+static void serve_waiters(struct pool_endpoint *endpoint, struct connection_pool *pool)
+{
+    struct checkout_ctx *checkout_ctx;
+
+    while ((checkout_ctx = endpoint->waiters)
+           && (endpoint->idle || !pool->max_total || endpoint->total < pool->max_total)) {
+        if (!(endpoint->waiters = checkout_ctx->next))
+            endpoint->waiters_tail = NULL;
+        serve(endpoint, checkout_ctx);
+    }
+}
+
+static void checkout_impl(void *ctx)
+{
+    struct checkout_ctx *checkout_ctx = ctx;
+    struct pool_endpoint *endpoint;
+
+    if (!(endpoint = get_endpoint(checkout_ctx->pool, checkout_ctx->host, checkout_ctx->port)))
+        return complete_checkout(checkout_ctx, CIO_ALLOC_ERROR, NULL);
+
+    serve(endpoint, checkout_ctx);
+}
+
+struct endpoint_selector_ctx {
+    struct connection_pool *pool;
+    void *endpoint_selector;
+};
+
+static void set_endpoint_selector_impl(void *ctx)
+{
+    struct endpoint_selector_ctx *endpoint_selector_ctx = ctx;
+
+    endpoint_selector_ctx->pool->endpoint_selector = endpoint_selector_ctx->endpoint_selector;
+    free(endpoint_selector_ctx);
+}
+
+void cio_connection_pool_set_endpoint_selector(void *connection_pool, void *endpoint_selector)
+{
+    struct connection_pool *pool = connection_pool;
+    struct endpoint_selector_ctx *endpoint_selector_ctx;
+
+    if (!(endpoint_selector_ctx = malloc(sizeof(*endpoint_selector_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_connection_pool_set_endpoint_selector");
+        return;
+    }
+
+    endpoint_selector_ctx->pool = pool;
+    endpoint_selector_ctx->endpoint_selector = endpoint_selector;
+    cio_event_loop_post(pool->event_loop, 0, endpoint_selector_ctx, set_endpoint_selector_impl);
+}
+
+void cio_connection_pool_async_checkout(void *connection_pool, const char *host, int port,
+    void *ctx, void (*on_checkout)(void *ctx, int ecode, void *connection))
+{
+    struct connection_pool *pool = connection_pool;
+    struct checkout_ctx *checkout_ctx;
+    int host_len = strlen(host);
+
+    if (!(checkout_ctx = malloc(sizeof(*checkout_ctx) + host_len + 1))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_connection_pool_async_checkout");
+        on_checkout(ctx, CIO_ALLOC_ERROR, NULL);
+        return;
+    }
+
+    checkout_ctx->pool = pool;
+    checkout_ctx->user_ctx = ctx;
+    checkout_ctx->on_checkout = on_checkout;
+    checkout_ctx->next = NULL;
+    checkout_ctx->port = port;
+    memcpy(checkout_ctx->host, host, host_len + 1);
+    cio_event_loop_post(pool->event_loop, 0, checkout_ctx, checkout_impl);
+}
+
+static void free_pool_memory(struct connection_pool *pool)
+{
+    struct pool_endpoint *endpoint;
+
+    while ((endpoint = pool->endpoint_list)) {
+        pool->endpoint_list = endpoint->next;
+        free(endpoint);
+    }
+
+    cio_event_loop_free_timer(pool->reaper);
+    cio_free_hash_set(pool->endpoints);
+    cio_free_int_map(pool->checked_out);
+    free(pool);
+}
+
+static void arm_reaper(struct connection_pool *pool, long long due);
+
+/**
+ * Closes the idle connections which timed out or were closed by the peer.
+ */
+static void reap_idle_connections(void *ctx)
+{
+    struct connection_pool *pool = ctx;
+    struct pool_endpoint *endpoint;
+    struct pooled_connection **pp, *pooled;
+    long long now = now_time_ms();
+    long long next_due = 0, due;
+
+    for (endpoint = pool->endpoint_list; endpoint; endpoint = endpoint->next) {
+        for (pp = &endpoint->idle; (pooled = *pp); ) {
+            due = pooled->idle_since + pool->idle_timeout_ms;
+            if (due <= now || !cio_tcp_connection_is_alive(pooled->connection)) {
+                *pp = pooled->next;
+                endpoint->idle_count--;
+                close_pooled_connection(pooled);
+                continue;
+            }
+            if (!next_due || due < next_due)
+                next_due = due;
+            pp = &pooled->next;
+        }
+    }
+
+    if (next_due)
+        arm_reaper(pool, next_due);
+}
+
+static void arm_reaper(struct connection_pool *pool, long long due)
+{
+    long long armed_due;
+
+    if (!pool->idle_timeout_ms)
+        return;
+
+    armed_due = cio_event_loop_timer_due(pool->reaper);
+    if (!armed_due || due < armed_due)
+        cio_event_loop_arm_timer(pool->reaper, (int) CIO_MAX(due - now_time_ms(), 0));
+}
+
+struct checkin_ctx {
+    struct connection_pool *pool;
+    void *connection;
+    int reusable;
+};
+
+static void checkin(struct connection_pool *pool, void *connection, int reusable)
+{
+    struct pooled_connection *pooled;
+    struct pool_endpoint *endpoint;
+
+    if (cio_int_map_remove(pool->checked_out, (uintptr_t) connection, &pooled)) {
+        cio_perror(CIO_NOT_FOUND_ERROR, "cio_connection_pool_checkin");
+        return;
+    }
+
+    endpoint = pooled->endpoint;
+    if (reusable && endpoint->idle_count < pool->max_idle
+            && cio_tcp_connection_is_alive(pooled->connection)) {
+        cio_tcp_connection_set_user_ctx(pooled->connection, pooled);
+        pooled->idle_since = now_time_ms();
+        pooled->next = endpoint->idle;
+        endpoint->idle = pooled;
+        endpoint->idle_count++;
+        arm_reaper(pool, pooled->idle_since + pool->idle_timeout_ms);
+    } else {
+        close_pooled_connection(pooled);
+    }
+
+    serve_waiters(endpoint, pool);
+}
+
+static void checkin_impl(void *ctx)
+{
+    struct checkin_ctx *checkin_ctx = ctx;
+
+    checkin(checkin_ctx->pool, checkin_ctx->connection, checkin_ctx->reusable);
+    free(checkin_ctx);
+}
+
+void cio_connection_pool_checkin(void *connection_pool, void *connection, int reusable)
+{
+    struct connection_pool *pool = connection_pool;
+    struct checkin_ctx *checkin_ctx;
+
+    /* Nothing is allocated on the loop thread, so the slot can't be lost there. */
+    if (cio_event_loop_is_loop_thread(pool->event_loop))
+        return checkin(pool, connection, reusable);
+
+    if (!(checkin_ctx = malloc(sizeof(*checkin_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_connection_pool_checkin");
+        return;
+    }
+
+    checkin_ctx->pool = pool;
+    checkin_ctx->connection = connection;
+    checkin_ctx->reusable = reusable;
+    cio_event_loop_post(pool->event_loop, 0, checkin_ctx, checkin_impl);
+}
+
+static void free_connection_pool_impl(void *ctx)
+{
+    struct connection_pool *pool = NULL;
+    struct completion_ctx *completion_ctx = NULL;
+    struct pool_endpoint *endpoint;
+    struct pooled_connection *pooled;
+    struct checkout_ctx *checkout_ctx;
+    enum obj_type type;
+
+    type = *((enum obj_type *) ctx);
+    switch (type) {
+        case CONNECTION_POOL:
+            pool = ctx;
+            break;
+        case COMPLETION:
+            completion_ctx = ctx;
+            pool = completion_ctx->wrapped_ctx;
+            break;
+        default:
+            assert(0);
+            return;
+    }
+
+    for (endpoint = pool->endpoint_list; endpoint; endpoint = endpoint->next) {
+        while ((pooled = endpoint->idle)) {
+            endpoint->idle = pooled->next;
+            close_pooled_connection(pooled);
+        }
+        endpoint->idle_count = 0;
+        while ((checkout_ctx = endpoint->waiters)) {
+            endpoint->waiters = checkout_ctx->next;
+            complete_checkout(checkout_ctx, CIO_ALREADY_DESTROYED_ERROR, NULL);
+        }
+        endpoint->waiters_tail = NULL;
+    }
+
+    free_pool_memory(pool);
+
+    if (type == COMPLETION) {
+        pthread_mutex_lock(&completion_ctx->mutex);
+        pthread_cond_signal(&completion_ctx->cond);
+        pthread_mutex_unlock(&completion_ctx->mutex);
+    }
+}
+
+void cio_free_connection_pool_async(void *connection_pool)
+{
+    struct connection_pool *pool = connection_pool;
+
+    if (!pool)
+        return;
+
+    cio_event_loop_post(pool->event_loop, 0, pool, free_connection_pool_impl);
+}
+
+void cio_free_connection_pool_sync(void *connection_pool)
+{
+    struct connection_pool *pool = connection_pool;
+    struct completion_ctx *completion_ctx;
+    int ecode;
+
+    if (!pool)
+        return;
+
+    if (!(completion_ctx = new_completion_ctx(pool)))
+        goto fail;
+
+    if ((ecode = completion_ctx_post_and_wait(completion_ctx, pool->event_loop,
+                                              free_connection_pool_impl, 0))) {
+        errno = ecode;
+        goto fail;
+    }
+
+    goto finally;
+
+fail:
+    perror("cio_free_connection_pool_sync");
+
+finally:
+    free_completion_ctx(completion_ctx);
+}
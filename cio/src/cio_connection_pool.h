@@ -0,0 +1,46 @@
+#if !defined(CIO_CONNECTION_POOL_H)
+#define CIO_CONNECTION_POOL_H
+
+/**
+ * Pool of client tcp connections keyed by (host, port). Requests to the same endpoint reuse the
+ * established connections instead of paying for DNS, the handshake and slow start each time.
+ * All the pool work is done on the event loop thread.
+ *
+ * max_idle - idle connections kept per endpoint.
+ * max_total - connections per endpoint, idle and checked out together, 0 - unlimited. Checkouts
+ * over the limit wait for a connection to be checked in.
+ * idle_timeout_ms - idle connections are closed after that long, 0 - never.
+ */
+void *cio_new_connection_pool(void *event_loop, int max_idle, int max_total, int idle_timeout_ms);
+
+/**
+ * All the connections must be checked in and all the checkouts completed before the pool is
+ * destroyed. Idle connections are closed.
+ */
+void cio_free_connection_pool_async(void *connection_pool);
+void cio_free_connection_pool_sync(void *connection_pool);
+
+/**
+ * The new connections of the pool connect through the endpoint selector (see
+ * cio_tcp_connection_set_endpoint_selector()), so that they spread over the addresses an endpoint
+ * host resolves to. NULL - none. The selector must outlive the pool.
+ */
+void cio_connection_pool_set_endpoint_selector(void *connection_pool, void *endpoint_selector);
+
+/**
+ * Calls 'on_checkout' with an idle connection to host:port which is still alive (see
+ * cio_tcp_connection_is_alive()) or with a newly connected one. The connection callbacks get
+ * 'ctx' until the connection is checked in. On error 'connection' is NULL.
+ */
+void cio_connection_pool_async_checkout(void *connection_pool, const char *host, int port,
+    void *ctx, void (*on_checkout)(void *ctx, int ecode, void *connection));
+
+/**
+ * Returns the checked out connection to the pool. It must have no operations in progress.
+ * reusable - 0 if the connection state is unknown (an operation failed, a response wasn't read
+ * completely), such a connection is closed instead. On the event loop thread, e.g. from the
+ * connection callbacks, it is done right away.
+ */
+void cio_connection_pool_checkin(void *connection_pool, void *connection, int reusable);
+
+#endif /* CIO_CONNECTION_POOL_H */
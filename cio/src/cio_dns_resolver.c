@@ -0,0 +1,818 @@
+#include "cio_dns_resolver.h"
+#include "cio_event_loop.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define DNS_MAX_ADDRS 16
+#define DNS_MAX_MESSAGE 1232
+#define DNS_MAX_NAME 255
+#define DNS_RANDOM_IDS 32
+
+static const int DNS_PORT = 53;
+static const int DEFAULT_TIMEOUT_MS = 5000;
+static const int DEFAULT_ATTEMPTS = 2;
+
+enum DNS_TYPE {
+    DNS_TYPE_A = 1,
+    DNS_TYPE_AAAA = 28
+};
+
+static const int DNS_CLASS_IN = 1;
+static const int DNS_RCODE_NXDOMAIN = 3;
+
+/**
+ * Query kinds, bits of dns_query.pending.
+ */
+enum QUERY_KIND {
+    QUERY_A = 1,
+    QUERY_AAAA = 2
+};
+
+struct dns_host {
+    struct sockaddr_storage addr;
+    struct dns_host *next;
+    char name[];
+};
+
+struct dns_query {
+    struct dns_resolver *dns;
+    void *user_ctx;
+    void (*on_resolved)(void *ctx, int ecode, void *resolver);
+    int port;
+    int family;
+    int socktype;
+    /**
+     * Ids of the A and the AAAA queries and which of them are still unanswered.
+     */
+    unsigned short ids[2];
+    int pending;
+    /**
+     * Sends made so far and the server of the last one.
+     */
+    int tries;
+    int server;
+    /**
+     * IPv4 and IPv6 sockets of this lookup alone, opened once a server of that family is queried.
+     * Each gets its own ephemeral port, so that an off-path answer has to guess it as well as the
+     * id.
+     */
+    int fds[2];
+    void *retry_timer;
+    struct sockaddr_storage addrs[DNS_MAX_ADDRS];
+    int addr_count;
+    struct dns_query *next;
+    char name[];
+};
+
+struct dns_resolver {
+    enum obj_type type;
+    void *event_loop;
+    struct cio_dns_config config;
+    struct dns_host *hosts;
+    /**
+     * Lookups in progress.
+     */
+    struct dns_query *queries;
+    /**
+     * Query ids read from the kernel ahead, 'random_left' of them are unused.
+     */
+    unsigned short random_ids[DNS_RANDOM_IDS];
+    int random_left;
+    unsigned random_state;
+};
+
+static void set_port(struct sockaddr_storage *addr, int port)
+{
+    if (addr->ss_family == AF_INET)
+        ((struct sockaddr_in *) addr)->sin_port = htons(port);
+    else
+        ((struct sockaddr_in6 *) addr)->sin6_port = htons(port);
+}
+
+/**
+ * Parses a numeric IPv4 or IPv6 address.
+ */
+static int parse_address(const char *str, struct sockaddr_storage *addr, socklen_t *len)
+{
+    struct sockaddr_in *addr4 = (struct sockaddr_in *) addr;
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *) addr;
+
+    memset(addr, 0, sizeof(*addr));
+    if (inet_pton(AF_INET, str, &addr4->sin_addr) == 1) {
+        addr4->sin_family = AF_INET;
+        *len = sizeof(*addr4);
+        return 0;
+    }
+
+    if (inet_pton(AF_INET6, str, &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        *len = sizeof(*addr6);
+        return 0;
+    }
+
+    return -1;
+}
+
+static int same_address(const struct sockaddr_storage *l, const struct sockaddr_storage *r)
+{
+    const struct sockaddr_in *l4 = (const struct sockaddr_in *) l;
+    const struct sockaddr_in *r4 = (const struct sockaddr_in *) r;
+    const struct sockaddr_in6 *l6 = (const struct sockaddr_in6 *) l;
+    const struct sockaddr_in6 *r6 = (const struct sockaddr_in6 *) r;
+
+    if (l->ss_family != r->ss_family)
+        return 0;
+
+    if (l->ss_family == AF_INET)
+        return l4->sin_port == r4->sin_port && l4->sin_addr.s_addr == r4->sin_addr.s_addr;
+
+    return l6->sin6_port == r6->sin6_port
+        && !memcmp(&l6->sin6_addr, &r6->sin6_addr, sizeof(l6->sin6_addr));
+}
+
+int cio_dns_config_add_server(struct cio_dns_config *config, const char *addr, int port)
+{
+    struct sockaddr_storage *server;
+
+    if (config->server_count >= CIO_DNS_MAX_SERVERS || port <= 0 || port > 65535)
+        return CIO_INVALID_ARGUMENT_ERROR;
+
+    server = &config->servers[config->server_count];
+    if (parse_address(addr, server, &config->server_lens[config->server_count]))
+        return CIO_INVALID_ARGUMENT_ERROR;
+
+    set_port(server, port);
+    config->server_count++;
+
+    return CIO_NO_ERROR;
+}
+
+int cio_dns_config_load(struct cio_dns_config *config, const char *resolv_conf_path)
+{
+    char line[512], *token, *save;
+    FILE *file;
+    int ecode = CIO_NO_ERROR;
+
+    memset(config, 0, sizeof(*config));
+    config->timeout_ms = DEFAULT_TIMEOUT_MS;
+    config->attempts = DEFAULT_ATTEMPTS;
+    strcpy(config->hosts_path, "/etc/hosts");
+
+    if (!(file = fopen(resolv_conf_path ? resolv_conf_path : "/etc/resolv.conf", "r"))) {
+        ecode = CIO_NOT_FOUND_ERROR;
+        goto finally;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        if (!(token = strtok_r(line, " \t\r\n", &save)) || *token == '#' || *token == ';')
+            continue;
+
+        if (!strcmp(token, "nameserver")) {
+            /* Beyond the max and scoped IPv6 addresses are skipped. */
+            if ((token = strtok_r(NULL, " \t\r\n", &save)))
+                cio_dns_config_add_server(config, token, DNS_PORT);
+        } else if (!strcmp(token, "options")) {
+            while ((token = strtok_r(NULL, " \t\r\n", &save))) {
+                if (!strncmp(token, "timeout:", 8))
+                    config->timeout_ms = CIO_MAX(atoi(token + 8), 1) * 1000;
+                else if (!strncmp(token, "attempts:", 9))
+                    config->attempts = CIO_MAX(atoi(token + 9), 1);
+            }
+        }
+    }
+    fclose(file);
+
+finally:
+    if (!config->server_count)
+        cio_dns_config_add_server(config, "127.0.0.1", DNS_PORT);
+
+    return ecode;
+}
+
+static void free_hosts(struct dns_host *hosts)
+{
+    struct dns_host *next;
+
+    for (; hosts; hosts = next) {
+        next = hosts->next;
+        free(hosts);
+    }
+}
+
+/**
+ * Lines of "address name [aliases...]", '#' starts a comment.
+ */
+static int load_hosts(struct dns_resolver *dns, const char *path)
+{
+    char line[512], *token, *save;
+    struct sockaddr_storage addr;
+    struct dns_host *host;
+    socklen_t len;
+    FILE *file;
+    int name_len;
+
+    if (!(file = fopen(path, "r")))
+        return CIO_NOT_FOUND_ERROR;
+
+    while (fgets(line, sizeof(line), file)) {
+        if ((token = strchr(line, '#')))
+            *token = '\0';
+
+        if (!(token = strtok_r(line, " \t\r\n", &save)) || parse_address(token, &addr, &len))
+            continue;
+
+        while ((token = strtok_r(NULL, " \t\r\n", &save))) {
+            name_len = strlen(token);
+            if (!(host = malloc(sizeof(*host) + name_len + 1))) {
+                fclose(file);
+                return CIO_ALLOC_ERROR;
+            }
+
+            memcpy(&host->addr, &addr, sizeof(addr));
+            memcpy(host->name, token, name_len + 1);
+            host->next = dns->hosts;
+            dns->hosts = host;
+        }
+    }
+    fclose(file);
+
+    return CIO_NO_ERROR;
+}
+
+/**
+ * Fills 'buf' from the kernel's random pool. Returns -1 if it can't be read.
+ */
+static int read_random(void *buf, int len)
+{
+    int fd, done = 0, result = 0;
+
+    if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    while (done < len) {
+        if ((result = read(fd, (char *) buf + done, len - done)) <= 0 && errno != EINTR)
+            break;
+        if (result > 0)
+            done += result;
+    }
+    close(fd);
+
+    return done == len ? 0 : -1;
+}
+
+void *cio_new_dns_resolver(void *event_loop, const struct cio_dns_config *config)
+{
+    struct dns_resolver *dns;
+
+    if (!(dns = malloc(sizeof(*dns))))
+        return NULL;
+
+    memset(dns, 0, sizeof(*dns));
+    dns->type = DNS_RESOLVER;
+    dns->event_loop = event_loop;
+    memcpy(&dns->config, config, sizeof(*config));
+    dns->config.timeout_ms = CIO_MAX(dns->config.timeout_ms, 1);
+    dns->config.attempts = CIO_MAX(dns->config.attempts, 1);
+    if (read_random(&dns->random_state, sizeof(dns->random_state)))
+        dns->random_state = (unsigned) now_time_ms() ^ (unsigned) getpid() ^ (unsigned) (long) dns;
+    if (!dns->random_state)
+        dns->random_state = 1;
+
+    /* A hosts file which isn't there is no error. */
+    if (*config->hosts_path && load_hosts(dns, config->hosts_path) == CIO_ALLOC_ERROR) {
+        free_hosts(dns->hosts);
+        free(dns);
+        return NULL;
+    }
+
+    return dns;
+}
+
+/**
+ * Query ids are random so that an off-path answer is harder to forge. They come from the kernel a
+ * batch at a time, the xorshift generator seeded from it is only the fallback.
+ */
+static unsigned short next_query_id(struct dns_resolver *dns)
+{
+    unsigned x;
+
+    if (!dns->random_left && !read_random(dns->random_ids, sizeof(dns->random_ids)))
+        dns->random_left = DNS_RANDOM_IDS;
+    if (dns->random_left)
+        return dns->random_ids[--dns->random_left];
+
+    x = dns->random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dns->random_state = x;
+
+    return (unsigned short) (x >> 8);
+}
+
+static int encode_query(unsigned char *buf, unsigned short id, const char *name, int type)
+{
+    const char *label, *dot;
+    int pos = 12, len;
+
+    memset(buf, 0, 12);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01; /* recursion desired */
+    buf[5] = 1; /* one question */
+
+    for (label = name; *label; label = dot + 1) {
+        if (!(dot = strchr(label, '.')))
+            dot = label + strlen(label);
+
+        len = dot - label;
+        /* With the length octets and the root label. */
+        if (len < 1 || len > 63 || pos - 12 + 1 + len + 1 > DNS_MAX_NAME)
+            return -1;
+
+        buf[pos++] = len;
+        memcpy(buf + pos, label, len);
+        pos += len;
+        if (!*dot)
+            break;
+    }
+
+    if (pos == 12)
+        return -1;
+
+    buf[pos++] = 0;
+    buf[pos++] = type >> 8;
+    buf[pos++] = type & 0xff;
+    buf[pos++] = DNS_CLASS_IN >> 8;
+    buf[pos++] = DNS_CLASS_IN & 0xff;
+
+    return pos;
+}
+
+/**
+ * Reads the name at 'pos' into 'name' (NULL to skip it) following the compression pointers.
+ * Returns the position after the name, -1 if it is malformed.
+ */
+static int read_name(const unsigned char *msg, int len, int pos, char *name)
+{
+    int end = -1, hops = 0, name_len = 0, label_len;
+
+    for (;;) {
+        if (pos >= len)
+            return -1;
+
+        label_len = msg[pos];
+        if ((label_len & 0xc0) == 0xc0) {
+            if (pos + 1 >= len || ++hops > 16)
+                return -1;
+            if (end < 0)
+                end = pos + 2;
+            pos = ((label_len & 0x3f) << 8) | msg[pos + 1];
+            continue;
+        }
+
+        if (label_len & 0xc0)
+            return -1;
+
+        if (!label_len)
+            break;
+
+        if (pos + 1 + label_len > len || name_len + label_len + 1 > DNS_MAX_NAME)
+            return -1;
+
+        if (name) {
+            if (name_len)
+                name[name_len++] = '.';
+            memcpy(name + name_len, msg + pos + 1, label_len);
+        } else if (name_len) {
+            name_len++;
+        }
+        name_len += label_len;
+        pos += 1 + label_len;
+    }
+
+    if (name)
+        name[name_len] = '\0';
+
+    return end < 0 ? pos + 1 : end;
+}
+
+static unsigned read_u16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void add_address(struct dns_query *query, int family, const void *data)
+{
+    struct sockaddr_storage *addr;
+
+    if (query->addr_count >= DNS_MAX_ADDRS)
+        return;
+
+    addr = &query->addrs[query->addr_count++];
+    memset(addr, 0, sizeof(*addr));
+    addr->ss_family = family;
+    if (family == AF_INET)
+        memcpy(&((struct sockaddr_in *) addr)->sin_addr, data, 4);
+    else
+        memcpy(&((struct sockaddr_in6 *) addr)->sin6_addr, data, 16);
+    set_port(addr, query->port);
+}
+
+/**
+ * Parses the answer to the query of 'kind'. Returns 0 if it settles the query (addresses or no
+ * such name), -1 if it should be ignored: malformed, for another question or a server failure, in
+ * which case the query is retried on timeout.
+ */
+static int parse_answer(struct dns_query *query, int kind, const unsigned char *msg, int len)
+{
+    int type = kind == QUERY_A ? DNS_TYPE_A : DNS_TYPE_AAAA;
+    int addr_len = kind == QUERY_A ? 4 : 16;
+    char name[DNS_MAX_NAME + 1];
+    int pos, count, rr_type, rr_class, rr_len, rcode;
+    const char *query_name = query->name;
+    int query_name_len = strlen(query_name);
+
+    /* An answer with the QR bit, one question and no opcode. */
+    if (len < 12 || !(msg[2] & 0x80) || (msg[2] & 0x78) || read_u16(msg + 4) != 1)
+        return -1;
+
+    if ((pos = read_name(msg, len, 12, name)) < 0 || pos + 4 > len)
+        return -1;
+
+    if (query_name_len && query_name[query_name_len - 1] == '.')
+        query_name_len--;
+    if ((int) strlen(name) != query_name_len || strncasecmp(name, query_name, query_name_len)
+            || read_u16(msg + pos) != type || read_u16(msg + pos + 2) != DNS_CLASS_IN)
+        return -1;
+    pos += 4;
+
+    rcode = msg[3] & 0x0f;
+    if (rcode == DNS_RCODE_NXDOMAIN)
+        return 0;
+    if (rcode)
+        return -1;
+
+    /* The answer section of a recursive server also carries the records the CNAMEs lead to. */
+    for (count = read_u16(msg + 6); count > 0; --count) {
+        if ((pos = read_name(msg, len, pos, NULL)) < 0 || pos + 10 > len)
+            break;
+
+        rr_type = read_u16(msg + pos);
+        rr_class = read_u16(msg + pos + 2);
+        rr_len = read_u16(msg + pos + 8);
+        pos += 10;
+        if (pos + rr_len > len)
+            break;
+
+        if (rr_type == type && rr_class == DNS_CLASS_IN && rr_len == addr_len)
+            add_address(query, kind == QUERY_A ? AF_INET : AF_INET6, msg + pos);
+        pos += rr_len;
+    }
+
+    return 0;
+}
+
+static void free_query(struct dns_query *query)
+{
+    struct dns_resolver *dns = query->dns;
+    struct dns_query **pp;
+    int i;
+
+    for (pp = &dns->queries; *pp && *pp != query; pp = &(*pp)->next)
+        ;
+    if (*pp)
+        *pp = query->next;
+
+    for (i = 0; i < 2; ++i) {
+        if (query->fds[i] >= 0) {
+            cio_event_loop_remove_fd(dns->event_loop, query->fds[i]);
+            close(query->fds[i]);
+        }
+    }
+    cio_event_loop_free_timer(query->retry_timer);
+    free(query);
+}
+
+/**
+ * Calls back with the addresses found so far, IPv4 first, and frees the query.
+ */
+static void complete_query(struct dns_query *query, int ecode)
+{
+    struct addrinfo nodes[DNS_MAX_ADDRS], *head = NULL, **tail = &head;
+    void *resolver = NULL;
+    int pass, i, family;
+
+    if (ecode == CIO_NO_ERROR) {
+        for (pass = 0; pass < 2; ++pass) {
+            family = pass ? AF_INET6 : AF_INET;
+            for (i = 0; i < query->addr_count; ++i) {
+                if (query->addrs[i].ss_family != family)
+                    continue;
+
+                memset(&nodes[i], 0, sizeof(nodes[i]));
+                nodes[i].ai_family = family;
+                nodes[i].ai_socktype = query->socktype;
+                nodes[i].ai_protocol = query->socktype == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP;
+                nodes[i].ai_addr = (struct sockaddr *) &query->addrs[i];
+                nodes[i].ai_addrlen = family == AF_INET ? sizeof(struct sockaddr_in)
+                    : sizeof(struct sockaddr_in6);
+                *tail = &nodes[i];
+                tail = &nodes[i].ai_next;
+            }
+        }
+
+        if (!head)
+            ecode = CIO_NOT_FOUND_ERROR;
+        else if (!(resolver = cio_new_resolver_from_list(head, query->socktype)))
+            ecode = CIO_ALLOC_ERROR;
+    }
+
+    query->on_resolved(query->user_ctx, ecode, resolver);
+    free_query(query);
+}
+
+static int query_kinds(int family)
+{
+    return family == AF_INET ? QUERY_A : family == AF_INET6 ? QUERY_AAAA : QUERY_A | QUERY_AAAA;
+}
+
+/**
+ * Numeric addresses and the hosts file. Returns 0 if the query is settled.
+ */
+static int resolve_locally(struct dns_query *query)
+{
+    struct dns_host *host;
+    socklen_t len;
+    int kinds = query_kinds(query->family);
+
+    if (!parse_address(query->name, &query->addrs[0], &len)) {
+        if (kinds & (query->addrs[0].ss_family == AF_INET ? QUERY_A : QUERY_AAAA)) {
+            set_port(&query->addrs[0], query->port);
+            query->addr_count = 1;
+        }
+        return 0;
+    }
+
+    for (host = query->dns->hosts; host; host = host->next) {
+        if (strcasecmp(host->name, query->name)
+                || !(kinds & (host->addr.ss_family == AF_INET ? QUERY_A : QUERY_AAAA))
+                || query->addr_count >= DNS_MAX_ADDRS)
+            continue;
+
+        memcpy(&query->addrs[query->addr_count], &host->addr, sizeof(host->addr));
+        set_port(&query->addrs[query->addr_count++], query->port);
+    }
+
+    return query->addr_count ? 0 : -1;
+}
+
+/**
+ * Kind of the unanswered query with the id, 0 - none.
+ */
+static int match_query(struct dns_query *query, unsigned short id)
+{
+    if ((query->pending & QUERY_A) && query->ids[0] == id)
+        return QUERY_A;
+    if ((query->pending & QUERY_AAAA) && query->ids[1] == id)
+        return QUERY_AAAA;
+
+    return 0;
+}
+
+static int is_server(struct dns_resolver *dns, const struct sockaddr_storage *addr)
+{
+    int i;
+
+    for (i = 0; i < dns->config.server_count; ++i) {
+        if (same_address(&dns->config.servers[i], addr))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void on_readable(void *ctx, int fd, int flags)
+{
+    struct dns_query *query = ctx;
+    unsigned char msg[DNS_MAX_MESSAGE];
+    struct sockaddr_storage from;
+    socklen_t from_len;
+    int len, kind;
+
+    for (;;) {
+        from_len = sizeof(from);
+        if ((len = recvfrom(fd, msg, sizeof(msg), 0, (struct sockaddr *) &from, &from_len)) < 0)
+            break;
+
+        if (len < 12 || !is_server(query->dns, &from)
+                || !(kind = match_query(query, read_u16(msg)))
+                || parse_answer(query, kind, msg, len))
+            continue;
+
+        /* The socket is closed with the query. */
+        if (!(query->pending &= ~kind))
+            return complete_query(query, CIO_NO_ERROR);
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNREFUSED)
+        perror("cio_dns_resolver: recvfrom");
+}
+
+static int get_socket(struct dns_query *query, int family)
+{
+    int *fd = &query->fds[family == AF_INET ? 0 : 1];
+
+    if (*fd >= 0)
+        return *fd;
+
+    if ((*fd = socket(family, SOCK_DGRAM, 0)) < 0)
+        return -1;
+
+    if (toggle_fd_nonblocking(*fd, 1) == -1
+            || cio_event_loop_add_fd(query->dns->event_loop, *fd, CIO_FLAG_IN, query,
+                                     on_readable)) {
+        close(*fd);
+        return *fd = -1;
+    }
+
+    return *fd;
+}
+
+/**
+ * Sends the unanswered queries to the current server. A failed send, or a socket which can't be
+ * opened, is left to the retry.
+ */
+static void send_queries(struct dns_query *query)
+{
+    struct dns_resolver *dns = query->dns;
+    struct sockaddr_storage *server = &dns->config.servers[query->server];
+    unsigned char msg[DNS_MAX_NAME + 12 + 5];
+    int kind, len, fd;
+
+    /* Counted even if there is no socket, e.g. of a family the host lacks, so the retries end. */
+    query->tries++;
+    if ((fd = get_socket(query, server->ss_family)) < 0) {
+        perror("cio_dns_resolver: socket");
+        return;
+    }
+
+    for (kind = QUERY_A; kind <= QUERY_AAAA; kind <<= 1) {
+        if (!(query->pending & kind))
+            continue;
+
+        len = encode_query(msg, query->ids[kind == QUERY_A ? 0 : 1], query->name,
+                           kind == QUERY_A ? DNS_TYPE_A : DNS_TYPE_AAAA);
+        if (sendto(fd, msg, len, 0, (struct sockaddr *) server,
+                   dns->config.server_lens[query->server]) < 0)
+            perror("cio_dns_resolver: sendto");
+    }
+}
+
+static void on_retry_timer(void *ctx)
+{
+    struct dns_query *query = ctx;
+    struct dns_resolver *dns = query->dns;
+
+    if (query->tries >= dns->config.attempts * dns->config.server_count)
+        return complete_query(query, query->addr_count ? CIO_NO_ERROR : CIO_TIMEOUT_ERROR);
+
+    query->server = (query->server + 1) % dns->config.server_count;
+    send_queries(query);
+    cio_event_loop_arm_timer(query->retry_timer, dns->config.timeout_ms);
+}
+
+static void resolve_impl(void *ctx)
+{
+    struct dns_query *query = ctx;
+    struct dns_resolver *dns = query->dns;
+    unsigned char msg[DNS_MAX_NAME + 12 + 5];
+
+    query->next = dns->queries;
+    dns->queries = query;
+
+    if (!resolve_locally(query))
+        return complete_query(query, CIO_NO_ERROR);
+
+    if (encode_query(msg, 0, query->name, DNS_TYPE_A) < 0)
+        return complete_query(query, CIO_INVALID_ARGUMENT_ERROR);
+
+    if (!dns->config.server_count)
+        return complete_query(query, CIO_NOT_FOUND_ERROR);
+
+    query->pending = query_kinds(query->family);
+    query->ids[0] = next_query_id(dns);
+    query->ids[1] = next_query_id(dns);
+    send_queries(query);
+    cio_event_loop_arm_timer(query->retry_timer, dns->config.timeout_ms);
+}
+
+void cio_dns_resolver_async_resolve(void *dns_resolver, const char *name, int port, int family,
+    int socktype, void *ctx, void (*on_resolved)(void *ctx, int ecode, void *resolver))
+{
+    struct dns_resolver *dns = dns_resolver;
+    struct dns_query *query;
+    int name_len = strlen(name);
+    int ecode = CIO_INVALID_ARGUMENT_ERROR;
+
+    if (port < 0 || port > 65535 || name_len > DNS_MAX_NAME
+            || (family != AF_INET && family != AF_INET6 && family != AF_UNSPEC))
+        goto fail;
+
+    ecode = CIO_ALLOC_ERROR;
+    if (!(query = malloc(sizeof(*query) + name_len + 1)))
+        goto fail;
+
+    memset(query, 0, sizeof(*query));
+    query->fds[0] = query->fds[1] = -1;
+    if (!(query->retry_timer = cio_event_loop_new_timer(dns->event_loop, query,
+                                                        on_retry_timer))) {
+        free(query);
+        goto fail;
+    }
+
+    query->dns = dns;
+    query->user_ctx = ctx;
+    query->on_resolved = on_resolved;
+    query->port = port;
+    query->family = family;
+    query->socktype = socktype;
+    memcpy(query->name, name, name_len + 1);
+    cio_event_loop_post(dns->event_loop, 0, query, resolve_impl);
+
+    return;
+
+fail:
+    cio_perror(ecode, "cio_dns_resolver_async_resolve");
+    on_resolved(ctx, ecode, NULL);
+}
+
+static void free_dns_resolver_impl(void *ctx)
+{
+    struct completion_ctx *completion_ctx = NULL;
+    struct dns_resolver *dns;
+    struct dns_query *query;
+
+    if (*((enum obj_type *) ctx) == COMPLETION) {
+        completion_ctx = ctx;
+        dns = completion_ctx->wrapped_ctx;
+    } else {
+        dns = ctx;
+    }
+
+    while ((query = dns->queries))
+        complete_query(query, CIO_ALREADY_DESTROYED_ERROR);
+
+    free_hosts(dns->hosts);
+    free(dns);
+
+    if (completion_ctx) {
+        pthread_mutex_lock(&completion_ctx->mutex);
+        pthread_cond_signal(&completion_ctx->cond);
+        pthread_mutex_unlock(&completion_ctx->mutex);
+    }
+}
+
+void cio_free_dns_resolver_async(void *dns_resolver)
+{
+    struct dns_resolver *dns = dns_resolver;
+
+    if (!dns)
+        return;
+
+    cio_event_loop_post(dns->event_loop, 0, dns, free_dns_resolver_impl);
+}
+
+void cio_free_dns_resolver_sync(void *dns_resolver)
+{
+    struct dns_resolver *dns = dns_resolver;
+    struct completion_ctx *completion_ctx;
+    int ecode;
+
+    if (!dns)
+        return;
+
+    if (!(completion_ctx = new_completion_ctx(dns)))
+        goto fail;
+
+    if ((ecode = completion_ctx_post_and_wait(completion_ctx, dns->event_loop,
+                                              free_dns_resolver_impl, 0))) {
+        errno = ecode;
+        goto fail;
+    }
+
+    goto finally;
+
+fail:
+    perror("cio_free_dns_resolver_sync");
+
+finally:
+    free_completion_ctx(completion_ctx);
+}
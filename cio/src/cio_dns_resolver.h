@@ -0,0 +1,72 @@
+/**
+ * DNS stub resolver running on the event loop thread. A and AAAA queries go to the name servers
+ * over non-blocking UDP sockets polled by the loop, one per lookup so that each has a random
+ * source port besides the random id, and are retried from the loop timers, so unlike
+ * cio_resolver_async_resolve() no helper thread is involved. Numeric addresses and the names of
+ * the hosts file are resolved without any query. Not supported: search domains and falling back
+ * to TCP for truncated answers (the addresses which made it into a truncated answer are used).
+ */
+
+#if !defined(CIO_DNS_RESOLVER_H)
+#define CIO_DNS_RESOLVER_H
+
+#include "cio_resolver.h"
+
+#define CIO_DNS_MAX_SERVERS 3
+
+struct cio_dns_config {
+    /**
+     * Tried in order, a timed out query goes to the next one.
+     */
+    struct sockaddr_storage servers[CIO_DNS_MAX_SERVERS];
+    socklen_t server_lens[CIO_DNS_MAX_SERVERS];
+    int server_count;
+    /**
+     * Wait for an answer before the query is resent to the next server.
+     */
+    int timeout_ms;
+    /**
+     * Rounds over all the servers before the lookup fails with CIO_TIMEOUT_ERROR.
+     */
+    int attempts;
+    /**
+     * "" - none.
+     */
+    char hosts_path[256];
+};
+
+/**
+ * Fills 'config' from resolv.conf ('nameserver' lines and the 'timeout' and 'attempts' options),
+ * NULL - /etc/resolv.conf, and sets the hosts file to /etc/hosts. As in libc, the defaults are a
+ * 5 s timeout, 2 attempts and the local name server if none is listed. Returns
+ * CIO_NOT_FOUND_ERROR if the file can't be read, 'config' has the defaults then.
+ */
+int cio_dns_config_load(struct cio_dns_config *config, const char *resolv_conf_path);
+
+/**
+ * Appends a server with a numeric address, e.g. one on a non-standard port. Returns
+ * CIO_INVALID_ARGUMENT_ERROR if the address isn't numeric or there are too many servers.
+ */
+int cio_dns_config_add_server(struct cio_dns_config *config, const char *addr, int port);
+
+/**
+ * The hosts file is read once, here.
+ */
+void *cio_new_dns_resolver(void *event_loop, const struct cio_dns_config *config);
+
+/**
+ * Lookups in progress fail with CIO_ALREADY_DESTROYED_ERROR.
+ */
+void cio_free_dns_resolver_async(void *dns_resolver);
+void cio_free_dns_resolver_sync(void *dns_resolver);
+
+/**
+ * Same contract as cio_resolver_async_resolve(): 'on_resolved' is called on the event loop thread
+ * with the resolver, which the callee frees, or NULL on failure: CIO_NOT_FOUND_ERROR if the name
+ * has no address of 'family' (AF_INET, AF_INET6 or AF_UNSPEC), CIO_TIMEOUT_ERROR if no server
+ * answered. The IPv4 addresses go first.
+ */
+void cio_dns_resolver_async_resolve(void *dns_resolver, const char *name, int port, int family,
+    int socktype, void *ctx, void (*on_resolved)(void *ctx, int ecode, void *resolver));
+
+#endif /* CIO_DNS_RESOLVER_H */
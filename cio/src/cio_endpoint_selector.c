@@ -0,0 +1,275 @@
+#include "cio_endpoint_selector.h"
+#include "cio_hash_set.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Endpoints tracked, beyond that the new ones are ordered as never connected to. Lists longer
+ * than SELECT_MAX_LIST keep the tail as is.
+ */
+static const int MAX_ENDPOINTS = 4096;
+static const int HASH_SET_CAPACITY = 1024;
+#define SELECT_MAX_LIST 64
+
+/**
+ * Weight of a new sample in the moving averages.
+ */
+static const double EWMA_ALPHA = 0.3;
+/**
+ * Failure ratio halves every FAILURE_HALF_LIFE_MS without connects. An always failing endpoint
+ * costs as much as one connecting in FAILURE_PENALTY_MS.
+ */
+static const int FAILURE_HALF_LIFE_MS = 10 * 1000;
+static const double FAILURE_PENALTY_MS = 1000;
+
+struct endpoint {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    struct cio_endpoint_stats stats;
+    long long updated;
+    struct endpoint *next;
+};
+
+struct endpoint_selector {
+    pthread_mutex_t mutex;
+    enum CIO_SELECT_POLICY policy;
+    void *endpoints;
+    struct endpoint *endpoint_list;
+    int endpoint_count;
+    unsigned random_state;
+};
+
+static int endpoint_cmp(const void *l, const void *r)
+{
+    const struct endpoint *le = l, *re = r;
+    return le->addr_len == re->addr_len && !memcmp(&le->addr, &re->addr, le->addr_len);
+}
+
+static void endpoint_hash_data(const void *elem, void **data, int *len)
+{
+    struct endpoint *endpoint = (struct endpoint *) elem;
+    *data = &endpoint->addr;
+    *len = endpoint->addr_len;
+}
+
+void *cio_new_endpoint_selector(enum CIO_SELECT_POLICY policy)
+{
+    struct endpoint_selector *selector;
+
+    if (!(selector = malloc(sizeof(*selector))))
+        return NULL;
+
+    memset(selector, 0, sizeof(*selector));
+    if (!(selector->endpoints = cio_new_hash_set(HASH_SET_CAPACITY, endpoint_cmp,
+                                                 endpoint_hash_data, NULL))) {
+        free(selector);
+        return NULL;
+    }
+
+    selector->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    selector->policy = policy;
+    selector->random_state = (unsigned) now_time_ms() ^ (unsigned) getpid() ^ (unsigned) (long) selector;
+    if (!selector->random_state)
+        selector->random_state = 1;
+
+    return selector;
+}
+
+void cio_free_endpoint_selector(void *selector)
+{
+    struct endpoint_selector *sel = selector;
+    struct endpoint *endpoint, *next;
+
+    if (!sel)
+        return;
+
+    for (endpoint = sel->endpoint_list; endpoint; endpoint = next) {
+        next = endpoint->next;
+        free(endpoint);
+    }
+    cio_free_hash_set(sel->endpoints);
+    pthread_mutex_destroy(&sel->mutex);
+    free(sel);
+}
+
+/**
+ * Selector mutex held.
+ */
+static unsigned next_random(struct endpoint_selector *sel)
+{
+    unsigned x = sel->random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return sel->random_state = x;
+}
+
+static int make_search_key(struct endpoint *search, const struct sockaddr *addr,
+    socklen_t addr_len)
+{
+    if (addr_len <= 0 || addr_len > (socklen_t) sizeof(search->addr))
+        return -1;
+
+    memset(&search->addr, 0, sizeof(search->addr));
+    memcpy(&search->addr, addr, addr_len);
+    search->addr_len = addr_len;
+    return 0;
+}
+
+static double decayed_failure_rate(const struct endpoint *endpoint, long long now)
+{
+    double rate = endpoint->stats.failure_rate;
+    long long elapsed = now - endpoint->updated;
+    int halvings;
+
+    if (elapsed <= 0)
+        return rate;
+
+    for (halvings = elapsed / FAILURE_HALF_LIFE_MS; halvings > 0 && rate > 0.001; --halvings)
+        rate /= 2;
+
+    /* Linear within the half-life. */
+    return rate * (1 - 0.5 * (elapsed % FAILURE_HALF_LIFE_MS) / FAILURE_HALF_LIFE_MS);
+}
+
+/**
+ * Expected connect time, 0 for the endpoints never connected to. Selector mutex held.
+ */
+static double endpoint_cost(struct endpoint_selector *sel, const struct addrinfo *ai,
+    long long now)
+{
+    struct endpoint search, *endpoint;
+
+    if (make_search_key(&search, ai->ai_addr, ai->ai_addrlen)
+            || !(endpoint = cio_hash_set_get(sel->endpoints, &search)))
+        return 0;
+
+    return endpoint->stats.latency_ms
+        + FAILURE_PENALTY_MS * decayed_failure_rate(endpoint, now);
+}
+
+struct addrinfo *cio_endpoint_selector_order(void *selector, struct addrinfo *list)
+{
+    struct endpoint_selector *sel = selector;
+    struct addrinfo *nodes[SELECT_MAX_LIST], *rest, *ai, **tail;
+    double costs[SELECT_MAX_LIST], cost;
+    long long now = now_time_ms();
+    int count = 0, i, j, k;
+
+    for (ai = list; ai && count < SELECT_MAX_LIST; ai = ai->ai_next)
+        nodes[count++] = ai;
+    rest = ai;
+    if (count < 2)
+        return list;
+
+    pthread_mutex_lock(&sel->mutex);
+    /* Shuffled first, so that the ties are broken at random. */
+    for (i = count - 1; i > 0; --i) {
+        j = next_random(sel) % (i + 1);
+        ai = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = ai;
+    }
+    for (i = 0; i < count; ++i)
+        costs[i] = endpoint_cost(sel, nodes[i], now);
+
+    for (i = 0; i < count - 1; ++i) {
+        if (sel->policy == CIO_SELECT_P2C) {
+            /* The better of two random ones left. */
+            j = i + next_random(sel) % (count - i);
+            k = i + next_random(sel) % (count - i - 1);
+            if (k >= j)
+                ++k;
+            if (costs[k] < costs[j])
+                j = k;
+        } else {
+            for (j = i, k = i + 1; k < count; ++k) {
+                if (costs[k] < costs[j])
+                    j = k;
+            }
+        }
+
+        ai = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = ai;
+        cost = costs[i];
+        costs[i] = costs[j];
+        costs[j] = cost;
+    }
+    pthread_mutex_unlock(&sel->mutex);
+
+    for (tail = &list, i = 0; i < count; ++i) {
+        *tail = nodes[i];
+        tail = &nodes[i]->ai_next;
+    }
+    *tail = rest;
+
+    return list;
+}
+
+void cio_endpoint_selector_report(void *selector, const struct sockaddr *addr,
+    socklen_t addr_len, int ecode, int latency_ms)
+{
+    struct endpoint_selector *sel = selector;
+    struct endpoint search, *endpoint;
+    long long now = now_time_ms();
+    double failed = ecode != CIO_NO_ERROR;
+
+    if (make_search_key(&search, addr, addr_len))
+        return;
+
+    pthread_mutex_lock(&sel->mutex);
+    if (!(endpoint = cio_hash_set_get(sel->endpoints, &search))) {
+        if (sel->endpoint_count >= MAX_ENDPOINTS || !(endpoint = malloc(sizeof(*endpoint))))
+            goto finally;
+
+        memcpy(endpoint, &search, sizeof(search));
+        memset(&endpoint->stats, 0, sizeof(endpoint->stats));
+        if (!cio_hash_set_add(sel->endpoints, endpoint)) {
+            free(endpoint);
+            goto finally;
+        }
+        endpoint->next = sel->endpoint_list;
+        sel->endpoint_list = endpoint;
+        sel->endpoint_count++;
+    }
+
+    /* The first sample of each average is taken as is. */
+    endpoint->stats.failure_rate = endpoint->stats.connects
+        ? decayed_failure_rate(endpoint, now) * (1 - EWMA_ALPHA) + failed * EWMA_ALPHA : failed;
+    if (!failed) {
+        endpoint->stats.latency_ms = endpoint->stats.connects > endpoint->stats.failures
+            ? endpoint->stats.latency_ms * (1 - EWMA_ALPHA) + latency_ms * EWMA_ALPHA
+            : latency_ms;
+    }
+    endpoint->stats.connects++;
+    endpoint->stats.failures += failed;
+    endpoint->updated = now;
+
+finally:
+    pthread_mutex_unlock(&sel->mutex);
+}
+
+int cio_endpoint_selector_get_stats(void *selector, const struct sockaddr *addr,
+    socklen_t addr_len, struct cio_endpoint_stats *stats)
+{
+    struct endpoint_selector *sel = selector;
+    struct endpoint search, *endpoint;
+    int ecode = CIO_NOT_FOUND_ERROR;
+
+    if (make_search_key(&search, addr, addr_len))
+        return CIO_NOT_FOUND_ERROR;
+
+    pthread_mutex_lock(&sel->mutex);
+    if ((endpoint = cio_hash_set_get(sel->endpoints, &search))) {
+        memcpy(stats, &endpoint->stats, sizeof(*stats));
+        stats->failure_rate = decayed_failure_rate(endpoint, now_time_ms());
+        ecode = CIO_NO_ERROR;
+    }
+    pthread_mutex_unlock(&sel->mutex);
+
+    return ecode;
+}
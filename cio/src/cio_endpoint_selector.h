@@ -0,0 +1,67 @@
+/**
+ * Client-side load balancing over the endpoints a name resolves to. The selector keeps per
+ * address (and port) the exponentially weighted moving averages of the connect latency and of the
+ * connect failures, and orders the resolved endpoints by them, so that the connects spread over
+ * the healthy endpoints instead of sticking to the first one getaddrinfo() returns. Shared by any
+ * number of connections and pools on any event loops.
+ */
+
+#if !defined(CIO_ENDPOINT_SELECTOR_H)
+#define CIO_ENDPOINT_SELECTOR_H
+
+#include <sys/socket.h>
+#include <netdb.h>
+
+enum CIO_SELECT_POLICY {
+    /**
+     * Power of two choices: each next endpoint is the better of two picked at random, which
+     * spreads the load while still avoiding the slow and failing endpoints.
+     */
+    CIO_SELECT_P2C,
+    /**
+     * Best first, ties in random order.
+     */
+    CIO_SELECT_LEAST_LATENCY
+};
+
+/**
+ * Connect statistics of an endpoint (see cio_endpoint_selector_get_stats()).
+ */
+struct cio_endpoint_stats {
+    long long connects;
+    long long failures;
+    /**
+     * Moving averages of the successful connect latency and of the failure ratio (0 - 1), the
+     * latter decaying with time since the last connect so that a failed endpoint gets retried.
+     */
+    double latency_ms;
+    double failure_rate;
+};
+
+void *cio_new_endpoint_selector(enum CIO_SELECT_POLICY policy);
+
+/**
+ * No connection or pool may use the selector any more.
+ */
+void cio_free_endpoint_selector(void *selector);
+
+/**
+ * Reorders the list by the policy and returns the new head. Endpoints never connected to go
+ * first, to be measured.
+ */
+struct addrinfo *cio_endpoint_selector_order(void *selector, struct addrinfo *list);
+
+/**
+ * Reports a connect attempt to 'addr': CIO_NO_ERROR and the time it took, or the error (the
+ * attempts abandoned for another one which connected first are not reported).
+ */
+void cio_endpoint_selector_report(void *selector, const struct sockaddr *addr,
+    socklen_t addr_len, int ecode, int latency_ms);
+
+/**
+ * CIO_NOT_FOUND_ERROR if nothing was reported for 'addr'.
+ */
+int cio_endpoint_selector_get_stats(void *selector, const struct sockaddr *addr,
+    socklen_t addr_len, struct cio_endpoint_stats *stats);
+
+#endif /* CIO_ENDPOINT_SELECTOR_H */
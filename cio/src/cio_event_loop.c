@@ -11,10 +11,12 @@
 #include <fcntl.h>
 #include <errno.h>
 
+/**
+ * Stored in the fd map by value.
+ */
 struct user_fd_cb_ctx {
     pollset_cb_t cb;
     void *ctx;
-    int fd;
 };
 
 struct timer_cb_ctx {
@@ -24,6 +26,17 @@ struct timer_cb_ctx {
     struct timer_cb_ctx *next;
 };
 
+/**
+ * Armed timers are the list sorted by 'due_time', which is 0 for the rest.
+ */
+struct timer {
+    struct event_loop *loop;
+    void (*action)(void *);
+    void *action_ctx;
+    long long due_time;
+    struct timer *next;
+};
+
 struct event_loop {
     void *pollset;
     void *fd_set;
@@ -31,6 +44,7 @@ struct event_loop {
     int poll_timeout_ms;
     int event_pipe[2];
     struct timer_cb_ctx* timer_actions;
+    struct timer *timers;
     pthread_mutex_t mutex;
     pthread_t self_id;
 };
@@ -40,23 +54,6 @@ enum event_code {
     WAKE_UP
 };
 
-static int user_fd_cb_ctx_cmp(const void *l, const void *r)
-{
-    return ((struct user_fd_cb_ctx *) l)->fd == ((struct user_fd_cb_ctx *) r)->fd;
-}
-
-static void user_fd_cb_ctx_hash_data(const void *elem, void **data, int *len)
-{
-    struct user_fd_cb_ctx *ctx = (struct user_fd_cb_ctx *)elem;
-    *data = &ctx->fd;
-    *len = sizeof(ctx->fd);
-}
-
-static void user_fd_cb_ctx_release(void *elem)
-{
-    free(elem);
-}
-
 void *cio_new_event_loop(int expected_capacity)
 {
     struct event_loop *el = malloc(sizeof(struct event_loop));
@@ -66,11 +63,11 @@ void *cio_new_event_loop(int expected_capacity)
     el->need_stop = 0;
     el->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
     el->timer_actions = NULL;
+    el->timers = NULL;
     el->poll_timeout_ms = -1;
     memset(&el->self_id, 0, sizeof(el->self_id));
 
-    el->fd_set = cio_new_hash_set(expected_capacity / 0.75, user_fd_cb_ctx_cmp,
-        user_fd_cb_ctx_hash_data, user_fd_cb_ctx_release);
+    el->fd_set = cio_new_int_map(expected_capacity / 0.75, sizeof(struct user_fd_cb_ctx));
 
     if (!el->fd_set) {
         ecode = CIO_ALLOC_ERROR;
@@ -108,7 +105,7 @@ void cio_free_event_loop(void *loop)
     
     tctx = el->timer_actions;
     cio_free_pollset(el->pollset);
-    cio_free_hash_set(el->fd_set);
+    cio_free_int_map(el->fd_set);
     close(el->event_pipe[0]);
     close(el->event_pipe[1]);
     pthread_mutex_destroy(&el->mutex);
@@ -127,7 +124,7 @@ static void pollset_cb(void *ctx, int fd, int flags)
     struct event_loop *el = (struct event_loop *) ctx;;
     int ecode = 0;
     int event_code;
-    struct user_fd_cb_ctx search_fctx, *fctx;
+    struct user_fd_cb_ctx *fctx;
 
     if (fd == el->event_pipe[0]) {
         assert(flags & CIO_FLAG_IN);
@@ -157,8 +154,7 @@ static void pollset_cb(void *ctx, int fd, int flags)
                 goto fail;
         }
     } else {
-        search_fctx.fd = fd;
-        if (!(fctx = cio_hash_set_get(el->fd_set, &search_fctx))) {
+        if (!(fctx = cio_int_map_get(el->fd_set, fd))) {
             ecode = CIO_NOT_FOUND_ERROR;
             goto fail;
         }
@@ -174,27 +170,14 @@ fail:
         perror("pollset_cb");
 }
 
-static long long now_time_ms()
-{
-    struct timeval tv;
-
-    if (gettimeofday(&tv, NULL) < 0)
-        goto fail;
-
-    return time_ms(&tv);
-
-fail:
-    perror("now_time_ms");
-    return -1LL;
-}
-
 int cio_event_loop_run(void *loop)
 {
     struct event_loop *el = loop;
     int ecode = 0, cio_ecode = 0;
     int poll_timeout_ms = -1;
-    long long now;
+    long long now, next_due;
     struct timer_cb_ctx *tctx, *prev_tctx;
+    struct timer *timer;
 
     el->self_id = pthread_self();
     do {
@@ -225,13 +208,25 @@ int cio_event_loop_run(void *loop)
             free(prev_tctx);
         }
 
-        if (tctx)
-            poll_timeout_ms = CIO_MAX(tctx->due_time - now_time_ms(), 0);
-        else
-            poll_timeout_ms = -1;
+        next_due = tctx ? tctx->due_time : 0;
 
         if ((ecode = pthread_mutex_unlock(&el->mutex)))
             goto fail;
+
+        /* Unlinked before the call, which may re-arm or free the timer. */
+        while ((timer = el->timers) && timer->due_time <= now) {
+            el->timers = timer->next;
+            timer->due_time = 0;
+            timer->action(timer->action_ctx);
+        }
+
+        if (el->timers && (!next_due || el->timers->due_time < next_due))
+            next_due = el->timers->due_time;
+
+        if (next_due)
+            poll_timeout_ms = CIO_MAX(next_due - now_time_ms(), 0);
+        else
+            poll_timeout_ms = -1;
     } while (1);
 
     return CIO_NO_ERROR;
@@ -272,23 +267,17 @@ static void add_fd_impl(void *ctx)
 {
     struct add_remove_ctx *actx = (struct add_remove_ctx *) ctx;
     struct event_loop *el = (struct event_loop *) actx->loop;
-    struct user_fd_cb_ctx *fd_ctx = malloc(sizeof(struct user_fd_cb_ctx));
+    struct user_fd_cb_ctx fd_ctx;
     int cio_ecode = 0;
 
-    if (!fd_ctx) {
-        cio_ecode = CIO_ALLOC_ERROR;
-        goto fail;
-    }
-
-    fd_ctx->fd = actx->fd;
-    fd_ctx->ctx = actx->cb_ctx;
-    fd_ctx->cb = actx->cb;
+    fd_ctx.ctx = actx->cb_ctx;
+    fd_ctx.cb = actx->cb;
 
     if ((cio_ecode = cio_pollset_add(el->pollset, actx->fd, actx->flags))) {
         goto fail;
     }
 
-    if (!cio_hash_set_add(el->fd_set, fd_ctx)) {
+    if (!cio_int_map_put(el->fd_set, actx->fd, &fd_ctx)) {
         cio_ecode = CIO_ALLOC_ERROR;
         goto fail;
     }
@@ -301,7 +290,6 @@ fail:
         cio_perror(cio_ecode, "add_fd_impl");
 
     free(actx);
-    free(fd_ctx);
 }
 
 int cio_event_loop_add_fd(void *loop, int fd, int flags, void *cb_ctx, pollset_cb_t cb)
@@ -320,18 +308,46 @@ int cio_event_loop_add_fd(void *loop, int fd, int flags, void *cb_ctx, pollset_c
     return cio_event_loop_dispatch(loop, actx, add_fd_impl);
 }
 
+static void modify_fd_impl(void *ctx)
+{
+    struct add_remove_ctx *actx = (struct add_remove_ctx *) ctx;
+    struct event_loop *el = (struct event_loop *) actx->loop;
+    int cio_ecode;
+
+    if ((cio_ecode = cio_pollset_modify(el->pollset, actx->fd, actx->flags))
+            && cio_ecode != CIO_NOT_FOUND_ERROR)
+        cio_perror(cio_ecode, "modify_fd_impl");
+
+    free(actx);
+}
+
+int cio_event_loop_modify_fd(void *loop, int fd, int flags)
+{
+    struct event_loop *el = loop;
+    struct add_remove_ctx *actx;
+
+    /* Interest is changed on every I/O operation, so don't allocate if possible. */
+    if (cio_event_loop_is_loop_thread(loop))
+        return cio_pollset_modify(el->pollset, fd, flags);
+
+    if (!(actx = malloc(sizeof(struct add_remove_ctx))))
+        return CIO_ALLOC_ERROR;
+
+    actx->loop = loop;
+    actx->fd = fd;
+    actx->flags = flags;
+
+    return cio_event_loop_post(loop, 0, actx, modify_fd_impl);
+}
+
 static void remove_fd_impl(void *ctx)
 {
     struct add_remove_ctx *actx = (struct add_remove_ctx *) ctx;
     struct event_loop *el = (struct event_loop *) actx->loop;
-    struct user_fd_cb_ctx *fd_ctx = NULL, search_fd_ctx;
     int cio_ecode = 0;
 
-    search_fd_ctx.fd = actx->fd;
-    if (!(fd_ctx = cio_hash_set_remove(el->fd_set, &search_fd_ctx))) {
-        cio_ecode = CIO_NOT_FOUND_ERROR;
+    if ((cio_ecode = cio_int_map_remove(el->fd_set, actx->fd, NULL)))
         goto fail;
-    }
 
     if ((cio_ecode = cio_pollset_remove(el->pollset, actx->fd)))
         goto fail;
@@ -343,7 +359,6 @@ fail:
         cio_perror(cio_ecode, "remove_fd_impl");
 
 finally:
-    free(fd_ctx);
     free(actx);
 }
 
@@ -360,11 +375,14 @@ int cio_event_loop_remove_fd(void *loop, int fd)
     return cio_event_loop_dispatch(loop, actx, remove_fd_impl);
 }
 
-int cio_event_loop_dispatch(void *loop, void *cb_ctx, void (*cb)(void *))
+int cio_event_loop_is_loop_thread(void *loop)
 {
-    struct event_loop *el = loop;
+    return pthread_self() == ((struct event_loop *) loop)->self_id;
+}
 
-    if (pthread_self() == el->self_id) {
+int cio_event_loop_dispatch(void *loop, void *cb_ctx, void (*cb)(void *))
+{
+    if (cio_event_loop_is_loop_thread(loop)) {
         cb(cb_ctx);
         return 0;
     }
@@ -422,3 +440,62 @@ fail:
     perror("cio_event_loop_add_timer");
     return errno;
 }
+
+void *cio_event_loop_new_timer(void *loop, void *cb_ctx, void (*cb)(void *))
+{
+    struct timer *timer;
+
+    if (!(timer = malloc(sizeof(*timer))))
+        return NULL;
+
+    timer->loop = loop;
+    timer->action = cb;
+    timer->action_ctx = cb_ctx;
+    timer->due_time = 0;
+    timer->next = NULL;
+    return timer;
+}
+
+void cio_event_loop_free_timer(void *timer)
+{
+    if (!timer)
+        return;
+
+    cio_event_loop_cancel_timer(timer);
+    free(timer);
+}
+
+void cio_event_loop_cancel_timer(void *timer)
+{
+    struct timer *t = timer;
+    struct timer **link;
+
+    if (!t->due_time)
+        return;
+
+    for (link = &t->loop->timers; *link != t; link = &(*link)->next)
+        assert(*link);
+    *link = t->next;
+    t->due_time = 0;
+    t->next = NULL;
+}
+
+void cio_event_loop_arm_timer(void *timer, int timeout_ms)
+{
+    struct timer *t = timer;
+    struct timer **link;
+
+    cio_event_loop_cancel_timer(t);
+    t->due_time = now_time_ms() + CIO_MAX(timeout_ms, 0);
+
+    for (link = &t->loop->timers; *link && (*link)->due_time <= t->due_time;
+            link = &(*link)->next)
+        ;
+    t->next = *link;
+    *link = t;
+}
+
+long long cio_event_loop_timer_due(void *timer)
+{
+    return ((struct timer *) timer)->due_time;
+}
@@ -15,17 +15,50 @@ int cio_event_loop_stop(void *loop);
 int cio_event_loop_add_fd(void *loop, int fd, int flags, void *cb_ctx, pollset_cb_t cb);
 int cio_event_loop_remove_fd(void *loop, int fd);
 
+/**
+ * Replaces the interest flags of the already added fd.
+ */
+int cio_event_loop_modify_fd(void *loop, int fd, int flags);
+
 /**
  * Posts the callback to the event loop. It implies that callback is always executed on the event
  * loop thread.
  */
 int cio_event_loop_post(void *loop, int timeout_ms, void *cb_ctx, void (*cb)(void *));
 
+/**
+ * Non-zero if called on the event loop thread.
+ */
+int cio_event_loop_is_loop_thread(void *loop);
+
 /**
  * If the caller's thread is the same as the event loop thread, executes callback immediately,
  * otherwise posts it to the event loop.
  */
 int cio_event_loop_dispatch(void *loop, void *cb_ctx, void (*cb)(void *));
 
+/**
+ * Unlike the posted callbacks, timers are owned by the caller: they are armed, re-armed and
+ * cancelled any number of times, and nothing is left to the loop once the timer is freed. A timer
+ * is armed, cancelled and freed on the event loop thread only, and freed before the loop is.
+ */
+void *cio_event_loop_new_timer(void *loop, void *cb_ctx, void (*cb)(void *));
+
+/**
+ * Cancels the timer if it is armed.
+ */
+void cio_event_loop_free_timer(void *timer);
+
+/**
+ * Makes the callback run once in 'timeout_ms', the earlier due time of an armed timer is replaced.
+ */
+void cio_event_loop_arm_timer(void *timer, int timeout_ms);
+void cio_event_loop_cancel_timer(void *timer);
+
+/**
+ * Due time of the armed timer in ms (see time_ms()), 0 - it isn't armed.
+ */
+long long cio_event_loop_timer_due(void *timer);
+
 #endif /* CIO_EVENT_LOOP_H */
 
@@ -1,7 +1,13 @@
 #include "cio_hash_set.h"
+#include "cio_common.h"
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CIO_HAVE_SSE2
+#endif
+
 struct node {
     void *data;
     struct node *next;
@@ -114,33 +120,465 @@ static unsigned jenkins_hash(const void *elem,
     return hash;
 }
 
+/**
+ * wyhash style: the data is read 8 (4 for the short keys) bytes at a time and mixed by 64 x 64
+ * bit multiplications, the 128 bit products folded by xor.
+ */
+static const uint64_t WY_P0 = 0xa0761d6478bd642fULL;
+static const uint64_t WY_P1 = 0xe7037ed1a0b428dbULL;
+
+static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t) a * b;
+
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t) a, hb = b >> 32, lb = (uint32_t) b;
+    uint64_t mid0 = ha * lb, mid1 = hb * la, lo = la * lb, t;
+    uint64_t hi = ha * hb + (mid0 >> 32) + (mid1 >> 32);
+
+    t = lo + (mid0 << 32);
+    hi += t < lo;
+    lo = t + (mid1 << 32);
+    hi += lo < t;
+
+    return lo ^ hi;
+#endif
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned hash_bytes(const void *data, int len)
+{
+    const unsigned char *p = data;
+    uint64_t seed = WY_P0 ^ (uint64_t) len, a, b;
+    int i;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = read32(p) << 32 | read32(p + ((len >> 3) << 2));
+            b = read32(p + len - 4) << 32 | read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = (uint64_t) p[0] << 16 | (uint64_t) p[len >> 1] << 8 | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        for (i = len; i > 16; i -= 16, p += 16)
+            seed = wy_mix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+        /* The last 16 bytes, overlapping the already mixed ones. */
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    return (unsigned) wy_mix(WY_P1 ^ (uint64_t) len, wy_mix(a ^ WY_P1, b ^ seed));
+}
+
+/**
+ * Multiply-shift, the high half of the product depends on all the key bits.
+ */
+static unsigned hash_int(uintptr_t key)
+{
+    return (unsigned) (((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+/**
+ * Open addressing. Each slot has a control byte: CTRL_EMPTY, CTRL_DELETED (a tombstone which keeps
+ * the probe sequences going through a removed element) or the low 7 bits of the element hash. The
+ * table is probed in aligned groups of GROUP_SIZE slots, the rest of the hash picks the first
+ * group and the next ones are at the triangular offsets, which visit every group of a power of
+ * two table. A lookup stops at the first group with an empty slot.
+ */
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+#define CTRL_HASH(hash) ((hash) & 0x7f)
+
+/**
+ * Groups of the old table moved to the new one per add or remove during a resize. A table grows
+ * at 7/8 load and shrinks at 1/8, so the old one is drained well before the new one needs
+ * resizing in turn.
+ */
+#define MIGRATE_GROUPS 2
+
+struct table {
+    /* Element pointers for the sets, key and value for the int maps. 'ctrl' follows 'slots' in
+     * the same allocation. */
+    char *slots;
+    unsigned char *ctrl;
+    unsigned capacity;
+    unsigned group_mask;
+    unsigned size;
+    /* Slots which may still turn from empty to full or deleted before the table is 7/8 full. */
+    unsigned growth_left;
+};
+
 struct hset {
+    enum CIO_HASH_SET_IMPL impl;
     int (*cmp)(const void *, const void *);
     void (*hash_data)(const void *elem, void **data, int *len);
     void (*release)(void *);
+    /* CIO_HASH_SET_CHAINED */
     struct node **nodes;
     unsigned capacity;
+    /* CIO_HASH_SET_OPEN */
+    struct table table;
+    /* During a resize, the previous table with the elements not moved yet from the groups
+     * 'migrated' and on. Otherwise no slots. */
+    struct table old;
+    unsigned migrated;
+    /* Never shrunk below the initial capacity. */
+    unsigned min_capacity;
 };
 
+struct int_map {
+    struct table table;
+    struct table old;
+    unsigned migrated;
+    unsigned min_capacity;
+    int value_size;
+    /* Key, then the value padded to the key alignment. */
+    int slot_size;
+};
+
+/**
+ * Bit i is set if ctrl[i] == byte.
+ */
+static unsigned group_match(const unsigned char *ctrl, unsigned char byte)
+{
+#if defined(CIO_HAVE_SSE2)
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+                                            _mm_loadu_si128((const __m128i *) ctrl)));
+#else
+    unsigned mask = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; ++i) {
+        if (ctrl[i] == byte)
+            mask |= 1u << i;
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * Empty and deleted slots, the only ones with the high bit set.
+ */
+static unsigned group_match_free(const unsigned char *ctrl)
+{
+#if defined(CIO_HAVE_SSE2)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    unsigned mask = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; ++i) {
+        if (ctrl[i] & 0x80)
+            mask |= 1u << i;
+    }
+
+    return mask;
+#endif
+}
+
+static int table_alloc(struct table *t, unsigned capacity, int slot_size)
+{
+    unsigned slot_count = GROUP_SIZE;
+    char *slots;
+
+    while (slot_count < capacity && slot_count < (1u << 30))
+        slot_count <<= 1;
+
+    if (!(slots = malloc((size_t) slot_count * (slot_size + 1))))
+        return -1;
+
+    t->slots = slots;
+    t->ctrl = (unsigned char *) (slots + (size_t) slot_count * slot_size);
+    memset(t->ctrl, CTRL_EMPTY, slot_count);
+    t->capacity = slot_count;
+    t->group_mask = slot_count / GROUP_SIZE - 1;
+    t->size = 0;
+    t->growth_left = slot_count - slot_count / 8;
+
+    return 0;
+}
+
+/**
+ * First group of the probe sequence, the next one is (group + step) & group_mask.
+ */
+static unsigned table_first_group(const struct table *t, unsigned hash)
+{
+    return (hash >> 7) & t->group_mask;
+}
+
+/**
+ * First empty or deleted slot of the probe sequence, there always is one as the table is never
+ * filled up.
+ */
+static unsigned table_find_free(const struct table *t, unsigned hash)
+{
+    unsigned group = table_first_group(t, hash);
+    unsigned step, mask;
+
+    for (step = 1; ; group = (group + step++) & t->group_mask) {
+        if ((mask = group_match_free(t->ctrl + group * GROUP_SIZE)))
+            return group * GROUP_SIZE + __builtin_ctz(mask);
+    }
+}
+
+/**
+ * Marks the slot full, the caller fills it.
+ */
+static void table_insert(struct table *t, unsigned pos, unsigned hash)
+{
+    if (t->ctrl[pos] == CTRL_EMPTY)
+        t->growth_left--;
+    t->ctrl[pos] = CTRL_HASH(hash);
+    t->size++;
+}
+
+static void table_erase(struct table *t, unsigned pos)
+{
+    /* No lookup went past a group with an empty slot, so no tombstone is needed there. */
+    if (group_match(t->ctrl + (pos & ~(GROUP_SIZE - 1)), CTRL_EMPTY)) {
+        t->ctrl[pos] = CTRL_EMPTY;
+        t->growth_left++;
+    } else {
+        t->ctrl[pos] = CTRL_DELETED;
+    }
+    t->size--;
+}
+
+/**
+ * Capacity of the table replacing a full one: mostly tombstones are cleaned up into a table of
+ * the same size, otherwise it is twice as large.
+ */
+static unsigned table_grown_capacity(const struct table *t)
+{
+    return t->size < t->capacity / 2 ? t->capacity : t->capacity * 2;
+}
+
+static int table_needs_shrinking(const struct table *t, unsigned min_capacity)
+{
+    return t->capacity > min_capacity && t->size < t->capacity / 8;
+}
+
+static void **elem_slot(const struct table *t, unsigned pos)
+{
+    return (void **) t->slots + pos;
+}
+
+static unsigned elem_hash(const struct hset *s, const void *elem)
+{
+    void *data;
+    int len;
+
+    s->hash_data(elem, &data, &len);
+    return hash_bytes(data, len);
+}
+
+/**
+ * Slot index, -1 if not found.
+ */
+static int open_find(const struct hset *s, const struct table *t, const void *elem, unsigned hash)
+{
+    unsigned group = table_first_group(t, hash);
+    unsigned step, pos, mask;
+
+    if (!t->size)
+        return -1;
+
+    for (step = 1; step <= t->group_mask + 1; group = (group + step++) & t->group_mask) {
+        pos = group * GROUP_SIZE;
+        for (mask = group_match(t->ctrl + pos, CTRL_HASH(hash)); mask; mask &= mask - 1) {
+            if (s->cmp(*elem_slot(t, pos + __builtin_ctz(mask)), elem))
+                return pos + __builtin_ctz(mask);
+        }
+
+        if (group_match(t->ctrl + pos, CTRL_EMPTY))
+            break;
+    }
+
+    return -1;
+}
+
+/**
+ * Moves up to 'groups' groups of the old table to the new one, frees the old table once it is
+ * empty.
+ */
+static void open_migrate(struct hset *s, unsigned groups)
+{
+    struct table *old = &s->old;
+    unsigned pos, end, hash, new_pos;
+
+    if (!old->slots)
+        return;
+
+    for ( ; groups && old->size && s->migrated <= old->group_mask; --groups, ++s->migrated) {
+        pos = s->migrated * GROUP_SIZE;
+        for (end = pos + GROUP_SIZE; pos < end; ++pos) {
+            if (old->ctrl[pos] & 0x80)
+                continue;
+
+            hash = elem_hash(s, *elem_slot(old, pos));
+            new_pos = table_find_free(&s->table, hash);
+            *elem_slot(&s->table, new_pos) = *elem_slot(old, pos);
+            table_insert(&s->table, new_pos, hash);
+            /* Not empty, the lookups in the old table still probe past it. */
+            old->ctrl[pos] = CTRL_DELETED;
+            old->size--;
+        }
+    }
+
+    if (!old->size) {
+        free(old->slots);
+        memset(old, 0, sizeof(*old));
+    }
+}
+
+/**
+ * Starts moving the elements to a new table of 'capacity' slots, finishing the previous resize
+ * first if it is still in progress.
+ */
+static int open_resize(struct hset *s, unsigned capacity)
+{
+    struct table table;
+
+    if (table_alloc(&table, capacity, sizeof(void *)))
+        return -1;
+
+    open_migrate(s, -1);
+    s->old = s->table;
+    s->table = table;
+    s->migrated = 0;
+    open_migrate(s, MIGRATE_GROUPS);
+
+    return 0;
+}
+
+static void *open_get(const struct hset *s, const void *elem, unsigned hash)
+{
+    int pos;
+
+    if ((pos = open_find(s, &s->table, elem, hash)) != -1)
+        return *elem_slot(&s->table, pos);
+    if ((pos = open_find(s, &s->old, elem, hash)) != -1)
+        return *elem_slot(&s->old, pos);
+
+    return NULL;
+}
+
+static void *open_add(struct hset *s, void *elem)
+{
+    unsigned hash = elem_hash(s, elem), pos;
+
+    if (open_get(s, elem, hash))
+        return NULL;
+
+    pos = table_find_free(&s->table, hash);
+    if (s->table.ctrl[pos] == CTRL_EMPTY && !s->table.growth_left) {
+        if (open_resize(s, table_grown_capacity(&s->table)))
+            return NULL;
+        pos = table_find_free(&s->table, hash);
+    }
+
+    *elem_slot(&s->table, pos) = elem;
+    table_insert(&s->table, pos, hash);
+    open_migrate(s, MIGRATE_GROUPS);
+
+    return elem;
+}
+
+static void *open_remove(struct hset *s, const void *elem)
+{
+    unsigned hash = elem_hash(s, elem);
+    struct table *t = &s->table;
+    void *result;
+    int pos;
+
+    if ((pos = open_find(s, t, elem, hash)) == -1
+            && (pos = open_find(s, (t = &s->old), elem, hash)) == -1)
+        return NULL;
+
+    result = *elem_slot(t, pos);
+    table_erase(t, pos);
+
+    /* A failed shrink is not an error, retried on the next remove. */
+    if (!s->old.slots && table_needs_shrinking(&s->table, s->min_capacity))
+        open_resize(s, s->table.capacity / 2);
+    else
+        open_migrate(s, MIGRATE_GROUPS);
+
+    return result;
+}
+
+static void open_free_table(struct table *t, void (*release)(void *))
+{
+    unsigned i;
+
+    for (i = 0; release && i < t->capacity; ++i) {
+        if (!(t->ctrl[i] & 0x80))
+            release(*elem_slot(t, i));
+    }
+
+    free(t->slots);
+}
+
 void *cio_new_hash_set(unsigned capacity, int (*cmp)(const void *, const void *),
     void (*hash_data)(const void *elem, void **data, int *len), void (*release)(void *))
+{
+    return cio_new_hash_set_impl(CIO_HASH_SET_OPEN, capacity, cmp, hash_data, release);
+}
+
+void *cio_new_hash_set_impl(enum CIO_HASH_SET_IMPL impl, unsigned capacity,
+    int (*cmp)(const void *, const void *),
+    void (*hash_data)(const void *elem, void **data, int *len), void (*release)(void *))
 {
     struct hset *s = malloc(sizeof(struct hset));
 
     if (!s)
         return NULL;
 
+    memset(s, 0, sizeof(*s));
+    s->impl = impl;
+    s->cmp = cmp;
+    s->hash_data = hash_data;
+    s->release = release;
+
+    if (impl == CIO_HASH_SET_OPEN) {
+        if (table_alloc(&s->table, capacity, sizeof(void *))) {
+            free(s);
+            return NULL;
+        }
+
+        s->min_capacity = s->table.capacity;
+        return s;
+    }
+
     s->nodes = calloc(capacity, sizeof(*s->nodes));
     if (!s->nodes) {
         free(s);
         return NULL;
     }
 
-    memset(s->nodes, 0, sizeof(*s->nodes)*capacity);
     s->capacity = capacity;
-    s->cmp = cmp;
-    s->hash_data = hash_data;
-    s->release = release;
 
     return s;
 }
@@ -152,7 +590,15 @@ void cio_free_hash_set(void *set)
 
     if (!s)
         return;
-    
+
+    if (s->impl == CIO_HASH_SET_OPEN) {
+        open_free_table(&s->table, s->release);
+        if (s->old.slots)
+            open_free_table(&s->old, s->release);
+        free(s);
+        return;
+    }
+
     for (i = 0; i < s->capacity; ++i) {
         if (s->nodes[i])
             free_node(s->nodes[i], s->release);
@@ -166,8 +612,12 @@ void *cio_hash_set_add(void *set, void *elem)
 {
     struct hset *s = (struct hset *)set;
     struct node *n = NULL;
-    unsigned pos = jenkins_hash(elem, s->hash_data) % s->capacity;
+    unsigned pos;
 
+    if (s->impl == CIO_HASH_SET_OPEN)
+        return open_add(s, elem);
+
+    pos = jenkins_hash(elem, s->hash_data) % s->capacity;
     n = new_node(elem, s->nodes[pos], s->cmp);
     if (!n)
         return NULL;
@@ -179,13 +629,212 @@ void *cio_hash_set_add(void *set, void *elem)
 void *cio_hash_set_get(void *set, const void *elem)
 {
     struct hset *s = (struct hset *)set;
-    unsigned pos = jenkins_hash(elem, s->hash_data) % s->capacity;
+    unsigned pos;
+
+    if (s->impl == CIO_HASH_SET_OPEN)
+        return open_get(s, elem, elem_hash(s, elem));
+
+    pos = jenkins_hash(elem, s->hash_data) % s->capacity;
     return get_node_data(s->nodes[pos], elem, s->cmp);
 }
 
 void *cio_hash_set_remove(void *set, void *elem)
 {
     struct hset *s = (struct hset *)set;
-    unsigned pos = jenkins_hash(elem, s->hash_data) % s->capacity;
+    unsigned pos;
+
+    if (s->impl == CIO_HASH_SET_OPEN)
+        return open_remove(s, elem);
+
+    pos = jenkins_hash(elem, s->hash_data) % s->capacity;
     return remove_node(&s->nodes[pos], elem, s->cmp);
 }
+
+unsigned cio_hash_set_capacity(void *set)
+{
+    struct hset *s = (struct hset *)set;
+
+    return s->impl == CIO_HASH_SET_OPEN ? s->table.capacity : s->capacity;
+}
+
+static uintptr_t *int_slot(const struct int_map *m, const struct table *t, unsigned pos)
+{
+    return (uintptr_t *) (t->slots + (size_t) pos * m->slot_size);
+}
+
+/**
+ * Slot index, -1 if not found.
+ */
+static int int_map_find(const struct int_map *m, const struct table *t, uintptr_t key,
+    unsigned hash)
+{
+    unsigned group = table_first_group(t, hash);
+    unsigned step, pos, mask;
+
+    if (!t->size)
+        return -1;
+
+    for (step = 1; step <= t->group_mask + 1; group = (group + step++) & t->group_mask) {
+        pos = group * GROUP_SIZE;
+        for (mask = group_match(t->ctrl + pos, CTRL_HASH(hash)); mask; mask &= mask - 1) {
+            if (*int_slot(m, t, pos + __builtin_ctz(mask)) == key)
+                return pos + __builtin_ctz(mask);
+        }
+
+        if (group_match(t->ctrl + pos, CTRL_EMPTY))
+            break;
+    }
+
+    return -1;
+}
+
+/**
+ * Same as open_migrate().
+ */
+static void int_map_migrate(struct int_map *m, unsigned groups)
+{
+    struct table *old = &m->old;
+    unsigned pos, end, hash, new_pos;
+
+    if (!old->slots)
+        return;
+
+    for ( ; groups && old->size && m->migrated <= old->group_mask; --groups, ++m->migrated) {
+        pos = m->migrated * GROUP_SIZE;
+        for (end = pos + GROUP_SIZE; pos < end; ++pos) {
+            if (old->ctrl[pos] & 0x80)
+                continue;
+
+            hash = hash_int(*int_slot(m, old, pos));
+            new_pos = table_find_free(&m->table, hash);
+            memcpy(int_slot(m, &m->table, new_pos), int_slot(m, old, pos), m->slot_size);
+            table_insert(&m->table, new_pos, hash);
+            old->ctrl[pos] = CTRL_DELETED;
+            old->size--;
+        }
+    }
+
+    if (!old->size) {
+        free(old->slots);
+        memset(old, 0, sizeof(*old));
+    }
+}
+
+static int int_map_resize(struct int_map *m, unsigned capacity)
+{
+    struct table table;
+
+    if (table_alloc(&table, capacity, m->slot_size))
+        return -1;
+
+    int_map_migrate(m, -1);
+    m->old = m->table;
+    m->table = table;
+    m->migrated = 0;
+    int_map_migrate(m, MIGRATE_GROUPS);
+
+    return 0;
+}
+
+void *cio_new_int_map(unsigned capacity, int value_size)
+{
+    struct int_map *m = malloc(sizeof(*m));
+
+    if (!m)
+        return NULL;
+
+    memset(m, 0, sizeof(*m));
+    m->value_size = value_size;
+    m->slot_size = sizeof(uintptr_t)
+        + (value_size + sizeof(uintptr_t) - 1) / sizeof(uintptr_t) * sizeof(uintptr_t);
+
+    if (table_alloc(&m->table, capacity, m->slot_size)) {
+        free(m);
+        return NULL;
+    }
+
+    m->min_capacity = m->table.capacity;
+    return m;
+}
+
+void cio_free_int_map(void *map)
+{
+    struct int_map *m = map;
+
+    if (!m)
+        return;
+
+    free(m->table.slots);
+    free(m->old.slots);
+    free(m);
+}
+
+void *cio_int_map_put(void *map, uintptr_t key, const void *value)
+{
+    struct int_map *m = map;
+    unsigned hash = hash_int(key), pos;
+    uintptr_t *slot;
+
+    if (int_map_find(m, &m->table, key, hash) != -1 || int_map_find(m, &m->old, key, hash) != -1)
+        return NULL;
+
+    pos = table_find_free(&m->table, hash);
+    if (m->table.ctrl[pos] == CTRL_EMPTY && !m->table.growth_left) {
+        if (int_map_resize(m, table_grown_capacity(&m->table)))
+            return NULL;
+        pos = table_find_free(&m->table, hash);
+    }
+
+    slot = int_slot(m, &m->table, pos);
+    slot[0] = key;
+    memcpy(slot + 1, value, m->value_size);
+    table_insert(&m->table, pos, hash);
+    /* Moves elements into the new table only, 'slot' stays. */
+    int_map_migrate(m, MIGRATE_GROUPS);
+
+    return slot + 1;
+}
+
+void *cio_int_map_get(void *map, uintptr_t key)
+{
+    struct int_map *m = map;
+    unsigned hash = hash_int(key);
+    int pos;
+
+    if ((pos = int_map_find(m, &m->table, key, hash)) != -1)
+        return int_slot(m, &m->table, pos) + 1;
+    if ((pos = int_map_find(m, &m->old, key, hash)) != -1)
+        return int_slot(m, &m->old, pos) + 1;
+
+    return NULL;
+}
+
+int cio_int_map_remove(void *map, uintptr_t key, void *value)
+{
+    struct int_map *m = map;
+    unsigned hash = hash_int(key);
+    struct table *t = &m->table;
+    int pos;
+
+    if ((pos = int_map_find(m, t, key, hash)) == -1
+            && (pos = int_map_find(m, (t = &m->old), key, hash)) == -1)
+        return CIO_NOT_FOUND_ERROR;
+
+    if (value)
+        memcpy(value, int_slot(m, t, pos) + 1, m->value_size);
+    table_erase(t, pos);
+
+    if (!m->old.slots && table_needs_shrinking(&m->table, m->min_capacity))
+        int_map_resize(m, m->table.capacity / 2);
+    else
+        int_map_migrate(m, MIGRATE_GROUPS);
+
+    return CIO_NO_ERROR;
+}
+
+unsigned cio_int_map_size(void *map)
+{
+    struct int_map *m = map;
+
+    return m->table.size + m->old.size;
+}
@@ -1,8 +1,29 @@
 #if !defined (CIO_HASH_SET_H)
 #define CIO_HASH_SET_H
 
+#include <stdint.h>
+
+enum CIO_HASH_SET_IMPL {
+    /**
+     * A list node allocated per element, 'capacity' lists, never resized. The 'hash_data' bytes
+     * are hashed one at a time (Jenkins).
+     */
+    CIO_HASH_SET_CHAINED,
+    /**
+     * Open addressing, SwissTable style: the element pointers are stored in the table itself,
+     * probed in groups of 16 slots whose control bytes (7 bits of the hash each) are matched at
+     * once with SSE2, so 'cmp' is called almost only for the equal elements. The 'hash_data'
+     * bytes are hashed wyhash style, 8 at a time. The table doubles
+     * when it is 7/8 full and halves, down to 'capacity', when it is 1/8 full. The elements are
+     * moved to the new table a few groups per add and remove, so no call pays for the whole
+     * rehash.
+     */
+    CIO_HASH_SET_OPEN
+};
+
 /**
- * 'capacity' should be equal to (expected size / 0.75) or more for good hashing results.
+ * Creates a CIO_HASH_SET_OPEN set.
+ * 'capacity' should be equal to (expected size / 0.75) or more to avoid resizing.
  * 'cmp' should return 0 if values are NOT equal, any other number otherwise.
  * 'hash_data' should fill its' arguments 'data' and 'len' for the given 'elem' with correct values
  * of memory area which will be used for calculating hash value.
@@ -12,6 +33,13 @@
 void *cio_new_hash_set(unsigned capacity, int (*cmp)(const void *, const void *),
     void (*hash_data)(const void *elem, void **data, int *len), void (*release)(void *));
 
+/**
+ * Same as cio_new_hash_set() with explicitly chosen implementation.
+ */
+void *cio_new_hash_set_impl(enum CIO_HASH_SET_IMPL impl, unsigned capacity,
+    int (*cmp)(const void *, const void *),
+    void (*hash_data)(const void *elem, void **data, int *len), void (*release)(void *));
+
 void cio_free_hash_set(void *set);
 
 /**
@@ -30,4 +58,38 @@ void *cio_hash_set_get(void *set, const void *elem);
  */
 void *cio_hash_set_remove(void *set, void *elem);
 
+/**
+ * Current number of lists or slots.
+ */
+unsigned cio_hash_set_capacity(void *set);
+
+/**
+ * Map from integer keys, such as fds or pointers cast to uintptr_t, to values of 'value_size'
+ * bytes. The same table as CIO_HASH_SET_OPEN, but the keys and values are stored in it and hashed
+ * by a multiplication, so there are no callbacks and no allocations per element.
+ */
+void *cio_new_int_map(unsigned capacity, int value_size);
+
+void cio_free_int_map(void *map);
+
+/**
+ * Copies 'value' into the map. Returns the stored value, NULL if 'key' is already in the map or on
+ * allocation failure.
+ */
+void *cio_int_map_put(void *map, uintptr_t key, const void *value);
+
+/**
+ * Returns the stored value, NULL if 'key' is not in the map. Values move when the map is resized,
+ * so the pointer is valid only until the next put or remove.
+ */
+void *cio_int_map_get(void *map, uintptr_t key);
+
+/**
+ * Copies the value to 'value' unless it is NULL and removes 'key'. Returns CIO_NOT_FOUND_ERROR if
+ * 'key' is not in the map.
+ */
+int cio_int_map_remove(void *map, uintptr_t key, void *value);
+
+unsigned cio_int_map_size(void *map);
+
 #endif /* CIO_HASH_SET_H */
@@ -20,7 +20,11 @@ struct pollset {
     struct pollfd *pollfds;
     int size;
     int capacity;
-    int used;
+    /**
+     * fd -> index in 'pollfds', -1 if fd is not in the set. Makes add, modify and remove O(1).
+     */
+    int *fd_index;
+    int fd_index_size;
 };
 
 static const int INITIAL_CAPACITY = 256;
@@ -28,10 +32,26 @@ static const int INITIAL_CAPACITY = 256;
 static void *new_pollset()
 {
     struct pollset *result = malloc(sizeof(struct pollset));
+    int i;
+
+    if (!result)
+        return NULL;
+
     result->size = 0;
-    result->used = 0;
     result->capacity = INITIAL_CAPACITY;
     result->pollfds = calloc(INITIAL_CAPACITY, sizeof(struct pollfd));
+    result->fd_index_size = INITIAL_CAPACITY;
+    result->fd_index = malloc(INITIAL_CAPACITY * sizeof(*result->fd_index));
+
+    if (!result->pollfds || !result->fd_index) {
+        free(result->pollfds);
+        free(result->fd_index);
+        free(result);
+        return NULL;
+    }
+
+    for (i = 0; i < result->fd_index_size; ++i)
+        result->fd_index[i] = -1;
 
     return result;
 }
@@ -42,70 +62,123 @@ static void free_pollset(void *pollset)
     if (!ps)
         return;
     free(ps->pollfds);
+    free(ps->fd_index);
     free(pollset);
 }
 
-static int pollset_add(void *pollset, int fd, int flags)
+static int fd_index_get(struct pollset *ps, int fd)
 {
-    struct pollset *ps = (struct pollset *) pollset;
-    int i, unreserved_index = -1;
+    return fd >= 0 && fd < ps->fd_index_size ? ps->fd_index[fd] : -1;
+}
 
-    for (i = 0; i < ps->size; ++i) {
-        if (ps->pollfds[i].fd == fd)
-            return CIO_ALREADY_EXISTS_ERROR;
-        if (ps->pollfds[i].fd == -1)
-            unreserved_index = i;
-    }
+static int fd_index_reserve(struct pollset *ps, int fd)
+{
+    int new_size, i, *new_index;
 
-    unreserved_index = unreserved_index == -1 ? ps->size : unreserved_index;
-    assert(unreserved_index <= ps->capacity);
-    if (unreserved_index == ps->capacity) {
-        ps->capacity *= 2;
-        ps->pollfds = realloc(ps->pollfds, sizeof(struct pollfd) * ps->capacity);
-        if (ps->pollfds == NULL)
-            return CIO_ALLOC_ERROR;
-    }
+    if (fd < ps->fd_index_size)
+        return CIO_NO_ERROR;
+
+    new_size = ps->fd_index_size;
+    while (new_size <= fd)
+        new_size *= 2;
+
+    if (!(new_index = realloc(ps->fd_index, new_size * sizeof(*new_index))))
+        return CIO_ALLOC_ERROR;
+
+    for (i = ps->fd_index_size; i < new_size; ++i)
+        new_index[i] = -1;
+
+    ps->fd_index = new_index;
+    ps->fd_index_size = new_size;
+
+    return CIO_NO_ERROR;
+}
 
-    ps->pollfds[unreserved_index].fd = fd;
-    ps->pollfds[unreserved_index].revents = 0;
+static short poll_events(int flags)
+{
+    short events = 0;
 
     if (flags & CIO_FLAG_IN)
-        ps->pollfds[unreserved_index].events = POLLIN;
+        events |= POLLIN;
     if (flags & CIO_FLAG_OUT)
-        ps->pollfds[unreserved_index].events |= POLLOUT;
+        events |= POLLOUT;
 
 #if defined (_GNU_SOURCE)
-    ps->pollfds[unreserved_index].events |= POLLRDHUP;
+    events |= POLLRDHUP;
 #endif
 
-    ps->used++;
-    if (unreserved_index == ps->size)
-        ps->size++;
+    return events;
+}
 
+static int pollset_add(void *pollset, int fd, int flags)
+{
+    struct pollset *ps = (struct pollset *) pollset;
+    struct pollfd *new_pollfds;
+    int ecode;
+
+    if (fd < 0)
+        return CIO_INVALID_ARGUMENT_ERROR;
+
+    if (fd_index_get(ps, fd) != -1)
+        return CIO_ALREADY_EXISTS_ERROR;
+
+    if ((ecode = fd_index_reserve(ps, fd)))
+        return ecode;
+
+    assert(ps->size <= ps->capacity);
+    if (ps->size == ps->capacity) {
+        new_pollfds = realloc(ps->pollfds, sizeof(struct pollfd) * ps->capacity * 2);
+        if (new_pollfds == NULL)
+            return CIO_ALLOC_ERROR;
+        ps->pollfds = new_pollfds;
+        ps->capacity *= 2;
+    }
+
+    ps->pollfds[ps->size].fd = fd;
+    ps->pollfds[ps->size].revents = 0;
+    ps->pollfds[ps->size].events = poll_events(flags);
+    ps->fd_index[fd] = ps->size++;
+
+    return CIO_NO_ERROR;
+}
+
+static int pollset_modify(void *pollset, int fd, int flags)
+{
+    struct pollset *ps = (struct pollset *) pollset;
+    int index;
+
+    if ((index = fd_index_get(ps, fd)) == -1)
+        return CIO_NOT_FOUND_ERROR;
+
+    ps->pollfds[index].events = poll_events(flags);
     return CIO_NO_ERROR;
 }
 
+/**
+ * The last pollfd takes the place of the removed one. If that happens while iterating over the
+ * poll results, the moved fd might be skipped, but it will be reported again by the next poll.
+ */
 static int pollset_remove(void* pollset, int fd)
 {
     struct pollset *ps = (struct pollset *)pollset;
-    int i;
+    int index;
 
-    for (i = 0; i < ps->size; ++i) {
-        if (ps->pollfds[i].fd == fd) {
-            ps->pollfds[i].events = 0;
-            ps->pollfds[i].fd = -1;
-            ps->used--;
-            return CIO_NO_ERROR;
-        }
+    if ((index = fd_index_get(ps, fd)) == -1)
+        return CIO_NOT_FOUND_ERROR;
+
+    ps->fd_index[fd] = -1;
+    if (index != --ps->size) {
+        ps->pollfds[index] = ps->pollfds[ps->size];
+        ps->fd_index[ps->pollfds[index].fd] = index;
     }
 
-    return CIO_NOT_FOUND_ERROR;
+    return CIO_NO_ERROR;
 }
 
 static int pollset_size(void *pollset)
 {
     struct pollset *ps = (struct pollset *)pollset;
-    return ps->used;
+    return ps->size;
 }
 
 static int pollset_poll(void *pollset, int timeout_ms, void *cb_ctx, pollset_cb_t cb)
@@ -163,6 +236,11 @@ int cio_pollset_add(void *pollset, int fd, int flags)
     return pollset_add(pollset, fd, flags);
 }
 
+int cio_pollset_modify(void *pollset, int fd, int flags)
+{
+    return pollset_modify(pollset, fd, flags);
+}
+
 int cio_pollset_remove(void *pollset, int fd)
 {
     return pollset_remove(pollset, fd);
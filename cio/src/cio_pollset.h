@@ -6,6 +6,10 @@
 void *cio_new_pollset();
 void cio_free_pollset(void *pollset);
 int cio_pollset_add(void *pollset, int fd, int flags);
+/**
+ * Replaces the interest flags of the already added fd.
+ */
+int cio_pollset_modify(void *pollset, int fd, int flags);
 int cio_pollset_remove(void *pollset, int fd);
 int cio_pollset_size(void *pollset);
 /**
@@ -0,0 +1,148 @@
+#include "cio_rate_limiter.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+
+static const int RESUME_QUANTUM_MS = 10;
+
+struct token_bucket {
+    /**
+     * Tokens per second, 0 - unlimited.
+     */
+    double rate;
+    double burst;
+    /**
+     * Negative after a call took more than there was.
+     */
+    double tokens;
+};
+
+struct rate_limiter {
+    struct rate_limiter *parent;
+    struct token_bucket bytes;
+    struct token_bucket ops;
+    long long last_refill;
+    pthread_mutex_t mutex;
+};
+
+static void init_bucket(struct token_bucket *bucket, int rate, int burst)
+{
+    bucket->rate = CIO_MAX(rate, 0);
+    bucket->burst = burst > 0 ? burst : bucket->rate;
+    bucket->tokens = bucket->burst;
+}
+
+void *cio_new_rate_limiter(void *parent, int bytes_per_sec, int bytes_burst, int ops_per_sec,
+    int ops_burst)
+{
+    struct rate_limiter *limiter;
+
+    if (!(limiter = malloc(sizeof(*limiter))))
+        return NULL;
+
+    limiter->parent = parent;
+    init_bucket(&limiter->bytes, bytes_per_sec, bytes_burst);
+    init_bucket(&limiter->ops, ops_per_sec, ops_burst);
+    limiter->last_refill = 0;
+    limiter->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+    return limiter;
+}
+
+void cio_free_rate_limiter(void *rate_limiter)
+{
+    struct rate_limiter *limiter = rate_limiter;
+
+    if (!limiter)
+        return;
+
+    pthread_mutex_destroy(&limiter->mutex);
+    free(limiter);
+}
+
+static void refill_bucket(struct token_bucket *bucket, long long elapsed_ms)
+{
+    if (bucket->rate)
+        bucket->tokens = CIO_MIN(bucket->burst, bucket->tokens + bucket->rate * elapsed_ms / 1000);
+}
+
+/**
+ * Must be called with the mutex locked.
+ */
+static void refill(struct rate_limiter *limiter, long long now_ms)
+{
+    if (limiter->last_refill && now_ms > limiter->last_refill) {
+        refill_bucket(&limiter->bytes, now_ms - limiter->last_refill);
+        refill_bucket(&limiter->ops, now_ms - limiter->last_refill);
+    }
+
+    if (now_ms > limiter->last_refill)
+        limiter->last_refill = now_ms;
+}
+
+/**
+ * Milliseconds till the bucket has the tokens of RESUME_QUANTUM_MS (but no more than the burst),
+ * so that a throttled connection isn't woken up for every few bytes.
+ */
+static int bucket_delay_ms(struct token_bucket *bucket)
+{
+    double target;
+
+    if (!bucket->rate || bucket->tokens >= 1)
+        return 0;
+
+    target = CIO_MIN(bucket->burst, CIO_MAX(1, bucket->rate * RESUME_QUANTUM_MS / 1000));
+    return (int) ((target - bucket->tokens) * 1000 / bucket->rate) + 1;
+}
+
+int cio_rate_limiter_allowance(void *rate_limiter, long long now_ms)
+{
+    struct rate_limiter *limiter;
+    int allowance = INT_MAX;
+
+    for (limiter = rate_limiter; limiter; limiter = limiter->parent) {
+        pthread_mutex_lock(&limiter->mutex);
+        refill(limiter, now_ms);
+        if ((limiter->ops.rate && limiter->ops.tokens < 1)
+                || (limiter->bytes.rate && limiter->bytes.tokens < 1))
+            allowance = 0;
+        else if (limiter->bytes.rate)
+            allowance = (int) CIO_MIN(allowance, limiter->bytes.tokens);
+        pthread_mutex_unlock(&limiter->mutex);
+        if (!allowance)
+            break;
+    }
+
+    return allowance;
+}
+
+void cio_rate_limiter_consume(void *rate_limiter, int bytes)
+{
+    struct rate_limiter *limiter;
+
+    for (limiter = rate_limiter; limiter; limiter = limiter->parent) {
+        pthread_mutex_lock(&limiter->mutex);
+        if (limiter->bytes.rate)
+            limiter->bytes.tokens -= bytes;
+        if (limiter->ops.rate)
+            limiter->ops.tokens -= 1;
+        pthread_mutex_unlock(&limiter->mutex);
+    }
+}
+
+int cio_rate_limiter_delay_ms(void *rate_limiter, long long now_ms)
+{
+    struct rate_limiter *limiter;
+    int delay = 0;
+
+    for (limiter = rate_limiter; limiter; limiter = limiter->parent) {
+        pthread_mutex_lock(&limiter->mutex);
+        refill(limiter, now_ms);
+        delay = CIO_MAX(delay, bucket_delay_ms(&limiter->bytes));
+        delay = CIO_MAX(delay, bucket_delay_ms(&limiter->ops));
+        pthread_mutex_unlock(&limiter->mutex);
+    }
+
+    return delay;
+}
@@ -0,0 +1,40 @@
+#if !defined(CIO_RATE_LIMITER_H)
+#define CIO_RATE_LIMITER_H
+
+/**
+ * Token bucket limiting bytes and I/O calls per second. Attached to connections (see
+ * cio_tcp_connection_set_rate_limiters()) it defers their reads or writes once the tokens run
+ * out. A limiter shared by several connections, e.g. all the connections of an event loop, limits
+ * them as a group. Thread safe.
+ *
+ * parent - limiter charged together with this one, e.g. the group limiter for a per-connection
+ * one, NULL - none. It must outlive this one.
+ * bytes_per_sec, ops_per_sec - refill rates, 0 - unlimited.
+ * bytes_burst, ops_burst - bucket sizes, 0 - a second worth of tokens.
+ */
+void *cio_new_rate_limiter(void *parent, int bytes_per_sec, int bytes_burst, int ops_per_sec,
+    int ops_burst);
+
+/**
+ * The limiter must be detached from all the connections before it is destroyed.
+ */
+void cio_free_rate_limiter(void *rate_limiter);
+
+/**
+ * Bytes which may be transferred by one I/O call at 'now_ms' (see time_ms()) according to this
+ * limiter and its parents, INT_MAX if bytes aren't limited, 0 if the tokens have run out.
+ */
+int cio_rate_limiter_allowance(void *rate_limiter, long long now_ms);
+
+/**
+ * Charges one I/O call of 'bytes' to this limiter and its parents. A call may take more bytes
+ * than allowed, the debt delays the following ones.
+ */
+void cio_rate_limiter_consume(void *rate_limiter, int bytes);
+
+/**
+ * Milliseconds from 'now_ms' till cio_rate_limiter_allowance() is non-zero.
+ */
+int cio_rate_limiter_delay_ms(void *rate_limiter, long long now_ms);
+
+#endif /* CIO_RATE_LIMITER_H */
@@ -1,23 +1,134 @@
 #include "cio_resolver.h"
+#include "cio_event_loop.h"
 #include "cio_common.h"
+#include "cio_hash_set.h"
+#include "cio_endpoint_selector.h"
 #include <sys/un.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+
+/**
+ * Lookup threads, started on demand up to the max and leaving after being idle for a while.
+ */
+static const int RESOLVE_THREADS_MAX = 4;
+static const int RESOLVE_THREAD_IDLE_MS = 10 * 1000;
+
+static const int CACHE_HASH_SET_CAPACITY = 512;
+
+enum CACHE_RESULT {
+    CACHE_MISS,
+    CACHE_HIT,
+    CACHE_WAIT
+};
 
 struct resolver_ctx {
     struct addrinfo *root;
     struct addrinfo *current;
     int socktype;
+    /**
+     * The list is a copy made by copy_addrinfo(), not a getaddrinfo() result.
+     */
+    int copied;
 };
 
+/**
+ * Result of a lookup shared by the async resolves of the same name. While the lookup is in
+ * flight the later requests wait in 'waiters' instead of making lookups of their own.
+ */
+struct cache_entry {
+    struct cache_entry *lru_prev;
+    struct cache_entry *lru_next;
+    /**
+     * Copy of the lookup result, NULL for a failed lookup.
+     */
+    struct addrinfo *list;
+    long long expires;
+    int in_flight;
+    struct resolve_request *waiters;
+    int port;
+    int family;
+    int socktype;
+    enum CIO_ROLE role;
+    /**
+     * Stored right after the entry, points to the looked up string in a search key.
+     */
+    const char *name;
+};
+
+struct resolve_request {
+    void *event_loop;
+    char *addr_string;
+    int port;
+    int family;
+    int socktype;
+    enum CIO_ROLE role;
+    void *ctx;
+    void (*on_resolved)(void *ctx, int ecode, void *resolver);
+    void *resolver;
+    /**
+     * The cache entry the lookup is made for, NULL if the result isn't cached.
+     */
+    struct cache_entry *entry;
+    struct resolve_request *next;
+};
+
+/**
+ * Lookups queued for the threads. Shared by all the event loops.
+ */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct resolve_request *head;
+    struct resolve_request *tail;
+    int threads;
+    int idle_threads;
+} resolve_queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0 };
+
+/**
+ * Async resolve results, most recently used first. Shared by all the event loops.
+ */
+static struct {
+    pthread_mutex_t mutex;
+    void *entries;
+    struct cache_entry *lru_head;
+    struct cache_entry *lru_tail;
+    int max_entries;
+    int ttl_ms;
+    int negative_ttl_ms;
+    struct cio_resolver_cache_stats stats;
+} resolve_cache = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, 256, 10 * 1000, 1000 };
+
+static int lookup(const char *addr_string, int port, int family, int socktype,
+    enum CIO_ROLE role, struct addrinfo **list)
+{
+    char port_buf[16];
+    struct addrinfo hints;
+
+    snprintf(port_buf, sizeof(port_buf), "%d", port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = 0;
+    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+    if (role == CIO_SERVER)
+        hints.ai_flags = AI_PASSIVE;
+
+    return getaddrinfo(addr_string, port_buf, &hints, list);
+}
+
+static struct addrinfo *copy_addrinfo(const struct addrinfo *list);
+
 void *cio_new_resolver(const char *addr_string, int port, int family, int socktype,
     enum CIO_ROLE role)
 {
     struct resolver_ctx *rctx;
-    char port_buf[16];
-    struct addrinfo hints;
     struct sockaddr_un un_addr;
+    struct addrinfo un_endpoint;
 
     rctx = malloc(sizeof(*rctx));
     if (!rctx)
@@ -29,9 +140,7 @@ void *cio_new_resolver(const char *addr_string, int port, int family, int sockty
     rctx->current = NULL;
     rctx->root = NULL;
     rctx->socktype = socktype;
-
-    snprintf(port_buf, sizeof(port_buf), "%d", port);
-    memset(&hints, 0, sizeof(hints));
+    rctx->copied = 0;
 
     if (socktype != SOCK_STREAM && socktype != SOCK_DGRAM)
         goto fail;
@@ -40,15 +149,7 @@ void *cio_new_resolver(const char *addr_string, int port, int family, int sockty
     case AF_INET:
     case AF_INET6:
     case AF_UNSPEC:
-        hints.ai_family = family;
-        hints.ai_socktype = socktype;
-        hints.ai_protocol = 0;
-        hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
-
-        if (role == CIO_SERVER)
-            hints.ai_flags = AI_PASSIVE;
-
-        if (getaddrinfo(addr_string, port_buf, &hints, &rctx->root))
+        if (lookup(addr_string, port, family, socktype, role, &rctx->root))
             goto fail;
 
         rctx->current = rctx->root;
@@ -56,23 +157,21 @@ void *cio_new_resolver(const char *addr_string, int port, int family, int sockty
 
     case AF_UNIX:
         memset(&un_addr, 0, sizeof(un_addr));
+        un_addr.sun_family = AF_UNIX;
         strncpy(un_addr.sun_path, addr_string, sizeof(un_addr.sun_path) - 1);
 
-        rctx->root = malloc(sizeof(*rctx->root));
-        if (!rctx->root)
-            goto fail;
-
-        memset(rctx->root, 0, sizeof(*rctx->root));
+        memset(&un_endpoint, 0, sizeof(un_endpoint));
+        un_endpoint.ai_family = AF_UNIX;
+        un_endpoint.ai_socktype = socktype;
+        un_endpoint.ai_addr = (struct sockaddr *) &un_addr;
+        un_endpoint.ai_addrlen = sizeof(un_addr);
 
-        rctx->root->ai_addr = malloc(sizeof(*rctx->root->ai_addr));
-        if (!rctx->root->ai_addr) {
-            free(rctx->root);
+        /* Copied with its address in one block, freed by cio_free_resolver(). */
+        if (!(rctx->root = copy_addrinfo(&un_endpoint)))
             goto fail;
-        }
-
-        memcpy(rctx->root->ai_addr, &un_addr, sizeof(un_addr));
-        rctx->root->ai_addrlen = sizeof(un_addr);
 
+        rctx->current = rctx->root;
+        rctx->copied = 1;
         break;
 
     default:
@@ -88,6 +187,61 @@ fail:
     return NULL;
 }
 
+static void free_addrinfo_copy(struct addrinfo *list)
+{
+    struct addrinfo *next;
+
+    for (; list; list = next) {
+        next = list->ai_next;
+        free(list);
+    }
+}
+
+/**
+ * Copies the nodes with their addresses, one allocation per node. The canonical names are
+ * dropped.
+ */
+static struct addrinfo *copy_addrinfo(const struct addrinfo *list)
+{
+    struct addrinfo *head = NULL, **tail = &head, *ai;
+
+    for (; list; list = list->ai_next) {
+        if (!(ai = malloc(sizeof(*ai) + list->ai_addrlen))) {
+            free_addrinfo_copy(head);
+            return NULL;
+        }
+
+        memcpy(ai, list, sizeof(*ai));
+        ai->ai_addr = (struct sockaddr *) (ai + 1);
+        memcpy(ai->ai_addr, list->ai_addr, list->ai_addrlen);
+        ai->ai_canonname = NULL;
+        ai->ai_next = NULL;
+        *tail = ai;
+        tail = &ai->ai_next;
+    }
+
+    return head;
+}
+
+void *cio_new_resolver_from_list(const struct addrinfo *list, int socktype)
+{
+    struct resolver_ctx *rctx;
+
+    if (!list || !(rctx = malloc(sizeof(*rctx))))
+        return NULL;
+
+    if (!(rctx->root = copy_addrinfo(list))) {
+        free(rctx);
+        return NULL;
+    }
+
+    rctx->current = rctx->root;
+    rctx->socktype = socktype;
+    rctx->copied = 1;
+
+    return rctx;
+}
+
 void cio_free_resolver(void *resolver)
 {
     struct resolver_ctx *rctx = resolver;
@@ -95,7 +249,9 @@ void cio_free_resolver(void *resolver)
     if (!rctx)
         return;
 
-    if (rctx->root)
+    if (rctx->copied)
+        free_addrinfo_copy(rctx->root);
+    else if (rctx->root)
         freeaddrinfo(rctx->root);
 
     free(rctx);
@@ -123,6 +279,66 @@ void cio_resolver_reset_endpoint_iterator(void *resolver)
     rctx->current = rctx->root;
 }
 
+struct addrinfo *cio_addrinfo_interleave_families(struct addrinfo *list)
+{
+    struct addrinfo *first = NULL, **first_tail = &first;
+    struct addrinfo *other = NULL, **other_tail = &other;
+    struct addrinfo *head = NULL, **tail = &head;
+    struct addrinfo *ai, *next;
+    int family;
+
+    if (!list)
+        return NULL;
+
+    /* Split into the first family and the rest, keeping the order. */
+    family = list->ai_family;
+    for (ai = list; ai; ai = next) {
+        next = ai->ai_next;
+        ai->ai_next = NULL;
+        if (ai->ai_family == family) {
+            *first_tail = ai;
+            first_tail = &ai->ai_next;
+        } else {
+            *other_tail = ai;
+            other_tail = &ai->ai_next;
+        }
+    }
+
+    while (first || other) {
+        if (first) {
+            *tail = first;
+            tail = &first->ai_next;
+            first = first->ai_next;
+        }
+        if (other) {
+            *tail = other;
+            tail = &other->ai_next;
+            other = other->ai_next;
+        }
+    }
+    *tail = NULL;
+
+    return head;
+}
+
+void cio_resolver_interleave_families(void *resolver)
+{
+    struct resolver_ctx *rctx = (struct resolver_ctx *) resolver;
+
+    /* freeaddrinfo() frees the nodes one by one, so relinking them is safe. */
+    rctx->root = cio_addrinfo_interleave_families(rctx->root);
+    rctx->current = rctx->root;
+}
+
+void cio_resolver_order_endpoints(void *resolver, void *selector)
+{
+    struct resolver_ctx *rctx = (struct resolver_ctx *) resolver;
+
+    /* Relinking the nodes is safe, same as for the interleaving. */
+    rctx->root = cio_endpoint_selector_order(selector, rctx->root);
+    rctx->current = rctx->root;
+}
+
 int cio_resolve_local(const char *addr_string, int port, int family, struct sockaddr *addr,
     int *addrlen)
 {
@@ -134,8 +350,8 @@ int cio_resolve_local(const char *addr_string, int port, int family, struct sock
     switch (family) {
     case AF_INET6:
         memset(&ipv6_addr, 0, sizeof(ipv6_addr));
-        if (inet_pton(AF_INET6, addr_string, &ipv6_addr.sin6_addr) == -1) {
-            perror("inet_pton6");
+        if (inet_pton(AF_INET6, addr_string, &ipv6_addr.sin6_addr) != 1) {
+            cio_perror(CIO_INVALID_ARGUMENT_ERROR, "cio_resolve_local");
             return -1;
         }
         ipv6_addr.sin6_family = AF_INET6;
@@ -145,8 +361,8 @@ int cio_resolve_local(const char *addr_string, int port, int family, struct sock
         break;
     case AF_INET:
         memset(&ipv4_addr, 0, sizeof(ipv4_addr));
-        if (inet_pton(AF_INET, addr_string, &ipv4_addr.sin_addr) == -1) {
-            perror("inet_pton4");
+        if (inet_pton(AF_INET, addr_string, &ipv4_addr.sin_addr) != 1) {
+            cio_perror(CIO_INVALID_ARGUMENT_ERROR, "cio_resolve_local");
             return -1;
         }
         ipv4_addr.sin_family = AF_INET;
@@ -162,11 +378,382 @@ int cio_resolve_local(const char *addr_string, int port, int family, struct sock
         *addrlen = sizeof(un_addr);
         break;
     default:
-        perror("invalid family");
+        cio_perror(CIO_INVALID_ARGUMENT_ERROR, "cio_resolve_local");
         return -1;
     }
 
-    fd = socket(SOCK_STREAM, family, 0);
+    fd = socket(family, SOCK_STREAM, 0);
     return fd;
 }
 
+int cio_resolve_numeric(const char *addr_string, int port, int family, int socktype,
+    struct sockaddr_storage *addr, struct addrinfo *endpoint)
+{
+    struct sockaddr_in *ipv4_addr = (struct sockaddr_in *) addr;
+    struct sockaddr_in6 *ipv6_addr = (struct sockaddr_in6 *) addr;
+
+    if (port < 0 || port > 65535)
+        return CIO_INVALID_ARGUMENT_ERROR;
+
+    memset(addr, 0, sizeof(*addr));
+    memset(endpoint, 0, sizeof(*endpoint));
+    if ((family == AF_INET || family == AF_UNSPEC)
+            && inet_pton(AF_INET, addr_string, &ipv4_addr->sin_addr) == 1) {
+        ipv4_addr->sin_family = AF_INET;
+        ipv4_addr->sin_port = htons(port);
+        endpoint->ai_addrlen = sizeof(*ipv4_addr);
+    } else if ((family == AF_INET6 || family == AF_UNSPEC)
+            && inet_pton(AF_INET6, addr_string, &ipv6_addr->sin6_addr) == 1) {
+        ipv6_addr->sin6_family = AF_INET6;
+        ipv6_addr->sin6_port = htons(port);
+        endpoint->ai_addrlen = sizeof(*ipv6_addr);
+    } else {
+        return CIO_NOT_FOUND_ERROR;
+    }
+
+    endpoint->ai_family = addr->ss_family;
+    endpoint->ai_socktype = socktype;
+    endpoint->ai_protocol = socktype == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP;
+    endpoint->ai_addr = (struct sockaddr *) addr;
+
+    return CIO_NO_ERROR;
+}
+
+static void free_resolve_request(struct resolve_request *request)
+{
+    free(request->addr_string);
+    free(request);
+}
+
+static void complete_resolve_request(void *ctx)
+{
+    struct resolve_request *request = ctx;
+
+    request->on_resolved(request->ctx, request->resolver ? CIO_NO_ERROR : CIO_NOT_FOUND_ERROR,
+                         request->resolver);
+    free_resolve_request(request);
+}
+
+static struct resolve_request *wait_resolve_request()
+{
+    struct resolve_request *request;
+    struct timeval now;
+    struct timespec until;
+
+    pthread_mutex_lock(&resolve_queue.mutex);
+    while (!(request = resolve_queue.head)) {
+        gettimeofday(&now, NULL);
+        until.tv_sec = now.tv_sec + RESOLVE_THREAD_IDLE_MS / 1000;
+        until.tv_nsec = now.tv_usec * 1000;
+        resolve_queue.idle_threads++;
+        if (pthread_cond_timedwait(&resolve_queue.cond, &resolve_queue.mutex, &until)
+                == ETIMEDOUT && !resolve_queue.head) {
+            resolve_queue.idle_threads--;
+            resolve_queue.threads--;
+            break;
+        }
+        resolve_queue.idle_threads--;
+    }
+
+    if (request && !(resolve_queue.head = request->next))
+        resolve_queue.tail = NULL;
+    pthread_mutex_unlock(&resolve_queue.mutex);
+
+    return request;
+}
+
+static int cache_entry_cmp(const void *l, const void *r)
+{
+    const struct cache_entry *le = l, *re = r;
+    return le->port == re->port && le->family == re->family && le->socktype == re->socktype
+        && le->role == re->role && strcmp(le->name, re->name) == 0;
+}
+
+static void cache_entry_hash_data(const void *elem, void **data, int *len)
+{
+    struct cache_entry *entry = (struct cache_entry *) elem;
+    *data = (void *) entry->name;
+    *len = strlen(entry->name);
+}
+
+static void lru_unlink(struct cache_entry *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        resolve_cache.lru_head = entry->lru_next;
+
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        resolve_cache.lru_tail = entry->lru_prev;
+}
+
+static void lru_push_front(struct cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = resolve_cache.lru_head;
+    if (resolve_cache.lru_head)
+        resolve_cache.lru_head->lru_prev = entry;
+    else
+        resolve_cache.lru_tail = entry;
+    resolve_cache.lru_head = entry;
+}
+
+/**
+ * Drops the least recently used entries over 'max_entries'. The entries with a lookup in flight
+ * are skipped since their requests refer to them. Cache mutex held.
+ */
+static void trim_cache(int max_entries)
+{
+    struct cache_entry *entry, *prev;
+
+    for (entry = resolve_cache.lru_tail; entry && resolve_cache.stats.size > max_entries;
+            entry = prev) {
+        prev = entry->lru_prev;
+        if (entry->in_flight)
+            continue;
+
+        lru_unlink(entry);
+        cio_hash_set_remove(resolve_cache.entries, entry);
+        free_addrinfo_copy(entry->list);
+        free(entry);
+        resolve_cache.stats.size--;
+        resolve_cache.stats.evictions++;
+    }
+}
+
+/**
+ * Finds or adds the entry of the request and decides how the request is served: from the cache
+ * (the resolver is set), by waiting for the lookup in flight or by a lookup of its own made for
+ * the entry. Cache mutex held.
+ */
+static enum CACHE_RESULT cache_resolve_request(struct resolve_request *request)
+{
+    struct cache_entry *entry, search;
+    int len;
+
+    memset(&search, 0, sizeof(search));
+    search.port = request->port;
+    search.family = request->family;
+    search.socktype = request->socktype;
+    search.role = request->role;
+    search.name = request->addr_string;
+
+    if ((entry = cio_hash_set_get(resolve_cache.entries, &search))) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+
+        if (entry->in_flight) {
+            request->next = entry->waiters;
+            entry->waiters = request;
+            resolve_cache.stats.coalesced++;
+            return CACHE_WAIT;
+        }
+
+        if (entry->expires > now_time_ms()) {
+            if (entry->list)
+                resolve_cache.stats.hits++;
+            else
+                resolve_cache.stats.negative_hits++;
+            request->resolver = cio_new_resolver_from_list(entry->list, request->socktype);
+            return CACHE_HIT;
+        }
+
+        /* Expired, looked up again. */
+        free_addrinfo_copy(entry->list);
+        entry->list = NULL;
+    } else {
+        len = strlen(request->addr_string);
+        if (!(entry = malloc(sizeof(*entry) + len + 1)))
+            return CACHE_MISS;
+
+        *entry = search;
+        entry->name = memcpy(entry + 1, request->addr_string, len + 1);
+        if (!cio_hash_set_add(resolve_cache.entries, entry)) {
+            free(entry);
+            return CACHE_MISS;
+        }
+
+        lru_push_front(entry);
+        resolve_cache.stats.size++;
+    }
+
+    /* Before trimming, which would drop the new entry if all the older ones are in flight. */
+    entry->in_flight = 1;
+    trim_cache(resolve_cache.max_entries);
+    resolve_cache.stats.misses++;
+    request->entry = entry;
+
+    return CACHE_MISS;
+}
+
+/**
+ * Stores the result of the lookup made for 'request' and completes it together with the requests
+ * waiting for it. A failure is cached only if 'negative' is set.
+ */
+static void complete_cached_lookup(struct resolve_request *request, struct addrinfo *list,
+    int negative)
+{
+    struct cache_entry *entry = request->entry;
+    struct resolve_request *next;
+
+    pthread_mutex_lock(&resolve_cache.mutex);
+    entry->list = copy_addrinfo(list);
+    /* A result which couldn't be copied isn't kept. */
+    entry->expires = now_time_ms() + (entry->list ? resolve_cache.ttl_ms
+                                 : !list && negative ? resolve_cache.negative_ttl_ms : 0);
+    entry->in_flight = 0;
+    request->next = entry->waiters;
+    entry->waiters = NULL;
+
+    for (; request; request = next) {
+        next = request->next;
+        request->resolver = cio_new_resolver_from_list(entry->list, request->socktype);
+        cio_event_loop_post(request->event_loop, 0, request, complete_resolve_request);
+    }
+
+    trim_cache(resolve_cache.max_entries);
+    pthread_mutex_unlock(&resolve_cache.mutex);
+}
+
+static void *resolve_thread_func(void *ctx)
+{
+    struct resolve_request *request;
+    struct addrinfo *list;
+    int ecode;
+
+    while ((request = wait_resolve_request())) {
+        if (request->entry) {
+            if ((ecode = lookup(request->addr_string, request->port, request->family,
+                                request->socktype, request->role, &list)))
+                list = NULL;
+            /*
+             * A DNS failure (EAI_AGAIN included) is cached too so that the DNS being down isn't
+             * hit by every reconnect, a local one isn't.
+             */
+            complete_cached_lookup(request, list, ecode != EAI_MEMORY && ecode != EAI_SYSTEM);
+            if (list)
+                freeaddrinfo(list);
+            continue;
+        }
+
+        request->resolver = cio_new_resolver(request->addr_string, request->port,
+                                             request->family, request->socktype, request->role);
+        cio_event_loop_post(request->event_loop, 0, request, complete_resolve_request);
+    }
+
+    return NULL;
+}
+
+/**
+ * Queues the request and starts a thread if none is idle. Without any thread the lookup fails.
+ */
+static int queue_resolve_request(struct resolve_request *request)
+{
+    pthread_t thread;
+    int ecode = CIO_NO_ERROR;
+
+    pthread_mutex_lock(&resolve_queue.mutex);
+    if (!resolve_queue.idle_threads && resolve_queue.threads < RESOLVE_THREADS_MAX) {
+        if (!pthread_create(&thread, NULL, resolve_thread_func, NULL)) {
+            pthread_detach(thread);
+            resolve_queue.threads++;
+        } else if (!resolve_queue.threads) {
+            ecode = CIO_UNKNOWN_ERROR;
+        }
+    }
+
+    if (ecode == CIO_NO_ERROR) {
+        if (resolve_queue.tail)
+            resolve_queue.tail->next = request;
+        else
+            resolve_queue.head = request;
+        resolve_queue.tail = request;
+        pthread_cond_signal(&resolve_queue.cond);
+    }
+    pthread_mutex_unlock(&resolve_queue.mutex);
+
+    return ecode;
+}
+
+void cio_resolver_async_resolve(void *event_loop, const char *addr_string, int port, int family,
+    int socktype, enum CIO_ROLE role, void *ctx,
+    void (*on_resolved)(void *ctx, int ecode, void *resolver))
+{
+    struct resolve_request *request;
+    enum CACHE_RESULT cached;
+    int ecode = CIO_ALLOC_ERROR;
+
+    if (!(request = malloc(sizeof(*request))))
+        goto fail;
+
+    memset(request, 0, sizeof(*request));
+    if (!(request->addr_string = strdup(addr_string)))
+        goto fail;
+
+    request->event_loop = event_loop;
+    request->port = port;
+    request->family = family;
+    request->socktype = socktype;
+    request->role = role;
+    request->ctx = ctx;
+    request->on_resolved = on_resolved;
+
+    if (family != AF_UNIX && port >= 0 && port <= 65535
+            && (socktype == SOCK_STREAM || socktype == SOCK_DGRAM)) {
+        pthread_mutex_lock(&resolve_cache.mutex);
+        if (resolve_cache.max_entries && !resolve_cache.entries)
+            resolve_cache.entries = cio_new_hash_set(CACHE_HASH_SET_CAPACITY, cache_entry_cmp,
+                                                     cache_entry_hash_data, NULL);
+        cached = resolve_cache.max_entries && resolve_cache.entries
+            ? cache_resolve_request(request) : CACHE_MISS;
+        pthread_mutex_unlock(&resolve_cache.mutex);
+
+        if (cached == CACHE_HIT)
+            cio_event_loop_post(event_loop, 0, request, complete_resolve_request);
+        if (cached != CACHE_MISS)
+            return;
+    }
+
+    if ((ecode = queue_resolve_request(request))) {
+        if (request->entry) {
+            /* Fails the waiters as well. */
+            cio_perror(ecode, "cio_resolver_async_resolve");
+            complete_cached_lookup(request, NULL, 0);
+            return;
+        }
+        goto fail;
+    }
+
+    return;
+
+fail:
+    cio_perror(ecode, "cio_resolver_async_resolve");
+    if (request)
+        free_resolve_request(request);
+    on_resolved(ctx, ecode, NULL);
+}
+
+void cio_resolver_set_cache(int max_entries, int ttl_ms, int negative_ttl_ms)
+{
+    int size;
+
+    pthread_mutex_lock(&resolve_cache.mutex);
+    /* The entries with a lookup in flight stay until it completes. */
+    trim_cache(0);
+    size = resolve_cache.stats.size;
+    memset(&resolve_cache.stats, 0, sizeof(resolve_cache.stats));
+    resolve_cache.stats.size = size;
+    resolve_cache.max_entries = CIO_MAX(max_entries, 0);
+    resolve_cache.ttl_ms = CIO_MAX(ttl_ms, 0);
+    resolve_cache.negative_ttl_ms = CIO_MAX(negative_ttl_ms, 0);
+    pthread_mutex_unlock(&resolve_cache.mutex);
+}
+
+void cio_resolver_get_cache_stats(struct cio_resolver_cache_stats *stats)
+{
+    pthread_mutex_lock(&resolve_cache.mutex);
+    memcpy(stats, &resolve_cache.stats, sizeof(*stats));
+    pthread_mutex_unlock(&resolve_cache.mutex);
+}
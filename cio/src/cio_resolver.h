@@ -19,14 +19,79 @@ enum CIO_ROLE {
 void *cio_new_resolver(const char *addr_string, int port, int family, int socktype,
     enum CIO_ROLE role);
 
+/**
+ * Resolver over a copy of 'list', e.g. one built by another lookup backend. NULL for an empty
+ * list or on allocation failure.
+ */
+void *cio_new_resolver_from_list(const struct addrinfo *list, int socktype);
+
 void cio_free_resolver(void *resolver);
 
+/**
+ * Counters of the async resolve cache (see cio_resolver_set_cache()).
+ */
+struct cio_resolver_cache_stats {
+    /**
+     * Requests served from a cached result, a cached failure, by a lookup, and by waiting for a
+     * lookup of the same name already in flight.
+     */
+    long long hits;
+    long long negative_hits;
+    long long misses;
+    long long coalesced;
+    /**
+     * Entries dropped to keep the cache within its size.
+     */
+    long long evictions;
+    int size;
+};
+
+/**
+ * Same as cio_new_resolver() but without blocking the event loop thread on a slow DNS: the lookup
+ * is made by a small pool of helper threads shared by all the event loops, and 'on_resolved' is
+ * called on the event loop thread with the resolver, which the callee frees. On failure
+ * 'resolver' is NULL. The event loop must outlive the lookup.
+ */
+void cio_resolver_async_resolve(void *event_loop, const char *addr_string, int port, int family,
+    int socktype, enum CIO_ROLE role, void *ctx,
+    void (*on_resolved)(void *ctx, int ecode, void *resolver));
+
+/**
+ * Configures the cache of the cio_resolver_async_resolve() results, shared by all the event loops
+ * and keyed by the name, port, family, socktype and role. A result is kept for 'ttl_ms' and a
+ * failed lookup (name not found or DNS unreachable) for 'negative_ttl_ms', since getaddrinfo()
+ * doesn't tell the DNS TTL. The requests for a name being looked up wait for that lookup instead
+ * of making their own. Beyond 'max_entries' the least recently used results are dropped, 0
+ * disables the cache. Defaults: 256 entries, 10 s, 1 s. Drops the cached results and resets the
+ * counters.
+ */
+void cio_resolver_set_cache(int max_entries, int ttl_ms, int negative_ttl_ms);
+
+void cio_resolver_get_cache_stats(struct cio_resolver_cache_stats *stats);
+
 /**
  * addr and addrlen - out parameters.
  */
 int cio_resolver_next_endpoint(void *resolver, struct addrinfo *addr);
 void cio_resolver_reset_endpoint_iterator(void *resolver);
 
+/**
+ * Reorders the endpoints so that the address families alternate, starting with the family of the
+ * first one (RFC 8305, section 4). The order within a family is kept. Resets the iterator.
+ */
+void cio_resolver_interleave_families(void *resolver);
+
+/**
+ * Same for a bare addrinfo list. Returns the new head.
+ */
+struct addrinfo *cio_addrinfo_interleave_families(struct addrinfo *list);
+
+/**
+ * Reorders the endpoints with the endpoint selector (see cio_endpoint_selector.h). Resets the
+ * iterator.
+ */
+void cio_resolver_order_endpoints(void *resolver, void *selector);
+
 /**
  * Resolve add_string with ipv4(6) address string locally, without DNS lookup. Creates and returns
  * socket in case of success, -1 otherwise.
@@ -34,4 +99,12 @@ void cio_resolver_reset_endpoint_iterator(void *resolver);
 int cio_resolve_local(const char *addr_string, int port, int family, struct sockaddr *addr,
     int *addrlen);
 
+/**
+ * Fills 'endpoint' for a numeric IPv4 or IPv6 'addr_string' of 'family' (AF_UNSPEC for both)
+ * without getaddrinfo() and without allocating: 'endpoint->ai_addr' points to 'addr'. Returns
+ * CIO_NOT_FOUND_ERROR if 'addr_string' isn't such an address, e.g. a host name.
+ */
+int cio_resolve_numeric(const char *addr_string, int port, int family, int socktype,
+    struct sockaddr_storage *addr, struct addrinfo *endpoint);
+
 #endif /* CIO_RESOLV_H */
@@ -0,0 +1,154 @@
+#include "cio_ring_buffer.h"
+#include "cio_common.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct ring_buffer {
+    char *data;
+    int capacity;
+    int head;
+    int size;
+};
+
+void *cio_new_ring_buffer(int capacity)
+{
+    struct ring_buffer *rb;
+
+    if (!(rb = malloc(sizeof(*rb))))
+        return NULL;
+
+    rb->head = 0;
+    rb->size = 0;
+    rb->capacity = capacity;
+    rb->data = NULL;
+    if (capacity > 0 && !(rb->data = malloc(capacity))) {
+        free(rb);
+        return NULL;
+    }
+
+    return rb;
+}
+
+void cio_free_ring_buffer(void *ring_buffer)
+{
+    struct ring_buffer *rb = ring_buffer;
+
+    if (!rb)
+        return;
+
+    free(rb->data);
+    free(rb);
+}
+
+int cio_ring_buffer_size(void *ring_buffer)
+{
+    return ((struct ring_buffer *) ring_buffer)->size;
+}
+
+int cio_ring_buffer_capacity(void *ring_buffer)
+{
+    return ((struct ring_buffer *) ring_buffer)->capacity;
+}
+
+int cio_ring_buffer_reserve(void *ring_buffer, int capacity)
+{
+    struct ring_buffer *rb = ring_buffer;
+    char *new_data;
+
+    if (capacity <= rb->capacity)
+        return CIO_NO_ERROR;
+
+    if (!(new_data = malloc(capacity)))
+        return CIO_ALLOC_ERROR;
+
+    cio_ring_buffer_peek(rb, new_data, rb->size);
+    free(rb->data);
+    rb->data = new_data;
+    rb->capacity = capacity;
+    rb->head = 0;
+
+    return CIO_NO_ERROR;
+}
+
+int cio_ring_buffer_write(void *ring_buffer, const void *data, int len)
+{
+    struct ring_buffer *rb = ring_buffer;
+    struct iovec iov[2];
+    int ecode, count, i, chunk, written = 0;
+
+    if (rb->size + len > rb->capacity
+        && (ecode = cio_ring_buffer_reserve(rb, CIO_MAX(rb->capacity * 2, rb->size + len))))
+        return ecode;
+
+    count = cio_ring_buffer_free_segments(rb, iov);
+    for (i = 0; i < count && written < len; ++i) {
+        chunk = CIO_MIN((int) iov[i].iov_len, len - written);
+        memcpy(iov[i].iov_base, (const char *) data + written, chunk);
+        written += chunk;
+    }
+
+    cio_ring_buffer_commit(rb, written);
+    return CIO_NO_ERROR;
+}
+
+int cio_ring_buffer_peek(void *ring_buffer, void *data, int len)
+{
+    struct ring_buffer *rb = ring_buffer;
+    int first_chunk;
+
+    len = CIO_MIN(len, rb->size);
+    first_chunk = CIO_MIN(len, rb->capacity - rb->head);
+    memcpy(data, rb->data + rb->head, first_chunk);
+    memcpy((char *) data + first_chunk, rb->data, len - first_chunk);
+
+    return len;
+}
+
+void cio_ring_buffer_consume(void *ring_buffer, int len)
+{
+    struct ring_buffer *rb = ring_buffer;
+
+    len = CIO_MIN(len, rb->size);
+    rb->size -= len;
+    rb->head = rb->size == 0 ? 0 : (rb->head + len) % rb->capacity;
+}
+
+int cio_ring_buffer_read(void *ring_buffer, void *data, int len)
+{
+    len = cio_ring_buffer_peek(ring_buffer, data, len);
+    cio_ring_buffer_consume(ring_buffer, len);
+
+    return len;
+}
+
+int cio_ring_buffer_free_segments(void *ring_buffer, struct iovec *iov)
+{
+    struct ring_buffer *rb = ring_buffer;
+    int tail;
+
+    if (rb->size == rb->capacity)
+        return 0;
+
+    tail = (rb->head + rb->size) % rb->capacity;
+    iov[0].iov_base = rb->data + tail;
+    if (tail < rb->head) {
+        iov[0].iov_len = rb->head - tail;
+        return 1;
+    }
+
+    iov[0].iov_len = rb->capacity - tail;
+    if (rb->head == 0)
+        return 1;
+
+    iov[1].iov_base = rb->data;
+    iov[1].iov_len = rb->head;
+
+    return 2;
+}
+
+void cio_ring_buffer_commit(void *ring_buffer, int len)
+{
+    struct ring_buffer *rb = ring_buffer;
+
+    rb->size += CIO_MIN(len, rb->capacity - rb->size);
+}
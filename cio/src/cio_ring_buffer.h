@@ -0,0 +1,43 @@
+#if !defined(CIO_RING_BUFFER_H)
+#define CIO_RING_BUFFER_H
+
+#include <sys/uio.h>
+
+/**
+ * Byte ring buffer. Not thread safe.
+ */
+void *cio_new_ring_buffer(int capacity);
+void cio_free_ring_buffer(void *ring_buffer);
+
+int cio_ring_buffer_size(void *ring_buffer);
+int cio_ring_buffer_capacity(void *ring_buffer);
+
+/**
+ * Grows the buffer to hold at least 'capacity' bytes preserving its content.
+ */
+int cio_ring_buffer_reserve(void *ring_buffer, int capacity);
+
+/**
+ * Appends 'len' bytes growing the buffer if needed.
+ */
+int cio_ring_buffer_write(void *ring_buffer, const void *data, int len);
+
+/**
+ * Copies up to 'len' bytes to 'data' without consuming them. Returns the number of bytes copied.
+ */
+int cio_ring_buffer_peek(void *ring_buffer, void *data, int len);
+void cio_ring_buffer_consume(void *ring_buffer, int len);
+
+/**
+ * Peek + consume.
+ */
+int cio_ring_buffer_read(void *ring_buffer, void *data, int len);
+
+/**
+ * Fills 'iov' (at least 2 elements) with the free space segments and returns their count. Use
+ * cio_ring_buffer_commit() to account for the bytes written there (e.g. by readv()).
+ */
+int cio_ring_buffer_free_segments(void *ring_buffer, struct iovec *iov);
+void cio_ring_buffer_commit(void *ring_buffer, int len);
+
+#endif /* CIO_RING_BUFFER_H */
@@ -0,0 +1,170 @@
+#include "cio_scan.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CIO_HAVE_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CIO_HAVE_AVX2
+#endif
+
+typedef int (*scan_func_t)(const unsigned char *, int, const unsigned char *, int);
+
+static int scan_scalar(const unsigned char *data, int len, const unsigned char *delim,
+    int delim_len)
+{
+    int i;
+
+    for (i = 0; i + delim_len <= len; ++i) {
+        if (data[i] == delim[0] && !memcmp(data + i + 1, delim + 1, delim_len - 1))
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * SIMD versions compare the whole block against the first and the last delimiter bytes at once
+ * and check the middle part only for the candidate positions.
+ */
+#if defined(CIO_HAVE_SSE2)
+static int scan_sse2(const unsigned char *data, int len, const unsigned char *delim,
+    int delim_len)
+{
+    const __m128i first = _mm_set1_epi8((char) delim[0]);
+    const __m128i last = _mm_set1_epi8((char) delim[delim_len - 1]);
+    __m128i block_first, block_last;
+    unsigned mask;
+    int i, bit, result;
+
+    for (i = 0; i + delim_len - 1 + 16 <= len; i += 16) {
+        block_first = _mm_loadu_si128((const __m128i *) (data + i));
+        if (delim_len == 1) {
+            mask = _mm_movemask_epi8(_mm_cmpeq_epi8(first, block_first));
+        } else {
+            block_last = _mm_loadu_si128((const __m128i *) (data + i + delim_len - 1));
+            mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                   _mm_cmpeq_epi8(last, block_last)));
+        }
+
+        while (mask) {
+            bit = __builtin_ctz(mask);
+            if (delim_len <= 2 || !memcmp(data + i + bit + 1, delim + 1, delim_len - 2))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    result = scan_scalar(data + i, len - i, delim, delim_len);
+    return result == -1 ? -1 : i + result;
+}
+#endif /* CIO_HAVE_SSE2 */
+
+#if defined(CIO_HAVE_AVX2)
+__attribute__((target("avx2")))
+static int scan_avx2(const unsigned char *data, int len, const unsigned char *delim,
+    int delim_len)
+{
+    const __m256i first = _mm256_set1_epi8((char) delim[0]);
+    const __m256i last = _mm256_set1_epi8((char) delim[delim_len - 1]);
+    __m256i block_first, block_last;
+    unsigned mask;
+    int i, bit, result;
+
+    for (i = 0; i + delim_len - 1 + 32 <= len; i += 32) {
+        block_first = _mm256_loadu_si256((const __m256i *) (data + i));
+        if (delim_len == 1) {
+            mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(first, block_first));
+        } else {
+            block_last = _mm256_loadu_si256((const __m256i *) (data + i + delim_len - 1));
+            mask = (unsigned) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                 _mm256_cmpeq_epi8(last, block_last)));
+        }
+
+        while (mask) {
+            bit = __builtin_ctz(mask);
+            if (delim_len <= 2 || !memcmp(data + i + bit + 1, delim + 1, delim_len - 2))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    result = scan_scalar(data + i, len - i, delim, delim_len);
+    return result == -1 ? -1 : i + result;
+}
+#endif /* CIO_HAVE_AVX2 */
+
+static scan_func_t best_scan_func = scan_scalar;
+static pthread_once_t best_scan_func_once = PTHREAD_ONCE_INIT;
+
+static void select_best_scan_func()
+{
+    if (cio_scan_impl_supported(CIO_SCAN_AVX2)) {
+#if defined(CIO_HAVE_AVX2)
+        best_scan_func = scan_avx2;
+#endif
+    } else if (cio_scan_impl_supported(CIO_SCAN_SSE2)) {
+#if defined(CIO_HAVE_SSE2)
+        best_scan_func = scan_sse2;
+#endif
+    }
+}
+
+int cio_scan_impl_supported(enum CIO_SCAN_IMPL impl)
+{
+    switch (impl) {
+    case CIO_SCAN_SCALAR:
+        return 1;
+    case CIO_SCAN_SSE2:
+#if defined(CIO_HAVE_SSE2)
+        return 1;
+#else
+        return 0;
+#endif
+    case CIO_SCAN_AVX2:
+#if defined(CIO_HAVE_AVX2)
+        return __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+        return 0;
+#endif
+    }
+
+    return 0;
+}
+
+int cio_scan_delim(const void *data, int len, const void *delim, int delim_len)
+{
+    if (delim_len <= 0 || len < delim_len)
+        return -1;
+
+    pthread_once(&best_scan_func_once, select_best_scan_func);
+    return best_scan_func(data, len, delim, delim_len);
+}
+
+int cio_scan_delim_impl(enum CIO_SCAN_IMPL impl, const void *data, int len, const void *delim,
+    int delim_len)
+{
+    if (delim_len <= 0 || len < delim_len)
+        return -1;
+
+    if (!cio_scan_impl_supported(impl))
+        return scan_scalar(data, len, delim, delim_len);
+
+    switch (impl) {
+#if defined(CIO_HAVE_SSE2)
+    case CIO_SCAN_SSE2:
+        return scan_sse2(data, len, delim, delim_len);
+#endif
+#if defined(CIO_HAVE_AVX2)
+    case CIO_SCAN_AVX2:
+        return scan_avx2(data, len, delim, delim_len);
+#endif
+    default:
+        return scan_scalar(data, len, delim, delim_len);
+    }
+}
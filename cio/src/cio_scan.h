@@ -0,0 +1,32 @@
+#if !defined(CIO_SCAN_H)
+#define CIO_SCAN_H
+
+/**
+ * Delimiter scanning routines used by the delimited reads. The best implementation available on
+ * the current CPU is selected at runtime.
+ */
+
+enum CIO_SCAN_IMPL {
+    CIO_SCAN_SCALAR,
+    CIO_SCAN_SSE2,
+    CIO_SCAN_AVX2
+};
+
+/**
+ * Returns 1 if 'impl' is compiled in and supported by the CPU, 0 otherwise.
+ */
+int cio_scan_impl_supported(enum CIO_SCAN_IMPL impl);
+
+/**
+ * Returns the offset of the first occurrence of 'delim' in 'data', -1 if there is none.
+ */
+int cio_scan_delim(const void *data, int len, const void *delim, int delim_len);
+
+/**
+ * Same as cio_scan_delim() but with explicitly chosen implementation. Falls back to the scalar
+ * one if 'impl' is not supported.
+ */
+int cio_scan_delim_impl(enum CIO_SCAN_IMPL impl, const void *data, int len, const void *delim,
+    int delim_len);
+
+#endif /* CIO_SCAN_H */
@@ -0,0 +1,97 @@
+#include "cio_socket_options.h"
+#include "cio_common.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static int set_option(int fd, int level, int name, int value)
+{
+    if (setsockopt(fd, level, name, &value, sizeof(value))) {
+        perror("cio_socket_options_apply: setsockopt");
+        return CIO_SOCKET_OPTION_ERROR;
+    }
+
+    return CIO_NO_ERROR;
+}
+
+static int set_keep_alive(int fd, const struct cio_socket_options *options)
+{
+    int cio_ecode;
+
+    if ((cio_ecode = set_option(fd, SOL_SOCKET, SO_KEEPALIVE, !!options->keep_alive)))
+        return cio_ecode;
+
+    if (!options->keep_alive)
+        return CIO_NO_ERROR;
+
+#if defined(TCP_KEEPIDLE)
+    if (options->keep_idle > 0
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, options->keep_idle)))
+        return cio_ecode;
+#elif defined(TCP_KEEPALIVE)
+    if (options->keep_idle > 0
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_KEEPALIVE, options->keep_idle)))
+        return cio_ecode;
+#endif
+#if defined(TCP_KEEPINTVL)
+    if (options->keep_interval > 0
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, options->keep_interval)))
+        return cio_ecode;
+#endif
+#if defined(TCP_KEEPCNT)
+    if (options->keep_count > 0
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, options->keep_count)))
+        return cio_ecode;
+#endif
+
+    return CIO_NO_ERROR;
+}
+
+int cio_socket_options_apply(int fd, const struct cio_socket_options *options)
+{
+    return cio_socket_options_apply_some(fd, options, options->mask);
+}
+
+int cio_socket_options_apply_some(int fd, const struct cio_socket_options *options, int mask)
+{
+    int cio_ecode = CIO_NO_ERROR;
+
+    mask &= options->mask;
+
+    if ((mask & CIO_SO_NODELAY)
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_NODELAY, !!options->no_delay)))
+        return cio_ecode;
+#if defined(TCP_QUICKACK)
+    if ((mask & CIO_SO_QUICKACK)
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_QUICKACK, !!options->quick_ack)))
+        return cio_ecode;
+#endif
+    if ((mask & CIO_SO_KEEPALIVE) && (cio_ecode = set_keep_alive(fd, options)))
+        return cio_ecode;
+    if ((mask & CIO_SO_SNDBUF)
+            && (cio_ecode = set_option(fd, SOL_SOCKET, SO_SNDBUF, options->send_buffer)))
+        return cio_ecode;
+    if ((mask & CIO_SO_RCVBUF)
+            && (cio_ecode = set_option(fd, SOL_SOCKET, SO_RCVBUF, options->receive_buffer)))
+        return cio_ecode;
+#if defined(TCP_NOTSENT_LOWAT)
+    if ((mask & CIO_SO_NOTSENT_LOWAT)
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                                       options->not_sent_lowat)))
+        return cio_ecode;
+#endif
+#if defined(TCP_DEFER_ACCEPT)
+    if ((mask & CIO_SO_DEFER_ACCEPT)
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options->defer_accept)))
+        return cio_ecode;
+#endif
+#if defined(TCP_FASTOPEN)
+    if ((mask & CIO_SO_FASTOPEN)
+            && (cio_ecode = set_option(fd, IPPROTO_TCP, TCP_FASTOPEN, options->fast_open_queue)))
+        return cio_ecode;
+#endif
+
+    return cio_ecode;
+}
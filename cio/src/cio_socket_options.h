@@ -0,0 +1,61 @@
+#if !defined(CIO_SOCKET_OPTIONS_H)
+#define CIO_SOCKET_OPTIONS_H
+
+/**
+ * Bits of cio_socket_options.mask telling which of the fields are to be applied.
+ */
+enum CIO_SOCKET_OPTION {
+    CIO_SO_NODELAY = 1,
+    CIO_SO_QUICKACK = 2,
+    CIO_SO_KEEPALIVE = 4,
+    CIO_SO_SNDBUF = 8,
+    CIO_SO_RCVBUF = 16,
+    CIO_SO_NOTSENT_LOWAT = 32,
+    CIO_SO_DEFER_ACCEPT = 64,
+    CIO_SO_FASTOPEN = 128
+};
+
+/**
+ * Socket tuning. Options the platform doesn't have (TCP_QUICKACK outside Linux, for example) are
+ * silently skipped.
+ *
+ * keep_idle, keep_interval, keep_count - keep-alive probing parameters in seconds / probes,
+ * applied together with 'keep_alive' when > 0, otherwise the system defaults are used.
+ * send_buffer, receive_buffer - must be set before the connection is established to affect the
+ * TCP window scale, so connections apply them before connect() and acceptors on the listening
+ * socket as well.
+ * defer_accept - seconds the listening socket waits for the first data before the connection is
+ * accepted (TCP_DEFER_ACCEPT, Linux only), so that the first read finds it.
+ * fast_open_queue - TCP Fast Open pending requests limit of the listening socket, so that the
+ * clients may send the first request with the SYN. The system must have the server side of Fast
+ * Open enabled (net.ipv4.tcp_fastopen).
+ * The last two are for the listening sockets only, acceptors don't apply them to the accepted ones.
+ */
+struct cio_socket_options {
+    int mask;
+    int no_delay;
+    int quick_ack;
+    int keep_alive;
+    int keep_idle;
+    int keep_interval;
+    int keep_count;
+    int send_buffer;
+    int receive_buffer;
+    int not_sent_lowat;
+    int defer_accept;
+    int fast_open_queue;
+};
+
+/**
+ * Applies the options in 'options->mask' to 'fd'. Stops at the first failing option and returns
+ * CIO_SOCKET_OPTION_ERROR leaving errno set.
+ */
+int cio_socket_options_apply(int fd, const struct cio_socket_options *options);
+
+/**
+ * Same for the options of 'options->mask' which are in 'mask' as well, e.g. to re-arm
+ * CIO_SO_QUICKACK alone.
+ */
+int cio_socket_options_apply_some(int fd, const struct cio_socket_options *options, int mask);
+
+#endif /* CIO_SOCKET_OPTIONS_H */
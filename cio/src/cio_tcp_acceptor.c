@@ -1,24 +1,118 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* accept4() */
+#define _GNU_SOURCE
+#endif
+
 #include "cio_tcp_acceptor.h"
 #include "cio_resolver.h"
 #include "cio_event_loop.h"
 #include "cio_common.h"
 #include "cio_tcp_connection.h"
+#include "cio_socket_options.h"
+#include "cio_rate_limiter.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
+static const int DEFAULT_BACKLOG = 128;
+static const int DEFAULT_ACCEPT_BATCH = 64;
+/**
+ * How long accepting is paused when out of fds and no reserve one is left to shed the connections.
+ */
+static const int FD_SHORTAGE_PAUSE_MS = 100;
+static const int LISTEN_ONLY_OPTIONS = CIO_SO_DEFER_ACCEPT | CIO_SO_FASTOPEN;
 
 struct tcp_acceptor_ctx {
+    enum obj_type type;
     void *event_loop;
     void *user_ctx;
-    void (*on_accept)(int fd, void *user_ctx, int ecode);
+    void (*on_accept)(int fd, void *user_ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len);
     int fd;
+    struct cio_socket_options options;
+    int backlog;
+    /**
+     * Max connections accepted per readiness event.
+     */
+    int accept_batch;
+    int reuse_port;
+    /**
+     * Size of the SO_REUSEPORT group to steer the connections in by the CPU, 0 - off.
+     */
+    int cpu_steering;
+    /**
+     * Set by cio_tcp_acceptor_async_accept_connections(), NULL - the sockets go to 'on_accept'.
+     */
+    struct handoff *handoff;
+    /**
+     * Spare fd closed to accept and drop a connection when the process is out of fds, -1 - none.
+     */
+    int reserve_fd;
+    /**
+     * Overload limits, 0 max_connections and NULL rate_limiter - none. 'connections' - accepted and
+     * not yet released.
+     */
+    int max_connections;
+    int connections;
+    void *rate_limiter;
+    /**
+     * While paused the listening socket isn't polled for, so the pending connections stay in the
+     * listen queue. The resume timer is armed while the pause has to last till a due time.
+     */
+    int paused;
+    void *resume_timer;
 };
 
+struct handoff_worker {
+    void *event_loop;
+    /**
+     * Connections handed off to the loop and not yet destroyed.
+     */
+    int connections;
+};
+
+/**
+ * Shared by the acceptor and the connections it has handed off, which report their destruction
+ * from the worker loop threads, hence the mutex. Freed by the last of them.
+ */
+struct handoff {
+    pthread_mutex_t mutex;
+    int reference_count;
+    void *user_ctx;
+    void (*on_connection)(void *connection, void *user_ctx, int ecode,
+                          const struct sockaddr *peer_addr, socklen_t peer_addr_len);
+    /**
+     * Notified of the destroyed connections if it limits them, NULL once it is destroyed.
+     */
+    struct tcp_acceptor_ctx *acceptor;
+    enum CIO_HANDOFF_POLICY policy;
+    int next_worker;
+    int worker_count;
+    struct handoff_worker workers[];
+};
+
+/**
+ * Accepted socket on its way to the worker loop. Then kept as the connection on_destroy context.
+ */
+struct handoff_ctx {
+    struct handoff *handoff;
+    int worker;
+    int fd;
+    struct sockaddr_storage peer_addr;
+    socklen_t peer_addr_len;
+};
+
+static void on_resume_timer(void *ctx);
+
 void *cio_new_tcp_acceptor(void *event_loop, void *user_ctx)
 {
     struct tcp_acceptor_ctx *sctx;
@@ -28,13 +122,206 @@ void *cio_new_tcp_acceptor(void *event_loop, void *user_ctx)
         return NULL;
 
     memset(sctx, 0, sizeof(*sctx));
+    sctx->type = ACCEPTOR;
     sctx->event_loop = event_loop;
     sctx->user_ctx = user_ctx;
     sctx->fd = -1;
+    sctx->backlog = DEFAULT_BACKLOG;
+    sctx->accept_batch = DEFAULT_ACCEPT_BATCH;
+    sctx->reserve_fd = -1;
+
+    if (!(sctx->resume_timer = cio_event_loop_new_timer(event_loop, sctx, on_resume_timer))) {
+        free(sctx);
+        return NULL;
+    }
 
     return sctx;
 }
 
+static struct handoff *new_handoff(void **worker_loops, int worker_count,
+    enum CIO_HANDOFF_POLICY policy, void *user_ctx,
+    void (*on_connection)(void *connection, void *user_ctx, int ecode,
+                          const struct sockaddr *peer_addr, socklen_t peer_addr_len))
+{
+    struct handoff *handoff;
+    int i;
+
+    if (!(handoff = malloc(sizeof(*handoff) + worker_count * sizeof(handoff->workers[0]))))
+        return NULL;
+
+    if (pthread_mutex_init(&handoff->mutex, NULL)) {
+        free(handoff);
+        return NULL;
+    }
+
+    handoff->reference_count = 1;
+    handoff->user_ctx = user_ctx;
+    handoff->on_connection = on_connection;
+    handoff->acceptor = NULL;
+    handoff->policy = policy;
+    handoff->next_worker = 0;
+    handoff->worker_count = worker_count;
+    for (i = 0; i < worker_count; ++i) {
+        handoff->workers[i].event_loop = worker_loops[i];
+        handoff->workers[i].connections = 0;
+    }
+
+    return handoff;
+}
+
+/**
+ * Drops a reference, and the worker connection count if the connection went to 'worker' (-1 for
+ * the acceptor itself).
+ */
+static void release_handoff(struct handoff *handoff, int worker)
+{
+    int reference_count;
+
+    pthread_mutex_lock(&handoff->mutex);
+    if (worker != -1)
+        --handoff->workers[worker].connections;
+    reference_count = --handoff->reference_count;
+    pthread_mutex_unlock(&handoff->mutex);
+
+    if (reference_count == 0) {
+        pthread_mutex_destroy(&handoff->mutex);
+        free(handoff);
+    }
+}
+
+/**
+ * Takes a reference and counts the connection to the chosen worker right away, so that the
+ * connections still on their way are taken into account by the least connections policy.
+ */
+static int acquire_handoff_worker(struct handoff *handoff)
+{
+    int worker = 0;
+    int i;
+
+    pthread_mutex_lock(&handoff->mutex);
+    switch (handoff->policy) {
+        case CIO_HANDOFF_LEAST_CONNECTIONS:
+            for (i = 1; i < handoff->worker_count; ++i) {
+                if (handoff->workers[i].connections < handoff->workers[worker].connections)
+                    worker = i;
+            }
+            break;
+        case CIO_HANDOFF_ROUND_ROBIN:
+        default:
+            worker = handoff->next_worker;
+            handoff->next_worker = (worker + 1) % handoff->worker_count;
+            break;
+    }
+    ++handoff->workers[worker].connections;
+    ++handoff->reference_count;
+    pthread_mutex_unlock(&handoff->mutex);
+
+    return worker;
+}
+
+static void release_connection_impl(void *ctx);
+
+/**
+ * Runs on the acceptor loop, which is also where the acceptor is destroyed, so it is either still
+ * there or the pointer is NULL.
+ */
+static void release_handed_off_connection(void *ctx)
+{
+    struct handoff *handoff = ctx;
+    struct tcp_acceptor_ctx *acceptor;
+
+    pthread_mutex_lock(&handoff->mutex);
+    acceptor = handoff->acceptor;
+    pthread_mutex_unlock(&handoff->mutex);
+
+    if (acceptor)
+        release_connection_impl(acceptor);
+    release_handoff(handoff, -1);
+}
+
+static void on_handed_off_connection_destroy(void *ctx)
+{
+    struct handoff_ctx *handoff_ctx = ctx;
+    struct handoff *handoff = handoff_ctx->handoff;
+    void *acceptor_loop = NULL;
+
+    pthread_mutex_lock(&handoff->mutex);
+    if (handoff->acceptor) {
+        acceptor_loop = handoff->acceptor->event_loop;
+        ++handoff->reference_count;
+    }
+    pthread_mutex_unlock(&handoff->mutex);
+
+    if (acceptor_loop)
+        cio_event_loop_post(acceptor_loop, 0, handoff, release_handed_off_connection);
+    release_handoff(handoff, handoff_ctx->worker);
+    free(handoff_ctx);
+}
+
+/**
+ * Runs on the worker loop, so the connection is registered with it at once and the user gets it
+ * on the thread which is going to do its I/O.
+ */
+static void hand_off_impl(void *ctx)
+{
+    struct handoff_ctx *handoff_ctx = ctx;
+    struct handoff *handoff = handoff_ctx->handoff;
+    void *connection;
+
+    connection = cio_new_tcp_connection_connected_fd(
+        handoff->workers[handoff_ctx->worker].event_loop, handoff->user_ctx, handoff_ctx->fd);
+    if (!connection) {
+        close(handoff_ctx->fd);
+        handoff->on_connection(NULL, handoff->user_ctx, CIO_ALLOC_ERROR, NULL, 0);
+        on_handed_off_connection_destroy(handoff_ctx);
+        return;
+    }
+
+    cio_tcp_connection_set_on_destroy(connection, handoff_ctx, on_handed_off_connection_destroy);
+    handoff->on_connection(connection, handoff->user_ctx, CIO_NO_ERROR,
+                           (struct sockaddr *) &handoff_ctx->peer_addr,
+                           handoff_ctx->peer_addr_len);
+}
+
+static void report_error(struct tcp_acceptor_ctx *sctx, int ecode)
+{
+    if (sctx->handoff)
+        sctx->handoff->on_connection(NULL, sctx->user_ctx, ecode, NULL, 0);
+    else
+        sctx->on_accept(-1, sctx->user_ctx, ecode, NULL, 0);
+}
+
+static void hand_off(struct tcp_acceptor_ctx *sctx, int fd, const struct sockaddr *peer_addr,
+    socklen_t peer_addr_len)
+{
+    struct handoff_ctx *handoff_ctx;
+    int worker;
+
+    if (!(handoff_ctx = malloc(sizeof(*handoff_ctx)))) {
+        close(fd);
+        release_connection_impl(sctx);
+        report_error(sctx, CIO_ALLOC_ERROR);
+        return;
+    }
+
+    worker = acquire_handoff_worker(sctx->handoff);
+    handoff_ctx->handoff = sctx->handoff;
+    handoff_ctx->worker = worker;
+    handoff_ctx->fd = fd;
+    memcpy(&handoff_ctx->peer_addr, peer_addr, peer_addr_len);
+    handoff_ctx->peer_addr_len = peer_addr_len;
+    cio_event_loop_post(sctx->handoff->workers[worker].event_loop, 0, handoff_ctx,
+                        hand_off_impl);
+}
+
+static void free_acceptor_memory(struct tcp_acceptor_ctx *acceptor_ctx)
+{
+    if (acceptor_ctx->handoff)
+        release_handoff(acceptor_ctx->handoff, -1);
+    cio_event_loop_free_timer(acceptor_ctx->resume_timer);
+    free(acceptor_ctx);
+}
+
 static void free_tcp_acceptor_impl(void *ctx)
 {
     struct tcp_acceptor_ctx *acceptor_ctx = NULL;
@@ -57,12 +344,21 @@ static void free_tcp_acceptor_impl(void *ctx)
     
     cio_event_loop_remove_fd(acceptor_ctx->event_loop, acceptor_ctx->fd);
     close(acceptor_ctx->fd);
-    free(acceptor_ctx);
- 
-    pthread_mutex_lock(&completion_ctx->mutex);
-    if (type == COMPLETION)
+    if (acceptor_ctx->reserve_fd != -1)
+        close(acceptor_ctx->reserve_fd);
+    if (acceptor_ctx->handoff) {
+        pthread_mutex_lock(&acceptor_ctx->handoff->mutex);
+        acceptor_ctx->handoff->acceptor = NULL;
+        pthread_mutex_unlock(&acceptor_ctx->handoff->mutex);
+    }
+
+    free_acceptor_memory(acceptor_ctx);
+
+    if (type == COMPLETION) {
+        pthread_mutex_lock(&completion_ctx->mutex);
         pthread_cond_signal(&completion_ctx->cond);
-    pthread_mutex_unlock(&completion_ctx->mutex);
+        pthread_mutex_unlock(&completion_ctx->mutex);
+    }
 }
 
 void cio_free_tcp_acceptor_async(void *tcp_acceptor)
@@ -102,32 +398,280 @@ finally:
     free_completion_ctx(completion_ctx);
 }
 
+/**
+ * Accepts a non-blocking, close-on-exec socket, with one syscall where accept4() is available.
+ */
+static int accept_nonblocking(int fd, struct sockaddr *addr, socklen_t *addr_len)
+{
+    int new_fd;
+
+#if defined(__linux__)
+    new_fd = accept4(fd, addr, addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    if ((new_fd = accept(fd, addr, addr_len)) == -1)
+        return -1;
+
+    if (toggle_fd_nonblocking(new_fd, 1) || fcntl(new_fd, F_SETFD, FD_CLOEXEC) == -1) {
+        close(new_fd);
+        return -1;
+    }
+#endif
+
+    return new_fd;
+}
+
+static void open_reserve_fd(struct tcp_acceptor_ctx *sctx)
+{
+    sctx->reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * Out of fds, accept() fails but the connection stays in the listen queue and the level-triggered
+ * loop would spin on the readable listening socket. Gives up the reserve fd to accept the
+ * connection and close it at once, so that the peer doesn't hang. Returns 1 if a connection was
+ * dropped, 0 if the listen queue is empty (accept() fails with EMFILE regardless), -1 if there is
+ * no reserve fd left.
+ */
+static int shed_connection(struct tcp_acceptor_ctx *sctx)
+{
+    int fd;
+    int saved_errno;
+
+    if (sctx->reserve_fd == -1)
+        return -1;
+
+    close(sctx->reserve_fd);
+    if ((fd = accept(sctx->fd, NULL, NULL)) != -1)
+        close(fd);
+    saved_errno = errno;
+    open_reserve_fd(sctx);
+
+    return fd != -1 || (saved_errno != EWOULDBLOCK && saved_errno != EAGAIN);
+}
+
+static void pause_accepting(struct tcp_acceptor_ctx *sctx)
+{
+    if (sctx->paused)
+        return;
+
+    sctx->paused = 1;
+    cio_event_loop_modify_fd(sctx->event_loop, sctx->fd, 0);
+}
+
+static void resume_accepting(struct tcp_acceptor_ctx *sctx)
+{
+    if (!sctx->paused)
+        return;
+
+    sctx->paused = 0;
+    cio_event_loop_modify_fd(sctx->event_loop, sctx->fd, CIO_FLAG_IN);
+}
+
+/**
+ * The limits are checked again by the next readiness event.
+ */
+static void on_resume_timer(void *ctx)
+{
+    struct tcp_acceptor_ctx *sctx = ctx;
+
+    if (sctx->reserve_fd == -1)
+        open_reserve_fd(sctx);
+    resume_accepting(sctx);
+}
+
+static void pause_accepting_for(struct tcp_acceptor_ctx *sctx, int delay_ms)
+{
+    pause_accepting(sctx);
+    if (!cio_event_loop_timer_due(sctx->resume_timer))
+        cio_event_loop_arm_timer(sctx->resume_timer, delay_ms);
+}
+
+/**
+ * Pauses accepting if a limit is reached: until a connection is released or, for the accept rate,
+ * until the rate limiter has tokens again.
+ */
+static int check_limits(struct tcp_acceptor_ctx *sctx)
+{
+    long long now;
+
+    if (sctx->max_connections && sctx->connections >= sctx->max_connections) {
+        pause_accepting(sctx);
+        return 0;
+    }
+
+    if (sctx->rate_limiter && !cio_rate_limiter_allowance(sctx->rate_limiter, now = now_time_ms())) {
+        pause_accepting_for(sctx, cio_rate_limiter_delay_ms(sctx->rate_limiter, now));
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Resumes accepting paused by the connections limit. Pauses with the resume timer pending end
+ * with it.
+ */
+static void release_connection_impl(void *ctx)
+{
+    struct tcp_acceptor_ctx *sctx = ctx;
+
+    if (sctx->connections > 0)
+        --sctx->connections;
+    if (!cio_event_loop_timer_due(sctx->resume_timer))
+        resume_accepting(sctx);
+}
+
+/**
+ * Drains up to 'accept_batch' connections from the listen queue, so that a connection storm
+ * doesn't overflow the backlog between the readiness events.
+ */
 static void on_accept_impl(void *ctx, int fd, int flags)
 {
     struct tcp_acceptor_ctx *sctx = ctx;
+    struct sockaddr_storage peer_addr;
+    socklen_t peer_addr_len;
     int new_fd;
+    int ecode;
+    int shed;
+    int i;
 
     if (!(flags & CIO_FLAG_IN)) {
         printf("on_accept poll error: %d\n", flags);
-        sctx->on_accept(-1, sctx->user_ctx, flags);
+        report_error(sctx, CIO_POLL_ERROR);
         return;
     }
 
     assert(fd == sctx->fd);
-    new_fd = accept(fd, NULL, NULL);
+    for (i = 0; i < sctx->accept_batch && check_limits(sctx); ++i) {
+        peer_addr_len = sizeof(peer_addr);
+        if ((new_fd = accept_nonblocking(fd, (struct sockaddr *) &peer_addr,
+                                         &peer_addr_len)) == -1) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return;
+            /* The peer has gone before being accepted. */
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                if ((shed = shed_connection(sctx)) == 1) {
+                    report_error(sctx, CIO_ACCEPT_ERROR);
+                    continue;
+                }
+                if (shed == -1) {
+                    perror("on_accept: accept");
+                    pause_accepting_for(sctx, FD_SHORTAGE_PAUSE_MS);
+                }
+                return;
+            }
+            perror("on_accept: accept");
+            report_error(sctx, CIO_ACCEPT_ERROR);
+            return;
+        }
+
+        ++sctx->connections;
+        if (sctx->rate_limiter)
+            cio_rate_limiter_consume(sctx->rate_limiter, 0);
 
-    sctx->on_accept(new_fd, sctx->user_ctx, CIO_NO_ERROR);
+        if ((ecode = cio_socket_options_apply(new_fd, &sctx->options)))
+            cio_perror(ecode, "on_accept: cio_socket_options_apply");
+
+        if (sctx->handoff)
+            hand_off(sctx, new_fd, (struct sockaddr *) &peer_addr, peer_addr_len);
+        else
+            sctx->on_accept(new_fd, sctx->user_ctx, CIO_NO_ERROR,
+                            (struct sockaddr *) &peer_addr, peer_addr_len);
+    }
 }
 
-void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
-    void (*on_accept)(int fd, void *user_ctx, int ecode))
+void cio_tcp_acceptor_set_options(void *tcp_server, const struct cio_socket_options *options)
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->options = *options;
+}
+
+void cio_tcp_acceptor_set_backlog(void *tcp_server, int backlog)
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->backlog = backlog > 0 ? backlog : DEFAULT_BACKLOG;
+}
+
+void cio_tcp_acceptor_set_accept_batch(void *tcp_server, int accept_batch)
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->accept_batch = accept_batch > 0 ? accept_batch : DEFAULT_ACCEPT_BATCH;
+}
+
+void cio_tcp_acceptor_set_limits(void *tcp_server, int max_connections, void *rate_limiter)
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->max_connections = CIO_MAX(max_connections, 0);
+    sctx->rate_limiter = rate_limiter;
+}
+
+void cio_tcp_acceptor_release_connection(void *tcp_server)
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    cio_event_loop_dispatch(sctx->event_loop, sctx, release_connection_impl);
+}
+
+void cio_tcp_acceptor_set_reuse_port(void *tcp_server, int on, int cpu_steering)
 {
     struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->reuse_port = on;
+    sctx->cpu_steering = on ? CIO_MAX(cpu_steering, 0) : 0;
+}
+
+/**
+ * Lets the kernel pick the socket of the SO_REUSEPORT group by the CPU which received the SYN, so
+ * that the connection is handled on the same core (given the loop threads are pinned to the
+ * CPUs in the order the sockets were bound).
+ */
+static int attach_cpu_steering(struct tcp_acceptor_ctx *sctx)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, sctx->cpu_steering },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog program = { sizeof(code) / sizeof(code[0]), code };
+
+    if (setsockopt(sctx->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program))) {
+        perror("cio_acceptor_async_accept: SO_ATTACH_REUSEPORT_CBPF");
+        return CIO_SOCKET_OPTION_ERROR;
+    }
+
+    return CIO_NO_ERROR;
+#else
+    return CIO_NOT_FOUND_ERROR;
+#endif
+}
+
+/**
+ * Accepted sockets inherit the buffer sizes of the listening one, and only the sizes set before
+ * listen() take part in the window scale negotiation. Deferred accept and Fast Open are listening
+ * socket options, so they are dropped from the ones applied to the accepted sockets.
+ */
+static int apply_listen_options(struct tcp_acceptor_ctx *sctx)
+{
+    struct cio_socket_options listen_options = sctx->options;
+
+    listen_options.mask &= CIO_SO_SNDBUF | CIO_SO_RCVBUF | LISTEN_ONLY_OPTIONS;
+    sctx->options.mask &= ~LISTEN_ONLY_OPTIONS;
+    return cio_socket_options_apply(sctx->fd, &listen_options);
+}
+
+static void listen_impl(struct tcp_acceptor_ctx *sctx, const char *addr, int port)
+{
     void *resolver = NULL;
     struct addrinfo ainfo;
     int ecode;
 
-    sctx->on_accept = on_accept;
     resolver = cio_new_resolver(addr, port, AF_UNSPEC, SOCK_STREAM, CIO_SERVER);
     if (!resolver)
         goto fail;
@@ -141,14 +685,28 @@ void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
                 perror("cio_acceptor_async_accept: setsockopt");
                 goto fail;
             }
-            if (bind(sctx->fd, ainfo.ai_addr, sizeof(*ainfo.ai_addr))) {
+#if defined(SO_REUSEPORT)
+            if (sctx->reuse_port
+                    && setsockopt(sctx->fd, SOL_SOCKET, SO_REUSEPORT, &(int){ 1 }, sizeof(int))) {
+                perror("cio_acceptor_async_accept: SO_REUSEPORT");
+                goto fail;
+            }
+#endif
+            if ((ecode = apply_listen_options(sctx))) {
+                cio_perror(ecode, "cio_acceptor_async_accept: socket options");
+                goto fail;
+            }
+            if (bind(sctx->fd, ainfo.ai_addr, ainfo.ai_addrlen)) {
                 perror("cio_acceptor_async_accept: bind");
                 goto fail;
             }
-            if (listen(sctx->fd, 128)) {
+            if (listen(sctx->fd, sctx->backlog)) {
                 perror("cio_acceptor_async_accept: listen");
                 goto fail;
             }
+            /* Only an optimization, the kernel falls back to hashing. */
+            if (sctx->cpu_steering && (ecode = attach_cpu_steering(sctx)))
+                cio_perror(ecode, "cio_acceptor_async_accept: cpu steering");
             if (toggle_fd_nonblocking(sctx->fd, 1)) {
                 perror("cio_acceptor_async_accept: toggle non-blocking");
                 goto fail;
@@ -157,6 +715,7 @@ void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
                 cio_perror(ecode, "cio_acceptor_async_accept: cio_event_loop_add_fd");
                 goto fail;
             }
+            open_reserve_fd(sctx);
             cio_free_resolver(resolver);
             return;
         }
@@ -165,5 +724,38 @@ void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
 fail:
     cio_free_resolver(resolver);
     close(sctx->fd);
-    sctx->on_accept(-1, sctx->user_ctx, CIO_NOT_FOUND_ERROR);
+    report_error(sctx, CIO_NOT_FOUND_ERROR);
+}
+
+void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
+    void (*on_accept)(int fd, void *user_ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len))
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    sctx->on_accept = on_accept;
+    listen_impl(sctx, addr, port);
+}
+
+void cio_tcp_acceptor_async_accept_connections(void *tcp_server, const char *addr, int port,
+    void **worker_loops, int worker_count, enum CIO_HANDOFF_POLICY policy,
+    void (*on_connection)(void *connection, void *user_ctx, int ecode,
+                          const struct sockaddr *peer_addr, socklen_t peer_addr_len))
+{
+    struct tcp_acceptor_ctx *sctx = tcp_server;
+
+    if (worker_count <= 0) {
+        on_connection(NULL, sctx->user_ctx, CIO_INVALID_ARGUMENT_ERROR, NULL, 0);
+        return;
+    }
+
+    if (!(sctx->handoff = new_handoff(worker_loops, worker_count, policy, sctx->user_ctx,
+                                      on_connection))) {
+        on_connection(NULL, sctx->user_ctx, CIO_ALLOC_ERROR, NULL, 0);
+        return;
+    }
+    if (sctx->max_connections)
+        sctx->handoff->acceptor = sctx;
+
+    listen_impl(sctx, addr, port);
 }
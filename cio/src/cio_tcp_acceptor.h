@@ -1,6 +1,24 @@
 #if !defined(CIO_TCP_ACCEPTOR_H)
 #define CIO_TCP_ACCEPTOR_H
 
+#include "cio_socket_options.h"
+#include <sys/socket.h>
+
+/**
+ * How cio_tcp_acceptor_async_accept_connections() picks the worker loop for a connection.
+ */
+enum CIO_HANDOFF_POLICY {
+    /**
+     * The loops in turn.
+     */
+    CIO_HANDOFF_ROUND_ROBIN,
+    /**
+     * The loop with the fewest live connections handed off by the acceptor, the first one of
+     * equals.
+     */
+    CIO_HANDOFF_LEAST_CONNECTIONS
+};
+
 void *cio_new_tcp_acceptor(void *event_loop, void *user_ctx);
 
 /**
@@ -15,7 +33,71 @@ void cio_free_tcp_acceptor_async(void *tcp_server);
  */
 void cio_free_tcp_acceptor_sync(void *tcp_server);
 
+/**
+ * Default socket options (see cio_socket_options.h) applied to every accepted socket before it
+ * is passed to 'on_accept'. The listening socket options (CIO_SO_DEFER_ACCEPT, CIO_SO_FASTOPEN)
+ * are set before listen(). Must be called before cio_tcp_acceptor_async_accept().
+ */
+void cio_tcp_acceptor_set_options(void *tcp_server, const struct cio_socket_options *options);
+
+/**
+ * Length of the listen queue, 128 by default. Must be called before
+ * cio_tcp_acceptor_async_accept().
+ */
+void cio_tcp_acceptor_set_backlog(void *tcp_server, int backlog);
+
+/**
+ * How many pending connections are accepted at most per readiness event, 64 by default.
+ */
+void cio_tcp_acceptor_set_accept_batch(void *tcp_server, int accept_batch);
+
+/**
+ * Overload protection, must be called before accepting starts. When 'max_connections' (0 - no
+ * limit) connections are alive, or 'rate_limiter' (see cio_rate_limiter.h, NULL - none) runs out
+ * of ops tokens, the listening socket stops being polled and the new connections wait in the
+ * listen queue until the capacity frees up. The rate limiter may be shared, e.g. by the acceptors
+ * of a group, and must outlive the acceptor.
+ *
+ * Independently of the limits, when the process runs out of fds the pending connections are
+ * accepted with a reserve fd and closed at once, each reported as CIO_ACCEPT_ERROR.
+ */
+void cio_tcp_acceptor_set_limits(void *tcp_server, int max_connections, void *rate_limiter);
+
+/**
+ * Tells the acceptor limiting the connections that one of those passed to 'on_accept' is closed.
+ * Safe to call from any thread while the acceptor exists. The connections handed off by
+ * cio_tcp_acceptor_async_accept_connections() are released on their destruction.
+ */
+void cio_tcp_acceptor_release_connection(void *tcp_server);
+
+/**
+ * Sets SO_REUSEPORT on the listening socket, so that several acceptors, typically one per event
+ * loop (see cio_tcp_acceptor_group.h), listen on the same address and the kernel balances the
+ * connections between them. cpu_steering - number of the acceptors in the group, to pick the
+ * acceptor by the CPU which received the connection (Linux SO_ATTACH_REUSEPORT_CBPF), 0 - off.
+ * Must be called before cio_tcp_acceptor_async_accept().
+ */
+void cio_tcp_acceptor_set_reuse_port(void *tcp_server, int on, int cpu_steering);
+
+/**
+ * Calls 'on_accept' for every accepted connection with its non-blocking, close-on-exec socket
+ * and the peer address. On error 'fd' is -1 and 'peer_addr' is NULL.
+ */
 void cio_tcp_acceptor_async_accept(void *tcp_server, const char *addr, int port,
-    void (*on_accept)(int fd, void *user_ctx, int ecode));
+    void (*on_accept)(int fd, void *user_ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len));
+
+/**
+ * Accepts on the acceptor loop and hands every connection off to one of 'worker_loops' chosen by
+ * 'policy': the tcp_connection (see cio_tcp_connection.h) is created on that loop with the
+ * acceptor 'user_ctx' and 'on_connection' is called on that loop thread, typically to set the
+ * connection own context with cio_tcp_connection_set_user_ctx() and start the I/O. The connection
+ * is then owned by the user. On error 'connection' and 'peer_addr' are NULL. The worker loops
+ * must outlive the connections.
+ */
+void cio_tcp_acceptor_async_accept_connections(void *tcp_server, const char *addr, int port,
+    void **worker_loops, int worker_count, enum CIO_HANDOFF_POLICY policy,
+    void (*on_connection)(void *connection, void *user_ctx, int ecode,
+                          const struct sockaddr *peer_addr, socklen_t peer_addr_len));
 
 #endif /* CIO_TCP_ACCEPTOR_H */
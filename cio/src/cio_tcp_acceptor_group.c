@@ -0,0 +1,76 @@
+#include "cio_tcp_acceptor_group.h"
+#include "cio_tcp_acceptor.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct tcp_acceptor_group {
+    int count;
+    void *acceptors[];
+};
+
+void *cio_new_tcp_acceptor_group(void **event_loops, void **user_ctxs, int count)
+{
+    struct tcp_acceptor_group *group;
+    int i;
+
+    if (count <= 0)
+        return NULL;
+
+    if (!(group = malloc(sizeof(*group) + count * sizeof(group->acceptors[0]))))
+        return NULL;
+
+    memset(group->acceptors, 0, count * sizeof(group->acceptors[0]));
+    group->count = count;
+    for (i = 0; i < count; ++i) {
+        if (!(group->acceptors[i] = cio_new_tcp_acceptor(event_loops[i],
+                                                         user_ctxs ? user_ctxs[i] : NULL)))
+            goto fail;
+        cio_tcp_acceptor_set_reuse_port(group->acceptors[i], 1, 0);
+    }
+
+    return group;
+
+fail:
+    cio_free_tcp_acceptor_group_sync(group);
+    return NULL;
+}
+
+void cio_free_tcp_acceptor_group_sync(void *acceptor_group)
+{
+    struct tcp_acceptor_group *group = acceptor_group;
+    int i;
+
+    if (!group)
+        return;
+
+    for (i = 0; i < group->count; ++i)
+        cio_free_tcp_acceptor_sync(group->acceptors[i]);
+    free(group);
+}
+
+int cio_tcp_acceptor_group_size(void *acceptor_group)
+{
+    return ((struct tcp_acceptor_group *) acceptor_group)->count;
+}
+
+void *cio_tcp_acceptor_group_get(void *acceptor_group, int i)
+{
+    struct tcp_acceptor_group *group = acceptor_group;
+
+    return i >= 0 && i < group->count ? group->acceptors[i] : NULL;
+}
+
+void cio_tcp_acceptor_group_async_accept(void *acceptor_group, const char *addr, int port,
+    int cpu_steering, void (*on_accept)(int fd, void *user_ctx, int ecode,
+                                        const struct sockaddr *peer_addr,
+                                        socklen_t peer_addr_len))
+{
+    struct tcp_acceptor_group *group = acceptor_group;
+    int i;
+
+    /* The sockets join the SO_REUSEPORT group in this order, the steering relies on it. */
+    for (i = 0; i < group->count; ++i) {
+        cio_tcp_acceptor_set_reuse_port(group->acceptors[i], 1, cpu_steering ? group->count : 0);
+        cio_tcp_acceptor_async_accept(group->acceptors[i], addr, port, on_accept);
+    }
+}
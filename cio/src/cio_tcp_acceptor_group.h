@@ -0,0 +1,39 @@
+#if !defined(CIO_TCP_ACCEPTOR_GROUP_H)
+#define CIO_TCP_ACCEPTOR_GROUP_H
+
+#include <sys/socket.h>
+
+/**
+ * Sharded acceptor: one SO_REUSEPORT listening socket per event loop, so that the kernel spreads
+ * the connections across the loops without a shared accept queue. Connections are accepted on
+ * the loop of the acceptor the kernel picked, and 'on_accept' is called there with that
+ * acceptor's user context.
+ *
+ * user_ctxs - per loop contexts, NULL - all NULL.
+ */
+void *cio_new_tcp_acceptor_group(void **event_loops, void **user_ctxs, int count);
+
+/**
+ * Synchronous destruction, NOT for use from any of the loop threads.
+ */
+void cio_free_tcp_acceptor_group_sync(void *acceptor_group);
+
+int cio_tcp_acceptor_group_size(void *acceptor_group);
+
+/**
+ * Acceptor of the i-th loop, for setting its options (see cio_tcp_acceptor.h) before
+ * cio_tcp_acceptor_group_async_accept().
+ */
+void *cio_tcp_acceptor_group_get(void *acceptor_group, int i);
+
+/**
+ * cpu_steering - pick the acceptor by the CPU which received the connection (see
+ * cio_tcp_acceptor_set_reuse_port()). The i-th loop thread should be pinned to the i-th CPU
+ * then.
+ */
+void cio_tcp_acceptor_group_async_accept(void *acceptor_group, const char *addr, int port,
+    int cpu_steering, void (*on_accept)(int fd, void *user_ctx, int ecode,
+                                        const struct sockaddr *peer_addr,
+                                        socklen_t peer_addr_len));
+
+#endif /* CIO_TCP_ACCEPTOR_GROUP_H */
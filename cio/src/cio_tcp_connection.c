@@ -1,7 +1,15 @@
 #include "cio_tcp_connection.h"
 #include "cio_event_loop.h"
 #include "cio_resolver.h"
+#include "cio_dns_resolver.h"
+#include "cio_endpoint_selector.h"
+#include "cio_scan.h"
+#include "cio_ring_buffer.h"
+#include "cio_buffer_pool.h"
+#include "cio_socket_options.h"
+#include "cio_rate_limiter.h"
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -9,6 +17,14 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/poll.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#if defined(__linux__)
+#include <linux/sockios.h>
+#endif
 
 enum connection_state {
     CIO_CS_INITIAL,
@@ -29,12 +45,141 @@ struct tcp_connection_ctx {
     int fd;
     int reference_count;
     enum connection_state cstate;
+    /**
+     * Bytes received from the socket but not yet consumed by the user: read-ahead data and the
+     * ones following the delimiter in the delimited read. Created on demand.
+     */
+    void *read_buffer;
+    int read_ahead;
+    /**
+     * Pending readiness waits. Kept here instead of separate contexts so that a waiting
+     * connection holds no extra memory.
+     */
+    void (*on_readable)(void *ctx, int ecode);
+    void (*on_writable)(void *ctx, int ecode);
+    /**
+     * Flags the fd is currently polled for. Only the directions with pending operations are.
+     */
+    int interest;
+    /**
+     * Applied to the connected fd and to every socket created while connecting.
+     */
+    struct cio_socket_options options;
+    /**
+     * Timeouts in ms, 0 - none. The deadlines are absolute times of the pending operations, the
+     * idle one is derived from 'last_activity'.
+     */
+    int connect_timeout_ms;
+    int read_timeout_ms;
+    int write_timeout_ms;
+    int idle_timeout_ms;
+    long long read_deadline;
+    long long write_deadline;
+    long long last_activity;
+    /**
+     * Armed for the nearest deadline, when it fires, it checks the deadlines and re-arms itself for
+     * the next one. Cancelled once the connection is destroyed.
+     */
+    void *deadline_timer;
+    /**
+     * Happy Eyeballs (RFC 8305) attempt delay, 0 - endpoints are tried one after another.
+     */
+    int attempt_delay_ms;
+    /**
+     * Stub resolver the connects use (see cio_dns_resolver.h), NULL - the getaddrinfo() threads.
+     */
+    void *dns_resolver;
+    /**
+     * Orders the resolved endpoints and gets the connect attempts reported, NULL - none.
+     */
+    void *endpoint_selector;
+    /**
+     * Queued writes are the list starting at 'write_ctx', only the head one is being written.
+     * 'queued_bytes' - not yet written bytes of all of them.
+     */
+    struct write_ctx *write_queue_tail;
+    int queued_bytes;
+    /**
+     * Write backpressure, 0 watermark - off, 0 limit - none. 'above_high_watermark' is set from
+     * the 'on_high_watermark' call till the 'on_drain' one.
+     */
+    int low_watermark;
+    int high_watermark;
+    int above_high_watermark;
+    void (*on_high_watermark)(void *ctx, int queued_bytes);
+    void (*on_drain)(void *ctx, int queued_bytes);
+    int write_limit;
+    enum CIO_WRITE_LIMIT_POLICY write_limit_policy;
+    /**
+     * Rate limiters (see cio_rate_limiter.h), NULL - none. While a direction is out of tokens, its
+     * resume time is set, it isn't polled for and the deadline timer resumes it.
+     */
+    void *read_limiter;
+    void *write_limiter;
+    long long read_resume_time;
+    long long write_resume_time;
+    /**
+     * Counters are updated on the loop thread only. 'write_pending_since' - when the write queue
+     * became non-empty, 0 - it is empty.
+     */
+    struct cio_tcp_connection_stats stats;
+    long long write_pending_since;
+    /**
+     * Called once the connection is destroyed, see cio_tcp_connection_set_on_destroy().
+     */
+    void *destroy_ctx;
+    void (*on_destroy)(void *ctx);
+};
+
+/**
+ * Socket connecting to one of the resolved endpoints.
+ */
+struct connect_attempt {
+    int fd;
+    long long deadline;
+    /**
+     * Bytes of the connect data sent with the SYN.
+     */
+    int sent;
+    /**
+     * For the endpoint selector.
+     */
+    long long started;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    struct connect_attempt *next;
 };
 
 struct connect_ctx {
     struct tcp_connection_ctx *tcp_connection;
     void (*on_connect)(void *ctx, int ecode);
     void *resolver;
+    /**
+     * Attempts in flight. More than one only in the Happy Eyeballs mode, where the next attempt is
+     * started at 'next_attempt_time' even if the previous ones haven't completed yet.
+     */
+    struct connect_attempt *attempts;
+    long long next_attempt_time;
+    /**
+     * Whether the last failed attempt was abandoned because of the connect timeout.
+     */
+    int timed_out;
+    /**
+     * Data to send on connecting (see cio_tcp_connection_async_connect_send()), 'sent' - the part
+     * of it the winning attempt sent with the SYN.
+     */
+    const char *data;
+    int len;
+    int sent;
+    /**
+     * A numeric address is connected to right away, 'numeric' set until its endpoint is tried.
+     * Other addresses are resolved off the loop thread once the connect starts.
+     */
+    struct sockaddr_storage numeric_addr;
+    struct addrinfo numeric_endpoint;
+    int numeric;
+    int port;
+    char addr[];
 };
 
 struct write_ctx {
@@ -43,17 +188,34 @@ struct write_ctx {
     const void *data;
     int len;
     int written;
+    struct write_ctx *next;
 };
 
 struct read_ctx {
     struct tcp_connection_ctx *tcp_connection;
     void (*on_read)(void *ctx, int ecode, int read_bytes);
+    void (*on_read_pooled)(void *ctx, int ecode, void *buffer, int read_bytes);
+    /**
+     * If set, 'data' is taken from the pool only for the time of the actual read. While the pool
+     * has none to give, 'waiting_for_buffer' is set and the read is retried by the deadline timer.
+     */
+    void *buffer_pool;
+    int waiting_for_buffer;
     void *data;
     int len;
     int read;
+    int delim_len;
+    char delim[];
 };
 
+/**
+ * How soon a read waiting for a pooled buffer tries again.
+ */
+static const int BUFFER_RETRY_MS = 5;
+
 static void event_loop_cb(void *ctx, int fd, int flags);
+static void connect_ctx_close_attempts(struct connect_ctx *connect_ctx);
+static void on_deadline_timer(void *ctx);
 
 static void *new_tcp_connection_impl(void *event_loop, void *ctx, int fd)
 {
@@ -64,6 +226,11 @@ static void *new_tcp_connection_impl(void *event_loop, void *ctx, int fd)
     if (!tctx)
         goto fail;
 
+    if (!(tctx->deadline_timer = cio_event_loop_new_timer(event_loop, tctx, on_deadline_timer))) {
+        cio_ecode = CIO_ALLOC_ERROR;
+        goto fail;
+    }
+
     tctx->type = CONNECTION;
     tctx->event_loop = event_loop;
     tctx->user_ctx = ctx;
@@ -71,6 +238,39 @@ static void *new_tcp_connection_impl(void *event_loop, void *ctx, int fd)
     tctx->read_ctx = NULL;
     tctx->connect_ctx = NULL;
     tctx->reference_count = 1;
+    tctx->read_buffer = NULL;
+    tctx->read_ahead = 0;
+    tctx->on_readable = NULL;
+    tctx->on_writable = NULL;
+    tctx->interest = 0;
+    memset(&tctx->options, 0, sizeof(tctx->options));
+    tctx->connect_timeout_ms = 0;
+    tctx->read_timeout_ms = 0;
+    tctx->write_timeout_ms = 0;
+    tctx->idle_timeout_ms = 0;
+    tctx->read_deadline = 0;
+    tctx->write_deadline = 0;
+    tctx->last_activity = 0;
+    tctx->attempt_delay_ms = 0;
+    tctx->dns_resolver = NULL;
+    tctx->endpoint_selector = NULL;
+    tctx->write_queue_tail = NULL;
+    tctx->queued_bytes = 0;
+    tctx->low_watermark = 0;
+    tctx->high_watermark = 0;
+    tctx->above_high_watermark = 0;
+    tctx->on_high_watermark = NULL;
+    tctx->on_drain = NULL;
+    tctx->write_limit = 0;
+    tctx->write_limit_policy = CIO_WLP_FAIL_WRITE;
+    tctx->read_limiter = NULL;
+    tctx->write_limiter = NULL;
+    tctx->read_resume_time = 0;
+    tctx->write_resume_time = 0;
+    memset(&tctx->stats, 0, sizeof(tctx->stats));
+    tctx->write_pending_since = 0;
+    tctx->destroy_ctx = NULL;
+    tctx->on_destroy = NULL;
 
     if (fd == -1) {
         tctx->fd = -1;
@@ -79,8 +279,9 @@ static void *new_tcp_connection_impl(void *event_loop, void *ctx, int fd)
         toggle_fd_nonblocking(fd, 1);
         tctx->fd = fd;
         tctx->cstate = CIO_CS_CONNECTED;
-        if ((cio_ecode = cio_event_loop_add_fd(tctx->event_loop, fd, CIO_FLAG_OUT | CIO_FLAG_IN,
-                                               tctx, event_loop_cb))) {
+        tctx->last_activity = now_time_ms();
+        if ((cio_ecode = cio_event_loop_add_fd(tctx->event_loop, fd, tctx->interest, tctx,
+                                               event_loop_cb))) {
             goto fail;
         }
     }
@@ -93,6 +294,8 @@ fail:
     else
         perror("cio_new_tcp_connection");
 
+    if (tctx)
+        cio_event_loop_free_timer(tctx->deadline_timer);
     free(tctx);
     return NULL;
 }
@@ -107,6 +310,18 @@ void *cio_new_tcp_connection_connected_fd(void *event_loop, void *ctx, int fd)
     return new_tcp_connection_impl(event_loop, ctx, fd);
 }
 
+/**
+ * Drops a reference, the last one frees the connection. Never allocates.
+ */
+static void release_tcp_connection(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    if (--tcp_connection_ctx->reference_count == 0) {
+        cio_event_loop_free_timer(tcp_connection_ctx->deadline_timer);
+        cio_free_ring_buffer(tcp_connection_ctx->read_buffer);
+        free(tcp_connection_ctx);
+    }
+}
+
 static void free_tcp_connection_impl(void *ctx)
 {
     struct free_connection_ctx *free_connection_ctx = ctx;
@@ -129,12 +344,18 @@ static void free_tcp_connection_impl(void *ctx)
     }
 
     if (free_connection_ctx->do_destroy) {
+        if (connection_ctx->connect_ctx)
+            connect_ctx_close_attempts(connection_ctx->connect_ctx);
+        cio_event_loop_cancel_timer(connection_ctx->deadline_timer);
         cio_event_loop_remove_fd(connection_ctx->event_loop, connection_ctx->fd);
         close(connection_ctx->fd);
+        connection_ctx->fd = -1;
+        connection_ctx->cstate = CIO_CS_DESTROYED;
+        if (connection_ctx->on_destroy)
+            connection_ctx->on_destroy(connection_ctx->destroy_ctx);
     }
 
-    if (--connection_ctx->reference_count == 0)
-        free(connection_ctx);
+    release_tcp_connection(connection_ctx);
 
     if (type == COMPLETION) {
         pthread_mutex_lock(&completion_ctx->mutex);
@@ -191,69 +412,371 @@ finally:
     free_completion_ctx(completion_ctx);
 }
 
-static void connect_ctx_try_next(struct connect_ctx *tctx);
+static void connect_ctx_start_next(struct connect_ctx *connect_ctx);
+static void connect_ctx_check_deadlines(struct connect_ctx *connect_ctx, long long now);
+static long long connect_ctx_deadline(struct connect_ctx *connect_ctx);
 static void free_connect_ctx(struct connect_ctx *cctx);
 static void write_ctx_cleanup(struct write_ctx *write_ctx, int cio_error);
-static void do_write(struct write_ctx *write_ctx);
+static void fail_queued_writes(struct tcp_connection_ctx *tcp_connection_ctx, int cio_error);
+static void do_write(struct tcp_connection_ctx *tcp_connection_ctx);
 static void do_read(struct read_ctx *read_ctx);
+static void read_ctx_cleanup(struct read_ctx *read_ctx, int cio_error);
+static void clean_all_contexts(struct tcp_connection_ctx *tcp_connection_ctx,
+                               enum CIO_ERROR cio_error);
+static void update_interest(struct tcp_connection_ctx *tcp_connection_ctx);
+static void arm_deadline_timer(struct tcp_connection_ctx *tcp_connection_ctx);
+
+static void update_interest(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    int interest = 0;
+
+    if (tcp_connection_ctx->fd == -1 || tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return;
+
+    switch (tcp_connection_ctx->cstate) {
+        case CIO_CS_CONNECTING:
+            interest = CIO_FLAG_OUT;
+            break;
+        case CIO_CS_CONNECTED:
+        case CIO_CS_ERROR:
+            if ((tcp_connection_ctx->read_ctx && !tcp_connection_ctx->read_resume_time)
+                    || tcp_connection_ctx->on_readable)
+                interest |= CIO_FLAG_IN;
+            if ((tcp_connection_ctx->write_ctx && !tcp_connection_ctx->write_resume_time)
+                    || tcp_connection_ctx->on_writable
+                    || (tcp_connection_ctx->above_high_watermark && !tcp_connection_ctx->write_ctx))
+                interest |= CIO_FLAG_OUT;
+            break;
+        default:
+            break;
+    }
+
+    if (interest != tcp_connection_ctx->interest) {
+        cio_event_loop_modify_fd(tcp_connection_ctx->event_loop, tcp_connection_ctx->fd,
+                                 interest);
+        tcp_connection_ctx->interest = interest;
+    }
+}
+
+static long long deadline_after(int timeout_ms)
+{
+    return timeout_ms > 0 ? now_time_ms() + timeout_ms : 0;
+}
+
+static void touch_tcp_connection(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    tcp_connection_ctx->last_activity = now_time_ms();
+}
+
+/**
+ * The idle timeout only runs while any of these is pending.
+ */
+static int has_pending_operations(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    return tcp_connection_ctx->read_ctx || tcp_connection_ctx->write_ctx
+        || tcp_connection_ctx->on_readable || tcp_connection_ctx->on_writable;
+}
+
+/**
+ * Called before an operation is made pending: the first one restarts the idle time.
+ */
+static void begin_operation(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    if (!has_pending_operations(tcp_connection_ctx))
+        touch_tcp_connection(tcp_connection_ctx);
+}
+
+static void account_read(struct tcp_connection_ctx *tcp_connection_ctx, int result)
+{
+    tcp_connection_ctx->stats.read_calls++;
+    if (result > 0)
+        tcp_connection_ctx->stats.bytes_read += result;
+    else if (result < 0 && errno == EWOULDBLOCK)
+        tcp_connection_ctx->stats.read_would_block++;
+}
+
+static void account_write(struct tcp_connection_ctx *tcp_connection_ctx, int result)
+{
+    tcp_connection_ctx->stats.write_calls++;
+    if (result > 0)
+        tcp_connection_ctx->stats.bytes_written += result;
+    else if (result < 0 && errno == EWOULDBLOCK)
+        tcp_connection_ctx->stats.write_would_block++;
+}
+
+static long long nearest_deadline(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    long long deadlines[6];
+    long long nearest = 0;
+    int i;
+
+    deadlines[0] = tcp_connection_ctx->connect_ctx
+        ? connect_ctx_deadline(tcp_connection_ctx->connect_ctx) : 0;
+    deadlines[1] = tcp_connection_ctx->read_ctx ? tcp_connection_ctx->read_deadline : 0;
+    deadlines[2] = tcp_connection_ctx->write_ctx ? tcp_connection_ctx->write_deadline : 0;
+    deadlines[3] = tcp_connection_ctx->idle_timeout_ms > 0
+                   && tcp_connection_ctx->cstate == CIO_CS_CONNECTED
+                   && has_pending_operations(tcp_connection_ctx)
+        ? tcp_connection_ctx->last_activity + tcp_connection_ctx->idle_timeout_ms : 0;
+    deadlines[4] = tcp_connection_ctx->read_ctx ? tcp_connection_ctx->read_resume_time : 0;
+    deadlines[5] = tcp_connection_ctx->write_ctx ? tcp_connection_ctx->write_resume_time : 0;
+
+    for (i = 0; i < 6; ++i) {
+        if (deadlines[i] && (!nearest || deadlines[i] < nearest))
+            nearest = deadlines[i];
+    }
+
+    return nearest;
+}
+
+static void check_deadlines(struct tcp_connection_ctx *tcp_connection_ctx, long long now)
+{
+    struct read_ctx *read_ctx;
+
+    if (tcp_connection_ctx->connect_ctx)
+        return connect_ctx_check_deadlines(tcp_connection_ctx->connect_ctx, now);
+
+    if (tcp_connection_ctx->write_ctx && tcp_connection_ctx->write_deadline
+            && tcp_connection_ctx->write_deadline <= now)
+        fail_queued_writes(tcp_connection_ctx, CIO_TIMEOUT_ERROR);
+    read_ctx = tcp_connection_ctx->read_ctx;
+    if (read_ctx && tcp_connection_ctx->read_deadline && tcp_connection_ctx->read_deadline <= now)
+        read_ctx_cleanup(read_ctx, read_ctx->waiting_for_buffer
+                                   ? CIO_BUFFER_POOL_EXHAUSTED_ERROR : CIO_TIMEOUT_ERROR);
+
+    if (tcp_connection_ctx->idle_timeout_ms > 0 && tcp_connection_ctx->cstate == CIO_CS_CONNECTED
+            && has_pending_operations(tcp_connection_ctx)
+            && tcp_connection_ctx->last_activity + tcp_connection_ctx->idle_timeout_ms <= now) {
+        tcp_connection_ctx->cstate = CIO_CS_ERROR;
+        clean_all_contexts(tcp_connection_ctx, CIO_TIMEOUT_ERROR);
+        update_interest(tcp_connection_ctx);
+    }
+
+    if (tcp_connection_ctx->write_resume_time && tcp_connection_ctx->write_resume_time <= now) {
+        tcp_connection_ctx->write_resume_time = 0;
+        update_interest(tcp_connection_ctx);
+        if (tcp_connection_ctx->write_ctx)
+            do_write(tcp_connection_ctx);
+    }
+    if (tcp_connection_ctx->read_resume_time && tcp_connection_ctx->read_resume_time <= now) {
+        tcp_connection_ctx->read_resume_time = 0;
+        update_interest(tcp_connection_ctx);
+        if (tcp_connection_ctx->read_ctx)
+            do_read(tcp_connection_ctx->read_ctx);
+    }
+}
+
+/**
+ * Bytes the rate limiter of the 'flag' direction lets through one I/O call now, INT_MAX without
+ * the limiter. When the tokens have run out, the direction is throttled till they are refilled.
+ */
+static int rate_limit_allowance(struct tcp_connection_ctx *tcp_connection_ctx, int flag)
+{
+    void *limiter;
+    long long *resume_time;
+    long long now;
+    int allowance;
+
+    if (flag == CIO_FLAG_IN) {
+        limiter = tcp_connection_ctx->read_limiter;
+        resume_time = &tcp_connection_ctx->read_resume_time;
+    } else {
+        limiter = tcp_connection_ctx->write_limiter;
+        resume_time = &tcp_connection_ctx->write_resume_time;
+    }
+
+    if (!limiter)
+        return INT_MAX;
+    if (*resume_time)
+        return 0;
+
+    now = now_time_ms();
+    if ((allowance = cio_rate_limiter_allowance(limiter, now)) > 0)
+        return allowance;
+
+    *resume_time = now + CIO_MAX(cio_rate_limiter_delay_ms(limiter, now), 1);
+    update_interest(tcp_connection_ctx);
+    arm_deadline_timer(tcp_connection_ctx);
+    return 0;
+}
+
+static void rate_limit_consume(struct tcp_connection_ctx *tcp_connection_ctx, int flag, int bytes)
+{
+    void *limiter = flag == CIO_FLAG_IN ? tcp_connection_ctx->read_limiter
+                                        : tcp_connection_ctx->write_limiter;
+
+    if (limiter)
+        cio_rate_limiter_consume(limiter, bytes);
+}
+
+static void on_deadline_timer(void *ctx)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = ctx;
+
+    check_deadlines(tcp_connection_ctx, now_time_ms());
+    arm_deadline_timer(tcp_connection_ctx);
+}
+
+static void arm_deadline_timer(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    long long due;
+
+    if (tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return;
+
+    if (!(due = nearest_deadline(tcp_connection_ctx)))
+        cio_event_loop_cancel_timer(tcp_connection_ctx->deadline_timer);
+    else if (due != cio_event_loop_timer_due(tcp_connection_ctx->deadline_timer))
+        cio_event_loop_arm_timer(tcp_connection_ctx->deadline_timer,
+                                 (int) CIO_MAX(due - now_time_ms(), 0));
+}
+
+struct write_ctx *new_write_ctx(struct tcp_connection_ctx *tcp_connection,
+    void (*on_write)(void *, int), const void *data, int len);
+static void async_write_impl(void *ctx);
+
+/**
+ * The connect data not sent with the SYN is written as the first write, which completes the
+ * connect.
+ */
+static int write_connect_data(struct connect_ctx *connect_ctx)
+{
+    struct write_ctx *write_ctx;
+
+    if (!(write_ctx = new_write_ctx(connect_ctx->tcp_connection, connect_ctx->on_connect,
+                                    connect_ctx->data + connect_ctx->sent,
+                                    connect_ctx->len - connect_ctx->sent)))
+        return CIO_ALLOC_ERROR;
+
+    async_write_impl(write_ctx);
+    return CIO_NO_ERROR;
+}
 
 static void connect_ctx_cleanup(struct connect_ctx *connect_ctx, int cio_error)
 {
     struct tcp_connection_ctx *tcp_connection_ctx = connect_ctx->tcp_connection;
-    struct free_connection_ctx *free_connection_ctx;
 
-    if (cio_error == CIO_NO_ERROR)
-        tcp_connection_ctx->cstate = CIO_CS_CONNECTED;
-    else if (cio_error != CIO_ALREADY_DESTROYED_ERROR)
-        tcp_connection_ctx->cstate = CIO_CS_ERROR;
+    connect_ctx_close_attempts(connect_ctx);
+    if (tcp_connection_ctx->connect_ctx == connect_ctx) {
+        tcp_connection_ctx->connect_ctx = NULL;
+        if (cio_error == CIO_NO_ERROR)
+            tcp_connection_ctx->cstate = CIO_CS_CONNECTED;
+        else if (cio_error != CIO_ALREADY_DESTROYED_ERROR)
+            tcp_connection_ctx->cstate = CIO_CS_ERROR;
+    }
 
-    free_connection_ctx = malloc(sizeof(*free_connection_ctx));
-    assert(free_connection_ctx);
-    free_connection_ctx->do_destroy = 0;
-    free_connection_ctx->wrapped_ctx = tcp_connection_ctx;
-    free_tcp_connection_impl(free_connection_ctx);
+    if (cio_error == CIO_NO_ERROR) {
+        touch_tcp_connection(tcp_connection_ctx);
+        arm_deadline_timer(tcp_connection_ctx);
+    }
 
-    connect_ctx->on_connect(tcp_connection_ctx->user_ctx, cio_error);
+    if (cio_error != CIO_NO_ERROR || connect_ctx->sent == connect_ctx->len
+            || (cio_error = write_connect_data(connect_ctx)))
+        connect_ctx->on_connect(tcp_connection_ctx->user_ctx, cio_error);
     free_connect_ctx(connect_ctx);
-    tcp_connection_ctx->connect_ctx = NULL;
+    update_interest(tcp_connection_ctx);
+    release_tcp_connection(tcp_connection_ctx);
 }
 
 static void write_ctx_cleanup(struct write_ctx *write_ctx, int cio_error)
 {
     struct tcp_connection_ctx *tcp_connection_ctx = write_ctx->tcp_connection;
-    struct free_connection_ctx *free_connection_ctx;
 
-    if (cio_error != CIO_ALREADY_DESTROYED_ERROR && cio_error != CIO_NO_ERROR)
-        tcp_connection_ctx->cstate = CIO_CS_ERROR;
+    if (tcp_connection_ctx->write_ctx == write_ctx) {
+        tcp_connection_ctx->queued_bytes -= write_ctx->len - write_ctx->written;
+        if (!(tcp_connection_ctx->write_ctx = write_ctx->next)) {
+            tcp_connection_ctx->write_queue_tail = NULL;
+            tcp_connection_ctx->stats.write_pending_ms +=
+                now_time_ms() - tcp_connection_ctx->write_pending_since;
+            tcp_connection_ctx->write_pending_since = 0;
+        }
+        if (cio_error != CIO_ALREADY_DESTROYED_ERROR && cio_error != CIO_NO_ERROR)
+            tcp_connection_ctx->cstate = CIO_CS_ERROR;
+        /* The write timeout counts from the moment the write gets to the head of the queue. */
+        tcp_connection_ctx->write_deadline = tcp_connection_ctx->write_ctx
+            ? deadline_after(tcp_connection_ctx->write_timeout_ms) : 0;
+        if (tcp_connection_ctx->write_deadline)
+            arm_deadline_timer(tcp_connection_ctx);
+    }
 
-    free_connection_ctx = malloc(sizeof(*free_connection_ctx));
-    assert(free_connection_ctx);
-    free_connection_ctx->do_destroy = 0;
-    free_connection_ctx->wrapped_ctx = tcp_connection_ctx;
-    free_tcp_connection_impl(free_connection_ctx);
+    if (cio_error == CIO_NO_ERROR)
+        tcp_connection_ctx->stats.writes_completed++;
 
     write_ctx->on_write(tcp_connection_ctx->user_ctx, cio_error);
     free(write_ctx);
-    tcp_connection_ctx->write_ctx = NULL;
+    update_interest(tcp_connection_ctx);
+    release_tcp_connection(tcp_connection_ctx);
+}
+
+/**
+ * Fails the write in progress and all the queued after it.
+ */
+static void fail_queued_writes(struct tcp_connection_ctx *tcp_connection_ctx, int cio_error)
+{
+    tcp_connection_ctx->above_high_watermark = 0;
+    while (tcp_connection_ctx->write_ctx)
+        write_ctx_cleanup(tcp_connection_ctx->write_ctx, cio_error);
 }
 
 static void read_ctx_cleanup(struct read_ctx *read_ctx, int cio_error)
 {
     struct tcp_connection_ctx *tcp_connection_ctx = read_ctx->tcp_connection;
-    struct free_connection_ctx *free_connection_ctx;
-
-    if (cio_error != CIO_ALREADY_DESTROYED_ERROR && cio_error != CIO_NO_ERROR)
-        tcp_connection_ctx->cstate = CIO_CS_ERROR;
 
-    free_connection_ctx = malloc(sizeof(*free_connection_ctx));
-    assert(free_connection_ctx);
-    free_connection_ctx->do_destroy = 0;
-    free_connection_ctx->wrapped_ctx = tcp_connection_ctx;
-    free_tcp_connection_impl(free_connection_ctx);
+    if (tcp_connection_ctx->read_ctx == read_ctx) {
+        tcp_connection_ctx->read_ctx = NULL;
+        tcp_connection_ctx->read_deadline = 0;
+        if (read_ctx->waiting_for_buffer)
+            tcp_connection_ctx->read_resume_time = 0;
+        /* Nothing has been read from the socket while waiting for a buffer. */
+        if (cio_error != CIO_ALREADY_DESTROYED_ERROR && cio_error != CIO_NO_ERROR
+                && cio_error != CIO_BUFFER_POOL_EXHAUSTED_ERROR)
+            tcp_connection_ctx->cstate = CIO_CS_ERROR;
+    }
 
-    read_ctx->on_read(tcp_connection_ctx->user_ctx, cio_error, read_ctx->read);
+    if (cio_error == CIO_NO_ERROR && read_ctx->read > 0)
+        touch_tcp_connection(tcp_connection_ctx);
+    if (cio_error == CIO_NO_ERROR)
+        tcp_connection_ctx->stats.reads_completed++;
+
+    /* The kernel drops out of the quick ack mode on its own, so it is re-armed after each read. */
+    if (cio_error == CIO_NO_ERROR && tcp_connection_ctx->options.quick_ack
+            && (tcp_connection_ctx->options.mask & CIO_SO_QUICKACK))
+        cio_socket_options_apply_some(tcp_connection_ctx->fd, &tcp_connection_ctx->options,
+                                      CIO_SO_QUICKACK);
+
+    if (read_ctx->buffer_pool) {
+        if (read_ctx->read == 0) {
+            cio_buffer_pool_put(read_ctx->buffer_pool, read_ctx->data);
+            read_ctx->data = NULL;
+        }
+        read_ctx->on_read_pooled(tcp_connection_ctx->user_ctx, cio_error, read_ctx->data,
+                                 read_ctx->read);
+    } else {
+        read_ctx->on_read(tcp_connection_ctx->user_ctx, cio_error, read_ctx->read);
+    }
     free(read_ctx);
-    tcp_connection_ctx->read_ctx = NULL;
+    update_interest(tcp_connection_ctx);
+    release_tcp_connection(tcp_connection_ctx);
+}
+
+/**
+ * flag - CIO_FLAG_IN for the readable wait, CIO_FLAG_OUT for the writable one.
+ */
+static void wait_cleanup(struct tcp_connection_ctx *tcp_connection_ctx, int flag, int cio_error)
+{
+    void (*on_ready)(void *ctx, int ecode);
+
+    if (flag == CIO_FLAG_IN) {
+        on_ready = tcp_connection_ctx->on_readable;
+        tcp_connection_ctx->on_readable = NULL;
+    } else {
+        on_ready = tcp_connection_ctx->on_writable;
+        tcp_connection_ctx->on_writable = NULL;
+    }
+
+    on_ready(tcp_connection_ctx->user_ctx, cio_error);
+    update_interest(tcp_connection_ctx);
+    release_tcp_connection(tcp_connection_ctx);
 }
 
 static void clean_all_contexts(struct tcp_connection_ctx *tcp_connection_ctx,
@@ -262,11 +785,43 @@ static void clean_all_contexts(struct tcp_connection_ctx *tcp_connection_ctx,
     if (tcp_connection_ctx->connect_ctx)
         connect_ctx_cleanup(tcp_connection_ctx->connect_ctx, cio_error);
     if (tcp_connection_ctx->write_ctx)
-        write_ctx_cleanup(tcp_connection_ctx->write_ctx, cio_error);
-    if (tcp_connection_ctx->connect_ctx)
+        fail_queued_writes(tcp_connection_ctx, cio_error);
+    if (tcp_connection_ctx->read_ctx)
         read_ctx_cleanup(tcp_connection_ctx->read_ctx, cio_error);
+    if (tcp_connection_ctx->on_writable)
+        wait_cleanup(tcp_connection_ctx, CIO_FLAG_OUT, cio_error);
+    if (tcp_connection_ctx->on_readable)
+        wait_cleanup(tcp_connection_ctx, CIO_FLAG_IN, cio_error);
+}
+
+static int has_pending_io(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    return tcp_connection_ctx->write_ctx || tcp_connection_ctx->read_ctx
+        || tcp_connection_ctx->on_writable || tcp_connection_ctx->on_readable;
+}
+
+static void check_watermarks(struct tcp_connection_ctx *tcp_connection_ctx, int writable);
+
+static void on_io_event(struct tcp_connection_ctx *tcp_connection_ctx, int flags)
+{
+    if ((flags & (CIO_FLAG_OUT | CIO_FLAG_ERR)) && tcp_connection_ctx->write_ctx)
+        do_write(tcp_connection_ctx);
+    else if ((flags & CIO_FLAG_OUT) && tcp_connection_ctx->above_high_watermark)
+        check_watermarks(tcp_connection_ctx, 1);
+    if ((flags & (CIO_FLAG_OUT | CIO_FLAG_ERR)) && tcp_connection_ctx->on_writable)
+        wait_cleanup(tcp_connection_ctx, CIO_FLAG_OUT,
+                     flags & CIO_FLAG_OUT ? CIO_NO_ERROR : CIO_POLL_ERROR);
+    if (tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return;
+    if ((flags & (CIO_FLAG_IN | CIO_FLAG_RDHUP | CIO_FLAG_ERR)) && tcp_connection_ctx->read_ctx)
+        do_read(tcp_connection_ctx->read_ctx);
+    if ((flags & (CIO_FLAG_IN | CIO_FLAG_RDHUP | CIO_FLAG_ERR)) && tcp_connection_ctx->on_readable)
+        wait_cleanup(tcp_connection_ctx, CIO_FLAG_IN,
+                     flags & (CIO_FLAG_IN | CIO_FLAG_RDHUP) ? CIO_NO_ERROR : CIO_POLL_ERROR);
 }
 
+static void on_connect_attempt_event(struct connect_ctx *connect_ctx, int fd, int flags);
+
 static void event_loop_cb(void *ctx, int fd, int flags)
 {
     struct tcp_connection_ctx *tcp_connection_ctx = ctx;
@@ -277,19 +832,21 @@ static void event_loop_cb(void *ctx, int fd, int flags)
             assert(tcp_connection_ctx->connect_ctx);
             assert(!tcp_connection_ctx->write_ctx);
             assert(!tcp_connection_ctx->read_ctx);
-            if (flags & CIO_FLAG_OUT)
-                return connect_ctx_cleanup(tcp_connection_ctx->connect_ctx, CIO_NO_ERROR);
-            fprintf(stdout, "on_connect_cb, error flags: %d\n", flags);
-            connect_ctx_try_next(tcp_connection_ctx->connect_ctx);
+            on_connect_attempt_event(tcp_connection_ctx->connect_ctx, fd, flags);
             break;
         case CIO_CS_CONNECTED:
+        case CIO_CS_ERROR:
             assert(!tcp_connection_ctx->connect_ctx);
-            if ((flags & CIO_FLAG_OUT) && tcp_connection_ctx->write_ctx)
-                do_write(tcp_connection_ctx->write_ctx);
-            if (tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
-                return;
-            if ((flags & CIO_FLAG_IN) && tcp_connection_ctx->read_ctx)
-                do_read(tcp_connection_ctx->read_ctx);
+            on_io_event(tcp_connection_ctx, flags);
+            /*
+             * Errors and hangups are reported regardless of the interest. Stop polling a broken
+             * fd nobody waits on, otherwise the level-triggered poll would spin on it.
+             */
+            if ((flags & CIO_FLAG_ERR) && !has_pending_io(tcp_connection_ctx)
+                    && tcp_connection_ctx->cstate != CIO_CS_DESTROYED) {
+                tcp_connection_ctx->cstate = CIO_CS_ERROR;
+                cio_event_loop_remove_fd(tcp_connection_ctx->event_loop, fd);
+            }
             break;
         case CIO_CS_DESTROYED:
             clean_all_contexts(tcp_connection_ctx, CIO_ALREADY_DESTROYED_ERROR);
@@ -303,92 +860,298 @@ static void event_loop_cb(void *ctx, int fd, int flags)
 
 static void free_connect_ctx(struct connect_ctx *connect_ctx)
 {
+    connect_ctx_close_attempts(connect_ctx);
     cio_free_resolver(connect_ctx->resolver);
     free(connect_ctx);
 }
 
 static struct connect_ctx *new_connect_ctx(struct tcp_connection_ctx *tcp_connection,
-    const char *addr, int port, void (*on_connect)(void *ctx, int ecode))
+    const char *addr, int port, const void *data, int len, void (*on_connect)(void *ctx, int ecode))
 {
     struct connect_ctx *connect_ctx;
 
-    connect_ctx = malloc(sizeof(*connect_ctx));
+    connect_ctx = malloc(sizeof(*connect_ctx) + strlen(addr) + 1);
     if (!connect_ctx)
         return NULL;
 
     connect_ctx->tcp_connection = tcp_connection;
     connect_ctx->on_connect = on_connect;
-    connect_ctx->resolver = cio_new_resolver(addr, port, AF_UNSPEC, SOCK_STREAM, CIO_CLIENT);
-    if (!connect_ctx->resolver) {
-        free(connect_ctx);
-        return NULL;
-    }
+    connect_ctx->timed_out = 0;
+    connect_ctx->attempts = NULL;
+    connect_ctx->next_attempt_time = 0;
+    connect_ctx->data = data;
+    connect_ctx->len = CIO_MAX(len, 0);
+    connect_ctx->sent = 0;
+    connect_ctx->resolver = NULL;
+    connect_ctx->numeric = 0;
+    connect_ctx->port = port;
+    strcpy(connect_ctx->addr, addr);
 
     return connect_ctx;
 }
 
-static void connect_ctx_try_next(struct connect_ctx *connect_ctx)
+static void close_attempt(struct connect_ctx *connect_ctx, struct connect_attempt *attempt)
 {
-    int cio_ecode = CIO_NO_ERROR;
-    int system_ecode = 0;
-    struct tcp_connection_ctx *tcp_connection_ctx = connect_ctx->tcp_connection;
-    struct addrinfo ainfo;
-    int set;
+    struct connect_attempt **pp;
 
-    assert(tcp_connection_ctx->cstate == CIO_CS_CONNECTING);
-    if ((cio_ecode = cio_resolver_next_endpoint(connect_ctx->resolver, &ainfo)))
-        goto fail;
+    for (pp = &connect_ctx->attempts; *pp != attempt; pp = &(*pp)->next)
+        ;
+    *pp = attempt->next;
 
-    if (tcp_connection_ctx->fd != -1) {
-        close(tcp_connection_ctx->fd);
-        cio_event_loop_remove_fd(tcp_connection_ctx->event_loop, tcp_connection_ctx->fd);
-    }
+    cio_event_loop_remove_fd(connect_ctx->tcp_connection->event_loop, attempt->fd);
+    close(attempt->fd);
+    free(attempt);
+}
 
-    if ((tcp_connection_ctx->fd = socket(ainfo.ai_family, ainfo.ai_socktype, 0)) == -1) {
-        system_ecode = errno;
-        goto fail;
+static void report_attempt(struct connect_ctx *connect_ctx, struct connect_attempt *attempt,
+    int ecode)
+{
+    void *selector = connect_ctx->tcp_connection->endpoint_selector;
+
+    if (selector)
+        cio_endpoint_selector_report(selector, (struct sockaddr *) &attempt->addr,
+                                     attempt->addr_len, ecode,
+                                     (int) CIO_MAX(now_time_ms() - attempt->started, 0));
+}
+
+static void connect_ctx_close_attempts(struct connect_ctx *connect_ctx)
+{
+    while (connect_ctx->attempts)
+        close_attempt(connect_ctx, connect_ctx->attempts);
+}
+
+static long long connect_ctx_deadline(struct connect_ctx *connect_ctx)
+{
+    struct connect_attempt *attempt;
+    long long nearest = connect_ctx->next_attempt_time;
+
+    for (attempt = connect_ctx->attempts; attempt; attempt = attempt->next) {
+        if (attempt->deadline && (!nearest || attempt->deadline < nearest))
+            nearest = attempt->deadline;
     }
 
-    tcp_connection_ctx->connect_ctx = connect_ctx;
-    if ((cio_ecode = cio_event_loop_add_fd(tcp_connection_ctx->event_loop, tcp_connection_ctx->fd,
-                                           CIO_FLAG_OUT | CIO_FLAG_IN, tcp_connection_ctx,
-                                           event_loop_cb))) {
-        goto fail;
+    return nearest;
+}
+
+/**
+ * The winner becomes the connection socket, the rest of the attempts are closed.
+ */
+static void connect_ctx_complete(struct connect_ctx *connect_ctx, struct connect_attempt *winner)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = connect_ctx->tcp_connection;
+    struct connect_attempt **pp;
+
+    for (pp = &connect_ctx->attempts; *pp != winner; pp = &(*pp)->next)
+        ;
+    *pp = winner->next;
+
+    report_attempt(connect_ctx, winner, CIO_NO_ERROR);
+    tcp_connection_ctx->fd = winner->fd;
+    tcp_connection_ctx->interest = CIO_FLAG_OUT;
+    if ((connect_ctx->sent = winner->sent) > 0)
+        account_write(tcp_connection_ctx, winner->sent);
+    free(winner);
+    connect_ctx_cleanup(connect_ctx, CIO_NO_ERROR);
+}
+
+/**
+ * Creates the attempt socket registered in the event loop, -1 on failure.
+ */
+static int new_attempt_socket(struct tcp_connection_ctx *tcp_connection_ctx,
+    const struct addrinfo *ainfo)
+{
+    int cio_ecode = CIO_NO_ERROR;
+    int fd;
+    int set;
+
+    if ((fd = socket(ainfo->ai_family, ainfo->ai_socktype, 0)) == -1) {
+        perror("new_attempt_socket");
+        return -1;
     }
 
+    /* Options are tuning only, the attempt goes on if they fail. */
+    if ((cio_ecode = cio_socket_options_apply(fd, &tcp_connection_ctx->options)))
+        cio_perror(cio_ecode, "new_attempt_socket");
+
 #ifdef __APPLE__
     set = 1;
-    setsockopt(tcp_connection_ctx->fd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
 #endif /* __APPLE__ */
 
     (void) set;
-    if ((system_ecode = toggle_fd_nonblocking(tcp_connection_ctx->fd, 1)))
+    if (toggle_fd_nonblocking(fd, 1)) {
+        perror("new_attempt_socket");
         goto fail;
+    }
 
-    if (connect(tcp_connection_ctx->fd, ainfo.ai_addr, ainfo.ai_addrlen))
-        system_ecode = errno;
-
-    switch (system_ecode) {
-    case 0:
-        connect_ctx_cleanup(connect_ctx, CIO_NO_ERROR);
-        break;
-    case EINPROGRESS:
-        break;
-    default:
-        perror("try_next_endpoint, connect");
-        connect_ctx_try_next(connect_ctx);
-        break;
+    if ((cio_ecode = cio_event_loop_add_fd(tcp_connection_ctx->event_loop, fd, CIO_FLAG_OUT,
+                                           tcp_connection_ctx, event_loop_cb))) {
+        cio_perror(cio_ecode, "new_attempt_socket");
+        goto fail;
     }
 
-    return;
+    return fd;
 
 fail:
-    if (cio_ecode)
-        cio_perror(cio_ecode, "try_next_endpoint");
-    if (system_ecode)
-        perror("try_next_endpoint");
+    close(fd);
+    return -1;
+}
+
+/**
+ * Same as connect() but, if there is connect data, tries to send it with the SYN (TCP Fast Open).
+ * That succeeds only with a cookie of the server cached by the kernel, otherwise the SYN asks for
+ * one and the data is written after connecting. Happy Eyeballs attempts don't carry the data, so
+ * that it isn't sent to several servers at once.
+ */
+static int start_attempt(struct connect_ctx *connect_ctx, struct connect_attempt *attempt,
+    const struct addrinfo *ainfo)
+{
+#if defined(MSG_FASTOPEN)
+    int sent;
+
+    if (connect_ctx->len && !connect_ctx->tcp_connection->attempt_delay_ms) {
+        if ((sent = sendto(attempt->fd, connect_ctx->data, connect_ctx->len,
+                           MSG_FASTOPEN | MSG_NOSIGNAL, ainfo->ai_addr, ainfo->ai_addrlen)) >= 0) {
+            attempt->sent = sent;
+            errno = EINPROGRESS;
+            return -1;
+        }
+        /* Fast Open is off in the system, connect() does without it. */
+        if (errno != EOPNOTSUPP)
+            return -1;
+    }
+#endif
+
+    return connect(attempt->fd, ainfo->ai_addr, ainfo->ai_addrlen);
+}
+
+static int connect_ctx_next_endpoint(struct connect_ctx *connect_ctx, struct addrinfo *ainfo)
+{
+    if (connect_ctx->resolver)
+        return cio_resolver_next_endpoint(connect_ctx->resolver, ainfo);
+
+    if (!connect_ctx->numeric)
+        return CIO_NOT_FOUND_ERROR;
+
+    connect_ctx->numeric = 0;
+    memcpy(ainfo, &connect_ctx->numeric_endpoint, sizeof(*ainfo));
+    return CIO_NO_ERROR;
+}
+
+/**
+ * Starts attempts with the next endpoints until one is in flight or connected. If there are no
+ * endpoints left and no attempts in flight, completes the connect with an error. 'connect_ctx'
+ * may be freed on return.
+ */
+static void connect_ctx_start_next(struct connect_ctx *connect_ctx)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = connect_ctx->tcp_connection;
+    struct connect_attempt *attempt;
+    struct addrinfo ainfo;
+
+    assert(tcp_connection_ctx->cstate == CIO_CS_CONNECTING);
+    connect_ctx->next_attempt_time = 0;
+    while (connect_ctx_next_endpoint(connect_ctx, &ainfo) == CIO_NO_ERROR) {
+        if (!(attempt = malloc(sizeof(*attempt)))) {
+            cio_perror(CIO_ALLOC_ERROR, "connect_ctx_start_next");
+            break;
+        }
+
+        if ((attempt->fd = new_attempt_socket(tcp_connection_ctx, &ainfo)) == -1) {
+            free(attempt);
+            continue;
+        }
+
+        attempt->deadline = deadline_after(tcp_connection_ctx->connect_timeout_ms);
+        attempt->sent = 0;
+        attempt->started = now_time_ms();
+        attempt->addr_len = CIO_MIN(ainfo.ai_addrlen, sizeof(attempt->addr));
+        memcpy(&attempt->addr, ainfo.ai_addr, attempt->addr_len);
+        attempt->next = connect_ctx->attempts;
+        connect_ctx->attempts = attempt;
+
+        if (start_attempt(connect_ctx, attempt, &ainfo) == 0)
+            return connect_ctx_complete(connect_ctx, attempt);
+
+        if (errno != EINPROGRESS) {
+            perror("connect_ctx_start_next, connect");
+            report_attempt(connect_ctx, attempt, CIO_UNKNOWN_ERROR);
+            close_attempt(connect_ctx, attempt);
+            continue;
+        }
+
+        if (tcp_connection_ctx->attempt_delay_ms > 0)
+            connect_ctx->next_attempt_time = deadline_after(tcp_connection_ctx->attempt_delay_ms);
+        arm_deadline_timer(tcp_connection_ctx);
+        return;
+    }
+
+    if (!connect_ctx->attempts)
+        connect_ctx_cleanup(connect_ctx, connect_ctx->timed_out ? CIO_TIMEOUT_ERROR
+                                                                : CIO_UNKNOWN_ERROR);
+}
+
+static void on_connect_attempt_event(struct connect_ctx *connect_ctx, int fd, int flags)
+{
+    struct connect_attempt *attempt;
+
+    for (attempt = connect_ctx->attempts; attempt && attempt->fd != fd; attempt = attempt->next)
+        ;
+    if (!attempt)
+        return;
+
+    if ((flags & CIO_FLAG_OUT) && !(flags & CIO_FLAG_ERR))
+        return connect_ctx_complete(connect_ctx, attempt);
+
+    fprintf(stdout, "on_connect_cb, error flags: %d\n", flags);
+    connect_ctx->timed_out = 0;
+    report_attempt(connect_ctx, attempt, CIO_POLL_ERROR);
+    close_attempt(connect_ctx, attempt);
+    /* A failed attempt starts the next one at once, without waiting for the attempt delay. */
+    connect_ctx_start_next(connect_ctx);
+}
+
+static void connect_ctx_check_deadlines(struct connect_ctx *connect_ctx, long long now)
+{
+    struct connect_attempt *attempt, *next;
+    int start_next = connect_ctx->next_attempt_time && connect_ctx->next_attempt_time <= now;
+
+    for (attempt = connect_ctx->attempts; attempt; attempt = next) {
+        next = attempt->next;
+        if (attempt->deadline && attempt->deadline <= now) {
+            /* The endpoint may be blackholing SYNs, the next one may still answer. */
+            connect_ctx->timed_out = 1;
+            report_attempt(connect_ctx, attempt, CIO_TIMEOUT_ERROR);
+            close_attempt(connect_ctx, attempt);
+            start_next = 1;
+        }
+    }
 
-    connect_ctx_cleanup(connect_ctx, CIO_UNKNOWN_ERROR);
+    if (start_next)
+        connect_ctx_start_next(connect_ctx);
+}
+
+/**
+ * Nothing but the destruction completes the connect while resolving: there are no attempts to
+ * poll or time out yet.
+ */
+static void on_connect_resolved(void *ctx, int cio_error, void *resolver)
+{
+    struct connect_ctx *connect_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = connect_ctx->tcp_connection;
+
+    connect_ctx->resolver = resolver;
+    if (tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return connect_ctx_cleanup(connect_ctx, CIO_ALREADY_DESTROYED_ERROR);
+    if (cio_error)
+        return connect_ctx_cleanup(connect_ctx, cio_error);
+
+    /* Interleaving keeps the selector order within each family. */
+    if (tcp_connection_ctx->endpoint_selector)
+        cio_resolver_order_endpoints(connect_ctx->resolver, tcp_connection_ctx->endpoint_selector);
+    if (tcp_connection_ctx->attempt_delay_ms > 0)
+        cio_resolver_interleave_families(connect_ctx->resolver);
+    connect_ctx_start_next(connect_ctx);
 }
 
 static void async_connect_impl(void *ctx)
@@ -412,18 +1175,46 @@ static void async_connect_impl(void *ctx)
             break;
     }
 
-    connect_ctx_try_next(connect_ctx);
+    if (tcp_connection_ctx->fd != -1) {
+        cio_event_loop_remove_fd(tcp_connection_ctx->event_loop, tcp_connection_ctx->fd);
+        close(tcp_connection_ctx->fd);
+        tcp_connection_ctx->fd = -1;
+    }
+
+    tcp_connection_ctx->connect_ctx = connect_ctx;
+    if (cio_resolve_numeric(connect_ctx->addr, connect_ctx->port, AF_UNSPEC, SOCK_STREAM,
+                            &connect_ctx->numeric_addr, &connect_ctx->numeric_endpoint)
+            == CIO_NO_ERROR) {
+        connect_ctx->numeric = 1;
+        connect_ctx_start_next(connect_ctx);
+    } else if (tcp_connection_ctx->dns_resolver) {
+        cio_dns_resolver_async_resolve(tcp_connection_ctx->dns_resolver, connect_ctx->addr,
+                                       connect_ctx->port, AF_UNSPEC, SOCK_STREAM, connect_ctx,
+                                       on_connect_resolved);
+    } else {
+        cio_resolver_async_resolve(tcp_connection_ctx->event_loop, connect_ctx->addr,
+                                   connect_ctx->port, AF_UNSPEC, SOCK_STREAM, CIO_CLIENT,
+                                   connect_ctx, on_connect_resolved);
+    }
 }
 
 void cio_tcp_connection_async_connect(void *tcp_connection, const char *addr, int port,
     void (*on_connect)(void *ctx, int ecode))
 {
-    struct connect_ctx *connect_ctx = new_connect_ctx(tcp_connection, addr, port, on_connect);
+    cio_tcp_connection_async_connect_send(tcp_connection, addr, port, NULL, 0, on_connect);
+}
+
+void cio_tcp_connection_async_connect_send(void *tcp_connection, const char *addr, int port,
+    const void *data, int len, void (*on_connect)(void *ctx, int ecode))
+{
+    struct connect_ctx *connect_ctx = new_connect_ctx(tcp_connection, addr, port, data, len,
+                                                      on_connect);
     struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
 
     if (!connect_ctx) {
         cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_async_connect");
         on_connect(tcp_connection_ctx->user_ctx, CIO_ALLOC_ERROR);
+        return;
     }
 
     cio_event_loop_post(tcp_connection_ctx->event_loop, 0, connect_ctx, async_connect_impl);
@@ -443,49 +1234,97 @@ struct write_ctx *new_write_ctx(struct tcp_connection_ctx *tcp_connection,
     write_ctx->data = data;
     write_ctx->len = len;
     write_ctx->written = 0;
+    write_ctx->next = NULL;
 
     return write_ctx;
 }
 
-static void do_write(struct write_ctx *write_ctx)
+/**
+ * Bytes written by the user but not sent yet. With CIO_SO_NOTSENT_LOWAT on, the kernel keeps
+ * only a little unsent data, and that counts too.
+ */
+static int pending_write_bytes(struct tcp_connection_ctx *tcp_connection_ctx)
 {
-    int cio_ecode = CIO_NO_ERROR;
-    int system_ecode = 0;
-    int write_result = 0;
-    struct tcp_connection_ctx *tcp_connection_ctx = write_ctx->tcp_connection;
+    int unsent = 0;
 
-    while (1) {
-#ifdef __APPLE__
-        write_result = write(tcp_connection_ctx->fd, write_ctx->data + write_ctx->written,
-            write_ctx->len - write_ctx->written);
-#else
-        write_result = send(tcp_connection_ctx->fd, write_ctx->data + write_ctx->written,
-            write_ctx->len - write_ctx->written, MSG_NOSIGNAL);
+#if defined(SIOCOUTQNSD)
+    if ((tcp_connection_ctx->options.mask & CIO_SO_NOTSENT_LOWAT)
+            && ioctl(tcp_connection_ctx->fd, SIOCOUTQNSD, &unsent) == -1)
+        unsent = 0;
 #endif
-        if (write_result == 0) {
-            return write_ctx_cleanup(write_ctx, CIO_CONNECTION_CLOSED_ERROR);
-        } else if (write_result > 0) {
-            write_ctx->written += write_result;
-            if (write_ctx->written == write_ctx->len) {
-                return write_ctx_cleanup(write_ctx, CIO_NO_ERROR);
-            } else {
-                continue;
-            }
+
+    return tcp_connection_ctx->queued_bytes + unsent;
+}
+
+/**
+ * writable - the socket has just been reported writable with nothing queued, i.e. the kernel
+ * unsent data dropped below CIO_SO_NOTSENT_LOWAT, which counts as drained.
+ */
+static void check_watermarks(struct tcp_connection_ctx *tcp_connection_ctx, int writable)
+{
+    int pending;
+
+    if (!tcp_connection_ctx->high_watermark || tcp_connection_ctx->cstate != CIO_CS_CONNECTED)
+        return;
+
+    pending = pending_write_bytes(tcp_connection_ctx);
+    if (!tcp_connection_ctx->above_high_watermark) {
+        if (pending < tcp_connection_ctx->high_watermark)
+            return;
+        tcp_connection_ctx->above_high_watermark = 1;
+        if (tcp_connection_ctx->on_high_watermark)
+            tcp_connection_ctx->on_high_watermark(tcp_connection_ctx->user_ctx, pending);
+    } else if (pending <= tcp_connection_ctx->low_watermark
+               || (writable && !tcp_connection_ctx->write_ctx)) {
+        tcp_connection_ctx->above_high_watermark = 0;
+        if (tcp_connection_ctx->on_drain)
+            tcp_connection_ctx->on_drain(tcp_connection_ctx->user_ctx, pending);
+    }
+
+    update_interest(tcp_connection_ctx);
+}
+
+/**
+ * Writes the queued data until the socket would block.
+ */
+static void do_write(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    int write_result = 0;
+    int allowance;
+    struct write_ctx *write_ctx;
+
+    while ((write_ctx = tcp_connection_ctx->write_ctx)) {
+        if (!(allowance = rate_limit_allowance(tcp_connection_ctx, CIO_FLAG_OUT)))
+            break;
+#ifdef __APPLE__
+        write_result = write(tcp_connection_ctx->fd, write_ctx->data + write_ctx->written,
+            CIO_MIN(write_ctx->len - write_ctx->written, allowance));
+#else
+        write_result = send(tcp_connection_ctx->fd, write_ctx->data + write_ctx->written,
+            CIO_MIN(write_ctx->len - write_ctx->written, allowance), MSG_NOSIGNAL);
+#endif
+        account_write(tcp_connection_ctx, write_result);
+        if (write_result == 0) {
+            return fail_queued_writes(tcp_connection_ctx, CIO_CONNECTION_CLOSED_ERROR);
+        } else if (write_result > 0) {
+            rate_limit_consume(tcp_connection_ctx, CIO_FLAG_OUT, write_result);
+            touch_tcp_connection(tcp_connection_ctx);
+            write_ctx->written += write_result;
+            tcp_connection_ctx->queued_bytes -= write_result;
+            if (write_ctx->written == write_ctx->len) {
+                write_ctx_cleanup(write_ctx, CIO_NO_ERROR);
+                if (tcp_connection_ctx->cstate != CIO_CS_CONNECTED)
+                    return;
+            }
+        } else if (errno == EWOULDBLOCK) {
+            break;
         } else {
-            system_ecode = errno;
-            if (system_ecode == EWOULDBLOCK)
-                return;
-            goto fail;
+            perror("do_write");
+            return fail_queued_writes(tcp_connection_ctx, CIO_WRITE_ERROR);
         }
     }
 
-fail:
-    if (cio_ecode)
-        cio_perror(cio_ecode, "do_write");
-    if (system_ecode)
-        perror("do_write");
-
-    write_ctx_cleanup(write_ctx, CIO_WRITE_ERROR);
+    check_watermarks(tcp_connection_ctx, 0);
 }
 
 static void async_write_impl(void *ctx)
@@ -499,13 +1338,29 @@ static void async_write_impl(void *ctx)
         case CIO_CS_DESTROYED:
             return write_ctx_cleanup(write_ctx, CIO_ALREADY_DESTROYED_ERROR);
         case CIO_CS_CONNECTED:
-            assert(!tcp_connection_ctx->write_ctx);
-            if (tcp_connection_ctx->write_ctx) {
-                write_ctx_cleanup(write_ctx, CIO_ALREADY_EXISTS_ERROR);
-                return;
+            if (tcp_connection_ctx->write_limit && pending_write_bytes(tcp_connection_ctx)
+                    + write_ctx->len > tcp_connection_ctx->write_limit) {
+                if (tcp_connection_ctx->write_limit_policy == CIO_WLP_CLOSE) {
+                    tcp_connection_ctx->cstate = CIO_CS_ERROR;
+                    clean_all_contexts(tcp_connection_ctx, CIO_WRITE_LIMIT_ERROR);
+                }
+                return write_ctx_cleanup(write_ctx, CIO_WRITE_LIMIT_ERROR);
             }
+            tcp_connection_ctx->queued_bytes += write_ctx->len;
+            if (tcp_connection_ctx->write_queue_tail) {
+                tcp_connection_ctx->write_queue_tail->next = write_ctx;
+                tcp_connection_ctx->write_queue_tail = write_ctx;
+                return check_watermarks(tcp_connection_ctx, 0);
+            }
+            begin_operation(tcp_connection_ctx);
             tcp_connection_ctx->write_ctx = write_ctx;
-            do_write(write_ctx);
+            tcp_connection_ctx->write_queue_tail = write_ctx;
+            tcp_connection_ctx->write_pending_since = now_time_ms();
+            tcp_connection_ctx->write_deadline = deadline_after(
+                tcp_connection_ctx->write_timeout_ms);
+            update_interest(tcp_connection_ctx);
+            arm_deadline_timer(tcp_connection_ctx);
+            do_write(tcp_connection_ctx);
             break;
         default:
             return write_ctx_cleanup(write_ctx, CIO_WRONG_STATE_ERROR);
@@ -528,39 +1383,223 @@ void cio_tcp_connection_async_write(void *tcp_connection, const void *data, int
 }
 
 struct read_ctx *new_read_ctx(struct tcp_connection_ctx *tcp_connection,
-    void (*on_read)(void *, int, int), void *data, int len)
+    void (*on_read)(void *, int, int), void *data, int len, const void *delim, int delim_len)
 {
     struct read_ctx *read_ctx;
 
-    read_ctx = malloc(sizeof(*read_ctx));
+    read_ctx = malloc(sizeof(*read_ctx) + delim_len);
     if (!read_ctx)
         return NULL;
 
     read_ctx->tcp_connection = tcp_connection;
     read_ctx->on_read = on_read;
+    read_ctx->on_read_pooled = NULL;
+    read_ctx->buffer_pool = NULL;
+    read_ctx->waiting_for_buffer = 0;
     read_ctx->data = data;
     read_ctx->len = len;
     read_ctx->read = 0;
+    read_ctx->delim_len = delim_len;
+    if (delim_len)
+        memcpy(read_ctx->delim, delim, delim_len);
 
     return read_ctx;
 }
 
+/**
+ * Reads from the socket to 'data' and, if read-ahead is on, to the read buffer in one syscall.
+ * The read buffer must be empty.
+ */
+static int read_with_read_ahead(struct tcp_connection_ctx *tcp_connection_ctx, void *data,
+    int len)
+{
+    struct iovec iov[3];
+    int count, result;
+
+    if (!tcp_connection_ctx->read_ahead || len >= tcp_connection_ctx->read_ahead)
+        return read(tcp_connection_ctx->fd, data, len);
+
+    iov[0].iov_base = data;
+    iov[0].iov_len = len;
+    count = cio_ring_buffer_free_segments(tcp_connection_ctx->read_buffer, iov + 1);
+    if ((result = readv(tcp_connection_ctx->fd, iov, count + 1)) > len) {
+        cio_ring_buffer_commit(tcp_connection_ctx->read_buffer, result - len);
+        result = len;
+    }
+
+    return result;
+}
+
+/**
+ * Fills the empty read buffer with one read() of up to the read-ahead size.
+ */
+static int fill_read_buffer(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    struct iovec iov[2];
+    int count, result;
+
+    count = cio_ring_buffer_free_segments(tcp_connection_ctx->read_buffer, iov);
+    if ((result = readv(tcp_connection_ctx->fd, iov, count)) > 0)
+        cio_ring_buffer_commit(tcp_connection_ctx->read_buffer, result);
+
+    return result;
+}
+
+static int read_buffer_size(struct tcp_connection_ctx *tcp_connection_ctx)
+{
+    return tcp_connection_ctx->read_buffer ? cio_ring_buffer_size(tcp_connection_ctx->read_buffer)
+                                           : 0;
+}
+
+static int read_buffer_append(struct tcp_connection_ctx *tcp_connection_ctx, const void *data,
+    int len)
+{
+    if (len == 0)
+        return CIO_NO_ERROR;
+
+    if (!tcp_connection_ctx->read_buffer
+        && !(tcp_connection_ctx->read_buffer = cio_new_ring_buffer(len)))
+        return CIO_ALLOC_ERROR;
+
+    return cio_ring_buffer_write(tcp_connection_ctx->read_buffer, data, len);
+}
+
+static void do_read_until(struct read_ctx *read_ctx)
+{
+    int system_ecode = 0;
+    struct tcp_connection_ctx *tcp_connection_ctx = read_ctx->tcp_connection;
+    char *data = read_ctx->data;
+    int from_buffer, prev_read, scan_from, pos, end, result, allowance;
+
+    while (read_ctx->read < read_ctx->len) {
+        if (read_buffer_size(tcp_connection_ctx) > 0) {
+            result = cio_ring_buffer_peek(tcp_connection_ctx->read_buffer, data + read_ctx->read,
+                                          read_ctx->len - read_ctx->read);
+            from_buffer = 1;
+        } else {
+            if (!(allowance = rate_limit_allowance(tcp_connection_ctx, CIO_FLAG_IN)))
+                return;
+            if (tcp_connection_ctx->read_ahead)
+                result = fill_read_buffer(tcp_connection_ctx);
+            else
+                result = read(tcp_connection_ctx->fd, data + read_ctx->read,
+                              CIO_MIN(read_ctx->len - read_ctx->read, allowance));
+            account_read(tcp_connection_ctx, result);
+            if (result > 0)
+                rate_limit_consume(tcp_connection_ctx, CIO_FLAG_IN, result);
+
+            if (result == 0) {
+                return read_ctx_cleanup(read_ctx, read_ctx->read == 0
+                                        ? CIO_NO_ERROR : CIO_CONNECTION_CLOSED_ERROR);
+            } else if (result < 0) {
+                system_ecode = errno;
+                if (system_ecode == EWOULDBLOCK)
+                    return;
+                goto fail;
+            } else if (tcp_connection_ctx->read_ahead) {
+                continue;
+            }
+            from_buffer = 0;
+        }
+
+        prev_read = read_ctx->read;
+        read_ctx->read += result;
+
+        /* Only the new bytes plus the possible delimiter prefix at the end of the old ones. */
+        scan_from = CIO_MAX(prev_read - read_ctx->delim_len + 1, 0);
+        pos = cio_scan_delim(data + scan_from, read_ctx->read - scan_from, read_ctx->delim,
+                             read_ctx->delim_len);
+        if (pos == -1) {
+            if (from_buffer)
+                cio_ring_buffer_consume(tcp_connection_ctx->read_buffer, result);
+            continue;
+        }
+
+        /* Bytes after the delimiter are left in (or returned to) the read buffer. */
+        end = scan_from + pos + read_ctx->delim_len;
+        if (from_buffer) {
+            cio_ring_buffer_consume(tcp_connection_ctx->read_buffer,
+                                    result - (read_ctx->read - end));
+        } else if (read_buffer_append(tcp_connection_ctx, data + end, read_ctx->read - end)) {
+            read_ctx->read = 0;
+            return read_ctx_cleanup(read_ctx, CIO_ALLOC_ERROR);
+        }
+
+        read_ctx->read = end;
+        return read_ctx_cleanup(read_ctx, CIO_NO_ERROR);
+    }
+
+    return read_ctx_cleanup(read_ctx, CIO_NOT_FOUND_ERROR);
+
+fail:
+    perror("do_read_until");
+    read_ctx->read = 0;
+    read_ctx_cleanup(read_ctx, CIO_READ_ERROR);
+}
+
+/**
+ * The buffer pool being out of buffers is backpressure: the read isn't polled for till the retry,
+ * so the data stays in the socket meanwhile.
+ */
+static void wait_for_buffer(struct read_ctx *read_ctx)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = read_ctx->tcp_connection;
+
+    read_ctx->waiting_for_buffer = 1;
+    tcp_connection_ctx->read_resume_time = now_time_ms() + BUFFER_RETRY_MS;
+    update_interest(tcp_connection_ctx);
+    arm_deadline_timer(tcp_connection_ctx);
+}
+
 static void do_read(struct read_ctx *read_ctx)
 {
     int cio_ecode = CIO_NO_ERROR;
     int system_ecode = 0;
+    int allowance = INT_MAX;
     struct tcp_connection_ctx *tcp_connection_ctx = read_ctx->tcp_connection;
 
-    read_ctx->read = read(tcp_connection_ctx->fd, read_ctx->data, read_ctx->len - read_ctx->read);
+    if (read_ctx->delim_len)
+        return do_read_until(read_ctx);
+
+    /* Before taking the pooled buffer, so that a throttled connection holds none. */
+    if (read_buffer_size(tcp_connection_ctx) == 0
+            && !(allowance = rate_limit_allowance(tcp_connection_ctx, CIO_FLAG_IN)))
+        return;
+
+    if (read_ctx->buffer_pool && !read_ctx->data) {
+        if (!(read_ctx->data = cio_buffer_pool_get(read_ctx->buffer_pool)))
+            return wait_for_buffer(read_ctx);
+        read_ctx->waiting_for_buffer = 0;
+        read_ctx->len = cio_buffer_pool_buffer_size(read_ctx->buffer_pool);
+    }
+
+    if (read_buffer_size(tcp_connection_ctx) > 0) {
+        read_ctx->read = cio_ring_buffer_read(tcp_connection_ctx->read_buffer, read_ctx->data,
+                                              read_ctx->len);
+        return read_ctx_cleanup(read_ctx, CIO_NO_ERROR);
+    }
+
+    read_ctx->read = read_with_read_ahead(tcp_connection_ctx, read_ctx->data,
+                                          CIO_MIN(read_ctx->len - read_ctx->read, allowance));
+    account_read(tcp_connection_ctx, read_ctx->read > 0
+                 ? read_ctx->read + read_buffer_size(tcp_connection_ctx) : read_ctx->read);
     if (read_ctx->read > 0) {
+        /* Read-ahead bytes come from the socket by the same call. */
+        rate_limit_consume(tcp_connection_ctx, CIO_FLAG_IN,
+                           read_ctx->read + read_buffer_size(tcp_connection_ctx));
         return read_ctx_cleanup(read_ctx, CIO_NO_ERROR);
     } else if (read_ctx->read == 0) {
         return read_ctx_cleanup(read_ctx, CIO_NO_ERROR);
     } else {
         read_ctx->read = 0;
         system_ecode = errno;
-        if (system_ecode == EWOULDBLOCK)
+        if (system_ecode == EWOULDBLOCK) {
+            if (read_ctx->buffer_pool) {
+                cio_buffer_pool_put(read_ctx->buffer_pool, read_ctx->data);
+                read_ctx->data = NULL;
+            }
             return;
+        }
     }
 
     if (cio_ecode)
@@ -587,7 +1626,11 @@ static void async_read_impl(void *ctx)
                 read_ctx_cleanup(read_ctx, CIO_ALREADY_EXISTS_ERROR);
                 return;
             }
+            begin_operation(tcp_connection_ctx);
             tcp_connection_ctx->read_ctx = read_ctx;
+            tcp_connection_ctx->read_deadline = deadline_after(tcp_connection_ctx->read_timeout_ms);
+            update_interest(tcp_connection_ctx);
+            arm_deadline_timer(tcp_connection_ctx);
             do_read(read_ctx);
             break;
         default:
@@ -598,7 +1641,7 @@ static void async_read_impl(void *ctx)
 void cio_tcp_connection_async_read(void *tcp_connection, void *data, int len,
     void (*on_read)(void *ctx, int ecode, int bytes_read))
 {
-    struct read_ctx *read_ctx = new_read_ctx(tcp_connection, on_read, data, len);
+    struct read_ctx *read_ctx = new_read_ctx(tcp_connection, on_read, data, len, NULL, 0);
     struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
 
     if (!read_ctx) {
@@ -609,3 +1652,552 @@ void cio_tcp_connection_async_read(void *tcp_connection, void *data, int len,
 
     cio_event_loop_post(tcp_connection_ctx->event_loop, 0, read_ctx, async_read_impl);
 }
+
+void cio_tcp_connection_async_read_until(void *tcp_connection, void *data, int len,
+    const void *delim, int delim_len, void (*on_read)(void *ctx, int ecode, int bytes_read))
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct read_ctx *read_ctx;
+
+    if (delim_len <= 0) {
+        on_read(tcp_connection_ctx->user_ctx, CIO_INVALID_ARGUMENT_ERROR, 0);
+        return;
+    }
+
+    if (!(read_ctx = new_read_ctx(tcp_connection, on_read, data, len, delim, delim_len))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_async_read_until");
+        on_read(tcp_connection_ctx->user_ctx, CIO_ALLOC_ERROR, 0);
+        return;
+    }
+
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, read_ctx, async_read_impl);
+}
+
+void cio_tcp_connection_async_read_pooled(void *tcp_connection, void *buffer_pool,
+    void (*on_read)(void *ctx, int ecode, void *buffer, int read_bytes))
+{
+    struct read_ctx *read_ctx = new_read_ctx(tcp_connection, NULL, NULL, 0, NULL, 0);
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+
+    if (!read_ctx) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_async_read_pooled");
+        on_read(tcp_connection_ctx->user_ctx, CIO_ALLOC_ERROR, NULL, 0);
+        return;
+    }
+
+    read_ctx->buffer_pool = buffer_pool;
+    read_ctx->on_read_pooled = on_read;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, read_ctx, async_read_impl);
+}
+
+struct read_ahead_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    int size;
+};
+
+static void set_read_ahead_impl(void *ctx)
+{
+    struct read_ahead_ctx *read_ahead_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = read_ahead_ctx->tcp_connection;
+    int cio_ecode = CIO_NO_ERROR;
+
+    if (read_ahead_ctx->size > 0) {
+        if (!tcp_connection_ctx->read_buffer) {
+            if (!(tcp_connection_ctx->read_buffer = cio_new_ring_buffer(read_ahead_ctx->size)))
+                cio_ecode = CIO_ALLOC_ERROR;
+        } else {
+            cio_ecode = cio_ring_buffer_reserve(tcp_connection_ctx->read_buffer,
+                                                read_ahead_ctx->size);
+        }
+    }
+
+    if (cio_ecode)
+        cio_perror(cio_ecode, "cio_tcp_connection_set_read_ahead");
+    else
+        tcp_connection_ctx->read_ahead = read_ahead_ctx->size;
+
+    free(read_ahead_ctx);
+}
+
+void cio_tcp_connection_set_read_ahead(void *tcp_connection, int size)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct read_ahead_ctx *read_ahead_ctx;
+
+    if (!(read_ahead_ctx = malloc(sizeof(*read_ahead_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_read_ahead");
+        return;
+    }
+
+    read_ahead_ctx->tcp_connection = tcp_connection_ctx;
+    read_ahead_ctx->size = CIO_MAX(size, 0);
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, read_ahead_ctx, set_read_ahead_impl);
+}
+
+struct wait_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    void (*on_ready)(void *ctx, int ecode);
+    int flag;
+};
+
+static void async_wait_impl(void *ctx)
+{
+    struct wait_ctx *wait_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = wait_ctx->tcp_connection;
+    void (*on_ready)(void *ctx, int ecode) = wait_ctx->on_ready;
+    void (**slot)(void *ctx, int ecode);
+    int cio_ecode = CIO_NO_ERROR;
+
+    slot = wait_ctx->flag == CIO_FLAG_IN ? &tcp_connection_ctx->on_readable
+                                         : &tcp_connection_ctx->on_writable;
+    free(wait_ctx);
+
+    switch (tcp_connection_ctx->cstate) {
+        case CIO_CS_DESTROYED:
+            cio_ecode = CIO_ALREADY_DESTROYED_ERROR;
+            break;
+        case CIO_CS_CONNECTED:
+            if (*slot)
+                cio_ecode = CIO_ALREADY_EXISTS_ERROR;
+            break;
+        default:
+            cio_ecode = CIO_WRONG_STATE_ERROR;
+            break;
+    }
+
+    if (cio_ecode) {
+        on_ready(tcp_connection_ctx->user_ctx, cio_ecode);
+        return;
+    }
+
+    tcp_connection_ctx->reference_count++;
+    begin_operation(tcp_connection_ctx);
+    *slot = on_ready;
+    if (slot == &tcp_connection_ctx->on_readable && read_buffer_size(tcp_connection_ctx) > 0)
+        return wait_cleanup(tcp_connection_ctx, CIO_FLAG_IN, CIO_NO_ERROR);
+
+    update_interest(tcp_connection_ctx);
+    arm_deadline_timer(tcp_connection_ctx);
+}
+
+static void async_wait(struct tcp_connection_ctx *tcp_connection_ctx, int flag,
+    void (*on_ready)(void *ctx, int ecode))
+{
+    struct wait_ctx *wait_ctx;
+
+    if (!(wait_ctx = malloc(sizeof(*wait_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_async_wait");
+        on_ready(tcp_connection_ctx->user_ctx, CIO_ALLOC_ERROR);
+        return;
+    }
+
+    wait_ctx->tcp_connection = tcp_connection_ctx;
+    wait_ctx->on_ready = on_ready;
+    wait_ctx->flag = flag;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, wait_ctx, async_wait_impl);
+}
+
+void cio_tcp_connection_async_wait_readable(void *tcp_connection,
+    void (*on_readable)(void *ctx, int ecode))
+{
+    async_wait(tcp_connection, CIO_FLAG_IN, on_readable);
+}
+
+void cio_tcp_connection_async_wait_writable(void *tcp_connection,
+    void (*on_writable)(void *ctx, int ecode))
+{
+    async_wait(tcp_connection, CIO_FLAG_OUT, on_writable);
+}
+
+struct options_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    struct cio_socket_options options;
+};
+
+static void set_options_impl(void *ctx)
+{
+    struct options_ctx *options_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = options_ctx->tcp_connection;
+    int cio_ecode;
+
+    tcp_connection_ctx->options = options_ctx->options;
+    free(options_ctx);
+
+    if (tcp_connection_ctx->fd == -1 || tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return;
+
+    if ((cio_ecode = cio_socket_options_apply(tcp_connection_ctx->fd,
+                                              &tcp_connection_ctx->options)))
+        cio_perror(cio_ecode, "cio_tcp_connection_set_options");
+}
+
+void cio_tcp_connection_set_options(void *tcp_connection, const struct cio_socket_options *options)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct options_ctx *options_ctx;
+
+    if (!(options_ctx = malloc(sizeof(*options_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_options");
+        return;
+    }
+
+    options_ctx->tcp_connection = tcp_connection_ctx;
+    options_ctx->options = *options;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, options_ctx, set_options_impl);
+}
+
+struct timeouts_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    int connect_timeout_ms;
+    int read_timeout_ms;
+    int write_timeout_ms;
+    int idle_timeout_ms;
+};
+
+static void set_timeouts_impl(void *ctx)
+{
+    struct timeouts_ctx *timeouts_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = timeouts_ctx->tcp_connection;
+
+    tcp_connection_ctx->connect_timeout_ms = timeouts_ctx->connect_timeout_ms;
+    tcp_connection_ctx->read_timeout_ms = timeouts_ctx->read_timeout_ms;
+    tcp_connection_ctx->write_timeout_ms = timeouts_ctx->write_timeout_ms;
+    if (tcp_connection_ctx->idle_timeout_ms <= 0)
+        tcp_connection_ctx->last_activity = now_time_ms();
+    tcp_connection_ctx->idle_timeout_ms = timeouts_ctx->idle_timeout_ms;
+    free(timeouts_ctx);
+
+    /* Operations already in progress keep their deadlines, only the idle one applies at once. */
+    if (tcp_connection_ctx->cstate != CIO_CS_DESTROYED)
+        arm_deadline_timer(tcp_connection_ctx);
+}
+
+void cio_tcp_connection_set_timeouts(void *tcp_connection, int connect_timeout_ms,
+    int read_timeout_ms, int write_timeout_ms, int idle_timeout_ms)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct timeouts_ctx *timeouts_ctx;
+
+    if (!(timeouts_ctx = malloc(sizeof(*timeouts_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_timeouts");
+        return;
+    }
+
+    timeouts_ctx->tcp_connection = tcp_connection_ctx;
+    timeouts_ctx->connect_timeout_ms = connect_timeout_ms;
+    timeouts_ctx->read_timeout_ms = read_timeout_ms;
+    timeouts_ctx->write_timeout_ms = write_timeout_ms;
+    timeouts_ctx->idle_timeout_ms = idle_timeout_ms;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, timeouts_ctx, set_timeouts_impl);
+}
+
+struct happy_eyeballs_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    int attempt_delay_ms;
+};
+
+static void set_happy_eyeballs_impl(void *ctx)
+{
+    struct happy_eyeballs_ctx *happy_eyeballs_ctx = ctx;
+
+    happy_eyeballs_ctx->tcp_connection->attempt_delay_ms = happy_eyeballs_ctx->attempt_delay_ms;
+    free(happy_eyeballs_ctx);
+}
+
+void cio_tcp_connection_set_happy_eyeballs(void *tcp_connection, int attempt_delay_ms)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct happy_eyeballs_ctx *happy_eyeballs_ctx;
+
+    if (!(happy_eyeballs_ctx = malloc(sizeof(*happy_eyeballs_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_happy_eyeballs");
+        return;
+    }
+
+    happy_eyeballs_ctx->tcp_connection = tcp_connection_ctx;
+    happy_eyeballs_ctx->attempt_delay_ms = CIO_MAX(attempt_delay_ms, 0);
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, happy_eyeballs_ctx,
+                        set_happy_eyeballs_impl);
+}
+
+struct dns_resolver_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    void *dns_resolver;
+};
+
+static void set_dns_resolver_impl(void *ctx)
+{
+    struct dns_resolver_ctx *dns_resolver_ctx = ctx;
+
+    dns_resolver_ctx->tcp_connection->dns_resolver = dns_resolver_ctx->dns_resolver;
+    free(dns_resolver_ctx);
+}
+
+void cio_tcp_connection_set_dns_resolver(void *tcp_connection, void *dns_resolver)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct dns_resolver_ctx *dns_resolver_ctx;
+
+    if (!(dns_resolver_ctx = malloc(sizeof(*dns_resolver_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_dns_resolver");
+        return;
+    }
+
+    dns_resolver_ctx->tcp_connection = tcp_connection_ctx;
+    dns_resolver_ctx->dns_resolver = dns_resolver;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, dns_resolver_ctx,
+                        set_dns_resolver_impl);
+}
+
+struct endpoint_selector_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    void *endpoint_selector;
+};
+
+static void set_endpoint_selector_impl(void *ctx)
+{
+    struct endpoint_selector_ctx *endpoint_selector_ctx = ctx;
+
+    endpoint_selector_ctx->tcp_connection->endpoint_selector =
+        endpoint_selector_ctx->endpoint_selector;
+    free(endpoint_selector_ctx);
+}
+
+void cio_tcp_connection_set_endpoint_selector(void *tcp_connection, void *endpoint_selector)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct endpoint_selector_ctx *endpoint_selector_ctx;
+
+    if (!(endpoint_selector_ctx = malloc(sizeof(*endpoint_selector_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_endpoint_selector");
+        return;
+    }
+
+    endpoint_selector_ctx->tcp_connection = tcp_connection_ctx;
+    endpoint_selector_ctx->endpoint_selector = endpoint_selector;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, endpoint_selector_ctx,
+                        set_endpoint_selector_impl);
+}
+
+struct user_ctx_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    void *user_ctx;
+};
+
+static void set_user_ctx_impl(void *ctx)
+{
+    struct user_ctx_ctx *user_ctx_ctx = ctx;
+
+    user_ctx_ctx->tcp_connection->user_ctx = user_ctx_ctx->user_ctx;
+    free(user_ctx_ctx);
+}
+
+void cio_tcp_connection_set_user_ctx(void *tcp_connection, void *ctx)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct user_ctx_ctx *user_ctx_ctx;
+
+    if (!(user_ctx_ctx = malloc(sizeof(*user_ctx_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_user_ctx");
+        return;
+    }
+
+    user_ctx_ctx->tcp_connection = tcp_connection_ctx;
+    user_ctx_ctx->user_ctx = ctx;
+    cio_event_loop_dispatch(tcp_connection_ctx->event_loop, user_ctx_ctx, set_user_ctx_impl);
+}
+
+void cio_tcp_connection_set_on_destroy(void *tcp_connection, void *ctx,
+    void (*on_destroy)(void *ctx))
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+
+    tcp_connection_ctx->destroy_ctx = ctx;
+    tcp_connection_ctx->on_destroy = on_destroy;
+}
+
+int cio_tcp_connection_is_alive(void *tcp_connection)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct pollfd pollfd;
+
+    if (tcp_connection_ctx->cstate != CIO_CS_CONNECTED || has_pending_io(tcp_connection_ctx)
+            || read_buffer_size(tcp_connection_ctx) > 0)
+        return 0;
+
+    /* Idle socket becoming readable means the peer closed it (CIO_FLAG_RDHUP) or sent something
+     * nobody expects. Either way it can't be reused. */
+    pollfd.fd = tcp_connection_ctx->fd;
+    pollfd.events = POLLIN;
+#if defined (_GNU_SOURCE)
+    pollfd.events |= POLLRDHUP;
+#endif
+    pollfd.revents = 0;
+
+    return poll(&pollfd, 1, 0) == 0;
+}
+
+struct watermarks_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    int low_watermark;
+    int high_watermark;
+    void (*on_high_watermark)(void *ctx, int queued_bytes);
+    void (*on_drain)(void *ctx, int queued_bytes);
+};
+
+static void set_write_watermarks_impl(void *ctx)
+{
+    struct watermarks_ctx *watermarks_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = watermarks_ctx->tcp_connection;
+
+    tcp_connection_ctx->low_watermark = watermarks_ctx->low_watermark;
+    tcp_connection_ctx->high_watermark = watermarks_ctx->high_watermark;
+    tcp_connection_ctx->on_high_watermark = watermarks_ctx->on_high_watermark;
+    tcp_connection_ctx->on_drain = watermarks_ctx->on_drain;
+    tcp_connection_ctx->above_high_watermark = 0;
+    free(watermarks_ctx);
+
+    if (tcp_connection_ctx->cstate != CIO_CS_DESTROYED) {
+        update_interest(tcp_connection_ctx);
+        check_watermarks(tcp_connection_ctx, 0);
+    }
+}
+
+void cio_tcp_connection_set_write_watermarks(void *tcp_connection, int low_watermark,
+    int high_watermark, void (*on_high_watermark)(void *ctx, int queued_bytes),
+    void (*on_drain)(void *ctx, int queued_bytes))
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct watermarks_ctx *watermarks_ctx;
+
+    if (high_watermark < 0 || low_watermark < 0
+            || (high_watermark && low_watermark >= high_watermark)) {
+        cio_perror(CIO_INVALID_ARGUMENT_ERROR, "cio_tcp_connection_set_write_watermarks");
+        return;
+    }
+
+    if (!(watermarks_ctx = malloc(sizeof(*watermarks_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_write_watermarks");
+        return;
+    }
+
+    watermarks_ctx->tcp_connection = tcp_connection_ctx;
+    watermarks_ctx->low_watermark = low_watermark;
+    watermarks_ctx->high_watermark = high_watermark;
+    watermarks_ctx->on_high_watermark = on_high_watermark;
+    watermarks_ctx->on_drain = on_drain;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, watermarks_ctx,
+                        set_write_watermarks_impl);
+}
+
+struct write_limit_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    int write_limit;
+    enum CIO_WRITE_LIMIT_POLICY policy;
+};
+
+static void set_write_limit_impl(void *ctx)
+{
+    struct write_limit_ctx *write_limit_ctx = ctx;
+
+    write_limit_ctx->tcp_connection->write_limit = write_limit_ctx->write_limit;
+    write_limit_ctx->tcp_connection->write_limit_policy = write_limit_ctx->policy;
+    free(write_limit_ctx);
+}
+
+void cio_tcp_connection_set_write_limit(void *tcp_connection, int write_limit,
+    enum CIO_WRITE_LIMIT_POLICY policy)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct write_limit_ctx *write_limit_ctx;
+
+    if (!(write_limit_ctx = malloc(sizeof(*write_limit_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_write_limit");
+        return;
+    }
+
+    write_limit_ctx->tcp_connection = tcp_connection_ctx;
+    write_limit_ctx->write_limit = CIO_MAX(write_limit, 0);
+    write_limit_ctx->policy = policy;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, write_limit_ctx, set_write_limit_impl);
+}
+
+struct rate_limiters_ctx {
+    struct tcp_connection_ctx *tcp_connection;
+    void *read_limiter;
+    void *write_limiter;
+};
+
+static void set_rate_limiters_impl(void *ctx)
+{
+    struct rate_limiters_ctx *limiters_ctx = ctx;
+    struct tcp_connection_ctx *tcp_connection_ctx = limiters_ctx->tcp_connection;
+
+    tcp_connection_ctx->read_limiter = limiters_ctx->read_limiter;
+    tcp_connection_ctx->write_limiter = limiters_ctx->write_limiter;
+    free(limiters_ctx);
+
+    /* Throttled directions are resumed by the deadline timer and get the new limiters then. */
+    if (tcp_connection_ctx->cstate != CIO_CS_DESTROYED)
+        update_interest(tcp_connection_ctx);
+}
+
+void cio_tcp_connection_set_rate_limiters(void *tcp_connection, void *read_limiter,
+    void *write_limiter)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+    struct rate_limiters_ctx *limiters_ctx;
+
+    if (!(limiters_ctx = malloc(sizeof(*limiters_ctx)))) {
+        cio_perror(CIO_ALLOC_ERROR, "cio_tcp_connection_set_rate_limiters");
+        return;
+    }
+
+    limiters_ctx->tcp_connection = tcp_connection_ctx;
+    limiters_ctx->read_limiter = read_limiter;
+    limiters_ctx->write_limiter = write_limiter;
+    cio_event_loop_post(tcp_connection_ctx->event_loop, 0, limiters_ctx, set_rate_limiters_impl);
+}
+
+static int sample_tcp_info(int fd, struct cio_tcp_connection_stats *stats)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1) {
+        perror("getsockopt(TCP_INFO)");
+        return CIO_SOCKET_OPTION_ERROR;
+    }
+
+    stats->rtt_us = info.tcpi_rtt;
+    stats->rtt_var_us = info.tcpi_rttvar;
+    stats->snd_cwnd = info.tcpi_snd_cwnd;
+    stats->snd_mss = info.tcpi_snd_mss;
+    stats->retransmits = info.tcpi_retransmits;
+    stats->total_retransmits = info.tcpi_total_retrans;
+    stats->has_tcp_info = 1;
+    return CIO_NO_ERROR;
+#else
+    return CIO_NOT_FOUND_ERROR;
+#endif
+}
+
+int cio_tcp_connection_get_stats(void *tcp_connection, struct cio_tcp_connection_stats *stats,
+    int with_tcp_info)
+{
+    struct tcp_connection_ctx *tcp_connection_ctx = tcp_connection;
+
+    *stats = tcp_connection_ctx->stats;
+    stats->last_activity = tcp_connection_ctx->last_activity;
+    if (tcp_connection_ctx->write_pending_since)
+        stats->write_pending_ms += now_time_ms() - tcp_connection_ctx->write_pending_since;
+
+    if (!with_tcp_info)
+        return CIO_NO_ERROR;
+
+    if (tcp_connection_ctx->fd == -1 || tcp_connection_ctx->cstate == CIO_CS_DESTROYED)
+        return CIO_WRONG_STATE_ERROR;
+
+    return sample_tcp_info(tcp_connection_ctx->fd, stats);
+}
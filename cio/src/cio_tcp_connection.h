@@ -8,6 +8,63 @@
 #if !defined(CIO_TCP_CONNECTION_H)
 #define CIO_TCP_CONNECTION_H
 
+#include "cio_socket_options.h"
+
+/**
+ * What to do with a write which would take the queued bytes over the limit (see
+ * cio_tcp_connection_set_write_limit()).
+ */
+enum CIO_WRITE_LIMIT_POLICY {
+    /**
+     * Only that write fails with CIO_WRITE_LIMIT_ERROR.
+     */
+    CIO_WLP_FAIL_WRITE,
+    /**
+     * The connection goes to the error state, all pending operations fail with
+     * CIO_WRITE_LIMIT_ERROR.
+     */
+    CIO_WLP_CLOSE
+};
+
+/**
+ * I/O statistics of a connection (see cio_tcp_connection_get_stats()).
+ */
+struct cio_tcp_connection_stats {
+    long long bytes_read;
+    long long bytes_written;
+    /**
+     * Read and write calls on the socket, and how many of them would have blocked. Many calls per
+     * byte point to small reads or writes.
+     */
+    long long read_calls;
+    long long write_calls;
+    long long read_would_block;
+    long long write_would_block;
+    /**
+     * Read and write operations completed successfully.
+     */
+    long long reads_completed;
+    long long writes_completed;
+    /**
+     * Total time with a write pending, i.e. waiting for a slow peer or the rate limiter.
+     */
+    long long write_pending_ms;
+    /**
+     * time_ms() of the last data sent or received, or of connecting.
+     */
+    long long last_activity;
+    /**
+     * TCP_INFO sample, valid if 'has_tcp_info' is set.
+     */
+    int has_tcp_info;
+    unsigned rtt_us;
+    unsigned rtt_var_us;
+    unsigned snd_cwnd;
+    unsigned snd_mss;
+    unsigned retransmits;
+    unsigned total_retransmits;
+};
+
 /**
  * ctx - user-provided context. It will be passed to the async functions callbacks.
  */
@@ -30,13 +87,175 @@ void cio_free_tcp_connection_async(void *tcp_connection);
  */
 void cio_free_tcp_connection_sync(void *tcp_connection);
 
+/**
+ * Replaces the context passed to the callbacks. Takes effect at once when called from the event
+ * loop thread, e.g. to hand over a connection from within a callback.
+ */
+void cio_tcp_connection_set_user_ctx(void *tcp_connection, void *ctx);
+
+/**
+ * Calls 'on_destroy' with 'ctx' on the event loop thread once the connection is destroyed, i.e.
+ * its socket is closed. Event loop thread only.
+ */
+void cio_tcp_connection_set_on_destroy(void *tcp_connection, void *ctx,
+    void (*on_destroy)(void *ctx));
+
+/**
+ * Checks without blocking that the connection is connected, has no pending operations and no
+ * unread data, and hasn't been closed by the peer. Event loop thread only.
+ */
+int cio_tcp_connection_is_alive(void *tcp_connection);
+
+/**
+ * Fills 'stats' with the connection counters and, if 'with_tcp_info' is set, samples TCP_INFO
+ * (Linux only, CIO_NOT_FOUND_ERROR elsewhere). Event loop thread only.
+ */
+int cio_tcp_connection_get_stats(void *tcp_connection, struct cio_tcp_connection_stats *stats,
+    int with_tcp_info);
+
+/**
+ * Enables (size > 0) or disables (size == 0) read-ahead. With read-ahead on, a read shorter than
+ * 'size' also fills the per-connection buffer of 'size' bytes within the same syscall, and the
+ * following reads are satisfied from that buffer without touching the socket.
+ */
+void cio_tcp_connection_set_read_ahead(void *tcp_connection, int size);
+
+/**
+ * Replaces the connection socket options (see cio_socket_options.h). They are applied to the
+ * connected socket right away and to each socket created by cio_tcp_connection_async_connect()
+ * before connect() is called.
+ */
+void cio_tcp_connection_set_options(void *tcp_connection,
+    const struct cio_socket_options *options);
+
+/**
+ * Timeouts in milliseconds, 0 - none (the default). An operation not completed in time fails with
+ * CIO_TIMEOUT_ERROR and leaves the connection in the error state.
+ *
+ * connect_timeout_ms - per resolved endpoint: when it expires the next endpoint is tried, and only
+ * when none is left 'on_connect' gets CIO_TIMEOUT_ERROR.
+ * read_timeout_ms, write_timeout_ms - for a single read or write operation as a whole.
+ * idle_timeout_ms - for the connection without any data sent or received. All pending operations,
+ * including the readiness waits, fail with CIO_TIMEOUT_ERROR. It only runs while an operation is
+ * pending, so the connection with none stays usable, and the first one started restarts it.
+ *
+ * New timeouts apply to the operations started afterwards.
+ */
+void cio_tcp_connection_set_timeouts(void *tcp_connection, int connect_timeout_ms,
+    int read_timeout_ms, int write_timeout_ms, int idle_timeout_ms);
+
+/**
+ * Enables Happy Eyeballs (RFC 8305) for the following connects, 0 disables it (the default). The
+ * resolved endpoints are reordered to alternate the address families, and the next endpoint is
+ * tried 'attempt_delay_ms' (250 ms recommended) after the previous attempt started, while the
+ * earlier ones are still in flight. The first attempt to succeed wins, the rest are closed.
+ */
+void cio_tcp_connection_set_happy_eyeballs(void *tcp_connection, int attempt_delay_ms);
+
+/**
+ * Makes the following connects resolve with the stub resolver (see cio_dns_resolver.h) instead of
+ * the getaddrinfo() threads, NULL switches back. It must run on the same event loop and outlive
+ * the connects.
+ */
+void cio_tcp_connection_set_dns_resolver(void *tcp_connection, void *dns_resolver);
+
+/**
+ * Makes the following connects try the resolved endpoints in the order of the endpoint selector
+ * (see cio_endpoint_selector.h) and report each attempt to it, NULL switches back to the resolver
+ * order. The selector must outlive the connects.
+ */
+void cio_tcp_connection_set_endpoint_selector(void *tcp_connection, void *endpoint_selector);
+
 void cio_tcp_connection_async_connect(void *tcp_connection, const char *addr, int port,
     void (*on_connect)(void *ctx, int ecode));
 
+/**
+ * Connects and writes 'data', calling 'on_connect' once both are done. 'data' must stay valid
+ * until then. Where the system allows (Linux with the client side of TCP Fast Open enabled) and
+ * the kernel has a Fast Open cookie of the server from an earlier connection, the data goes with
+ * the SYN, saving a round trip. Otherwise it is written right after connecting. The data sent
+ * with a SYN may be delivered twice, so it should be an idempotent request.
+ */
+void cio_tcp_connection_async_connect_send(void *tcp_connection, const char *addr, int port,
+    const void *data, int len, void (*on_connect)(void *ctx, int ecode));
+
 void cio_tcp_connection_async_read(void *tcp_connection, void *data, int len,
     void (*on_read)(void *ctx, int ecode, int read_bytes));
 
+/**
+ * Reads into 'data' until 'delim' is met. On success 'bytes_read' includes the delimiter itself.
+ * Bytes received after the delimiter are kept by the connection and returned by the subsequent
+ * reads. If 'len' bytes are read and no delimiter is found, 'on_read' is called with
+ * CIO_NOT_FOUND_ERROR. If the peer closes the connection in the middle of the line, 'on_read' is
+ * called with CIO_CONNECTION_CLOSED_ERROR and the number of bytes read so far.
+ */
+void cio_tcp_connection_async_read_until(void *tcp_connection, void *data, int len,
+    const void *delim, int delim_len, void (*on_read)(void *ctx, int ecode, int read_bytes));
+
+/**
+ * Same as cio_tcp_connection_async_read() but the buffer is taken from 'buffer_pool' (see
+ * cio_buffer_pool.h) only when the data is actually there, so a connection waiting for data holds
+ * no buffer. On success 'buffer' is handed over to the user who must return it to the pool with
+ * cio_buffer_pool_put(). On error or when the peer closed the connection 'buffer' is NULL.
+ * While the pool is out of buffers, the socket isn't read and the read waits for one to be
+ * returned. If the read timeout expires meanwhile, 'on_read' gets CIO_BUFFER_POOL_EXHAUSTED_ERROR
+ * and, as nothing has been read, the connection stays usable.
+ */
+void cio_tcp_connection_async_read_pooled(void *tcp_connection, void *buffer_pool,
+    void (*on_read)(void *ctx, int ecode, void *buffer, int read_bytes));
+
+/**
+ * Writes issued while the previous ones are in progress are queued and written in order, each
+ * completing with its own 'on_write'. 'data' must stay valid until then. If a write fails, all the
+ * queued ones fail with the same error.
+ */
 void cio_tcp_connection_async_write(void *tcp_connection, const void *data, int len,
     void (*on_write)(void *ctx, int ecode));
 
+/**
+ * Write backpressure. 'on_high_watermark' is called once the bytes queued and not yet written
+ * reach 'high_watermark', so the producer can pause, and 'on_drain' once they fall to
+ * 'low_watermark' afterwards. Both get the queued bytes count. 0 'high_watermark' disables the
+ * notifications (the default).
+ *
+ * With CIO_SO_NOTSENT_LOWAT set (see cio_tcp_connection_set_options()) the kernel takes only a
+ * little unsent data, which also counts as queued, and the drain is reported no earlier than the
+ * kernel unsent data falls below 'not_sent_lowat'.
+ */
+void cio_tcp_connection_set_write_watermarks(void *tcp_connection, int low_watermark,
+    int high_watermark, void (*on_high_watermark)(void *ctx, int queued_bytes),
+    void (*on_drain)(void *ctx, int queued_bytes));
+
+/**
+ * Hard limit of the queued bytes, 0 - none (the default). A write which would exceed it is
+ * handled according to 'policy'.
+ */
+void cio_tcp_connection_set_write_limit(void *tcp_connection, int write_limit,
+    enum CIO_WRITE_LIMIT_POLICY policy);
+
+/**
+ * Attaches rate limiters (see cio_rate_limiter.h) to the reads and the writes, NULL - none. When a
+ * limiter runs out of tokens, the socket stops being polled in that direction and the I/O resumes
+ * from a loop timer once the tokens are refilled. The limiters must outlive the connection or be
+ * detached first.
+ */
+void cio_tcp_connection_set_rate_limiters(void *tcp_connection, void *read_limiter,
+    void *write_limiter);
+
+/**
+ * Calls 'on_readable' once the connection has data to read (or the peer closed it) without
+ * reading anything, so no buffer is needed while waiting. Data already kept by the connection
+ * (see cio_tcp_connection_set_read_ahead()) completes the wait immediately. On a socket error
+ * 'on_readable' is called with CIO_POLL_ERROR. Only one readable wait may be pending.
+ */
+void cio_tcp_connection_async_wait_readable(void *tcp_connection,
+    void (*on_readable)(void *ctx, int ecode));
+
+/**
+ * Calls 'on_writable' once the socket send buffer has room. Only one writable wait may be
+ * pending.
+ */
+void cio_tcp_connection_async_wait_writable(void *tcp_connection,
+    void (*on_writable)(void *ctx, int ecode));
+
 #endif /* CIO_TCP_CONNECTION_H */
@@ -0,0 +1,2 @@
+#define HAVE_POLL_H
+#define HAVE_EPOLL_H
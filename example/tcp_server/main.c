@@ -175,7 +175,8 @@ fail:
     free_connection_ctx(cctx);
 }
 
-static void on_accept(int fd, void *user_ctx, int ecode)
+static void on_accept(int fd, void *user_ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len)
 {
     struct connection_ctx *cctx;
     void *connection = NULL;
@@ -200,6 +201,7 @@ static void on_accept(int fd, void *user_ctx, int ecode)
     }
 
     cctx->connection = connection;
+    cio_tcp_connection_set_read_ahead(cctx->connection, 64 * 1024);
     cio_tcp_connection_async_read(cctx->connection, cctx->buf, sizeof(cctx->buf), on_read);
 
     return;
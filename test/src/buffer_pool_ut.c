@@ -0,0 +1,54 @@
+#include "buffer_pool_ut.h"
+#include <cio_buffer_pool.h>
+#include <ct.h>
+#include <stddef.h>
+
+static const int BUFFER_SIZE = 1024;
+static const int MAX_IDLE = 1;
+static const int MAX_TOTAL = 2;
+
+int setup_buffer_pool_tests(void **ctx)
+{
+    if (!(*ctx = cio_new_buffer_pool(BUFFER_SIZE, MAX_IDLE, MAX_TOTAL)))
+        return -1;
+
+    return 0;
+}
+
+int teardown_buffer_pool_tests(void **ctx)
+{
+    ASSERT_EQ_INT(0, cio_buffer_pool_in_use(*ctx));
+    cio_free_buffer_pool(*ctx);
+    return 0;
+}
+
+void test_buffer_pool_reuse(void **ctx)
+{
+    void *buffer, *buffer1;
+
+    ASSERT_EQ_INT(BUFFER_SIZE, cio_buffer_pool_buffer_size(*ctx));
+    ASSERT_NE_PTR(NULL, (buffer = cio_buffer_pool_get(*ctx)));
+    ASSERT_EQ_INT(1, cio_buffer_pool_in_use(*ctx));
+
+    cio_buffer_pool_put(*ctx, buffer);
+    ASSERT_EQ_INT(0, cio_buffer_pool_in_use(*ctx));
+
+    /* The only idle buffer is given out again. */
+    ASSERT_EQ_PTR(buffer, (buffer1 = cio_buffer_pool_get(*ctx)));
+    cio_buffer_pool_put(*ctx, buffer1);
+}
+
+void test_buffer_pool_max_total(void **ctx)
+{
+    void *buffer, *buffer1;
+
+    ASSERT_NE_PTR(NULL, (buffer = cio_buffer_pool_get(*ctx)));
+    ASSERT_NE_PTR(NULL, (buffer1 = cio_buffer_pool_get(*ctx)));
+    ASSERT_EQ_PTR(NULL, cio_buffer_pool_get(*ctx));
+
+    cio_buffer_pool_put(*ctx, buffer);
+    ASSERT_NE_PTR(NULL, (buffer = cio_buffer_pool_get(*ctx)));
+
+    cio_buffer_pool_put(*ctx, buffer);
+    cio_buffer_pool_put(*ctx, buffer1);
+}
@@ -0,0 +1,10 @@
+#if !defined(CIO_BUFFER_POOL_UT_H)
+#define CIO_BUFFER_POOL_UT_H
+
+int setup_buffer_pool_tests(void **ctx);
+int teardown_buffer_pool_tests(void **ctx);
+
+void test_buffer_pool_reuse(void **ctx);
+void test_buffer_pool_max_total(void **ctx);
+
+#endif // CIO_BUFFER_POOL_UT_H
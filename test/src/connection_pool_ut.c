@@ -0,0 +1,264 @@
+#include "connection_pool_ut.h"
+#include <cio_connection_pool.h>
+#include <cio_tcp_acceptor.h>
+#include <cio_event_loop.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_ACCEPTED 8
+
+static const char *const SERVER_ADDR = "127.0.0.1";
+static const int SERVER_PORT = 23656;
+
+struct pool_tests {
+    void *event_loop;
+    pthread_t event_loop_thread;
+    pthread_mutex_t mutex;
+    void *acceptor;
+    void *pool;
+    int accepted_fds[MAX_ACCEPTED];
+    int accepted;
+};
+
+struct checkout_result {
+    struct pool_tests *fixture;
+    int done;
+    int ecode;
+    void *connection;
+};
+
+static void *event_loop_run_func(void *ctx)
+{
+    return (void *) cio_event_loop_run(ctx);
+}
+
+static void on_accept(int fd, void *ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len)
+{
+    struct pool_tests *fixture = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    pthread_mutex_lock(&fixture->mutex);
+    ASSERT_LT_INT(fixture->accepted, MAX_ACCEPTED);
+    fixture->accepted_fds[fixture->accepted++] = fd;
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+int setup_connection_pool_tests(void **ctx)
+{
+    struct pool_tests *fixture;
+
+    if (!(fixture = malloc(sizeof(*fixture))))
+        return 1;
+
+    memset(fixture, 0, sizeof(*fixture));
+    fixture->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    *ctx = fixture;
+    if (!(fixture->event_loop = cio_new_event_loop(64)))
+        return 1;
+
+    if (!(fixture->acceptor = cio_new_tcp_acceptor(fixture->event_loop, fixture)))
+        return 1;
+
+    if (pthread_create(&fixture->event_loop_thread, NULL, event_loop_run_func,
+                       fixture->event_loop))
+        return 1;
+
+    cio_tcp_acceptor_async_accept(fixture->acceptor, SERVER_ADDR, SERVER_PORT, on_accept);
+    return 0;
+}
+
+int teardown_connection_pool_tests(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    void *result;
+    int i;
+
+    cio_free_connection_pool_sync(fixture->pool);
+    cio_free_tcp_acceptor_sync(fixture->acceptor);
+    cio_event_loop_stop(fixture->event_loop);
+    ASSERT_EQ_INT(0, pthread_join(fixture->event_loop_thread, &result));
+    cio_free_event_loop(fixture->event_loop);
+    for (i = 0; i < fixture->accepted; ++i)
+        if (fixture->accepted_fds[i] != -1)
+            close(fixture->accepted_fds[i]);
+    pthread_mutex_destroy(&fixture->mutex);
+    free(fixture);
+    return 0;
+}
+
+static void given_pool(struct pool_tests *fixture, int max_idle, int max_total,
+                       int idle_timeout_ms)
+{
+    ASSERT_NE_PTR(NULL, (fixture->pool = cio_new_connection_pool(fixture->event_loop, max_idle,
+                                                                 max_total, idle_timeout_ms)));
+}
+
+static void on_checkout(void *ctx, int ecode, void *connection)
+{
+    struct checkout_result *result = ctx;
+
+    pthread_mutex_lock(&result->fixture->mutex);
+    result->ecode = ecode;
+    result->connection = connection;
+    result->done = 1;
+    pthread_mutex_unlock(&result->fixture->mutex);
+}
+
+static void on_checkout_checkin(void *ctx, int ecode, void *connection)
+{
+    struct checkout_result *result = ctx;
+
+    if (ecode == CIO_NO_ERROR)
+        cio_connection_pool_checkin(result->fixture->pool, connection, 1);
+    on_checkout(ctx, ecode, connection);
+}
+
+static void when_checked_out(struct pool_tests *fixture, struct checkout_result *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->fixture = fixture;
+    cio_connection_pool_async_checkout(fixture->pool, SERVER_ADDR, SERVER_PORT, result,
+                                       on_checkout);
+}
+
+static int is_done(struct checkout_result *result)
+{
+    int done;
+
+    pthread_mutex_lock(&result->fixture->mutex);
+    done = result->done;
+    pthread_mutex_unlock(&result->fixture->mutex);
+    return done;
+}
+
+static void then_checkout_succeeds(struct checkout_result *result)
+{
+    while (!is_done(result))
+        usleep(5 * 1000);
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, result->ecode);
+    ASSERT_NE_PTR(NULL, result->connection);
+}
+
+static void then_accepted_count_is(struct pool_tests *fixture, int expected)
+{
+    int accepted;
+
+    /* The accept may be dispatched after the connect completion. */
+    usleep(20 * 1000);
+    pthread_mutex_lock(&fixture->mutex);
+    accepted = fixture->accepted;
+    pthread_mutex_unlock(&fixture->mutex);
+    ASSERT_EQ_INT(expected, accepted);
+}
+
+void test_connection_pool_reuse(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    struct checkout_result first, second, third;
+
+    given_pool(fixture, 1, 0, 0);
+    when_checked_out(fixture, &first);
+    then_checkout_succeeds(&first);
+
+    cio_connection_pool_checkin(fixture->pool, first.connection, 1);
+    when_checked_out(fixture, &second);
+    then_checkout_succeeds(&second);
+    ASSERT_EQ_PTR(first.connection, second.connection);
+    then_accepted_count_is(fixture, 1);
+
+    /* Not reusable connections are closed. */
+    cio_connection_pool_checkin(fixture->pool, second.connection, 0);
+    when_checked_out(fixture, &third);
+    then_checkout_succeeds(&third);
+    then_accepted_count_is(fixture, 2);
+    cio_connection_pool_checkin(fixture->pool, third.connection, 1);
+}
+
+void test_connection_pool_max_total(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    struct checkout_result first, second;
+
+    given_pool(fixture, 1, 1, 0);
+    when_checked_out(fixture, &first);
+    then_checkout_succeeds(&first);
+
+    when_checked_out(fixture, &second);
+    usleep(50 * 1000);
+    ASSERT_FALSE(is_done(&second));
+
+    /* The waiting checkout gets the connection checked in. */
+    cio_connection_pool_checkin(fixture->pool, first.connection, 1);
+    then_checkout_succeeds(&second);
+    ASSERT_EQ_PTR(first.connection, second.connection);
+    then_accepted_count_is(fixture, 1);
+    cio_connection_pool_checkin(fixture->pool, second.connection, 1);
+}
+
+void test_connection_pool_peer_closed(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    struct checkout_result first, second;
+
+    given_pool(fixture, 1, 0, 0);
+    when_checked_out(fixture, &first);
+    then_checkout_succeeds(&first);
+    then_accepted_count_is(fixture, 1);
+    cio_connection_pool_checkin(fixture->pool, first.connection, 1);
+
+    pthread_mutex_lock(&fixture->mutex);
+    close(fixture->accepted_fds[0]);
+    fixture->accepted_fds[0] = -1;
+    pthread_mutex_unlock(&fixture->mutex);
+    usleep(20 * 1000);
+
+    /* The idle connection closed by the peer is not handed out. */
+    when_checked_out(fixture, &second);
+    then_checkout_succeeds(&second);
+    then_accepted_count_is(fixture, 2);
+    cio_connection_pool_checkin(fixture->pool, second.connection, 1);
+}
+
+void test_connection_pool_idle_timeout(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    struct checkout_result first, second;
+
+    given_pool(fixture, 1, 0, 50);
+    when_checked_out(fixture, &first);
+    then_checkout_succeeds(&first);
+    cio_connection_pool_checkin(fixture->pool, first.connection, 1);
+
+    /* The reaper closes the connection idle for too long. */
+    usleep(150 * 1000);
+    when_checked_out(fixture, &second);
+    then_checkout_succeeds(&second);
+    then_accepted_count_is(fixture, 2);
+    cio_connection_pool_checkin(fixture->pool, second.connection, 1);
+}
+
+void test_connection_pool_checkin_on_loop_thread(void **ctx)
+{
+    struct pool_tests *fixture = *ctx;
+    struct checkout_result first, second;
+
+    given_pool(fixture, 1, 1, 0);
+    memset(&first, 0, sizeof(first));
+    first.fixture = fixture;
+    cio_connection_pool_async_checkout(fixture->pool, SERVER_ADDR, SERVER_PORT, &first,
+                                       on_checkout_checkin);
+    then_checkout_succeeds(&first);
+
+    /* Checked in right away from the callback, so the slot is free again. */
+    when_checked_out(fixture, &second);
+    then_checkout_succeeds(&second);
+    ASSERT_EQ_PTR(first.connection, second.connection);
+    then_accepted_count_is(fixture, 1);
+    cio_connection_pool_checkin(fixture->pool, second.connection, 1);
+}
@@ -0,0 +1,13 @@
+#if !defined(CIO_CONNECTION_POOL_UT_H)
+#define CIO_CONNECTION_POOL_UT_H
+
+int setup_connection_pool_tests(void **ctx);
+int teardown_connection_pool_tests(void **ctx);
+
+void test_connection_pool_reuse(void **ctx);
+void test_connection_pool_max_total(void **ctx);
+void test_connection_pool_peer_closed(void **ctx);
+void test_connection_pool_idle_timeout(void **ctx);
+void test_connection_pool_checkin_on_loop_thread(void **ctx);
+
+#endif // CIO_CONNECTION_POOL_UT_H
@@ -0,0 +1,526 @@
+#include "dns_resolver_ut.h"
+#include <cio_dns_resolver.h>
+#include <cio_tcp_connection.h>
+#include <cio_event_loop.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/**
+ * Stand-in DNS server on a local UDP port answering the ".test" names below.
+ */
+struct dns_server {
+    int fd;
+    int port;
+    pthread_t thread;
+    int stop;
+    int queries;
+    int dropped;
+    /**
+     * Of the first queries.
+     */
+    int source_ports[8];
+};
+
+struct dns_resolver_tests {
+    void *event_loop;
+    pthread_t event_loop_thread;
+    pthread_mutex_t mutex;
+    struct dns_server server;
+    struct cio_dns_config config;
+    void *dns_resolver;
+    char hosts_path[64];
+    char resolv_conf_path[64];
+};
+
+struct resolve_result {
+    struct dns_resolver_tests *fixture;
+    int done;
+    int ecode;
+    void *resolver;
+};
+
+static void *event_loop_run_func(void *ctx)
+{
+    return (void *) (long) cio_event_loop_run(ctx);
+}
+
+static int append_answer(unsigned char *msg, int pos, int type, const void *data, int len)
+{
+    unsigned char header[] = {
+        0xc0, 12, type >> 8, type & 0xff, 0, 1, 0, 0, 0, 60, len >> 8, len & 0xff
+    };
+
+    memcpy(msg + pos, header, sizeof(header));
+    memcpy(msg + pos + sizeof(header), data, len);
+    return pos + sizeof(header) + len;
+}
+
+/**
+ * example.test - two A and one AAAA records, alias.test - CNAME to example.test with its A
+ * record, drop.test - the first query is dropped, silent.test - never answered, the rest don't
+ * exist.
+ */
+static int answer(struct dns_server *server, unsigned char *msg, int len)
+{
+    unsigned char a1[] = { 10, 1, 2, 3 }, a2[] = { 10, 1, 2, 4 };
+    unsigned char aaaa[16] = { 0xfd, 0, [15] = 1 };
+    unsigned char cname[] = { 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 4, 't', 'e', 's', 't', 0 };
+    char name[256];
+    int pos = 12, name_len = 0, type, count = 0;
+
+    while (pos < len && msg[pos]) {
+        if (name_len)
+            name[name_len++] = '.';
+        memcpy(name + name_len, msg + pos + 1, msg[pos]);
+        name_len += msg[pos];
+        pos += msg[pos] + 1;
+    }
+    name[name_len] = '\0';
+    type = (msg[pos + 1] << 8) | msg[pos + 2];
+    pos += 5;
+
+    if (!strcmp(name, "silent.test") || (!strcmp(name, "drop.test") && !server->dropped++))
+        return 0;
+
+    msg[2] = 0x81;
+    msg[3] = 0x80;
+    if (!strcmp(name, "example.test") || !strcmp(name, "drop.test")) {
+        if (type == 1) {
+            pos = append_answer(msg, pos, 1, a1, 4);
+            pos = append_answer(msg, pos, 1, a2, 4);
+            count = 2;
+        } else {
+            pos = append_answer(msg, pos, 28, aaaa, 16);
+            count = 1;
+        }
+    } else if (!strcmp(name, "alias.test")) {
+        pos = append_answer(msg, pos, 5, cname, sizeof(cname));
+        count = 1;
+        if (type == 1) {
+            pos = append_answer(msg, pos, 1, a1, 4);
+            count = 2;
+        }
+    } else {
+        msg[3] |= 3;
+    }
+    msg[7] = count;
+
+    return pos;
+}
+
+static void *dns_server_func(void *ctx)
+{
+    struct dns_resolver_tests *fixture = ctx;
+    struct dns_server *server = &fixture->server;
+    unsigned char msg[512];
+    struct sockaddr_storage from;
+    socklen_t from_len;
+    int len, stop = 0;
+
+    while (!stop) {
+        from_len = sizeof(from);
+        len = recvfrom(server->fd, msg, sizeof(msg), 0, (struct sockaddr *) &from, &from_len);
+        pthread_mutex_lock(&fixture->mutex);
+        if (len > 12) {
+            if (server->queries < 8)
+                server->source_ports[server->queries] =
+                    ntohs(((struct sockaddr_in *) &from)->sin_port);
+            server->queries++;
+            if ((len = answer(server, msg, len)) > 0)
+                sendto(server->fd, msg, len, 0, (struct sockaddr *) &from, from_len);
+        }
+        stop = server->stop;
+        pthread_mutex_unlock(&fixture->mutex);
+    }
+
+    return NULL;
+}
+
+static int start_dns_server(struct dns_resolver_tests *fixture)
+{
+    struct dns_server *server = &fixture->server;
+    struct timeval timeout = { 0, 20 * 1000 };
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((server->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0
+            || setsockopt(server->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+            || bind(server->fd, (struct sockaddr *) &addr, sizeof(addr))
+            || getsockname(server->fd, (struct sockaddr *) &addr, &addr_len))
+        return 1;
+
+    server->port = ntohs(addr.sin_port);
+    return pthread_create(&server->thread, NULL, dns_server_func, fixture);
+}
+
+static int write_file(char *path, const char *content)
+{
+    FILE *file;
+    int fd;
+
+    strcpy(path, "/tmp/cio_dns_XXXXXX");
+    if ((fd = mkstemp(path)) < 0 || !(file = fdopen(fd, "w")))
+        return 1;
+
+    fputs(content, file);
+    fclose(file);
+    return 0;
+}
+
+int setup_dns_resolver_tests(void **ctx)
+{
+    struct dns_resolver_tests *fixture;
+
+    if (!(fixture = malloc(sizeof(*fixture))))
+        return 1;
+
+    memset(fixture, 0, sizeof(*fixture));
+    fixture->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    fixture->server.fd = -1;
+    *ctx = fixture;
+    if (!(fixture->event_loop = cio_new_event_loop(64)))
+        return 1;
+
+    if (pthread_create(&fixture->event_loop_thread, NULL, event_loop_run_func,
+                       fixture->event_loop))
+        return 1;
+
+    if (start_dns_server(fixture))
+        return 1;
+
+    if (write_file(fixture->hosts_path, "# comment\n10.9.8.7 myhost.test alias2.test\n"
+                   "::1 myhost.test\n127.0.0.1 loopback.test\n"))
+        return 1;
+
+    cio_dns_config_load(&fixture->config, "/nonexistent");
+    fixture->config.server_count = 0;
+    cio_dns_config_add_server(&fixture->config, "127.0.0.1", fixture->server.port);
+    fixture->config.timeout_ms = 100;
+    fixture->config.attempts = 2;
+    strcpy(fixture->config.hosts_path, fixture->hosts_path);
+
+    return 0;
+}
+
+int teardown_dns_resolver_tests(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    void *result;
+
+    cio_free_dns_resolver_sync(fixture->dns_resolver);
+    cio_event_loop_stop(fixture->event_loop);
+    ASSERT_EQ_INT(0, pthread_join(fixture->event_loop_thread, &result));
+    cio_free_event_loop(fixture->event_loop);
+
+    pthread_mutex_lock(&fixture->mutex);
+    fixture->server.stop = 1;
+    pthread_mutex_unlock(&fixture->mutex);
+    ASSERT_EQ_INT(0, pthread_join(fixture->server.thread, &result));
+    close(fixture->server.fd);
+
+    unlink(fixture->hosts_path);
+    if (*fixture->resolv_conf_path)
+        unlink(fixture->resolv_conf_path);
+    pthread_mutex_destroy(&fixture->mutex);
+    free(fixture);
+    return 0;
+}
+
+static void given_dns_resolver(struct dns_resolver_tests *fixture)
+{
+    ASSERT_NE_PTR(NULL, (fixture->dns_resolver = cio_new_dns_resolver(fixture->event_loop,
+                                                                      &fixture->config)));
+}
+
+static void on_resolved(void *ctx, int ecode, void *resolver)
+{
+    struct resolve_result *result = ctx;
+
+    pthread_mutex_lock(&result->fixture->mutex);
+    result->ecode = ecode;
+    result->resolver = resolver;
+    result->done = 1;
+    pthread_mutex_unlock(&result->fixture->mutex);
+}
+
+static void when_resolved(struct dns_resolver_tests *fixture, const char *name, int family,
+                          struct resolve_result *result)
+{
+    int done = 0;
+
+    memset(result, 0, sizeof(*result));
+    result->fixture = fixture;
+    cio_dns_resolver_async_resolve(fixture->dns_resolver, name, 80, family, SOCK_STREAM, result,
+                                   on_resolved);
+    while (!done) {
+        usleep(5 * 1000);
+        pthread_mutex_lock(&fixture->mutex);
+        done = result->done;
+        pthread_mutex_unlock(&fixture->mutex);
+    }
+}
+
+/**
+ * Checks the endpoints against the "a.b.c.d" or IPv6 strings, in order, and frees the resolver.
+ */
+static void then_endpoints_are(struct resolve_result *result, const char **expected, int count)
+{
+    struct addrinfo ainfo;
+    char buf[INET6_ADDRSTRLEN];
+    const void *addr;
+    int i;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, result->ecode);
+    for (i = 0; i < count; ++i) {
+        ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(result->resolver, &ainfo));
+        ASSERT_EQ_INT(SOCK_STREAM, ainfo.ai_socktype);
+        if (ainfo.ai_family == AF_INET) {
+            addr = &((struct sockaddr_in *) ainfo.ai_addr)->sin_addr;
+            ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in *) ainfo.ai_addr)->sin_port));
+        } else {
+            addr = &((struct sockaddr_in6 *) ainfo.ai_addr)->sin6_addr;
+            ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in6 *) ainfo.ai_addr)->sin6_port));
+        }
+        ASSERT_NE_PTR(NULL, inet_ntop(ainfo.ai_family, addr, buf, sizeof(buf)));
+        ASSERT_EQ_INT(0, strcmp(expected[i], buf));
+    }
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_resolver_next_endpoint(result->resolver, &ainfo));
+    cio_free_resolver(result->resolver);
+}
+
+static int server_queries(struct dns_resolver_tests *fixture)
+{
+    int queries;
+
+    pthread_mutex_lock(&fixture->mutex);
+    queries = fixture->server.queries;
+    pthread_mutex_unlock(&fixture->mutex);
+
+    return queries;
+}
+
+void test_dns_resolver_config(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct cio_dns_config config;
+    struct sockaddr_in *server;
+
+    ASSERT_EQ_INT(0, write_file(fixture->resolv_conf_path, "# comment\nsearch example.com\n"
+                                "nameserver 10.0.0.1\nnameserver ::1\n"
+                                "options ndots:1 timeout:2 attempts:3\n"));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_dns_config_load(&config, fixture->resolv_conf_path));
+    ASSERT_EQ_INT(2, config.server_count);
+    server = (struct sockaddr_in *) &config.servers[0];
+    ASSERT_EQ_INT(AF_INET, server->sin_family);
+    ASSERT_EQ_INT(53, ntohs(server->sin_port));
+    ASSERT_EQ_INT(AF_INET6, config.servers[1].ss_family);
+    ASSERT_EQ_INT(2000, config.timeout_ms);
+    ASSERT_EQ_INT(3, config.attempts);
+    ASSERT_EQ_INT(0, strcmp("/etc/hosts", config.hosts_path));
+
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_dns_config_load(&config, "/nonexistent"));
+    ASSERT_EQ_INT(1, config.server_count);
+    server = (struct sockaddr_in *) &config.servers[0];
+    ASSERT_EQ_INT(htonl(INADDR_LOOPBACK), server->sin_addr.s_addr);
+    ASSERT_EQ_INT(5000, config.timeout_ms);
+    ASSERT_EQ_INT(2, config.attempts);
+    ASSERT_EQ_INT(CIO_INVALID_ARGUMENT_ERROR, cio_dns_config_add_server(&config, "host", 53));
+}
+
+void test_dns_resolver_resolve(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    const char *all[] = { "10.1.2.3", "10.1.2.4", "fd00::1" };
+    const char *alias[] = { "10.1.2.3" };
+
+    given_dns_resolver(fixture);
+    when_resolved(fixture, "example.test", AF_UNSPEC, &result);
+    then_endpoints_are(&result, all, 3);
+    ASSERT_EQ_INT(2, server_queries(fixture));
+
+    when_resolved(fixture, "alias.test.", AF_INET, &result);
+    then_endpoints_are(&result, alias, 1);
+    ASSERT_EQ_INT(3, server_queries(fixture));
+}
+
+void test_dns_resolver_not_found(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+
+    given_dns_resolver(fixture);
+    when_resolved(fixture, "missing.test", AF_UNSPEC, &result);
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, result.ecode);
+    ASSERT_EQ_PTR(NULL, result.resolver);
+
+    /* alias.test has no AAAA record. */
+    when_resolved(fixture, "alias.test", AF_INET6, &result);
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, result.ecode);
+
+    when_resolved(fixture, "bad..name", AF_INET, &result);
+    ASSERT_EQ_INT(CIO_INVALID_ARGUMENT_ERROR, result.ecode);
+}
+
+void test_dns_resolver_retry(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    const char *expected[] = { "10.1.2.3", "10.1.2.4" };
+    long long started;
+    struct timeval tv;
+
+    given_dns_resolver(fixture);
+    when_resolved(fixture, "drop.test", AF_INET, &result);
+    then_endpoints_are(&result, expected, 2);
+    ASSERT_EQ_INT(2, server_queries(fixture));
+
+    gettimeofday(&tv, NULL);
+    started = time_ms(&tv);
+    when_resolved(fixture, "silent.test", AF_INET, &result);
+    gettimeofday(&tv, NULL);
+    ASSERT_EQ_INT(CIO_TIMEOUT_ERROR, result.ecode);
+    ASSERT_EQ_INT(4, server_queries(fixture));
+    ASSERT_LE_INT(190, time_ms(&tv) - started);
+}
+
+/**
+ * Takes all the fds left under a lowered limit. Returns how many.
+ */
+static int when_out_of_fds(struct rlimit *saved_limit, int *fds, int max_fds)
+{
+    struct rlimit limit;
+    int count = 0;
+
+    ASSERT_EQ_INT(0, getrlimit(RLIMIT_NOFILE, saved_limit));
+    limit = *saved_limit;
+    limit.rlim_cur = CIO_MIN(limit.rlim_cur, 256);
+    ASSERT_EQ_INT(0, setrlimit(RLIMIT_NOFILE, &limit));
+    while (count < max_fds && (fds[count] = dup(0)) != -1)
+        count++;
+    ASSERT_LT_INT(count, max_fds);
+
+    return count;
+}
+
+static void then_fds_are_given_back(struct rlimit *saved_limit, int *fds, int count)
+{
+    while (count > 0)
+        close(fds[--count]);
+    ASSERT_EQ_INT(0, setrlimit(RLIMIT_NOFILE, saved_limit));
+}
+
+void test_dns_resolver_no_socket(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    struct rlimit limit;
+    int fds[256], count;
+
+    given_dns_resolver(fixture);
+
+    /* Out of fds the query sockets can't be opened, the lookup still ends after the retries. */
+    count = when_out_of_fds(&limit, fds, 256);
+    when_resolved(fixture, "example.test", AF_INET, &result);
+    then_fds_are_given_back(&limit, fds, count);
+
+    ASSERT_EQ_INT(CIO_TIMEOUT_ERROR, result.ecode);
+    ASSERT_EQ_PTR(NULL, result.resolver);
+    ASSERT_EQ_INT(0, server_queries(fixture));
+}
+
+void test_dns_resolver_source_ports(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    const char *alias[] = { "10.1.2.3" };
+    int i;
+
+    given_dns_resolver(fixture);
+    for (i = 0; i < 3; ++i) {
+        when_resolved(fixture, "alias.test", AF_INET, &result);
+        then_endpoints_are(&result, alias, 1);
+    }
+
+    /* Every lookup has a socket of its own, so the ports aren't all the same. */
+    pthread_mutex_lock(&fixture->mutex);
+    ASSERT_EQ_INT(3, fixture->server.queries);
+    ASSERT_TRUE(fixture->server.source_ports[0] != fixture->server.source_ports[1]
+                || fixture->server.source_ports[1] != fixture->server.source_ports[2]);
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+void test_dns_resolver_hosts(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    const char *both[] = { "10.9.8.7", "::1" };
+    const char *alias[] = { "10.9.8.7" };
+    const char *numeric[] = { "192.168.1.1" };
+
+    given_dns_resolver(fixture);
+    when_resolved(fixture, "MyHost.test", AF_UNSPEC, &result);
+    then_endpoints_are(&result, both, 2);
+    when_resolved(fixture, "alias2.test", AF_UNSPEC, &result);
+    then_endpoints_are(&result, alias, 1);
+    when_resolved(fixture, "192.168.1.1", AF_UNSPEC, &result);
+    then_endpoints_are(&result, numeric, 1);
+    ASSERT_EQ_INT(0, server_queries(fixture));
+}
+
+static void on_connect(void *ctx, int ecode)
+{
+    struct resolve_result *result = ctx;
+
+    pthread_mutex_lock(&result->fixture->mutex);
+    result->ecode = ecode;
+    result->done = 1;
+    pthread_mutex_unlock(&result->fixture->mutex);
+}
+
+void test_dns_resolver_connect(void **ctx)
+{
+    struct dns_resolver_tests *fixture = *ctx;
+    struct resolve_result result;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    void *connection;
+    int listen_fd, done = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_NE_INT(-1, (listen_fd = socket(AF_INET, SOCK_STREAM, 0)));
+    ASSERT_EQ_INT(0, bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)));
+    ASSERT_EQ_INT(0, listen(listen_fd, 1));
+    ASSERT_EQ_INT(0, getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len));
+
+    given_dns_resolver(fixture);
+    memset(&result, 0, sizeof(result));
+    result.fixture = fixture;
+    ASSERT_NE_PTR(NULL, (connection = cio_new_tcp_connection(fixture->event_loop, &result)));
+    cio_tcp_connection_set_dns_resolver(connection, fixture->dns_resolver);
+    cio_tcp_connection_async_connect(connection, "loopback.test", ntohs(addr.sin_port),
+                                     on_connect);
+    while (!done) {
+        usleep(5 * 1000);
+        pthread_mutex_lock(&fixture->mutex);
+        done = result.done;
+        pthread_mutex_unlock(&fixture->mutex);
+    }
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, result.ecode);
+    ASSERT_EQ_INT(0, server_queries(fixture));
+    cio_free_tcp_connection_sync(connection);
+    close(listen_fd);
+}
@@ -0,0 +1,16 @@
+#if !defined(CIO_DNS_RESOLVER_UT_H)
+#define CIO_DNS_RESOLVER_UT_H
+
+int setup_dns_resolver_tests(void **ctx);
+int teardown_dns_resolver_tests(void **ctx);
+
+void test_dns_resolver_config(void **ctx);
+void test_dns_resolver_resolve(void **ctx);
+void test_dns_resolver_not_found(void **ctx);
+void test_dns_resolver_retry(void **ctx);
+void test_dns_resolver_source_ports(void **ctx);
+void test_dns_resolver_no_socket(void **ctx);
+void test_dns_resolver_hosts(void **ctx);
+void test_dns_resolver_connect(void **ctx);
+
+#endif // CIO_DNS_RESOLVER_UT_H
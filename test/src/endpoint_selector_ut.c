@@ -0,0 +1,114 @@
+#include "endpoint_selector_ut.h"
+#include <cio_endpoint_selector.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define ENDPOINT_COUNT 4
+
+struct endpoints {
+    struct sockaddr_in addrs[ENDPOINT_COUNT];
+    struct addrinfo nodes[ENDPOINT_COUNT];
+};
+
+/**
+ * 10.0.0.1 - 10.0.0.<count>, linked in that order.
+ */
+static struct addrinfo *given_endpoints(struct endpoints *endpoints, int count)
+{
+    int i;
+
+    memset(endpoints, 0, sizeof(*endpoints));
+    for (i = 0; i < count; ++i) {
+        endpoints->addrs[i].sin_family = AF_INET;
+        endpoints->addrs[i].sin_port = htons(80);
+        endpoints->addrs[i].sin_addr.s_addr = htonl(0x0a000001 + i);
+        endpoints->nodes[i].ai_family = AF_INET;
+        endpoints->nodes[i].ai_addr = (struct sockaddr *) &endpoints->addrs[i];
+        endpoints->nodes[i].ai_addrlen = sizeof(endpoints->addrs[i]);
+        endpoints->nodes[i].ai_next = i < count - 1 ? &endpoints->nodes[i + 1] : NULL;
+    }
+
+    return endpoints->nodes;
+}
+
+static void when_reported(void *selector, struct endpoints *endpoints, int i, int ecode,
+                          int latency_ms)
+{
+    cio_endpoint_selector_report(selector, (struct sockaddr *) &endpoints->addrs[i],
+                                 sizeof(endpoints->addrs[i]), ecode, latency_ms);
+}
+
+void test_endpoint_selector_stats(void **ctx)
+{
+    struct endpoints endpoints;
+    struct cio_endpoint_stats stats;
+    void *selector;
+
+    ASSERT_NE_PTR(NULL, (selector = cio_new_endpoint_selector(CIO_SELECT_P2C)));
+    given_endpoints(&endpoints, 2);
+    when_reported(selector, &endpoints, 0, CIO_NO_ERROR, 10);
+    when_reported(selector, &endpoints, 0, CIO_NO_ERROR, 20);
+    when_reported(selector, &endpoints, 0, CIO_TIMEOUT_ERROR, 1000);
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_endpoint_selector_get_stats(selector,
+        (struct sockaddr *) &endpoints.addrs[0], sizeof(endpoints.addrs[0]), &stats));
+    ASSERT_EQ_INT(3, stats.connects);
+    ASSERT_EQ_INT(1, stats.failures);
+    /* 10 * 0.7 + 20 * 0.3, the failure doesn't count. */
+    ASSERT_EQ_INT(13, (int) (stats.latency_ms + 0.5));
+    ASSERT_EQ_INT(30, (int) (stats.failure_rate * 100 + 0.5));
+
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_endpoint_selector_get_stats(selector,
+        (struct sockaddr *) &endpoints.addrs[1], sizeof(endpoints.addrs[1]), &stats));
+    cio_free_endpoint_selector(selector);
+}
+
+void test_endpoint_selector_least_latency(void **ctx)
+{
+    struct endpoints endpoints;
+    struct addrinfo *list;
+    void *selector;
+
+    ASSERT_NE_PTR(NULL, (selector = cio_new_endpoint_selector(CIO_SELECT_LEAST_LATENCY)));
+    list = given_endpoints(&endpoints, 4);
+    when_reported(selector, &endpoints, 0, CIO_NO_ERROR, 50);
+    when_reported(selector, &endpoints, 1, CIO_NO_ERROR, 5);
+    when_reported(selector, &endpoints, 2, CIO_POLL_ERROR, 1);
+
+    /* Never connected to first, failing last. */
+    list = cio_endpoint_selector_order(selector, list);
+    ASSERT_EQ_PTR(&endpoints.nodes[3], list);
+    ASSERT_EQ_PTR(&endpoints.nodes[1], list->ai_next);
+    ASSERT_EQ_PTR(&endpoints.nodes[0], list->ai_next->ai_next);
+    ASSERT_EQ_PTR(&endpoints.nodes[2], list->ai_next->ai_next->ai_next);
+    ASSERT_EQ_PTR(NULL, list->ai_next->ai_next->ai_next->ai_next);
+    cio_free_endpoint_selector(selector);
+}
+
+void test_endpoint_selector_p2c(void **ctx)
+{
+    struct endpoints endpoints;
+    struct addrinfo *list;
+    int firsts[3] = { 0 };
+    void *selector;
+    int i;
+
+    ASSERT_NE_PTR(NULL, (selector = cio_new_endpoint_selector(CIO_SELECT_P2C)));
+    given_endpoints(&endpoints, 3);
+    when_reported(selector, &endpoints, 0, CIO_NO_ERROR, 10);
+    when_reported(selector, &endpoints, 1, CIO_NO_ERROR, 10);
+    when_reported(selector, &endpoints, 2, CIO_NO_ERROR, 200);
+
+    /* The slow one loses any pair it is in, the load spreads over the other two. */
+    for (i = 0; i < 1000; ++i) {
+        list = cio_endpoint_selector_order(selector, given_endpoints(&endpoints, 3));
+        firsts[list - endpoints.nodes]++;
+    }
+    ASSERT_LT_INT(300, firsts[0]);
+    ASSERT_LT_INT(300, firsts[1]);
+    ASSERT_EQ_INT(0, firsts[2]);
+    cio_free_endpoint_selector(selector);
+}
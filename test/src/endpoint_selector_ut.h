@@ -0,0 +1,8 @@
+#if !defined(CIO_ENDPOINT_SELECTOR_UT_H)
+#define CIO_ENDPOINT_SELECTOR_UT_H
+
+void test_endpoint_selector_stats(void **ctx);
+void test_endpoint_selector_least_latency(void **ctx);
+void test_endpoint_selector_p2c(void **ctx);
+
+#endif // CIO_ENDPOINT_SELECTOR_UT_H
@@ -15,6 +15,7 @@ struct loop_ctx {
     int should_unsubscribe_from_cb;
     int on_timer_called;
     int test_pipe[2];
+    void *timers[3];
 };
 
 static void *loop_thread_func(void *ctx)
@@ -253,6 +254,47 @@ finally:
     pthread_mutex_unlock(&lctx->mutex);
 }
 
+static void arm_cancel_timers_impl(void *ctx)
+{
+    struct loop_ctx *lctx = (struct loop_ctx *) ctx;
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        ASSERT_NE_PTR(NULL, lctx->timers[i] = cio_event_loop_new_timer(lctx->loop, lctx, on_timer));
+        ASSERT_EQ_INT(0, cio_event_loop_timer_due(lctx->timers[i]));
+    }
+
+    cio_event_loop_arm_timer(lctx->timers[0], 40);
+    cio_event_loop_arm_timer(lctx->timers[1], 20);
+    cio_event_loop_arm_timer(lctx->timers[2], 30);
+    cio_event_loop_cancel_timer(lctx->timers[1]);
+    cio_event_loop_arm_timer(lctx->timers[0], 10);
+    ASSERT_EQ_INT(0, cio_event_loop_timer_due(lctx->timers[1]));
+    ASSERT_LT_INT(cio_event_loop_timer_due(lctx->timers[0]),
+                  cio_event_loop_timer_due(lctx->timers[2]));
+}
+
+static void free_timers_impl(void *ctx)
+{
+    struct loop_ctx *lctx = (struct loop_ctx *) ctx;
+    int i;
+
+    for (i = 0; i < 3; ++i)
+        cio_event_loop_free_timer(lctx->timers[i]);
+    on_timer(lctx);
+}
+
+static void when_timers_armed_and_cancelled(struct loop_ctx *lctx)
+{
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_event_loop_post(lctx->loop, 0, lctx, arm_cancel_timers_impl));
+}
+
+static void then_timers_freed(struct loop_ctx *lctx, int timer_count)
+{
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_event_loop_post(lctx->loop, 0, lctx, free_timers_impl));
+    then_timers_fired(lctx, timer_count + 1);
+}
+
 void test_event_loop_add_remove(void **ctx)
 {
     struct loop_ctx *lctx = (struct loop_ctx *) *ctx;
@@ -287,3 +329,13 @@ void test_event_loop_timers(void **ctx)
    when_timers_added(lctx, timer_count);
    then_timers_fired(lctx, timer_count);
 }
+
+void test_event_loop_cancellable_timers(void **ctx)
+{
+   struct loop_ctx *lctx = (struct loop_ctx *) *ctx;
+
+   when_timers_armed_and_cancelled(lctx);
+   then_timers_fired(lctx, 2);
+   usleep(50 * 1000);
+   then_timers_freed(lctx, 2);
+}
@@ -1,5 +1,6 @@
 #include "int_hash_set_ut.h"
 #include <cio_hash_set.h>
+#include <cio_common.h>
 #include <stdlib.h>
 #include <ct.h>
 
@@ -30,6 +31,18 @@ int setup_int_hash_set_tests_with_release(void **ctx)
     return 0;
 }
 
+int setup_chained_int_hash_set_tests_with_release(void **ctx)
+{
+    void *set = cio_new_hash_set_impl(CIO_HASH_SET_CHAINED, 1024, int_cmp, int_hash_data,
+                                      release_int);
+
+    if (!set)
+        return -1;
+
+    *ctx = set;
+    return 0;
+}
+
 int teardown_int_hash_set_tests(void **ctx)
 {
     cio_free_hash_set(*ctx);
@@ -60,6 +73,78 @@ void test_int_hash_set_w_release(void **ctx)
     /* no need to free(elem1) as it should be destroyed along with the set itself */
 }
 
+static int *new_int(int value)
+{
+    int *elem = malloc(sizeof(int));
+
+    *elem = value;
+    return elem;
+}
+
+void test_int_hash_set_grow(void **ctx)
+{
+    const int count = 20000;
+    int i, key, *elem;
+
+    /* Way over the capacity. */
+    for (i = 0; i < count; ++i)
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, new_int(i)));
+
+    for (i = 0; i < count; i += 2) {
+        ASSERT_NE_PTR(NULL, (elem = cio_hash_set_remove(*ctx, &i)));
+        free(elem);
+    }
+
+    for (i = 0; i < count; ++i) {
+        elem = cio_hash_set_get(*ctx, &i);
+        if (i % 2) {
+            ASSERT_NE_PTR(NULL, elem);
+            ASSERT_EQ_INT(i, *elem);
+        } else {
+            ASSERT_EQ_PTR(NULL, elem);
+        }
+    }
+
+    key = count;
+    ASSERT_EQ_PTR(NULL, cio_hash_set_get(*ctx, &key));
+}
+
+static void then_all_found(void *set, int from, int to)
+{
+    int i, *elem;
+
+    for (i = from; i < to; ++i) {
+        ASSERT_NE_PTR(NULL, (elem = cio_hash_set_get(set, &i)));
+        ASSERT_EQ_INT(i, *elem);
+    }
+}
+
+void test_int_hash_set_resize(void **ctx)
+{
+    const int count = 20000, left = 10;
+    unsigned initial_capacity = cio_hash_set_capacity(*ctx);
+    int i, *elem;
+
+    /* The lookups see the elements in both tables while they are being moved. */
+    for (i = 0; i < count; ++i) {
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, new_int(i)));
+        ASSERT_EQ_PTR(NULL, cio_hash_set_add(*ctx, &i));
+        if (i % 1000 == 0)
+            then_all_found(*ctx, 0, i + 1);
+    }
+    then_all_found(*ctx, 0, count);
+    ASSERT_LE_INT(count / 0.875, cio_hash_set_capacity(*ctx));
+
+    for (i = left; i < count; ++i) {
+        ASSERT_NE_PTR(NULL, (elem = cio_hash_set_remove(*ctx, &i)));
+        free(elem);
+        if (i % 1000 == 0)
+            then_all_found(*ctx, i + 1, count);
+    }
+    then_all_found(*ctx, 0, left);
+    ASSERT_EQ_INT(initial_capacity, cio_hash_set_capacity(*ctx));
+}
+
 /* ---------------------------------------------------------------------------------------------- */
 
 static void int_hash_data_always_same(const void *elem, void **data, int *len)
@@ -82,6 +167,18 @@ int setup_int_hash_set_tests_linked_list(void **ctx)
     return 0;
 }
 
+int setup_chained_int_hash_set_tests_linked_list(void **ctx)
+{
+    void *set = cio_new_hash_set_impl(CIO_HASH_SET_CHAINED, 1024, int_cmp,
+                                      int_hash_data_always_same, release_int);
+
+    if (!set)
+        return -1;
+
+    *ctx = set;
+    return 0;
+}
+
 void test_int_hash_set_linked_list(void **ctx)
 {
     int *elem = malloc(sizeof(int)), *elem1 = malloc(sizeof(int)), *elem2 = malloc(sizeof(int));
@@ -108,3 +205,105 @@ void test_int_hash_set_linked_list(void **ctx)
 
     free(elem1);
 }
+
+void test_int_hash_set_collisions(void **ctx)
+{
+    const int count = 100;
+    int i, *elem;
+
+    /* All in the same chain / probe sequence, removing leaves holes in the middle of it. */
+    for (i = 0; i < count; ++i)
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, new_int(i)));
+
+    for (i = 0; i < count; i += 2) {
+        ASSERT_NE_PTR(NULL, (elem = cio_hash_set_remove(*ctx, &i)));
+        free(elem);
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (i % 2) {
+            ASSERT_NE_PTR(NULL, cio_hash_set_get(*ctx, &i));
+        } else {
+            ASSERT_EQ_PTR(NULL, cio_hash_set_get(*ctx, &i));
+        }
+    }
+
+    for (i = 0; i < count; i += 2)
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, new_int(i)));
+
+    for (i = 0; i < count; ++i) {
+        ASSERT_NE_PTR(NULL, (elem = cio_hash_set_get(*ctx, &i)));
+        ASSERT_EQ_INT(i, *elem);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+struct fd_handler {
+    void *ctx;
+    short flags;
+};
+
+void test_int_map(void **ctx)
+{
+    struct fd_handler handler = { &handler, 3 }, removed, *stored;
+    void *map;
+
+    ASSERT_NE_PTR(NULL, (map = cio_new_int_map(16, sizeof(handler))));
+    ASSERT_NE_PTR(NULL, (stored = cio_int_map_put(map, 42, &handler)));
+    ASSERT_NE_PTR(&handler, stored);
+    ASSERT_EQ_PTR(NULL, cio_int_map_put(map, 42, &handler));
+    handler.flags = 4;
+    ASSERT_NE_PTR(NULL, cio_int_map_put(map, 0, &handler));
+    ASSERT_EQ_INT(2, cio_int_map_size(map));
+
+    ASSERT_NE_PTR(NULL, (stored = cio_int_map_get(map, 42)));
+    ASSERT_EQ_PTR(&handler, stored->ctx);
+    ASSERT_EQ_INT(3, stored->flags);
+    ASSERT_EQ_INT(4, ((struct fd_handler *) cio_int_map_get(map, 0))->flags);
+    ASSERT_EQ_PTR(NULL, cio_int_map_get(map, 43));
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_int_map_remove(map, 42, &removed));
+    ASSERT_EQ_INT(3, removed.flags);
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_int_map_remove(map, 42, &removed));
+    ASSERT_EQ_PTR(NULL, cio_int_map_get(map, 42));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_int_map_remove(map, 0, NULL));
+    ASSERT_EQ_INT(0, cio_int_map_size(map));
+
+    cio_free_int_map(map);
+}
+
+void test_int_map_resize(void **ctx)
+{
+    const int count = 20000, left = 10;
+    int *values = malloc(count * sizeof(int)), i, value;
+    void *map, *pointer, **stored;
+
+    /* Pointer keys, with the low bits always zero. */
+    ASSERT_NE_PTR(NULL, (map = cio_new_int_map(16, sizeof(void *))));
+    for (i = 0; i < count; ++i) {
+        values[i] = i;
+        pointer = &values[i];
+        ASSERT_NE_PTR(NULL, cio_int_map_put(map, (uintptr_t) pointer, &pointer));
+    }
+    ASSERT_EQ_INT(count, cio_int_map_size(map));
+
+    for (i = left; i < count; ++i) {
+        ASSERT_EQ_INT(CIO_NO_ERROR, cio_int_map_remove(map, (uintptr_t) &values[i], NULL));
+        if (i % 1000 == 0) {
+            value = i + 1 + (count - i - 1) / 2;
+            ASSERT_NE_PTR(NULL, (stored = cio_int_map_get(map, (uintptr_t) &values[value])));
+            ASSERT_EQ_INT(value, *(int *) *stored);
+        }
+    }
+
+    for (i = 0; i < left; ++i) {
+        ASSERT_NE_PTR(NULL, (stored = cio_int_map_get(map, (uintptr_t) &values[i])));
+        ASSERT_EQ_INT(i, *(int *) *stored);
+    }
+    ASSERT_EQ_PTR(NULL, cio_int_map_get(map, (uintptr_t) &values[left]));
+    ASSERT_EQ_INT(left, cio_int_map_size(map));
+
+    cio_free_int_map(map);
+    free(values);
+}
@@ -2,10 +2,18 @@
 #define CIO_INT_HASH_SET_UT_H
 
 int setup_int_hash_set_tests_with_release(void **ctx);
+int setup_chained_int_hash_set_tests_with_release(void **ctx);
 int teardown_int_hash_set_tests(void **ctx);
 void test_int_hash_set_w_release(void **ctx);
+void test_int_hash_set_grow(void **ctx);
+void test_int_hash_set_resize(void **ctx);
 
 int setup_int_hash_set_tests_linked_list(void **ctx);
+int setup_chained_int_hash_set_tests_linked_list(void **ctx);
 void test_int_hash_set_linked_list(void **ctx);
+void test_int_hash_set_collisions(void **ctx);
+
+void test_int_map(void **ctx);
+void test_int_map_resize(void **ctx);
 
 #endif // CIO_INT_HASH_SET_UT_H
@@ -3,6 +3,16 @@
 #include "int_hash_set_ut.h"
 #include "struct_hash_set_ut.h"
 #include "tcp_connection_ut.h"
+#include "scan_ut.h"
+#include "ring_buffer_ut.h"
+#include "buffer_pool_ut.h"
+#include "socket_options_ut.h"
+#include "resolver_ut.h"
+#include "dns_resolver_ut.h"
+#include "endpoint_selector_ut.h"
+#include "connection_pool_ut.h"
+#include "rate_limiter_ut.h"
+#include "tcp_acceptor_ut.h"
 #include <ct.h>
 
 int main(int argc, char *argv[])
@@ -14,13 +24,15 @@ int main(int argc, char *argv[])
         TEST(test_pollset_new),
         TEST(test_pollset_add),
         TEST(test_pollset_remove),
-        TEST(test_pollset_poll)
+        TEST(test_pollset_poll),
+        TEST(test_pollset_modify)
     };
 
     struct ct_ut event_loop_tests[] = {
         TEST(test_event_loop_add_remove),
         TEST(test_event_loop_add_remove_from_cb),
         TEST(test_event_loop_timers),
+        TEST(test_event_loop_cancellable_timers),
     };
 
     struct ct_ut hash_set_tests[] = {
@@ -29,20 +41,149 @@ int main(int argc, char *argv[])
         TEST_SETUP_TEARDOWN(test_struct_hash_set_without_release,
             setup_struct_hash_set_tests_without_release, teardown_struct_hash_set_tests),
         TEST_SETUP_TEARDOWN(test_int_hash_set_linked_list,
-            setup_int_hash_set_tests_linked_list, teardown_int_hash_set_tests)
+            setup_int_hash_set_tests_linked_list, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_grow, setup_int_hash_set_tests_with_release,
+            teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_resize, setup_int_hash_set_tests_with_release,
+            teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_collisions,
+            setup_int_hash_set_tests_linked_list, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_w_release,
+            setup_chained_int_hash_set_tests_with_release, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_struct_hash_set_without_release,
+            setup_chained_struct_hash_set_tests_without_release, teardown_struct_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_linked_list,
+            setup_chained_int_hash_set_tests_linked_list, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_grow,
+            setup_chained_int_hash_set_tests_with_release, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_int_hash_set_collisions,
+            setup_chained_int_hash_set_tests_linked_list, teardown_int_hash_set_tests),
+        TEST_SETUP_TEARDOWN(test_string_hash_set, setup_string_hash_set_tests,
+            teardown_struct_hash_set_tests),
+        TEST(test_int_map),
+        TEST(test_int_map_resize)
     };
     
     struct ct_ut tcp_connection_tests[] = {
         TEST(test_new_tcp_connection),
         TEST(test_tcp_connection_connect_correct_address),
-        TEST(test_tcp_connection_read_write_duplex_success)
+        TEST(test_tcp_connection_read_write_duplex_success),
+        TEST(test_tcp_connection_read_until),
+        TEST(test_tcp_connection_read_until_with_read_ahead),
+        TEST(test_tcp_connection_small_reads_with_read_ahead),
+        TEST(test_tcp_connection_pooled_reads),
+        TEST(test_tcp_connection_pooled_reads_exhausted_pool),
+        TEST(test_tcp_connection_wait_readable_writable),
+        TEST(test_tcp_connection_read_timeout),
+        TEST(test_tcp_connection_idle_timeout),
+        TEST(test_tcp_connection_idle_timeout_without_operations),
+        TEST(test_tcp_connection_happy_eyeballs_connect),
+        TEST(test_tcp_connection_connect_timeout),
+        TEST(test_tcp_connection_write_watermarks),
+        TEST(test_tcp_connection_write_limit),
+        TEST(test_tcp_connection_rate_limited_write),
+        TEST(test_tcp_connection_stats),
+        TEST(test_tcp_connection_connect_send),
+        TEST(test_tcp_connection_connect_numeric_address),
+        TEST(test_tcp_connection_endpoint_selector)
+    };
+
+    struct ct_ut scan_tests[] = {
+        TEST(test_scan_single_byte_delim),
+        TEST(test_scan_multi_byte_delim),
+        TEST(test_scan_matches_scalar)
+    };
+
+    struct ct_ut ring_buffer_tests[] = {
+        TEST(test_ring_buffer_write_read),
+        TEST(test_ring_buffer_wrap_around),
+        TEST(test_ring_buffer_grow),
+        TEST(test_ring_buffer_free_segments)
+    };
+
+    struct ct_ut buffer_pool_tests[] = {
+        TEST(test_buffer_pool_reuse),
+        TEST(test_buffer_pool_max_total)
+    };
+
+    struct ct_ut socket_options_tests[] = {
+        TEST(test_socket_options_apply),
+        TEST(test_socket_options_empty_mask),
+        TEST(test_socket_options_apply_some),
+        TEST(test_socket_options_invalid_fd)
+    };
+
+    struct ct_ut resolver_tests[] = {
+        TEST(test_resolver_numeric_endpoint),
+        TEST(test_resolver_numeric_address),
+        TEST(test_resolver_unix_endpoint),
+        TEST(test_resolver_interleave_families),
+        TEST(test_resolver_async_resolve),
+        TEST(test_resolver_cache),
+        TEST(test_resolver_cache_all_in_flight)
+    };
+
+    struct ct_ut dns_resolver_tests[] = {
+        TEST(test_dns_resolver_config),
+        TEST(test_dns_resolver_resolve),
+        TEST(test_dns_resolver_not_found),
+        TEST(test_dns_resolver_retry),
+        TEST(test_dns_resolver_source_ports),
+        TEST(test_dns_resolver_no_socket),
+        TEST(test_dns_resolver_hosts),
+        TEST(test_dns_resolver_connect)
+    };
+
+    struct ct_ut endpoint_selector_tests[] = {
+        TEST(test_endpoint_selector_stats),
+        TEST(test_endpoint_selector_least_latency),
+        TEST(test_endpoint_selector_p2c)
+    };
+
+    struct ct_ut rate_limiter_tests[] = {
+        TEST(test_rate_limiter_bytes),
+        TEST(test_rate_limiter_ops),
+        TEST(test_rate_limiter_parent)
+    };
+
+    struct ct_ut tcp_acceptor_tests[] = {
+        TEST(test_tcp_acceptor_accept_batch),
+        TEST(test_tcp_acceptor_group),
+        TEST(test_tcp_acceptor_handoff),
+        TEST(test_tcp_acceptor_handoff_least_connections),
+        TEST(test_tcp_acceptor_max_connections),
+        TEST(test_tcp_acceptor_accept_rate),
+        TEST(test_tcp_acceptor_out_of_fds),
+        TEST(test_tcp_acceptor_listen_options)
+    };
+
+    struct ct_ut connection_pool_tests[] = {
+        TEST(test_connection_pool_reuse),
+        TEST(test_connection_pool_max_total),
+        TEST(test_connection_pool_peer_closed),
+        TEST(test_connection_pool_idle_timeout),
+        TEST(test_connection_pool_checkin_on_loop_thread)
     };
 
     result = RUN_TESTS(pollset_tests, setup_pollset_tests, teardown_pollset_tests);
     result |= RUN_TESTS(event_loop_tests, setup_event_loop_tests, teardown_event_loop_tests);
     result |= RUN_TESTS(hash_set_tests, NULL, NULL);
+    result |= RUN_TESTS(scan_tests, NULL, NULL);
+    result |= RUN_TESTS(ring_buffer_tests, setup_ring_buffer_tests, teardown_ring_buffer_tests);
+    result |= RUN_TESTS(buffer_pool_tests, setup_buffer_pool_tests, teardown_buffer_pool_tests);
+    result |= RUN_TESTS(socket_options_tests, setup_socket_options_tests,
+                        teardown_socket_options_tests);
+    result |= RUN_TESTS(resolver_tests, NULL, NULL);
+    result |= RUN_TESTS(dns_resolver_tests, setup_dns_resolver_tests,
+                        teardown_dns_resolver_tests);
+    result |= RUN_TESTS(endpoint_selector_tests, NULL, NULL);
+    result |= RUN_TESTS(rate_limiter_tests, NULL, NULL);
     result |= RUN_TESTS(tcp_connection_tests, setup_tcp_connnection_tests,
                         teardown_tcp_connnection_tests);
+    result |= RUN_TESTS(tcp_acceptor_tests, setup_tcp_acceptor_tests,
+                        teardown_tcp_acceptor_tests);
+    result |= RUN_TESTS(connection_pool_tests, setup_connection_pool_tests,
+                        teardown_connection_pool_tests);
 
     return result;
 }
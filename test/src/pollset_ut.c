@@ -92,3 +92,24 @@ void test_pollset_poll(void **ctx)
     close(test_pipe[0]);
     close(test_pipe[1]);
 }
+
+void test_pollset_modify(void **ctx)
+{
+    int result;
+    int test_pipe[2];
+
+    ASSERT_EQ_INT(0, pipe(test_pipe));
+
+    result = cio_pollset_add(*ctx, test_pipe[1], 0);
+    ASSERT_EQ_INT(CIO_NO_ERROR, result);
+    ASSERT_EQ_INT(0, cio_pollset_poll(*ctx, 0, test_pipe, pollset_cb));
+
+    result = cio_pollset_modify(*ctx, test_pipe[1], CIO_FLAG_OUT);
+    ASSERT_EQ_INT(CIO_NO_ERROR, result);
+    ASSERT_EQ_INT(1, cio_pollset_poll(*ctx, -1, test_pipe, pollset_cb));
+
+    result = cio_pollset_modify(*ctx, test_pipe[0], CIO_FLAG_IN);
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, result);
+    close(test_pipe[0]);
+    close(test_pipe[1]);
+}
@@ -0,0 +1,70 @@
+#include "rate_limiter_ut.h"
+#include <cio_rate_limiter.h>
+#include <ct.h>
+#include <stddef.h>
+#include <limits.h>
+
+static const long long START_MS = 1000000;
+
+void test_rate_limiter_bytes(void **ctx)
+{
+    void *limiter;
+
+    ASSERT_NE_PTR(NULL, (limiter = cio_new_rate_limiter(NULL, 1000, 500, 0, 0)));
+    ASSERT_EQ_INT(500, cio_rate_limiter_allowance(limiter, START_MS));
+    ASSERT_EQ_INT(0, cio_rate_limiter_delay_ms(limiter, START_MS));
+
+    cio_rate_limiter_consume(limiter, 500);
+    ASSERT_EQ_INT(0, cio_rate_limiter_allowance(limiter, START_MS));
+    ASSERT_LE_INT(10, cio_rate_limiter_delay_ms(limiter, START_MS));
+    ASSERT_LE_INT(cio_rate_limiter_delay_ms(limiter, START_MS), 11);
+
+    /* Refilled at the rate, up to the burst. */
+    ASSERT_EQ_INT(100, cio_rate_limiter_allowance(limiter, START_MS + 100));
+    ASSERT_EQ_INT(500, cio_rate_limiter_allowance(limiter, START_MS + 10000));
+
+    /* The debt delays the following calls. */
+    cio_rate_limiter_consume(limiter, 1500);
+    ASSERT_EQ_INT(0, cio_rate_limiter_allowance(limiter, START_MS + 10000));
+    ASSERT_LE_INT(1010, cio_rate_limiter_delay_ms(limiter, START_MS + 10000));
+    ASSERT_LE_INT(cio_rate_limiter_delay_ms(limiter, START_MS + 10000), 1011);
+    cio_free_rate_limiter(limiter);
+}
+
+void test_rate_limiter_ops(void **ctx)
+{
+    void *limiter;
+
+    ASSERT_NE_PTR(NULL, (limiter = cio_new_rate_limiter(NULL, 0, 0, 10, 1)));
+    ASSERT_EQ_INT(INT_MAX, cio_rate_limiter_allowance(limiter, START_MS));
+
+    cio_rate_limiter_consume(limiter, 1000000);
+    ASSERT_EQ_INT(0, cio_rate_limiter_allowance(limiter, START_MS));
+    ASSERT_LE_INT(100, cio_rate_limiter_delay_ms(limiter, START_MS));
+    ASSERT_LE_INT(cio_rate_limiter_delay_ms(limiter, START_MS), 101);
+    ASSERT_EQ_INT(INT_MAX, cio_rate_limiter_allowance(limiter, START_MS + 100));
+    cio_free_rate_limiter(limiter);
+}
+
+void test_rate_limiter_parent(void **ctx)
+{
+    void *group, *limiter, *other;
+
+    ASSERT_NE_PTR(NULL, (group = cio_new_rate_limiter(NULL, 1000, 0, 0, 0)));
+    ASSERT_NE_PTR(NULL, (limiter = cio_new_rate_limiter(group, 0, 0, 0, 0)));
+    ASSERT_NE_PTR(NULL, (other = cio_new_rate_limiter(group, 300, 0, 0, 0)));
+
+    ASSERT_EQ_INT(1000, cio_rate_limiter_allowance(limiter, START_MS));
+    ASSERT_EQ_INT(300, cio_rate_limiter_allowance(other, START_MS));
+
+    /* The group tokens are shared. */
+    cio_rate_limiter_consume(limiter, 800);
+    ASSERT_EQ_INT(200, cio_rate_limiter_allowance(other, START_MS));
+    cio_rate_limiter_consume(other, 200);
+    ASSERT_EQ_INT(0, cio_rate_limiter_allowance(limiter, START_MS));
+    ASSERT_EQ_INT(0, cio_rate_limiter_allowance(other, START_MS));
+
+    cio_free_rate_limiter(other);
+    cio_free_rate_limiter(limiter);
+    cio_free_rate_limiter(group);
+}
@@ -0,0 +1,8 @@
+#if !defined(CIO_RATE_LIMITER_UT_H)
+#define CIO_RATE_LIMITER_UT_H
+
+void test_rate_limiter_bytes(void **ctx);
+void test_rate_limiter_ops(void **ctx);
+void test_rate_limiter_parent(void **ctx);
+
+#endif // CIO_RATE_LIMITER_UT_H
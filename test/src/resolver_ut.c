@@ -0,0 +1,270 @@
+#include "resolver_ut.h"
+#include <cio_resolver.h>
+#include <cio_event_loop.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/un.h>
+
+struct async_resolve {
+    pthread_t event_loop_thread;
+    pthread_mutex_t mutex;
+    int done;
+    int ecode;
+    int on_loop_thread;
+    void *resolver;
+};
+
+static void *event_loop_run_func(void *ctx)
+{
+    return (void *) (long) cio_event_loop_run(ctx);
+}
+
+static void on_resolved(void *ctx, int ecode, void *resolver)
+{
+    struct async_resolve *async_resolve = ctx;
+
+    pthread_mutex_lock(&async_resolve->mutex);
+    async_resolve->ecode = ecode;
+    async_resolve->resolver = resolver;
+    async_resolve->on_loop_thread = pthread_equal(pthread_self(),
+                                                  async_resolve->event_loop_thread);
+    async_resolve->done = 1;
+    pthread_mutex_unlock(&async_resolve->mutex);
+}
+
+static void wait_resolved(struct async_resolve *async_resolve)
+{
+    int done = 0;
+
+    while (!done) {
+        usleep(5 * 1000);
+        pthread_mutex_lock(&async_resolve->mutex);
+        done = async_resolve->done;
+        pthread_mutex_unlock(&async_resolve->mutex);
+    }
+}
+
+void test_resolver_numeric_endpoint(void **ctx)
+{
+    void *resolver;
+    struct addrinfo ainfo;
+
+    ASSERT_NE_PTR(NULL, (resolver = cio_new_resolver("127.0.0.1", 80, AF_UNSPEC, SOCK_STREAM,
+                                                     CIO_CLIENT)));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(resolver, &ainfo));
+    ASSERT_EQ_INT(AF_INET, ainfo.ai_family);
+    ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in *) ainfo.ai_addr)->sin_port));
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_resolver_next_endpoint(resolver, &ainfo));
+    cio_free_resolver(resolver);
+}
+
+void test_resolver_numeric_address(void **ctx)
+{
+    struct sockaddr_storage addr;
+    struct addrinfo endpoint;
+    struct sockaddr_in6 *ipv6_addr = (struct sockaddr_in6 *) &addr;
+    int fd, addrlen;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolve_numeric("10.0.0.1", 80, AF_UNSPEC, SOCK_STREAM, &addr,
+                                                    &endpoint));
+    ASSERT_EQ_INT(AF_INET, endpoint.ai_family);
+    ASSERT_EQ_INT(SOCK_STREAM, endpoint.ai_socktype);
+    ASSERT_EQ_PTR(&addr, endpoint.ai_addr);
+    ASSERT_EQ_INT(sizeof(struct sockaddr_in), endpoint.ai_addrlen);
+    ASSERT_EQ_INT(htonl(0x0a000001), ((struct sockaddr_in *) &addr)->sin_addr.s_addr);
+    ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in *) &addr)->sin_port));
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolve_numeric("::1", 443, AF_UNSPEC, SOCK_STREAM, &addr,
+                                                    &endpoint));
+    ASSERT_EQ_INT(AF_INET6, endpoint.ai_family);
+    ASSERT_EQ_INT(sizeof(struct sockaddr_in6), endpoint.ai_addrlen);
+    ASSERT_TRUE(IN6_IS_ADDR_LOOPBACK(&ipv6_addr->sin6_addr));
+    ASSERT_EQ_INT(443, ntohs(ipv6_addr->sin6_port));
+
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_resolve_numeric("localhost", 80, AF_UNSPEC,
+                                                           SOCK_STREAM, &addr, &endpoint));
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_resolve_numeric("10.0.0.1", 80, AF_INET6,
+                                                           SOCK_STREAM, &addr, &endpoint));
+
+    ASSERT_NE_INT(-1, (fd = cio_resolve_local("127.0.0.1", 80, AF_INET,
+                                              (struct sockaddr *) &addr, &addrlen)));
+    ASSERT_EQ_INT(sizeof(struct sockaddr_in), addrlen);
+    close(fd);
+    ASSERT_EQ_INT(-1, cio_resolve_local("localhost", 80, AF_INET, (struct sockaddr *) &addr,
+                                        &addrlen));
+}
+
+void test_resolver_unix_endpoint(void **ctx)
+{
+    void *resolver;
+    struct addrinfo ainfo;
+    struct sockaddr_un *un_addr;
+
+    ASSERT_NE_PTR(NULL, (resolver = cio_new_resolver("/tmp/cio.sock", 0, AF_UNIX, SOCK_STREAM,
+                                                     CIO_CLIENT)));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(resolver, &ainfo));
+    ASSERT_EQ_INT(AF_UNIX, ainfo.ai_family);
+    ASSERT_EQ_INT(sizeof(struct sockaddr_un), ainfo.ai_addrlen);
+    un_addr = (struct sockaddr_un *) ainfo.ai_addr;
+    ASSERT_EQ_INT(AF_UNIX, un_addr->sun_family);
+    ASSERT_EQ_INT(0, strcmp("/tmp/cio.sock", un_addr->sun_path));
+    ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, cio_resolver_next_endpoint(resolver, &ainfo));
+    cio_free_resolver(resolver);
+}
+
+void test_resolver_interleave_families(void **ctx)
+{
+    int families[] = { AF_INET6, AF_INET6, AF_INET6, AF_INET, AF_INET };
+    int expected[] = { 0, 3, 1, 4, 2 };
+    struct addrinfo nodes[5], *ai;
+    int i;
+
+    memset(nodes, 0, sizeof(nodes));
+    for (i = 0; i < 5; ++i) {
+        nodes[i].ai_family = families[i];
+        nodes[i].ai_next = i < 4 ? &nodes[i + 1] : NULL;
+    }
+
+    ai = cio_addrinfo_interleave_families(nodes);
+    for (i = 0; i < 5; ++i, ai = ai->ai_next)
+        ASSERT_EQ_PTR(&nodes[expected[i]], ai);
+    ASSERT_EQ_PTR(NULL, ai);
+}
+
+void test_resolver_async_resolve(void **ctx)
+{
+    struct async_resolve async_resolve;
+    struct addrinfo ainfo;
+    void *event_loop, *result;
+
+    memset(&async_resolve, 0, sizeof(async_resolve));
+    async_resolve.mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    ASSERT_NE_PTR(NULL, (event_loop = cio_new_event_loop(8)));
+    ASSERT_EQ_INT(0, pthread_create(&async_resolve.event_loop_thread, NULL, event_loop_run_func,
+                                    event_loop));
+
+    cio_resolver_async_resolve(event_loop, "localhost", 80, AF_INET, SOCK_STREAM, CIO_CLIENT,
+                               &async_resolve, on_resolved);
+    wait_resolved(&async_resolve);
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, async_resolve.ecode);
+    ASSERT_TRUE(async_resolve.on_loop_thread);
+    ASSERT_NE_PTR(NULL, async_resolve.resolver);
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(async_resolve.resolver, &ainfo));
+    ASSERT_EQ_INT(AF_INET, ainfo.ai_family);
+    ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in *) ainfo.ai_addr)->sin_port));
+    cio_free_resolver(async_resolve.resolver);
+
+    cio_event_loop_stop(event_loop);
+    ASSERT_EQ_INT(0, pthread_join(async_resolve.event_loop_thread, &result));
+    cio_free_event_loop(event_loop);
+}
+
+void test_resolver_cache(void **ctx)
+{
+    struct async_resolve async_resolves[5];
+    struct cio_resolver_cache_stats stats;
+    struct addrinfo ainfo;
+    pthread_t event_loop_thread;
+    void *event_loop, *result;
+    int i;
+
+    memset(async_resolves, 0, sizeof(async_resolves));
+    ASSERT_NE_PTR(NULL, (event_loop = cio_new_event_loop(8)));
+    ASSERT_EQ_INT(0, pthread_create(&event_loop_thread, NULL, event_loop_run_func, event_loop));
+    for (i = 0; i < 5; ++i) {
+        async_resolves[i].mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        async_resolves[i].event_loop_thread = event_loop_thread;
+    }
+    cio_resolver_set_cache(2, 60 * 1000, 60 * 1000);
+
+    /* One lookup for the three, the later ones wait for it or hit its result. */
+    for (i = 0; i < 3; ++i)
+        cio_resolver_async_resolve(event_loop, "localhost", 80, AF_INET, SOCK_STREAM, CIO_CLIENT,
+                                   &async_resolves[i], on_resolved);
+    for (i = 0; i < 3; ++i) {
+        wait_resolved(&async_resolves[i]);
+        ASSERT_EQ_INT(CIO_NO_ERROR, async_resolves[i].ecode);
+        ASSERT_TRUE(async_resolves[i].on_loop_thread);
+        ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(async_resolves[i].resolver,
+                                                               &ainfo));
+        ASSERT_EQ_INT(AF_INET, ainfo.ai_family);
+        ASSERT_EQ_INT(80, ntohs(((struct sockaddr_in *) ainfo.ai_addr)->sin_port));
+        cio_free_resolver(async_resolves[i].resolver);
+    }
+    cio_resolver_get_cache_stats(&stats);
+    ASSERT_EQ_INT(1, (int) stats.misses);
+    ASSERT_EQ_INT(2, (int) (stats.hits + stats.coalesced));
+
+    /* The failure is cached too. */
+    for (i = 3; i < 5; ++i) {
+        cio_resolver_async_resolve(event_loop, "no-such-host.invalid", 80, AF_INET, SOCK_STREAM,
+                                   CIO_CLIENT, &async_resolves[i], on_resolved);
+        wait_resolved(&async_resolves[i]);
+        ASSERT_EQ_INT(CIO_NOT_FOUND_ERROR, async_resolves[i].ecode);
+        ASSERT_EQ_PTR(NULL, async_resolves[i].resolver);
+    }
+    cio_resolver_get_cache_stats(&stats);
+    ASSERT_EQ_INT(2, (int) stats.misses);
+    ASSERT_EQ_INT(1, (int) stats.negative_hits);
+
+    /* The third name evicts the least recently used one. */
+    memset(&async_resolves[0], 0, sizeof(async_resolves[0]));
+    async_resolves[0].mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    async_resolves[0].event_loop_thread = event_loop_thread;
+    cio_resolver_async_resolve(event_loop, "localhost", 81, AF_INET, SOCK_STREAM, CIO_CLIENT,
+                               &async_resolves[0], on_resolved);
+    wait_resolved(&async_resolves[0]);
+    ASSERT_EQ_INT(CIO_NO_ERROR, async_resolves[0].ecode);
+    cio_free_resolver(async_resolves[0].resolver);
+    cio_resolver_get_cache_stats(&stats);
+    ASSERT_EQ_INT(1, (int) stats.evictions);
+    ASSERT_EQ_INT(2, stats.size);
+
+    cio_resolver_set_cache(256, 10 * 1000, 1000);
+    cio_event_loop_stop(event_loop);
+    ASSERT_EQ_INT(0, pthread_join(event_loop_thread, &result));
+    cio_free_event_loop(event_loop);
+}
+
+void test_resolver_cache_all_in_flight(void **ctx)
+{
+    struct async_resolve async_resolves[8];
+    struct cio_resolver_cache_stats stats;
+    struct addrinfo ainfo;
+    pthread_t event_loop_thread;
+    void *event_loop, *result;
+    int i;
+
+    memset(async_resolves, 0, sizeof(async_resolves));
+    ASSERT_NE_PTR(NULL, (event_loop = cio_new_event_loop(8)));
+    ASSERT_EQ_INT(0, pthread_create(&event_loop_thread, NULL, event_loop_run_func, event_loop));
+    cio_resolver_set_cache(1, 60 * 1000, 60 * 1000);
+
+    /* More lookups in flight than the cache holds, none of their entries may be evicted. */
+    for (i = 0; i < 8; ++i) {
+        async_resolves[i].mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        async_resolves[i].event_loop_thread = event_loop_thread;
+        cio_resolver_async_resolve(event_loop, "localhost", 90 + i, AF_INET, SOCK_STREAM,
+                                   CIO_CLIENT, &async_resolves[i], on_resolved);
+    }
+    for (i = 0; i < 8; ++i) {
+        wait_resolved(&async_resolves[i]);
+        ASSERT_EQ_INT(CIO_NO_ERROR, async_resolves[i].ecode);
+        ASSERT_EQ_INT(CIO_NO_ERROR, cio_resolver_next_endpoint(async_resolves[i].resolver,
+                                                               &ainfo));
+        ASSERT_EQ_INT(90 + i, ntohs(((struct sockaddr_in *) ainfo.ai_addr)->sin_port));
+        cio_free_resolver(async_resolves[i].resolver);
+    }
+    cio_resolver_get_cache_stats(&stats);
+    ASSERT_EQ_INT(8, (int) stats.misses);
+    ASSERT_EQ_INT(1, stats.size);
+
+    cio_resolver_set_cache(256, 10 * 1000, 1000);
+    cio_event_loop_stop(event_loop);
+    ASSERT_EQ_INT(0, pthread_join(event_loop_thread, &result));
+    cio_free_event_loop(event_loop);
+}
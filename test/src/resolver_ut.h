@@ -0,0 +1,12 @@
+#if !defined(CIO_RESOLVER_UT_H)
+#define CIO_RESOLVER_UT_H
+
+void test_resolver_numeric_endpoint(void **ctx);
+void test_resolver_numeric_address(void **ctx);
+void test_resolver_unix_endpoint(void **ctx);
+void test_resolver_interleave_families(void **ctx);
+void test_resolver_async_resolve(void **ctx);
+void test_resolver_cache(void **ctx);
+void test_resolver_cache_all_in_flight(void **ctx);
+
+#endif // CIO_RESOLVER_UT_H
@@ -0,0 +1,87 @@
+#include "ring_buffer_ut.h"
+#include <cio_ring_buffer.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <string.h>
+
+static const int CAPACITY = 8;
+
+int setup_ring_buffer_tests(void **ctx)
+{
+    if (!(*ctx = cio_new_ring_buffer(CAPACITY)))
+        return -1;
+
+    return 0;
+}
+
+int teardown_ring_buffer_tests(void **ctx)
+{
+    cio_free_ring_buffer(*ctx);
+    return 0;
+}
+
+void test_ring_buffer_write_read(void **ctx)
+{
+    char buf[16];
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "hello", 5));
+    ASSERT_EQ_INT(5, cio_ring_buffer_size(*ctx));
+
+    ASSERT_EQ_INT(3, cio_ring_buffer_peek(*ctx, buf, 3));
+    ASSERT_EQ_INT(0, memcmp(buf, "hel", 3));
+    ASSERT_EQ_INT(5, cio_ring_buffer_size(*ctx));
+
+    ASSERT_EQ_INT(5, cio_ring_buffer_read(*ctx, buf, sizeof(buf)));
+    ASSERT_EQ_INT(0, memcmp(buf, "hello", 5));
+    ASSERT_EQ_INT(0, cio_ring_buffer_size(*ctx));
+    ASSERT_EQ_INT(0, cio_ring_buffer_read(*ctx, buf, sizeof(buf)));
+}
+
+void test_ring_buffer_wrap_around(void **ctx)
+{
+    char buf[16];
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "abcdef", 6));
+    ASSERT_EQ_INT(4, cio_ring_buffer_read(*ctx, buf, 4));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "ghijkl", 6));
+    ASSERT_EQ_INT(CAPACITY, cio_ring_buffer_capacity(*ctx));
+
+    ASSERT_EQ_INT(8, cio_ring_buffer_read(*ctx, buf, sizeof(buf)));
+    ASSERT_EQ_INT(0, memcmp(buf, "efghijkl", 8));
+}
+
+void test_ring_buffer_grow(void **ctx)
+{
+    char buf[32];
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "abcdef", 6));
+    ASSERT_EQ_INT(4, cio_ring_buffer_read(*ctx, buf, 4));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "0123456789", 10));
+    ASSERT_LE_INT(12, cio_ring_buffer_capacity(*ctx));
+
+    ASSERT_EQ_INT(12, cio_ring_buffer_read(*ctx, buf, sizeof(buf)));
+    ASSERT_EQ_INT(0, memcmp(buf, "ef0123456789", 12));
+}
+
+void test_ring_buffer_free_segments(void **ctx)
+{
+    struct iovec iov[2];
+    char buf[16];
+
+    ASSERT_EQ_INT(1, cio_ring_buffer_free_segments(*ctx, iov));
+    ASSERT_EQ_INT(CAPACITY, iov[0].iov_len);
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_ring_buffer_write(*ctx, "abcdef", 6));
+    ASSERT_EQ_INT(3, cio_ring_buffer_read(*ctx, buf, 3));
+    ASSERT_EQ_INT(2, cio_ring_buffer_free_segments(*ctx, iov));
+    ASSERT_EQ_INT(2, iov[0].iov_len);
+    ASSERT_EQ_INT(3, iov[1].iov_len);
+
+    memcpy(iov[0].iov_base, "gh", 2);
+    memcpy(iov[1].iov_base, "ijk", 3);
+    cio_ring_buffer_commit(*ctx, 5);
+    ASSERT_EQ_INT(0, cio_ring_buffer_free_segments(*ctx, iov));
+
+    ASSERT_EQ_INT(8, cio_ring_buffer_read(*ctx, buf, sizeof(buf)));
+    ASSERT_EQ_INT(0, memcmp(buf, "defghijk", 8));
+}
@@ -0,0 +1,12 @@
+#if !defined(CIO_RING_BUFFER_UT_H)
+#define CIO_RING_BUFFER_UT_H
+
+int setup_ring_buffer_tests(void **ctx);
+int teardown_ring_buffer_tests(void **ctx);
+
+void test_ring_buffer_write_read(void **ctx);
+void test_ring_buffer_wrap_around(void **ctx);
+void test_ring_buffer_grow(void **ctx);
+void test_ring_buffer_free_segments(void **ctx);
+
+#endif // CIO_RING_BUFFER_UT_H
@@ -0,0 +1,81 @@
+#include "scan_ut.h"
+#include <cio_scan.h>
+#include <ct.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const enum CIO_SCAN_IMPL impls[] = { CIO_SCAN_SCALAR, CIO_SCAN_SSE2, CIO_SCAN_AVX2 };
+
+static void fill(char *buf, int len, char c)
+{
+    memset(buf, c, len);
+}
+
+void test_scan_single_byte_delim(void **ctx)
+{
+    char buf[100];
+    int i, pos;
+
+    (void) ctx;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        fill(buf, sizeof(buf), 'a');
+        ASSERT_EQ_INT(-1, cio_scan_delim_impl(impls[i], buf, sizeof(buf), "\n", 1));
+
+        for (pos = 0; pos < sizeof(buf); ++pos) {
+            fill(buf, sizeof(buf), 'a');
+            buf[pos] = '\n';
+            ASSERT_EQ_INT(pos, cio_scan_delim_impl(impls[i], buf, sizeof(buf), "\n", 1));
+            ASSERT_EQ_INT(-1, cio_scan_delim_impl(impls[i], buf, pos, "\n", 1));
+        }
+    }
+}
+
+void test_scan_multi_byte_delim(void **ctx)
+{
+    char buf[100];
+    int i, pos;
+
+    (void) ctx;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        for (pos = 0; pos < sizeof(buf) - 1; ++pos) {
+            fill(buf, sizeof(buf), '\r');
+            buf[pos + 1] = '\n';
+            ASSERT_EQ_INT(pos, cio_scan_delim_impl(impls[i], buf, sizeof(buf), "\r\n", 2));
+            ASSERT_EQ_INT(-1, cio_scan_delim_impl(impls[i], buf, pos + 1, "\r\n", 2));
+        }
+
+        for (pos = 0; pos < sizeof(buf) - 3; ++pos) {
+            fill(buf, sizeof(buf), 'x');
+            memcpy(buf + pos, "\r\n\r\n", 4);
+            if (pos >= 4) {
+                /* First and last bytes match, the middle ones don't. */
+                buf[0] = '\r';
+                buf[3] = '\n';
+            }
+            ASSERT_EQ_INT(pos, cio_scan_delim_impl(impls[i], buf, sizeof(buf), "\r\n\r\n", 4));
+        }
+
+        ASSERT_EQ_INT(-1, cio_scan_delim_impl(impls[i], "\r\n", 2, "\r\n\r\n", 4));
+    }
+}
+
+void test_scan_matches_scalar(void **ctx)
+{
+    const int size = 4096;
+    char *buf = malloc(size);
+    int i, j, expected;
+
+    (void) ctx;
+    ASSERT_NE_PTR(NULL, buf);
+    srand(42);
+    for (j = 0; j < 100; ++j) {
+        for (i = 0; i < size; ++i)
+            buf[i] = "ab\r\n"[rand() % 4];
+        expected = cio_scan_delim_impl(CIO_SCAN_SCALAR, buf + j, size - j, "\r\n", 2);
+        for (i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i)
+            ASSERT_EQ_INT(expected, cio_scan_delim_impl(impls[i], buf + j, size - j, "\r\n", 2));
+        ASSERT_EQ_INT(expected, cio_scan_delim(buf + j, size - j, "\r\n", 2));
+    }
+
+    free(buf);
+}
@@ -0,0 +1,8 @@
+#if !defined(CIO_SCAN_UT_H)
+#define CIO_SCAN_UT_H
+
+void test_scan_single_byte_delim(void **ctx);
+void test_scan_multi_byte_delim(void **ctx);
+void test_scan_matches_scalar(void **ctx);
+
+#endif // CIO_SCAN_UT_H
@@ -0,0 +1,111 @@
+#include "socket_options_ut.h"
+#include <cio_socket_options.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+int setup_socket_options_tests(void **ctx)
+{
+    int *fd;
+
+    if (!(fd = malloc(sizeof(*fd))))
+        return -1;
+
+    if ((*fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        free(fd);
+        return -1;
+    }
+
+    *ctx = fd;
+    return 0;
+}
+
+int teardown_socket_options_tests(void **ctx)
+{
+    int *fd = *ctx;
+
+    close(*fd);
+    free(fd);
+    return 0;
+}
+
+static int get_option(int fd, int level, int name)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+
+    ASSERT_EQ_INT(0, getsockopt(fd, level, name, &value, &len));
+    return value;
+}
+
+void test_socket_options_apply(void **ctx)
+{
+    int fd = *((int *) *ctx);
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.mask = CIO_SO_NODELAY | CIO_SO_KEEPALIVE | CIO_SO_SNDBUF | CIO_SO_RCVBUF;
+    options.no_delay = 1;
+    options.keep_alive = 1;
+    options.keep_count = 3;
+    options.send_buffer = 64 * 1024;
+    options.receive_buffer = 32 * 1024;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_socket_options_apply(fd, &options));
+    ASSERT_NE_INT(0, get_option(fd, IPPROTO_TCP, TCP_NODELAY));
+    ASSERT_NE_INT(0, get_option(fd, SOL_SOCKET, SO_KEEPALIVE));
+#if defined(TCP_KEEPCNT)
+    ASSERT_EQ_INT(3, get_option(fd, IPPROTO_TCP, TCP_KEEPCNT));
+#endif
+    /* Linux reports the doubled value, so only the lower bound is checked. */
+    ASSERT_LE_INT(64 * 1024, get_option(fd, SOL_SOCKET, SO_SNDBUF));
+    ASSERT_LE_INT(32 * 1024, get_option(fd, SOL_SOCKET, SO_RCVBUF));
+}
+
+void test_socket_options_empty_mask(void **ctx)
+{
+    int fd = *((int *) *ctx);
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.no_delay = 1;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_socket_options_apply(fd, &options));
+    ASSERT_EQ_INT(0, get_option(fd, IPPROTO_TCP, TCP_NODELAY));
+}
+
+void test_socket_options_apply_some(void **ctx)
+{
+    int fd = *((int *) *ctx);
+    int send_buffer = get_option(fd, SOL_SOCKET, SO_SNDBUF);
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.mask = CIO_SO_NODELAY | CIO_SO_SNDBUF;
+    options.no_delay = 1;
+    options.send_buffer = send_buffer * 4;
+
+    /* Only the ones in both masks. */
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_socket_options_apply_some(fd, &options,
+                                                              CIO_SO_NODELAY | CIO_SO_KEEPALIVE));
+    ASSERT_EQ_INT(1, get_option(fd, IPPROTO_TCP, TCP_NODELAY));
+    ASSERT_EQ_INT(send_buffer, get_option(fd, SOL_SOCKET, SO_SNDBUF));
+    ASSERT_EQ_INT(0, get_option(fd, SOL_SOCKET, SO_KEEPALIVE));
+}
+
+void test_socket_options_invalid_fd(void **ctx)
+{
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.mask = CIO_SO_NODELAY;
+    options.no_delay = 1;
+
+    ASSERT_EQ_INT(CIO_SOCKET_OPTION_ERROR, cio_socket_options_apply(-1, &options));
+}
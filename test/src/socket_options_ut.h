@@ -0,0 +1,12 @@
+#if !defined(CIO_SOCKET_OPTIONS_UT_H)
+#define CIO_SOCKET_OPTIONS_UT_H
+
+int setup_socket_options_tests(void **ctx);
+int teardown_socket_options_tests(void **ctx);
+
+void test_socket_options_apply(void **ctx);
+void test_socket_options_empty_mask(void **ctx);
+void test_socket_options_apply_some(void **ctx);
+void test_socket_options_invalid_fd(void **ctx);
+
+#endif // CIO_SOCKET_OPTIONS_UT_H
@@ -2,6 +2,7 @@
 #include <cio_hash_set.h>
 #include <ct.h>
 #include <stddef.h>
+#include <string.h>
 
 typedef struct {
     double value;
@@ -21,6 +22,17 @@ static void hash_data(const void *elem, void **data, int *len)
     *len = sizeof(ts->key);
 }
 
+static int string_cmp(const void *l, const void *r)
+{
+    return !strcmp(l, r);
+}
+
+static void string_hash_data(const void *elem, void **data, int *len)
+{
+    *data = (void *) elem;
+    *len = strlen(elem);
+}
+
 int setup_struct_hash_set_tests_without_release(void **ctx)
 {
     void *set = cio_new_hash_set(1024, cmp, hash_data, NULL);
@@ -32,6 +44,28 @@ int setup_struct_hash_set_tests_without_release(void **ctx)
     return 0;
 }
 
+int setup_chained_struct_hash_set_tests_without_release(void **ctx)
+{
+    void *set = cio_new_hash_set_impl(CIO_HASH_SET_CHAINED, 1024, cmp, hash_data, NULL);
+
+    if (!set)
+        return -1;
+
+    *ctx = set;
+    return 0;
+}
+
+int setup_string_hash_set_tests(void **ctx)
+{
+    void *set = cio_new_hash_set(16, string_cmp, string_hash_data, NULL);
+
+    if (!set)
+        return -1;
+
+    *ctx = set;
+    return 0;
+}
+
 int teardown_struct_hash_set_tests(void **ctx)
 {
     cio_free_hash_set(*ctx);
@@ -63,3 +97,37 @@ void test_struct_hash_set_without_release(void **ctx)
     free(elem);
     free(elem1);
 }
+
+void test_string_hash_set(void **ctx)
+{
+    static const char chars[] = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+    char strings[2][sizeof(chars)][sizeof(chars)];
+    int len, i;
+
+    /* All the lengths the hash reads differently: none, bytes, two and four words, loop. The
+     * second set differs from the first in one byte. */
+    for (len = 0; len < sizeof(chars); ++len) {
+        for (i = 0; i < 2; ++i) {
+            memcpy(strings[i][len], chars, len);
+            strings[i][len][len] = '\0';
+        }
+        if (len)
+            strings[1][len][len / 2] = 'y';
+    }
+
+    for (len = 0; len < sizeof(chars); ++len)
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, strings[0][len]));
+    for (len = 1; len < sizeof(chars); ++len) {
+        ASSERT_EQ_PTR(NULL, cio_hash_set_get(*ctx, strings[1][len]));
+        ASSERT_NE_PTR(NULL, cio_hash_set_add(*ctx, strings[1][len]));
+    }
+
+    for (len = 0; len < sizeof(chars); ++len) {
+        for (i = 0; i < 2; ++i) {
+            if (i && !len)
+                continue;
+            ASSERT_EQ_PTR(strings[i][len], cio_hash_set_get(*ctx, strings[i][len]));
+            ASSERT_EQ_PTR(strings[i][len], cio_hash_set_remove(*ctx, strings[i][len]));
+        }
+    }
+}
@@ -2,8 +2,11 @@
 #define CIO_STRUCT_HASH_SET_UT_H
 
 int setup_struct_hash_set_tests_without_release(void **ctx);
+int setup_chained_struct_hash_set_tests_without_release(void **ctx);
+int setup_string_hash_set_tests(void **ctx);
 int teardown_struct_hash_set_tests(void **ctx);
 
 void test_struct_hash_set_without_release(void **ctx);
+void test_string_hash_set(void **ctx);
 
 #endif // CIO_STRUCT_HASH_SET_UT_H
@@ -0,0 +1,491 @@
+#include "tcp_acceptor_ut.h"
+#include <cio_tcp_acceptor.h>
+#include <cio_tcp_acceptor_group.h>
+#include <cio_tcp_connection.h>
+#include <cio_rate_limiter.h>
+#include <cio_event_loop.h>
+#include <cio_common.h>
+#include <ct.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+
+#define CLIENT_COUNT 8
+#define SHARD_COUNT 2
+
+static const char *const SERVER_ADDR = "127.0.0.1";
+static const int SERVER_PORT = 23657;
+
+struct acceptor_tests;
+
+struct shard {
+    struct acceptor_tests *fixture;
+    void *event_loop;
+    pthread_t event_loop_thread;
+    int accepted;
+};
+
+struct acceptor_tests {
+    void *event_loop;
+    pthread_t event_loop_thread;
+    pthread_mutex_t mutex;
+    void *acceptor;
+    int client_fds[CLIENT_COUNT];
+    int accepted_fds[CLIENT_COUNT];
+    int peer_ports[CLIENT_COUNT];
+    int accepted;
+    struct shard shards[SHARD_COUNT];
+    void *acceptor_group;
+    void *connections[CLIENT_COUNT];
+    int connection_shards[CLIENT_COUNT];
+    int accept_errors;
+    void *rate_limiter;
+};
+
+static void *event_loop_run_func(void *ctx)
+{
+    return (void *) cio_event_loop_run(ctx);
+}
+
+int setup_tcp_acceptor_tests(void **ctx)
+{
+    struct acceptor_tests *fixture;
+    int i;
+
+    if (!(fixture = malloc(sizeof(*fixture))))
+        return 1;
+
+    memset(fixture, 0, sizeof(*fixture));
+    for (i = 0; i < CLIENT_COUNT; ++i)
+        fixture->client_fds[i] = fixture->accepted_fds[i] = -1;
+    fixture->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    *ctx = fixture;
+    if (!(fixture->event_loop = cio_new_event_loop(64)))
+        return 1;
+
+    if (!(fixture->acceptor = cio_new_tcp_acceptor(fixture->event_loop, fixture)))
+        return 1;
+
+    if (pthread_create(&fixture->event_loop_thread, NULL, event_loop_run_func,
+                       fixture->event_loop))
+        return 1;
+
+    return 0;
+}
+
+int teardown_tcp_acceptor_tests(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+    void *result;
+    int i;
+
+    cio_free_tcp_acceptor_sync(fixture->acceptor);
+    cio_free_tcp_acceptor_group_sync(fixture->acceptor_group);
+    for (i = 0; i < CLIENT_COUNT; ++i)
+        cio_free_tcp_connection_sync(fixture->connections[i]);
+    cio_event_loop_stop(fixture->event_loop);
+    ASSERT_EQ_INT(0, pthread_join(fixture->event_loop_thread, &result));
+    cio_free_event_loop(fixture->event_loop);
+    cio_free_rate_limiter(fixture->rate_limiter);
+    for (i = 1; i < SHARD_COUNT; ++i) {
+        if (!fixture->shards[i].event_loop)
+            continue;
+        cio_event_loop_stop(fixture->shards[i].event_loop);
+        ASSERT_EQ_INT(0, pthread_join(fixture->shards[i].event_loop_thread, &result));
+        cio_free_event_loop(fixture->shards[i].event_loop);
+    }
+    for (i = 0; i < CLIENT_COUNT; ++i) {
+        if (fixture->client_fds[i] != -1)
+            close(fixture->client_fds[i]);
+        if (fixture->accepted_fds[i] != -1)
+            close(fixture->accepted_fds[i]);
+    }
+    pthread_mutex_destroy(&fixture->mutex);
+    free(fixture);
+    return 0;
+}
+
+static void on_accept(int fd, void *ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len)
+{
+    struct acceptor_tests *fixture = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_NE_INT(-1, fd);
+    ASSERT_EQ_INT(sizeof(struct sockaddr_in), peer_addr_len);
+    ASSERT_EQ_INT(AF_INET, peer_addr->sa_family);
+
+    pthread_mutex_lock(&fixture->mutex);
+    ASSERT_LT_INT(fixture->accepted, CLIENT_COUNT);
+    fixture->accepted_fds[fixture->accepted] = fd;
+    fixture->peer_ports[fixture->accepted] = ntohs(((struct sockaddr_in *) peer_addr)->sin_port);
+    fixture->accepted++;
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+static void on_overloaded_accept(int fd, void *ctx, int ecode, const struct sockaddr *peer_addr,
+                                 socklen_t peer_addr_len)
+{
+    struct acceptor_tests *fixture = ctx;
+
+    if (ecode == CIO_ACCEPT_ERROR) {
+        pthread_mutex_lock(&fixture->mutex);
+        fixture->accept_errors++;
+        pthread_mutex_unlock(&fixture->mutex);
+        return;
+    }
+
+    on_accept(fd, ctx, ecode, peer_addr, peer_addr_len);
+}
+
+static void when_limited_acceptor_started(struct acceptor_tests *fixture, int max_connections,
+                                          void *rate_limiter)
+{
+    cio_tcp_acceptor_set_limits(fixture->acceptor, max_connections, rate_limiter);
+    cio_tcp_acceptor_async_accept(fixture->acceptor, SERVER_ADDR, SERVER_PORT,
+                                  on_overloaded_accept);
+}
+
+static void when_acceptor_started(struct acceptor_tests *fixture, int backlog, int accept_batch)
+{
+    cio_tcp_acceptor_set_backlog(fixture->acceptor, backlog);
+    cio_tcp_acceptor_set_accept_batch(fixture->acceptor, accept_batch);
+    cio_tcp_acceptor_async_accept(fixture->acceptor, SERVER_ADDR, SERVER_PORT, on_accept);
+}
+
+static void on_shard_accept(int fd, void *ctx, int ecode, const struct sockaddr *peer_addr,
+                            socklen_t peer_addr_len)
+{
+    struct shard *shard = ctx;
+
+    on_accept(fd, shard->fixture, ecode, peer_addr, peer_addr_len);
+    pthread_mutex_lock(&shard->fixture->mutex);
+    shard->accepted++;
+    pthread_mutex_unlock(&shard->fixture->mutex);
+}
+
+static void when_shard_loops_started(struct acceptor_tests *fixture)
+{
+    int i;
+
+    fixture->shards[0].event_loop = fixture->event_loop;
+    fixture->shards[0].event_loop_thread = fixture->event_loop_thread;
+    for (i = 1; i < SHARD_COUNT; ++i) {
+        ASSERT_NE_PTR(NULL, (fixture->shards[i].event_loop = cio_new_event_loop(64)));
+        ASSERT_EQ_INT(0, pthread_create(&fixture->shards[i].event_loop_thread, NULL,
+                                        event_loop_run_func, fixture->shards[i].event_loop));
+    }
+}
+
+static void when_sharded_acceptor_started(struct acceptor_tests *fixture)
+{
+    void *event_loops[SHARD_COUNT];
+    void *user_ctxs[SHARD_COUNT];
+    int i;
+
+    when_shard_loops_started(fixture);
+    for (i = 0; i < SHARD_COUNT; ++i) {
+        fixture->shards[i].fixture = fixture;
+        event_loops[i] = fixture->shards[i].event_loop;
+        user_ctxs[i] = &fixture->shards[i];
+    }
+
+    ASSERT_NE_PTR(NULL, (fixture->acceptor_group = cio_new_tcp_acceptor_group(
+        event_loops, user_ctxs, SHARD_COUNT)));
+    ASSERT_EQ_INT(SHARD_COUNT, cio_tcp_acceptor_group_size(fixture->acceptor_group));
+    cio_tcp_acceptor_group_async_accept(fixture->acceptor_group, SERVER_ADDR, SERVER_PORT, 1,
+                                        on_shard_accept);
+}
+
+static void on_connection(void *connection, void *ctx, int ecode,
+                          const struct sockaddr *peer_addr, socklen_t peer_addr_len)
+{
+    struct acceptor_tests *fixture = ctx;
+    int i, shard = -1;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_NE_PTR(NULL, connection);
+    ASSERT_EQ_INT(sizeof(struct sockaddr_in), peer_addr_len);
+    ASSERT_EQ_INT(AF_INET, peer_addr->sa_family);
+    for (i = 0; i < SHARD_COUNT; ++i) {
+        if (pthread_equal(pthread_self(), fixture->shards[i].event_loop_thread))
+            shard = i;
+    }
+    ASSERT_NE_INT(-1, shard);
+
+    pthread_mutex_lock(&fixture->mutex);
+    ASSERT_LT_INT(fixture->accepted, CLIENT_COUNT);
+    fixture->connections[fixture->accepted] = connection;
+    fixture->connection_shards[fixture->accepted] = shard;
+    fixture->shards[shard].accepted++;
+    fixture->accepted++;
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+static void when_handoff_acceptor_started(struct acceptor_tests *fixture,
+                                          enum CIO_HANDOFF_POLICY policy)
+{
+    void *event_loops[SHARD_COUNT];
+    int i;
+
+    when_shard_loops_started(fixture);
+    for (i = 0; i < SHARD_COUNT; ++i)
+        event_loops[i] = fixture->shards[i].event_loop;
+
+    cio_tcp_acceptor_async_accept_connections(fixture->acceptor, SERVER_ADDR, SERVER_PORT,
+                                              event_loops, SHARD_COUNT, policy, on_connection);
+}
+
+static void connect_to_server(int fd)
+{
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    ASSERT_EQ_INT(1, inet_pton(AF_INET, SERVER_ADDR, &addr.sin_addr));
+    ASSERT_EQ_INT(0, connect(fd, (struct sockaddr *) &addr, sizeof(addr)));
+}
+
+static void when_client_connects(struct acceptor_tests *fixture, int i)
+{
+    ASSERT_NE_INT(-1, (fixture->client_fds[i] = socket(AF_INET, SOCK_STREAM, 0)));
+    connect_to_server(fixture->client_fds[i]);
+}
+
+static void when_clients_connect(struct acceptor_tests *fixture)
+{
+    int i;
+
+    for (i = 0; i < CLIENT_COUNT; ++i)
+        when_client_connects(fixture, i);
+}
+
+static void wait_accepted(struct acceptor_tests *fixture, int count)
+{
+    int accepted = 0;
+
+    while (accepted < count) {
+        pthread_mutex_lock(&fixture->mutex);
+        accepted = fixture->accepted;
+        pthread_mutex_unlock(&fixture->mutex);
+        usleep(5 * 1000);
+    }
+}
+
+static int client_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    ASSERT_EQ_INT(0, getsockname(fd, (struct sockaddr *) &addr, &len));
+    return ntohs(addr.sin_port);
+}
+
+static void then_all_clients_are_accepted(struct acceptor_tests *fixture)
+{
+    int i, j, found;
+
+    wait_accepted(fixture, CLIENT_COUNT);
+
+    for (i = 0; i < CLIENT_COUNT; ++i) {
+        ASSERT_TRUE(fcntl(fixture->accepted_fds[i], F_GETFL) & O_NONBLOCK);
+        ASSERT_TRUE(fcntl(fixture->accepted_fds[i], F_GETFD) & FD_CLOEXEC);
+        for (j = 0, found = 0; j < CLIENT_COUNT; ++j)
+            found |= fixture->peer_ports[j] == client_port(fixture->client_fds[i]);
+        ASSERT_TRUE(found);
+    }
+}
+
+static void then_shards_accepted_all(struct acceptor_tests *fixture)
+{
+    int i, total = 0;
+
+    pthread_mutex_lock(&fixture->mutex);
+    for (i = 0; i < SHARD_COUNT; ++i)
+        total += fixture->shards[i].accepted;
+    pthread_mutex_unlock(&fixture->mutex);
+    ASSERT_EQ_INT(CLIENT_COUNT, total);
+}
+
+static int accepted_count(struct acceptor_tests *fixture)
+{
+    int accepted;
+
+    pthread_mutex_lock(&fixture->mutex);
+    accepted = fixture->accepted;
+    pthread_mutex_unlock(&fixture->mutex);
+    return accepted;
+}
+
+static long long now_ms()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return time_ms(&tv);
+}
+
+static void then_shards_accepted_evenly(struct acceptor_tests *fixture)
+{
+    int i;
+
+    wait_accepted(fixture, CLIENT_COUNT);
+    pthread_mutex_lock(&fixture->mutex);
+    for (i = 0; i < SHARD_COUNT; ++i)
+        ASSERT_EQ_INT(CLIENT_COUNT / SHARD_COUNT, fixture->shards[i].accepted);
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+void test_tcp_acceptor_accept_batch(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+
+    when_acceptor_started(fixture, CLIENT_COUNT, 4);
+    when_clients_connect(fixture);
+    then_all_clients_are_accepted(fixture);
+}
+
+void test_tcp_acceptor_group(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+
+    when_sharded_acceptor_started(fixture);
+    when_clients_connect(fixture);
+    then_all_clients_are_accepted(fixture);
+    then_shards_accepted_all(fixture);
+}
+
+void test_tcp_acceptor_handoff(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+
+    when_handoff_acceptor_started(fixture, CIO_HANDOFF_ROUND_ROBIN);
+    when_clients_connect(fixture);
+    then_shards_accepted_evenly(fixture);
+}
+
+void test_tcp_acceptor_handoff_least_connections(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+
+    when_handoff_acceptor_started(fixture, CIO_HANDOFF_LEAST_CONNECTIONS);
+    when_client_connects(fixture, 0);
+    wait_accepted(fixture, 1);
+    ASSERT_EQ_INT(0, fixture->connection_shards[0]);
+
+    /* The first loop is the least loaded again once its connection is destroyed. */
+    cio_free_tcp_connection_sync(fixture->connections[0]);
+    fixture->connections[0] = NULL;
+    when_client_connects(fixture, 1);
+    wait_accepted(fixture, 2);
+    ASSERT_EQ_INT(0, fixture->connection_shards[1]);
+
+    when_client_connects(fixture, 2);
+    wait_accepted(fixture, 3);
+    ASSERT_EQ_INT(1, fixture->connection_shards[2]);
+}
+
+void test_tcp_acceptor_max_connections(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+
+    when_limited_acceptor_started(fixture, 2, NULL);
+    when_clients_connect(fixture);
+    wait_accepted(fixture, 2);
+    usleep(50 * 1000);
+    ASSERT_EQ_INT(2, accepted_count(fixture));
+
+    cio_tcp_acceptor_release_connection(fixture->acceptor);
+    wait_accepted(fixture, 3);
+    usleep(50 * 1000);
+    ASSERT_EQ_INT(3, accepted_count(fixture));
+}
+
+void test_tcp_acceptor_accept_rate(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+    long long started;
+
+    /* Two accepts at once, then one per 50 ms. */
+    ASSERT_NE_PTR(NULL, (fixture->rate_limiter = cio_new_rate_limiter(NULL, 0, 0, 20, 2)));
+    started = now_ms();
+    when_limited_acceptor_started(fixture, 0, fixture->rate_limiter);
+    when_clients_connect(fixture);
+    then_all_clients_are_accepted(fixture);
+    ASSERT_LE_INT(250, now_ms() - started);
+}
+
+void test_tcp_acceptor_out_of_fds(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+    struct timeval recv_timeout = { 2, 0 };
+    struct rlimit saved, limit;
+    char byte;
+    int i, fd;
+
+    when_limited_acceptor_started(fixture, 0, NULL);
+    usleep(50 * 1000);
+    ASSERT_EQ_INT(0, getrlimit(RLIMIT_NOFILE, &saved));
+
+    /* The client sockets are created first, then the fds are capped at the ones in use. */
+    for (i = 0; i < 2; ++i) {
+        ASSERT_NE_INT(-1, (fixture->client_fds[i] = socket(AF_INET, SOCK_STREAM, 0)));
+        ASSERT_EQ_INT(0, setsockopt(fixture->client_fds[i], SOL_SOCKET, SO_RCVTIMEO,
+                                    &recv_timeout, sizeof(recv_timeout)));
+    }
+    ASSERT_NE_INT(-1, (fd = dup(0)));
+    close(fd);
+    limit = saved;
+    limit.rlim_cur = fd;
+    ASSERT_EQ_INT(0, setrlimit(RLIMIT_NOFILE, &limit));
+
+    /* Dropped at once instead of hanging in the listen queue. */
+    for (i = 0; i < 2; ++i) {
+        connect_to_server(fixture->client_fds[i]);
+        ASSERT_EQ_INT(0, recv(fixture->client_fds[i], &byte, 1, 0));
+    }
+    ASSERT_EQ_INT(0, setrlimit(RLIMIT_NOFILE, &saved));
+
+    /* Reported after the connection is closed. */
+    for (i = 0; i < 2; usleep(5 * 1000)) {
+        pthread_mutex_lock(&fixture->mutex);
+        i = fixture->accept_errors;
+        pthread_mutex_unlock(&fixture->mutex);
+    }
+    usleep(50 * 1000);
+    ASSERT_EQ_INT(0, accepted_count(fixture));
+    pthread_mutex_lock(&fixture->mutex);
+    ASSERT_EQ_INT(2, fixture->accept_errors);
+    pthread_mutex_unlock(&fixture->mutex);
+}
+
+void test_tcp_acceptor_listen_options(void **ctx)
+{
+    struct acceptor_tests *fixture = *ctx;
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.mask = CIO_SO_DEFER_ACCEPT | CIO_SO_FASTOPEN | CIO_SO_NODELAY;
+    options.defer_accept = 5;
+    options.fast_open_queue = 16;
+    options.no_delay = 1;
+    cio_tcp_acceptor_set_options(fixture->acceptor, &options);
+    when_acceptor_started(fixture, CLIENT_COUNT, 4);
+    when_client_connects(fixture, 0);
+
+#if defined(TCP_DEFER_ACCEPT)
+    /* Not accepted until the first data arrives. */
+    usleep(100 * 1000);
+    ASSERT_EQ_INT(0, accepted_count(fixture));
+#endif
+    ASSERT_EQ_INT(1, send(fixture->client_fds[0], "x", 1, 0));
+    wait_accepted(fixture, 1);
+}
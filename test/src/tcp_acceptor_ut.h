@@ -0,0 +1,16 @@
+#if !defined(CIO_TCP_ACCEPTOR_UT_H)
+#define CIO_TCP_ACCEPTOR_UT_H
+
+int setup_tcp_acceptor_tests(void **ctx);
+int teardown_tcp_acceptor_tests(void **ctx);
+
+void test_tcp_acceptor_accept_batch(void **ctx);
+void test_tcp_acceptor_group(void **ctx);
+void test_tcp_acceptor_handoff(void **ctx);
+void test_tcp_acceptor_handoff_least_connections(void **ctx);
+void test_tcp_acceptor_max_connections(void **ctx);
+void test_tcp_acceptor_accept_rate(void **ctx);
+void test_tcp_acceptor_out_of_fds(void **ctx);
+void test_tcp_acceptor_listen_options(void **ctx);
+
+#endif // CIO_TCP_ACCEPTOR_UT_H
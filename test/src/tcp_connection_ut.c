@@ -2,12 +2,19 @@
 #include <cio_tcp_connection.h>
 #include <cio_tcp_acceptor.h>
 #include <cio_event_loop.h>
+#include <cio_buffer_pool.h>
+#include <cio_rate_limiter.h>
+#include <cio_resolver.h>
+#include <cio_endpoint_selector.h>
 #include <ct.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 struct growable_buffer {
     char *data;
@@ -66,6 +73,12 @@ struct test_client {
     struct connection_tests *tests_fixture;
     int connected;
     int written;
+    int lines_read;
+    int timed_out;
+    int above_high_watermark;
+    int drained;
+    int write_results[4];
+    int writes_done;
     char read_buf[1024];
     struct growable_buffer *total_read_buf;
     pthread_mutex_t mutex;
@@ -156,10 +169,21 @@ struct connection_tests {
     int duplex_on;
     char *test_data;
     int test_data_size;
+    void *buffer_pool;
+    void *rate_limiter;
+    struct cio_tcp_connection_stats client_stats;
+    struct cio_tcp_connection_stats server_stats;
+    int stats_taken;
+    /**
+     * Listener with the full accept queue, which drops SYNs, and the connection filling it.
+     */
+    int blackhole_fds[2];
 };
 
 static const char *const VALID_SERVER_ADDR = "0.0.0.0";
 static const int VALID_SERVER_PORT = 23654;
+static const char *const BLACKHOLE_ADDR = "127.0.0.1";
+static const int BLACKHOLE_PORT = 23655;
 
 static void free_connection_tests_ctx(struct connection_tests *test_ctx)
 {
@@ -172,6 +196,12 @@ static void free_connection_tests_ctx(struct connection_tests *test_ctx)
         ASSERT_EQ_INT(0, pthread_join(test_ctx->event_loop_thread, &result));
         cio_free_event_loop(test_ctx->event_loop);
         pthread_mutex_destroy(&test_ctx->mutex);
+        cio_free_buffer_pool(test_ctx->buffer_pool);
+        cio_free_rate_limiter(test_ctx->rate_limiter);
+        if (test_ctx->blackhole_fds[0] > 0)
+            close(test_ctx->blackhole_fds[0]);
+        if (test_ctx->blackhole_fds[1] > 0)
+            close(test_ctx->blackhole_fds[1]);
         free(test_ctx->test_data);
         free(test_ctx);
     }
@@ -256,7 +286,8 @@ int teardown_tcp_connnection_tests(void **ctx)
     return 0;
 }
 
-static void on_accept(int fd, void *ctx, int ecode)
+static void on_accept(int fd, void *ctx, int ecode, const struct sockaddr *peer_addr,
+                      socklen_t peer_addr_len)
 {
     struct connection_tests *tests_fixture = ctx;
     
@@ -400,6 +431,522 @@ static void then_all_data_transferred_correctly(struct connection_tests *tests_c
     }
 }
 
+static const char *const TEST_LINES = "first line\r\nsecond\r\n\r\nlast line\r\n";
+static const int TEST_LINES_COUNT = 4;
+
+static void on_line_written(void *ctx, int ecode)
+{
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+}
+
+static void on_read_line(void *ctx, int ecode, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_LE_INT(2, bytes_read);
+    ASSERT_EQ_INT(0, memcmp(test_client->read_buf + bytes_read - 2, "\r\n", 2));
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    growable_buffer_append(test_client->total_read_buf, test_client->read_buf, bytes_read);
+    test_client->lines_read++;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+
+    if (test_client->lines_read == TEST_LINES_COUNT)
+        return;
+
+    cio_tcp_connection_async_read_until(test_client->connection, test_client->read_buf,
+                                        sizeof(test_client->read_buf), "\r\n", 2, on_read_line);
+}
+
+static void when_read_ahead_is(struct connection_tests *tests_ctx, int size)
+{
+    ASSERT_NE_PTR(NULL, tests_ctx->test_server->server_client->connection);
+    cio_tcp_connection_set_read_ahead(tests_ctx->test_server->server_client->connection, size);
+}
+
+static void when_server_reads_lines(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    ASSERT_NE_PTR(NULL, server_client->connection);
+    cio_tcp_connection_async_read_until(server_client->connection, server_client->read_buf,
+                                        sizeof(server_client->read_buf), "\r\n", 2,
+                                        on_read_line);
+}
+
+static void when_lines_are_sent(struct connection_tests *tests_ctx)
+{
+    when_server_reads_lines(tests_ctx);
+    cio_tcp_connection_async_write(tests_ctx->test_client->connection, TEST_LINES,
+                                   strlen(TEST_LINES), on_line_written);
+}
+
+static void when_fast_open_server_started(struct connection_tests *tests_ctx)
+{
+    struct cio_socket_options options;
+
+    memset(&options, 0, sizeof(options));
+    options.mask = CIO_SO_FASTOPEN;
+    options.fast_open_queue = 16;
+    cio_tcp_acceptor_set_options(tests_ctx->test_server->acceptor, &options);
+    when_test_tcp_server_started(tests_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+}
+
+static void when_connection_attempt_with_lines_is_made(struct connection_tests *tests_ctx)
+{
+    cio_tcp_connection_async_connect_send(tests_ctx->test_client->connection, VALID_SERVER_ADDR,
+                                          VALID_SERVER_PORT, TEST_LINES, strlen(TEST_LINES),
+                                          on_connect);
+}
+
+static void then_all_lines_are_read(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+    int done = 0;
+
+    while (!done) {
+        ASSERT_EQ_INT(0, pthread_mutex_lock(&server_client->mutex));
+        done = server_client->lines_read == TEST_LINES_COUNT;
+        ASSERT_EQ_INT(0, pthread_mutex_unlock(&server_client->mutex));
+        usleep(5 * 1000);
+    }
+
+    ASSERT_EQ_INT(strlen(TEST_LINES), server_client->total_read_buf->size);
+    ASSERT_EQ_INT(0, memcmp(TEST_LINES, server_client->total_read_buf->data, strlen(TEST_LINES)));
+}
+
+static const int SMALL_READ_SIZE = 4;
+static const int SMALL_READS_DATA_SIZE = 4096;
+
+static void on_small_read(void *ctx, int ecode, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_EQ_INT(SMALL_READ_SIZE, bytes_read);
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    growable_buffer_append(test_client->total_read_buf, test_client->read_buf, bytes_read);
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+
+    if (test_client->total_read_buf->size == SMALL_READS_DATA_SIZE)
+        return;
+
+    cio_tcp_connection_async_read(test_client->connection, test_client->read_buf,
+                                  SMALL_READ_SIZE, on_small_read);
+}
+
+static void when_data_is_read_in_small_chunks(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    cio_tcp_connection_async_read(server_client->connection, server_client->read_buf,
+                                  SMALL_READ_SIZE, on_small_read);
+    cio_tcp_connection_async_write(tests_ctx->test_client->connection, tests_ctx->test_data,
+                                   SMALL_READS_DATA_SIZE, on_line_written);
+}
+
+static void then_small_reads_data_is_correct(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    while (!all_data_read(server_client, SMALL_READS_DATA_SIZE))
+        usleep(5 * 1000);
+
+    ASSERT_EQ_INT(0, memcmp(tests_ctx->test_data, server_client->total_read_buf->data,
+                            SMALL_READS_DATA_SIZE));
+}
+
+static void on_pooled_read(void *ctx, int ecode, void *buffer, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+    void *buffer_pool = test_client->tests_fixture->buffer_pool;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_NE_PTR(NULL, buffer);
+    ASSERT_LT_INT(0, bytes_read);
+    ASSERT_EQ_INT(1, cio_buffer_pool_in_use(buffer_pool));
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    growable_buffer_append(test_client->total_read_buf, buffer, bytes_read);
+    cio_buffer_pool_put(buffer_pool, buffer);
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+
+    if (test_client->total_read_buf->size == SMALL_READS_DATA_SIZE)
+        return;
+
+    cio_tcp_connection_async_read_pooled(test_client->connection, buffer_pool, on_pooled_read);
+}
+
+static void when_data_is_read_with_pooled_buffers(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    ASSERT_NE_PTR(NULL, (tests_ctx->buffer_pool = cio_new_buffer_pool(1000, 1, 1)));
+    cio_tcp_connection_async_read_pooled(server_client->connection, tests_ctx->buffer_pool,
+                                         on_pooled_read);
+    cio_tcp_connection_async_write(tests_ctx->test_client->connection, tests_ctx->test_data,
+                                   SMALL_READS_DATA_SIZE, on_line_written);
+}
+
+static void on_pooled_read_exhausted(void *ctx, int ecode, void *buffer, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_BUFFER_POOL_EXHAUSTED_ERROR, ecode);
+    ASSERT_EQ_PTR(NULL, buffer);
+    ASSERT_EQ_INT(0, bytes_read);
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    test_client->timed_out = 1;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+}
+
+/**
+ * Returns the only buffer of the pool, which is held by the test.
+ */
+static void *when_pooled_read_waits_for_buffer(struct connection_tests *tests_ctx, int timeout_ms)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+    void *buffer;
+
+    ASSERT_NE_PTR(NULL, (tests_ctx->buffer_pool = cio_new_buffer_pool(1000, 1, 1)));
+    ASSERT_NE_PTR(NULL, (buffer = cio_buffer_pool_get(tests_ctx->buffer_pool)));
+    cio_tcp_connection_set_timeouts(server_client->connection, 0, timeout_ms, 0, 0);
+    cio_tcp_connection_async_read_pooled(server_client->connection, tests_ctx->buffer_pool,
+                                         on_pooled_read_exhausted);
+    cio_tcp_connection_async_write(tests_ctx->test_client->connection, tests_ctx->test_data,
+                                   SMALL_READS_DATA_SIZE, on_line_written);
+    return buffer;
+}
+
+static void when_buffer_is_returned_and_read_again(struct connection_tests *tests_ctx,
+                                                   void *buffer)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    cio_buffer_pool_put(tests_ctx->buffer_pool, buffer);
+    cio_tcp_connection_set_timeouts(server_client->connection, 0, 0, 0, 0);
+    cio_tcp_connection_async_read_pooled(server_client->connection, tests_ctx->buffer_pool,
+                                         on_pooled_read);
+}
+
+static void on_readable(void *ctx, int ecode)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    cio_tcp_connection_async_read_until(test_client->connection, test_client->read_buf,
+                                        sizeof(test_client->read_buf), "\r\n", 2, on_read_line);
+}
+
+static void on_writable(void *ctx, int ecode)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    cio_tcp_connection_async_write(test_client->connection, TEST_LINES, strlen(TEST_LINES),
+                                   on_line_written);
+}
+
+static void when_lines_are_sent_after_waiting(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    ASSERT_NE_PTR(NULL, server_client->connection);
+    cio_tcp_connection_async_wait_readable(server_client->connection, on_readable);
+    cio_tcp_connection_async_wait_writable(tests_ctx->test_client->connection, on_writable);
+}
+
+static void on_read_timeout(void *ctx, int ecode, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_TIMEOUT_ERROR, ecode);
+    ASSERT_EQ_INT(0, bytes_read);
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    test_client->timed_out = 1;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+}
+
+static void on_wait_timeout(void *ctx, int ecode)
+{
+    on_read_timeout(ctx, ecode, 0);
+}
+
+static void when_nothing_is_sent_to_read_with_timeout(struct connection_tests *tests_ctx,
+                                                      int timeout_ms)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    cio_tcp_connection_set_timeouts(server_client->connection, 0, timeout_ms, 0, 0);
+    cio_tcp_connection_async_read(server_client->connection, server_client->read_buf,
+                                  sizeof(server_client->read_buf), on_read_timeout);
+}
+
+static void when_connection_is_idle_with_timeout(struct connection_tests *tests_ctx,
+                                                 int timeout_ms)
+{
+    struct test_client *test_client = tests_ctx->test_client;
+
+    cio_tcp_connection_set_timeouts(test_client->connection, 0, 0, 0, timeout_ms);
+    cio_tcp_connection_async_wait_readable(test_client->connection, on_wait_timeout);
+}
+
+static void when_connection_is_idle_without_operations(struct connection_tests *tests_ctx,
+                                                       int timeout_ms)
+{
+    cio_tcp_connection_set_timeouts(tests_ctx->test_client->connection, 0, 0, 0, timeout_ms);
+    usleep(3 * timeout_ms * 1000);
+}
+
+static void then_operation_times_out(struct test_client *test_client)
+{
+    int done = 0;
+
+    while (!done) {
+        ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+        done = test_client->timed_out;
+        ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+        usleep(5 * 1000);
+    }
+}
+
+static void on_connect_timeout(void *ctx, int ecode)
+{
+    on_read_timeout(ctx, ecode, 0);
+}
+
+static void when_blackhole_server_started(struct connection_tests *tests_ctx)
+{
+    struct sockaddr_in addr;
+    int *fds = tests_ctx->blackhole_fds;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BLACKHOLE_PORT);
+    ASSERT_EQ_INT(1, inet_pton(AF_INET, BLACKHOLE_ADDR, &addr.sin_addr));
+
+    ASSERT_NE_INT(-1, (fds[0] = socket(AF_INET, SOCK_STREAM, 0)));
+    ASSERT_EQ_INT(0, setsockopt(fds[0], SOL_SOCKET, SO_REUSEADDR, &(int){ 1 }, sizeof(int)));
+    ASSERT_EQ_INT(0, bind(fds[0], (struct sockaddr *) &addr, sizeof(addr)));
+    ASSERT_EQ_INT(0, listen(fds[0], 0));
+
+    ASSERT_NE_INT(-1, (fds[1] = socket(AF_INET, SOCK_STREAM, 0)));
+    ASSERT_EQ_INT(0, connect(fds[1], (struct sockaddr *) &addr, sizeof(addr)));
+}
+
+static void when_connection_attempt_times_out(struct connection_tests *tests_ctx)
+{
+    void *connection = tests_ctx->test_client->connection;
+
+    cio_tcp_connection_set_timeouts(connection, 100, 0, 0, 0);
+    cio_tcp_connection_set_happy_eyeballs(connection, 50);
+    cio_tcp_connection_async_connect(connection, BLACKHOLE_ADDR, BLACKHOLE_PORT,
+                                     on_connect_timeout);
+}
+
+static const int WATERMARK_CHUNK_SIZE = 1024 * 1024;
+
+static void on_high_watermark(void *ctx, int queued_bytes)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    test_client->above_high_watermark = 1;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+}
+
+static void on_drain(void *ctx, int queued_bytes)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    ASSERT_TRUE(test_client->above_high_watermark);
+    test_client->drained = 1;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+}
+
+static void on_queued_write(void *ctx, int ecode)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    if (test_client->writes_done < 4)
+        test_client->write_results[test_client->writes_done] = ecode;
+    test_client->writes_done++;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+}
+
+static int test_client_flag(struct test_client *test_client, int *flag)
+{
+    int value;
+
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    value = *flag;
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+    return value;
+}
+
+static void when_all_data_is_queued_with_watermarks(struct connection_tests *tests_ctx)
+{
+    struct test_client *test_client = tests_ctx->test_client;
+    int offset;
+
+    cio_tcp_connection_set_write_watermarks(test_client->connection, 64 * 1024, 512 * 1024,
+                                            on_high_watermark, on_drain);
+    for (offset = 0; offset < tests_ctx->test_data_size; offset += WATERMARK_CHUNK_SIZE)
+        cio_tcp_connection_async_write(test_client->connection, tests_ctx->test_data + offset,
+                                       WATERMARK_CHUNK_SIZE, on_queued_write);
+}
+
+static void then_high_watermark_is_reached(struct test_client *test_client)
+{
+    while (!test_client_flag(test_client, &test_client->above_high_watermark))
+        usleep(5 * 1000);
+    ASSERT_FALSE(test_client_flag(test_client, &test_client->drained));
+}
+
+static void when_peer_reads_all_data(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+
+    cio_tcp_connection_async_read(server_client->connection, server_client->read_buf,
+                                  sizeof(server_client->read_buf), on_read);
+}
+
+static void then_queue_drains(struct connection_tests *tests_ctx)
+{
+    struct test_client *test_client = tests_ctx->test_client;
+
+    while (!all_data_read(tests_ctx->test_server->server_client, tests_ctx->test_data_size))
+        usleep(10 * 1000);
+    while (!test_client_flag(test_client, &test_client->drained))
+        usleep(5 * 1000);
+    ASSERT_EQ_INT(tests_ctx->test_data_size / WATERMARK_CHUNK_SIZE,
+                  test_client_flag(test_client, &test_client->writes_done));
+}
+
+static void when_writes_exceed_limit(struct connection_tests *tests_ctx)
+{
+    void *connection = tests_ctx->test_client->connection;
+
+    cio_tcp_connection_set_write_limit(connection, 1000, CIO_WLP_FAIL_WRITE);
+    cio_tcp_connection_async_write(connection, tests_ctx->test_data, 4096, on_queued_write);
+    cio_tcp_connection_async_write(connection, tests_ctx->test_data, 100, on_queued_write);
+    cio_tcp_connection_set_write_limit(connection, 1000, CIO_WLP_CLOSE);
+    cio_tcp_connection_async_write(connection, tests_ctx->test_data, 4096, on_queued_write);
+    cio_tcp_connection_async_write(connection, tests_ctx->test_data, 100, on_queued_write);
+}
+
+static void then_write_limit_policies_apply(struct test_client *test_client)
+{
+    while (test_client_flag(test_client, &test_client->writes_done) < 4)
+        usleep(5 * 1000);
+
+    ASSERT_EQ_INT(CIO_WRITE_LIMIT_ERROR, test_client->write_results[0]);
+    ASSERT_EQ_INT(CIO_NO_ERROR, test_client->write_results[1]);
+    ASSERT_EQ_INT(CIO_WRITE_LIMIT_ERROR, test_client->write_results[2]);
+    ASSERT_EQ_INT(CIO_WRONG_STATE_ERROR, test_client->write_results[3]);
+}
+
+static const int RATE_LIMIT_BYTES_PER_SEC = 8192;
+static const int RATE_LIMIT_BURST = 1024;
+
+static void on_rate_limited_read(void *ctx, int ecode, int bytes_read)
+{
+    struct test_client *test_client = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, ecode);
+    ASSERT_EQ_INT(0, pthread_mutex_lock(&test_client->mutex));
+    growable_buffer_append(test_client->total_read_buf, test_client->read_buf, bytes_read);
+    ASSERT_EQ_INT(0, pthread_mutex_unlock(&test_client->mutex));
+
+    if (test_client->total_read_buf->size == SMALL_READS_DATA_SIZE)
+        return;
+
+    cio_tcp_connection_async_read(test_client->connection, test_client->read_buf,
+                                  sizeof(test_client->read_buf), on_rate_limited_read);
+}
+
+static long long when_write_is_rate_limited(struct connection_tests *tests_ctx)
+{
+    struct test_client *server_client = tests_ctx->test_server->server_client;
+    struct timeval tv;
+
+    ASSERT_NE_PTR(NULL, (tests_ctx->rate_limiter = cio_new_rate_limiter(
+        NULL, RATE_LIMIT_BYTES_PER_SEC, RATE_LIMIT_BURST, 0, 0)));
+    cio_tcp_connection_set_rate_limiters(tests_ctx->test_client->connection, NULL,
+                                         tests_ctx->rate_limiter);
+    gettimeofday(&tv, NULL);
+    cio_tcp_connection_async_read(server_client->connection, server_client->read_buf,
+                                  sizeof(server_client->read_buf), on_rate_limited_read);
+    cio_tcp_connection_async_write(tests_ctx->test_client->connection, tests_ctx->test_data,
+                                   SMALL_READS_DATA_SIZE, on_line_written);
+    return time_ms(&tv);
+}
+
+static void then_transfer_takes_at_least(long long start_ms, int expected_ms)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    ASSERT_LE_INT(expected_ms, (int) (time_ms(&tv) - start_ms));
+}
+
+static void take_stats(void *ctx)
+{
+    struct connection_tests *tests_ctx = ctx;
+
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_tcp_connection_get_stats(
+        tests_ctx->test_client->connection, &tests_ctx->client_stats, 1));
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_tcp_connection_get_stats(
+        tests_ctx->test_server->server_client->connection, &tests_ctx->server_stats, 0));
+
+    pthread_mutex_lock(&tests_ctx->mutex);
+    tests_ctx->stats_taken = 1;
+    pthread_mutex_unlock(&tests_ctx->mutex);
+}
+
+static void when_stats_are_taken(struct connection_tests *tests_ctx)
+{
+    int done = 0;
+
+    cio_event_loop_post(tests_ctx->event_loop, 0, tests_ctx, take_stats);
+    while (!done) {
+        pthread_mutex_lock(&tests_ctx->mutex);
+        done = tests_ctx->stats_taken;
+        pthread_mutex_unlock(&tests_ctx->mutex);
+        usleep(5 * 1000);
+    }
+}
+
+static void then_stats_match_lines_transfer(struct connection_tests *tests_ctx)
+{
+    struct cio_tcp_connection_stats *client = &tests_ctx->client_stats;
+    struct cio_tcp_connection_stats *server = &tests_ctx->server_stats;
+
+    ASSERT_EQ_INT(strlen(TEST_LINES), (int) client->bytes_written);
+    ASSERT_EQ_INT(0, (int) client->bytes_read);
+    ASSERT_EQ_INT(1, (int) client->writes_completed);
+    ASSERT_LE_INT(1, (int) client->write_calls);
+    ASSERT_TRUE(client->last_activity > 0);
+
+    ASSERT_EQ_INT(strlen(TEST_LINES), (int) server->bytes_read);
+    ASSERT_EQ_INT(TEST_LINES_COUNT, (int) server->reads_completed);
+    ASSERT_LE_INT(1, (int) server->read_calls);
+    ASSERT_LE_INT((int) server->read_would_block, (int) server->read_calls);
+    ASSERT_EQ_INT(0, server->has_tcp_info);
+
+#if defined(__linux__)
+    ASSERT_EQ_INT(1, client->has_tcp_info);
+    ASSERT_LT_INT(0, (int) client->snd_mss);
+    ASSERT_LT_INT(0, (int) client->snd_cwnd);
+#endif
+}
+
 /**
  * Tests.
  */
@@ -430,3 +977,254 @@ void test_tcp_connection_read_write_duplex_success(void **ctx)
     when_data_transfer_is_started(test_ctx);
     then_all_data_transferred_correctly(test_ctx);
 }
+
+void test_tcp_connection_read_until(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_lines_are_sent(test_ctx);
+    then_all_lines_are_read(test_ctx);
+}
+
+void test_tcp_connection_read_until_with_read_ahead(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_read_ahead_is(test_ctx, 64 * 1024);
+    when_lines_are_sent(test_ctx);
+    then_all_lines_are_read(test_ctx);
+}
+
+void test_tcp_connection_small_reads_with_read_ahead(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_read_ahead_is(test_ctx, 64 * 1024);
+    when_data_is_read_in_small_chunks(test_ctx);
+    then_small_reads_data_is_correct(test_ctx);
+}
+
+void test_tcp_connection_pooled_reads(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_data_is_read_with_pooled_buffers(test_ctx);
+    then_small_reads_data_is_correct(test_ctx);
+    ASSERT_EQ_INT(0, cio_buffer_pool_in_use(test_ctx->buffer_pool));
+}
+
+void test_tcp_connection_pooled_reads_exhausted_pool(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+    void *buffer;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    buffer = when_pooled_read_waits_for_buffer(test_ctx, 50);
+    then_operation_times_out(test_ctx->test_server->server_client);
+
+    /* The connection is still usable and nothing sent meanwhile is lost. */
+    when_buffer_is_returned_and_read_again(test_ctx, buffer);
+    then_small_reads_data_is_correct(test_ctx);
+    ASSERT_EQ_INT(0, cio_buffer_pool_in_use(test_ctx->buffer_pool));
+}
+
+void test_tcp_connection_wait_readable_writable(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_lines_are_sent_after_waiting(test_ctx);
+    then_all_lines_are_read(test_ctx);
+}
+
+void test_tcp_connection_read_timeout(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_nothing_is_sent_to_read_with_timeout(test_ctx, 50);
+    then_operation_times_out(test_ctx->test_server->server_client);
+}
+
+void test_tcp_connection_idle_timeout(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_connection_is_idle_with_timeout(test_ctx, 50);
+    then_operation_times_out(test_ctx->test_client);
+}
+
+void test_tcp_connection_idle_timeout_without_operations(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    /* The connection stays usable: the wait times out instead of failing with the wrong state. */
+    when_connection_is_idle_without_operations(test_ctx, 50);
+    when_connection_is_idle_with_timeout(test_ctx, 50);
+    then_operation_times_out(test_ctx->test_client);
+}
+
+void test_tcp_connection_happy_eyeballs_connect(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    cio_tcp_connection_set_happy_eyeballs(test_ctx->test_client->connection, 250);
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_lines_are_sent(test_ctx);
+    then_all_lines_are_read(test_ctx);
+}
+
+void test_tcp_connection_connect_timeout(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_blackhole_server_started(test_ctx);
+    when_connection_attempt_times_out(test_ctx);
+    then_operation_times_out(test_ctx->test_client);
+}
+
+void test_tcp_connection_write_watermarks(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_all_data_is_queued_with_watermarks(test_ctx);
+    then_high_watermark_is_reached(test_ctx->test_client);
+    when_peer_reads_all_data(test_ctx);
+    then_queue_drains(test_ctx);
+}
+
+void test_tcp_connection_write_limit(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_writes_exceed_limit(test_ctx);
+    then_write_limit_policies_apply(test_ctx->test_client);
+}
+
+void test_tcp_connection_rate_limited_write(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+    long long start_ms;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    start_ms = when_write_is_rate_limited(test_ctx);
+    then_small_reads_data_is_correct(test_ctx);
+    then_transfer_takes_at_least(start_ms, (SMALL_READS_DATA_SIZE - RATE_LIMIT_BURST) * 1000
+                                           / RATE_LIMIT_BYTES_PER_SEC);
+}
+
+void test_tcp_connection_stats(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_lines_are_sent(test_ctx);
+    then_all_lines_are_read(test_ctx);
+    when_stats_are_taken(test_ctx);
+    then_stats_match_lines_transfer(test_ctx);
+}
+
+void test_tcp_connection_connect_send(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+
+    when_fast_open_server_started(test_ctx);
+    when_connection_attempt_with_lines_is_made(test_ctx);
+    then_both_side_connections_are_successful(test_ctx);
+
+    when_server_reads_lines(test_ctx);
+    then_all_lines_are_read(test_ctx);
+}
+
+void test_tcp_connection_connect_numeric_address(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+    struct cio_resolver_cache_stats stats;
+
+    /* Resets the counters. */
+    cio_resolver_set_cache(256, 10 * 1000, 1000);
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    when_connection_attempt_is_made(test_ctx, "127.0.0.1", VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    cio_resolver_get_cache_stats(&stats);
+    ASSERT_EQ_INT(0, (int) (stats.hits + stats.misses + stats.coalesced));
+}
+
+void test_tcp_connection_endpoint_selector(void **ctx)
+{
+    struct connection_tests* test_ctx = *ctx;
+    struct cio_endpoint_stats stats;
+    struct sockaddr_in addr;
+    void *selector;
+
+    ASSERT_NE_PTR(NULL, (selector = cio_new_endpoint_selector(CIO_SELECT_P2C)));
+    cio_tcp_connection_set_endpoint_selector(test_ctx->test_client->connection, selector);
+    when_test_tcp_server_started(test_ctx, VALID_SERVER_ADDR, VALID_SERVER_PORT);
+    /* May resolve to ::1 as well, which the server doesn't listen on. */
+    when_connection_attempt_is_made(test_ctx, "localhost", VALID_SERVER_PORT);
+    then_both_side_connections_are_successful(test_ctx);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(VALID_SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ_INT(CIO_NO_ERROR, cio_endpoint_selector_get_stats(selector,
+        (struct sockaddr *) &addr, sizeof(addr), &stats));
+    ASSERT_EQ_INT(1, stats.connects);
+    ASSERT_EQ_INT(0, stats.failures);
+
+    cio_free_tcp_connection_sync(test_ctx->test_client->connection);
+    test_ctx->test_client->connection = NULL;
+    cio_free_endpoint_selector(selector);
+}
@@ -7,17 +7,22 @@
  *   - connect correct address ipv6
  *   - connect correct address ipv4 && ipv6
  *   - connect invalid address
- *   - connect timeout
+ *   - connect timeout +
  *   - close connection on_write
  *   - close connection on_read
  *   - read/write duplex success
  *   - read/write duplex success multiple connections
  *   - read/write sequence success
  *   - read failed
- *   - read timeout
+ *   - read timeout +
  *   - write success
  *   - write failed
  *   - write timeout
+ *   - write watermarks +
+ *   - write limit +
+ *   - rate limited write +
+ *   - stats +
+ *   - idle timeout +
  */
 
 int setup_tcp_connnection_tests(void **ctx);
@@ -26,5 +31,23 @@ int teardown_tcp_connnection_tests(void **ctx);
 void test_new_tcp_connection(void **ctx);
 void test_tcp_connection_connect_correct_address(void **ctx);
 void test_tcp_connection_read_write_duplex_success(void **ctx);
+void test_tcp_connection_read_until(void **ctx);
+void test_tcp_connection_read_until_with_read_ahead(void **ctx);
+void test_tcp_connection_small_reads_with_read_ahead(void **ctx);
+void test_tcp_connection_pooled_reads(void **ctx);
+void test_tcp_connection_pooled_reads_exhausted_pool(void **ctx);
+void test_tcp_connection_wait_readable_writable(void **ctx);
+void test_tcp_connection_read_timeout(void **ctx);
+void test_tcp_connection_idle_timeout(void **ctx);
+void test_tcp_connection_idle_timeout_without_operations(void **ctx);
+void test_tcp_connection_happy_eyeballs_connect(void **ctx);
+void test_tcp_connection_connect_timeout(void **ctx);
+void test_tcp_connection_write_watermarks(void **ctx);
+void test_tcp_connection_write_limit(void **ctx);
+void test_tcp_connection_rate_limited_write(void **ctx);
+void test_tcp_connection_stats(void **ctx);
+void test_tcp_connection_connect_send(void **ctx);
+void test_tcp_connection_connect_numeric_address(void **ctx);
+void test_tcp_connection_endpoint_selector(void **ctx);
 
 #endif //CIO_TCP_SERVER_CLIENT_UT_H